@@ -3,7 +3,7 @@
  *  acionar botões e monitorar sensores em uma portaria remota.
  * autor: João Vianna (jvianna@gmail.com)
  * data: 2024-04-27
- * versão: 0.7.0
+ * versão: 0.13.0
  */
 'use strict';
 
@@ -292,6 +292,10 @@ class Atuador {
       // Se não sabe quem é o servidor...
       return;
     }
+    if (enviarQuadroComando(this.id, acao, this.duracao)) {
+      // Comando enviado pelo canal WebSocket
+      return;
+    }
     var xhttp = new XMLHttpRequest();
     
     var cmd = {};
@@ -365,6 +369,291 @@ var sirene = new Atuador("3");
 var refletor = new Atuador("4");
 
 
+// Periféricos por classe, na ordem dos identificadores no servidor
+var listaSensores = [campainha, portaAberta];
+var listaContadores = [contadorVeiculos];
+var listaAtuadores = [atAbrirCancela, atFecharCancela, sirene, refletor];
+
+
+
+/** Converte uma lista 'v1,v2,...' recebida do servidor em Array de inteiros.
+ */
+function listaParaValores(lista) {
+  if (lista === undefined || lista == '') {
+    return [];
+  }
+  return lista.split(',').map(function (v) { return parseInt(v); });
+}
+
+
+/** Aplica os valores lidos de GET /snapshot aos objetos dos periféricos.
+
+    @param texto Resposta do servidor, com linhas 'classe=v1,v2,...'
+ */
+function aplicarSnapshot(texto) {
+  let valores = {};
+
+  for (let linha of texto.split('\n')) {
+    let pos = linha.indexOf('=');
+
+    if (pos > 0) {
+      valores[linha.substring(0, pos)] = listaParaValores(linha.substring(pos + 1));
+    }
+  }
+
+  let sensores = valores['sensores'] || [];
+  let contadores = valores['contadores'] || [];
+  let atuadores = valores['atuadores'] || [];
+
+  // Os identificadores dos periféricos começam em 1
+  for (let sensor of listaSensores) {
+    if (sensores.length >= sensor.id) {
+      sensor.mudarValor(sensores[sensor.id - 1]);
+    }
+  }
+  for (let contador of listaContadores) {
+    if (contadores.length >= contador.id) {
+      contador.mudarContagem(contadores[contador.id - 1]);
+    }
+  }
+  for (let atuador of listaAtuadores) {
+    if (atuadores.length >= atuador.id) {
+      atuador.mudarValor(atuadores[atuador.id - 1]);
+    }
+  }
+}
+
+
+/** Envia um comando GET /snapshot para o servidor.
+
+    Lê o estado de todos os periféricos em uma única solicitação, em vez
+    de uma solicitação para cada sensor e contador.
+
+    Envia o último ETag recebido: se nada mudou, o servidor responde 304,
+    sem conteúdo, e a tela fica como está.
+ */
+var etagSnapshot = null;
+
+function lerSnapshot() {
+  var serv = txURI.value;
+
+  var xhttp = new XMLHttpRequest();
+
+  xhttp.onreadystatechange = function() {
+    if (this.readyState == 4) {
+      if (this.status == 200) {
+        etagSnapshot = this.getResponseHeader('ETag');
+        aplicarSnapshot(this.responseText);
+      } else if (this.status == 304) {
+        // Estado não mudou desde a última leitura
+      } else {
+        console.log('Erro lerSnapshot: ' + this.status.toString() + ' - ' + this.statusText);
+      }
+    }
+  };
+  xhttp.open('GET', serv + 'snapshot', true);
+  if (etagSnapshot) {
+    xhttp.setRequestHeader('If-None-Match', etagSnapshot);
+  }
+  xhttp.send();
+}
+
+
+/* Eventos enviados pelo servidor (GET /eventos)
+
+   Enquanto a assinatura estiver ativa, a tela é atualizada a cada evento
+   recebido. Se o navegador não suportar EventSource, ou a conexão cair,
+   voltamos a ler GET /snapshot periodicamente.
+*/
+var fonteEventos = null;
+var eventosAtivos = false;
+
+
+/** Procura na lista o periférico com o identificador indicado.
+ */
+function procurarPeriferico(lista, id) {
+  for (let periferico of lista) {
+    if (periferico.id == id) {
+      return periferico;
+    }
+  }
+  return null;
+}
+
+
+/** Trata uma mensagem recebida do servidor, no formato '(id)=(valor)'.
+
+    @param lista Periféricos da classe a que se refere o evento
+    @param aplicar Função que aplica o valor ao periférico
+ */
+function tratarEvento(lista, aplicar, evento) {
+  let pos = evento.data.indexOf('=');
+
+  if (pos > 0) {
+    let periferico = procurarPeriferico(lista, evento.data.substring(0, pos));
+
+    if (periferico !== null) {
+      aplicar(periferico, parseInt(evento.data.substring(pos + 1)));
+      atualizarTela();
+    }
+  }
+}
+
+
+/** Assina os eventos do servidor, se o navegador permitir.
+ */
+function assinarEventos() {
+  if (fonteEventos !== null || typeof EventSource === 'undefined') {
+    return;
+  }
+  fonteEventos = new EventSource(txURI.value + 'eventos');
+
+  fonteEventos.onopen = function() {
+    eventosAtivos = true;
+    // Os eventos só indicam mudanças; o estado inicial vem do snapshot.
+    lerSnapshot();
+  };
+  fonteEventos.onerror = function() {
+    // O navegador tenta reconectar sozinho. Enquanto isso, usamos polling.
+    eventosAtivos = false;
+  };
+  fonteEventos.addEventListener('sensor', function (evento) {
+    tratarEvento(listaSensores, function (p, v) { p.mudarValor(v); }, evento);
+  });
+  fonteEventos.addEventListener('contador', function (evento) {
+    tratarEvento(listaContadores, function (p, v) { p.mudarContagem(v); }, evento);
+  });
+  fonteEventos.addEventListener('atuador', function (evento) {
+    tratarEvento(listaAtuadores, function (p, v) { p.mudarValor(v); }, evento);
+  });
+}
+
+
+/** Cancela a assinatura dos eventos do servidor e fecha o canal de controle.
+ */
+function cancelarEventos() {
+  if (fonteEventos !== null) {
+    fonteEventos.close();
+    fonteEventos = null;
+  }
+  eventosAtivos = false;
+
+  fecharCanalControle();
+}
+
+
+/* Canal de controle WebSocket (/controle)
+
+   Quando o canal está aberto, os comandos dos atuadores são enviados em
+   quadros binários de 8 bytes, em vez de um POST para cada comando.
+   O servidor confirma cada comando e avisa as mudanças de estado com
+   quadros de estado, também de 8 bytes.
+*/
+var canalControle = null;
+var sequenciaComando = 0;
+
+// Códigos das ações no quadro de comando (enum acao_atuador no servidor)
+const codigosAcoes = { 'off': 0, 'on': 1, 'toggle': 2, 'pulse': 3 };
+
+// Classes de periféricos no quadro de estado (enum periferico no servidor)
+const PRF_ATUADOR = 1;
+const PRF_CONTADOR = 2;
+const PRF_SENSOR = 3;
+
+
+/** Envia um comando para um atuador pelo canal WebSocket.
+
+    @return true se o comando foi enviado; false se o canal não está aberto.
+ */
+function enviarQuadroComando(id, acao, duracao) {
+  if (canalControle === null || canalControle.readyState !== WebSocket.OPEN) {
+    return false;
+  }
+  let quadro = new DataView(new ArrayBuffer(8));
+
+  sequenciaComando = (sequenciaComando % 65535) + 1;
+
+  quadro.setUint8(0, parseInt(id));
+  quadro.setUint8(1, codigosAcoes[acao]);
+  quadro.setUint16(2, sequenciaComando, true);
+  quadro.setUint32(4, duracao, true);
+
+  canalControle.send(quadro.buffer);
+  return true;
+}
+
+
+/** Trata um quadro de estado recebido pelo canal WebSocket.
+ */
+function tratarQuadroEstado(mensagem) {
+  if (!(mensagem.data instanceof ArrayBuffer) || mensagem.data.byteLength != 8) {
+    return;
+  }
+  let quadro = new DataView(mensagem.data);
+  let classe = quadro.getUint8(0);
+  let id = quadro.getUint8(1);
+  let sequencia = quadro.getUint16(2, true);
+  let valor = quadro.getInt32(4, true);
+
+  if (valor == -2) {
+    console.log('Comando ' + sequencia.toString() + ' não confirmado pelo módulo (ocupado)');
+    return;
+  }
+  if (valor < 0) {
+    console.log('Comando ' + sequencia.toString() + ' rejeitado pelo atuador ' + id.toString());
+    return;
+  }
+  let periferico = null;
+
+  if (classe == PRF_ATUADOR) {
+    periferico = procurarPeriferico(listaAtuadores, id);
+    if (periferico !== null) {
+      periferico.mudarValor(valor);
+    }
+  } else if (classe == PRF_CONTADOR) {
+    periferico = procurarPeriferico(listaContadores, id);
+    if (periferico !== null) {
+      periferico.mudarContagem(valor);
+    }
+  } else if (classe == PRF_SENSOR) {
+    periferico = procurarPeriferico(listaSensores, id);
+    if (periferico !== null) {
+      periferico.mudarValor(valor);
+    }
+  }
+  if (periferico !== null) {
+    atualizarTela();
+  }
+}
+
+
+/** Abre o canal de controle WebSocket, se o navegador permitir.
+ */
+function abrirCanalControle() {
+  if (canalControle !== null || typeof WebSocket === 'undefined') {
+    return;
+  }
+  canalControle = new WebSocket(txURI.value.replace(/^http/, 'ws') + 'controle');
+  canalControle.binaryType = 'arraybuffer';
+
+  canalControle.onmessage = tratarQuadroEstado;
+  canalControle.onclose = function() {
+    // Os comandos voltam a ser enviados por POST.
+    canalControle = null;
+  };
+}
+
+
+/** Fecha o canal de controle WebSocket.
+ */
+function fecharCanalControle() {
+  if (canalControle !== null) {
+    canalControle.onclose = null;
+    canalControle.close();
+    canalControle = null;
+  }
+}
+
 
 /** Enviar comando para o atuador que controla a cancela para abri-la.
  */
@@ -455,6 +744,27 @@ function cancelarConfig(evento) {
 btCancelar.addEventListener('click', cancelarConfig);
 
 
+/** Acompanha a gravação da configuração (GET /config) até terminar.
+ */
+function acompanharGravacaoConfig(serv) {
+  var xhttp = new XMLHttpRequest();
+
+  xhttp.onload = function() {
+    if (this.status == 200) {
+      var estado = this.responseText.trim().split('=')[1];
+
+      if (estado == 'pendente') {
+        setTimeout(acompanharGravacaoConfig, 500, serv);
+      } else {
+        console.log('Gravação da configuração: ' + estado);
+      }
+    }
+  };
+  xhttp.open('GET', serv + 'config', true);
+  xhttp.send();
+}
+
+
 function salvarConfig(evento) {
   var serv = txURI.value;
   
@@ -472,7 +782,12 @@ function salvarConfig(evento) {
   xhttp.onload = function() {
     if (this.readyState == 4) {
       if (this.status >= 200 && this.status <= 204) {
+        if (this.status == 202) {
+          // Gravação em segundo plano
+          acompanharGravacaoConfig(serv);
+        }
         servidorConectado = false;
+        cancelarEventos();
         limparResultados();
       } else {
         console.log('Erro salvarConfig: ' + this.status.toString() + ' - ' + this.statusText);
@@ -492,27 +807,33 @@ btSalvar.addEventListener('click', salvarConfig);
 
 
 
+/** Mostra na tela o estado atual dos periféricos.
+ */
+function atualizarTela() {
+  if (campainha.obterValor() == 0) {
+    // Campainha está acionada
+    txCampainha.style = "display: block; color: blue;";
+  } else {
+    txCampainha.style = "display: none;";
+  }
+  if (portaAberta.obterValor() != 0) {
+    // A porta está aberta
+    txPorta.style = "display: block; color: red;";
+  } else {
+    txPorta.style = "display: none;";
+  }
+  txContagem.innerHTML = contadorVeiculos.obterContagem();
+
+  mostrarResultados();
+}
+
+
 function refrescarTela() {
   if (servidorConectado) {
-    campainha.ler();
-    portaAberta.ler();
-    contadorVeiculos.ler();
-    
-    if (campainha.obterValor() == 0) {
-      // Campainha está acionada
-      txCampainha.style = "display: block; color: blue;";
-    } else {
-      txCampainha.style = "display: none;";
+    if (!eventosAtivos) {
+      lerSnapshot();
     }
-    if (portaAberta.obterValor() != 0) {
-      // A porta está aberta
-      txPorta.style = "display: block; color: red;";
-    } else {
-      txPorta.style = "display: none;";
-    }
-    txContagem.innerHTML = contadorVeiculos.obterContagem();
-
-    mostrarResultados();
+    atualizarTela();
   } else {
     verificarConexao();
   }
@@ -549,6 +870,8 @@ function verificarConexao() {
         imprimir(resposta);
         
         servidorConectado = true;
+        assinarEventos();
+        abrirCanalControle();
       } else {
         servidorConectado = false;
         console.log('Erro verificarConexao: ' + this.status.toString() + ' - ' + this.statusText);
@@ -615,6 +938,9 @@ function lembrarURI() {
   
   if (servidor !== null) {
     txURI.value = servidor;
+  } else if (location.protocol == 'http:' || location.protocol == 'https:') {
+    // Página servida pelo próprio módulo: o servidor é a origem da página
+    txURI.value = location.origin + '/';
   }
   atualizarServPerifericos();
 }
@@ -625,6 +951,7 @@ function tratarModifURI(evento) {
     btMudarURI.value = "Reativar";
     
     servidorConectado = false;
+    cancelarEventos();
     suspenderTela();
 
     limparResultados();
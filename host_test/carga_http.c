@@ -0,0 +1,580 @@
+/** @file carga_http.c - Gerador de carga para o servidor HTTP do módulo.
+
+    Executa o firmware no computador (servidor de app_web_server.c sobre
+    servidor_http_local.c, com os pinos simulados em tempo virtual) e
+    envia uma sequência de solicitações misturadas:
+
+      status     GET /status, com If-None-Match
+      sensor     GET /sensor?id=(1..MAX_SENSORES), com If-None-Match
+      contador   GET /contador?id=1, com If-None-Match
+      atuador    POST /atuador(1..MAX_ATUADORES), action=toggle
+      config     POST /config, hostname=...
+      painel     Atualização da tela do console como antes de GET /snapshot:
+                 GET /sensor?id= de cada sensor e GET /contador?id= de
+                 cada contador, sem If-None-Match
+      snapshot   Atualização da tela por GET /snapshot, sem If-None-Match
+
+    As conexões são atendidas uma de cada vez, em rodízio, como pela
+    tarefa única do servidor do ESP-IDF. Cada conexão se autentica uma
+    vez (GET /basic_auth) e reutiliza o cookie de sessão; se receber 401,
+    autentica de novo. Entre as solicitações, o tempo virtual avança e a
+    tarefa de controle simulada processa os pulsos do roteiro.
+
+    Relatório, por tipo de solicitação:
+      - Quantidade e respostas por classe (2xx, 3xx, 4xx, 5xx);
+      - Tempo de atendimento (p50 e p99), medido no computador;
+      - Latência vista pelo cliente (p50 e p99): com c conexões em rodízio,
+        a soma do atendimento das últimas c solicitações;
+      - Alocações no heap por solicitação (malloc, calloc e realloc feitos
+        pelo firmware, contados com --wrap do ligador).
+    Em painel, cada atualização conta como uma solicitação, com as
+    várias solicitações HTTP somadas; a coluna http/sol mostra quantas.
+    No fim, solicitações HTTP por segundo, reconexões e novas autenticações.
+
+    Uso:
+      carga_http [-n solicitações] [-c conexões] [-m tipo=peso,...]
+                 [-v ms virtuais por solicitação] [-s semente]
+                 [-r roteiro da simulação] [-e] [-a] [-p]
+
+    Retorna 1 se houve respostas 5xx ou 4xx inesperadas, ou se as respostas
+    304 contadas em GET /metrics divergem das recebidas; com -e, se
+    alguma solicitação alocou memória depois do aquecimento; com -a, se
+    alguma conexão perdeu a sessão e precisou se autenticar de novo; com
+    -p, se a atualização por snapshot não for mais barata (p50 do
+    atendimento) que a por painel.
+*/
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "esp_tls_crypto.h"
+
+#include "app_config.h"
+#include "app_web_server.h"
+#include "controle_gpio.h"
+#include "regras.h"
+#include "simulacao_gpio.h"
+#include "servidor_http_local.h"
+
+#define MAX_CONEXOES        (16)
+#define TAM_COOKIE          (64)
+#define TAM_ETAG            (24)
+
+// Roteiro usado sem -r: pulsos de 40 ms a cada 250 ms no contador 1
+#define ROTEIRO_PADRAO      "pulsos = 0,4,250,40,1000000\n"
+
+enum tipo_solicitacao {
+  TIPO_STATUS,
+  TIPO_SENSOR,
+  TIPO_CONTADOR,
+  TIPO_ATUADOR,
+  TIPO_CONFIG,
+  TIPO_PAINEL,
+  TIPO_SNAPSHOT,
+  NUM_TIPOS
+};
+
+static const char *nomes_tipos[NUM_TIPOS] = {
+  "status", "sensor", "contador", "atuador", "config", "painel", "snapshot"
+};
+
+// Pesos padrão de cada tipo na mistura (em %)
+static int pesos[NUM_TIPOS] = { 40, 20, 20, 15, 5, 0, 0 };
+
+typedef struct {
+  int   sockfd;                           // -1 se fechada
+  char  cookie[TAM_COOKIE];               // "sessao=..." (vazio sem sessão)
+  char  etags[NUM_TIPOS][TAM_ETAG];       // Último ETag recebido por tipo
+} conexao_t;
+
+typedef struct {
+  int       quantidade;
+  int       solicitacoes_http;
+  int       classes[6];                   // Respostas por centena do status
+  int       inesperadas;                  // 4xx e 5xx
+  uint64_t  alocacoes;
+  double    *atendimento_us;              // Uma amostra por solicitação
+  double    *cliente_us;
+} medidas_t;
+
+static conexao_t conexoes[MAX_CONEXOES];
+static int num_conexoes = 4;
+static medidas_t medidas[NUM_TIPOS];
+static int reconexoes = 0;
+static int autenticacoes = 0;
+static int solicitacoes_http = 0;
+
+static resposta_local_t resposta;
+
+
+// Contagem de alocações (-Wl,--wrap=malloc,...) ---------------------------
+
+void *__real_malloc(size_t tamanho);
+void *__real_calloc(size_t quantidade, size_t tamanho);
+void *__real_realloc(void *p, size_t tamanho);
+
+static uint64_t alocacoes = 0;
+
+void *__wrap_malloc(size_t tamanho) {
+  alocacoes++;
+  return __real_malloc(tamanho);
+}
+
+
+void *__wrap_calloc(size_t quantidade, size_t tamanho) {
+  alocacoes++;
+  return __real_calloc(quantidade, tamanho);
+}
+
+
+void *__wrap_realloc(void *p, size_t tamanho) {
+  alocacoes++;
+  return __real_realloc(p, tamanho);
+}
+
+
+// Solicitações --------------------------------------------------------------
+
+static double agora_real_us(void) {
+  struct timespec agora;
+
+  clock_gettime(CLOCK_MONOTONIC, &agora);
+  return (double)agora.tv_sec * 1e6 + (double)agora.tv_nsec / 1e3;
+}
+
+
+static void conectar(conexao_t *conexao) {
+  conexao->sockfd = servidor_local_conectar();
+  if (conexao->sockfd < 0) {
+    fprintf(stderr, "carga_http: conexão recusada\n");
+    exit(2);
+  }
+}
+
+
+/*  GET /basic_auth com a credencial; guarda o cookie de sessão.
+ */
+static void autenticar(conexao_t *conexao) {
+  static const char credencial[] = CONFIG_EXAMPLE_BASIC_AUTH_USERNAME ":" CONFIG_EXAMPLE_BASIC_AUTH_PASSWORD;
+  unsigned char base64[128];
+  char cabecalhos[192];
+  char valor[TAM_CABECALHOS_LOCAL];
+  size_t len;
+
+  esp_crypto_base64_encode(base64, sizeof(base64), &len, (const unsigned char *)credencial,
+                           sizeof(credencial) - 1);
+  snprintf(cabecalhos, sizeof(cabecalhos), "Authorization: Basic %s\n", base64);
+
+  servidor_local_atender(conexao->sockfd, HTTP_GET, "/basic_auth", cabecalhos, NULL, &resposta);
+  if (resposta.status != 200 ||
+      servidor_local_cabecalho(&resposta, "Set-Cookie", valor, sizeof(valor)) == NULL) {
+    fprintf(stderr, "carga_http: autenticação recusada (%d)\n", resposta.status);
+    exit(2);
+  }
+  valor[strcspn(valor, ";")] = '\0';
+  snprintf(conexao->cookie, sizeof(conexao->cookie), "%.*s", TAM_COOKIE - 1, valor);
+  autenticacoes++;
+}
+
+
+/*  Atualiza a tela do console com uma solicitação por periférico, como
+    portaria_remota.js antes de GET /snapshot. Para na primeira resposta
+    que não for 200, que fica em resposta.
+ */
+static void atualizar_painel(conexao_t *conexao) {
+  char uri[64];
+  char cabecalhos[96];
+
+  snprintf(cabecalhos, sizeof(cabecalhos), "Cookie: %s\n", conexao->cookie);
+  for (int i = 0; i < MAX_SENSORES + MAX_CONTADORES; i++) {
+    if (i < MAX_SENSORES) {
+      snprintf(uri, sizeof(uri), "/sensor?id=%d", i + 1);
+    } else {
+      snprintf(uri, sizeof(uri), "/contador?id=%d", i - MAX_SENSORES + 1);
+    }
+    servidor_local_atender(conexao->sockfd, HTTP_GET, uri, cabecalhos, NULL, &resposta);
+    solicitacoes_http++;
+    if (resposta.status != 200) {
+      return;
+    }
+  }
+}
+
+
+/*  Envia uma solicitação do tipo indicado e guarda o ETag recebido.
+ */
+static void solicitar(conexao_t *conexao, enum tipo_solicitacao tipo, int sequencia) {
+  char uri[64];
+  char cabecalhos[192];
+  char conteudo[64] = "";
+  httpd_method_t metodo = HTTP_GET;
+
+  switch (tipo) {
+    case TIPO_PAINEL:
+      atualizar_painel(conexao);
+      return;
+    case TIPO_SNAPSHOT:
+      snprintf(uri, sizeof(uri), "/snapshot");
+      break;
+    case TIPO_STATUS:
+      snprintf(uri, sizeof(uri), "/status");
+      break;
+    case TIPO_SENSOR:
+      snprintf(uri, sizeof(uri), "/sensor?id=%d", 1 + sequencia % MAX_SENSORES);
+      break;
+    case TIPO_CONTADOR:
+      snprintf(uri, sizeof(uri), "/contador?id=%d", 1 + sequencia % MAX_CONTADORES);
+      break;
+    case TIPO_ATUADOR:
+      metodo = HTTP_POST;
+      snprintf(uri, sizeof(uri), "/atuador%d", 1 + sequencia % MAX_ATUADORES);
+      snprintf(conteudo, sizeof(conteudo), "action=toggle\n");
+      break;
+    default:
+      metodo = HTTP_POST;
+      snprintf(uri, sizeof(uri), "/config");
+      snprintf(conteudo, sizeof(conteudo), "hostname=esp32-carga%d\n", sequencia % 10);
+      break;
+  }
+
+  int n = snprintf(cabecalhos, sizeof(cabecalhos), "Cookie: %s\n", conexao->cookie);
+
+  if (conexao->etags[tipo][0] != '\0' && tipo != TIPO_SNAPSHOT) {
+    snprintf(cabecalhos + n, sizeof(cabecalhos) - n, "If-None-Match: %s\n", conexao->etags[tipo]);
+  }
+
+  servidor_local_atender(conexao->sockfd, metodo, uri, cabecalhos,
+                         (metodo == HTTP_POST) ? conteudo : NULL, &resposta);
+  solicitacoes_http++;
+
+  if (servidor_local_cabecalho(&resposta, "ETag", conexao->etags[tipo], TAM_ETAG) == NULL) {
+    conexao->etags[tipo][0] = '\0';
+  }
+}
+
+
+static enum tipo_solicitacao sortear_tipo(void) {
+  int total = 0;
+
+  for (int t = 0; t < NUM_TIPOS; t++) {
+    total += pesos[t];
+  }
+  int sorteio = rand() % total;
+
+  for (int t = 0; t < NUM_TIPOS; t++) {
+    if (sorteio < pesos[t]) {
+      return (enum tipo_solicitacao)t;
+    }
+    sorteio -= pesos[t];
+  }
+  return TIPO_STATUS;
+}
+
+
+/*  Lê a mistura no formato "status=40,sensor=20,...". Tipos omitidos
+    ficam com peso 0.
+ */
+static bool ler_mistura(char *texto) {
+  int total = 0;
+
+  memset(pesos, 0, sizeof(pesos));
+  for (char *item = strtok(texto, ","); item != NULL; item = strtok(NULL, ",")) {
+    char *igual = strchr(item, '=');
+    int t;
+
+    if (igual == NULL) {
+      return false;
+    }
+    *igual = '\0';
+    for (t = 0; t < NUM_TIPOS && strcmp(item, nomes_tipos[t]) != 0; t++) {
+    }
+    if (t == NUM_TIPOS || atoi(igual + 1) < 0) {
+      return false;
+    }
+    pesos[t] = atoi(igual + 1);
+    total += pesos[t];
+  }
+  return total > 0;
+}
+
+
+static bool carregar_roteiro(const char *caminho) {
+  FILE *arquivo = (caminho != NULL) ? fopen(caminho, "r")
+                                    : fmemopen((void *)ROTEIRO_PADRAO, strlen(ROTEIRO_PADRAO), "r");
+
+  if (arquivo == NULL) {
+    perror(caminho);
+    return false;
+  }
+  int erros = simulacao_gpio_carregar(arquivo);
+
+  fclose(arquivo);
+  return erros == 0;
+}
+
+
+/*  Confere, em GET /metrics, as respostas 304 contadas pelo servidor para
+    cada leitura condicional com as recebidas pelo cliente. Devolve o
+    número de divergências.
+ */
+static int conferir_metricas(conexao_t *conexao) {
+  static const char *uris[NUM_TIPOS] = { "/status", "/sensor", "/contador", NULL, NULL, NULL, NULL };
+  char cabecalhos[96];
+  int divergencias = 0;
+
+  if (!servidor_local_conectado(conexao->sockfd)) {
+    conectar(conexao);
+  }
+  snprintf(cabecalhos, sizeof(cabecalhos), "Cookie: %s\n", conexao->cookie);
+  servidor_local_atender(conexao->sockfd, HTTP_GET, "/metrics", cabecalhos, NULL, &resposta);
+
+  for (int t = 0; t < NUM_TIPOS; t++) {
+    char linha[128];
+    unsigned servidor = 0;
+
+    if (uris[t] == NULL) {
+      continue;
+    }
+    int len = snprintf(linha, sizeof(linha),
+                       "http_respostas_total{metodo=\"GET\",uri=\"%s\",status=\"3xx\"} ", uris[t]);
+    const char *encontrada = strstr(resposta.corpo, linha);
+
+    if (encontrada != NULL) {
+      servidor = (unsigned)strtoul(encontrada + len, NULL, 10);
+    }
+    if (servidor != (unsigned)medidas[t].classes[3]) {
+      printf("falha: /metrics conta %u respostas 3xx em %s, o cliente recebeu %d\n",
+             servidor, uris[t], medidas[t].classes[3]);
+      divergencias++;
+    }
+  }
+  return divergencias;
+}
+
+
+// Relatório -----------------------------------------------------------------
+
+static int comparar_double(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+
+  return (x > y) - (x < y);
+}
+
+
+static double percentil(double *amostras, int quantidade, int p) {
+  if (quantidade == 0) {
+    return 0;
+  }
+  qsort(amostras, quantidade, sizeof(double), comparar_double);
+  return amostras[(quantidade - 1) * p / 100];
+}
+
+
+static void relatar(double duracao_us) {
+  printf("%-9s %7s %6s %6s %6s %6s %9s %9s %9s %9s %8s %8s\n", "tipo", "n", "2xx", "3xx", "4xx",
+         "5xx", "at.p50us", "at.p99us", "cl.p50us", "cl.p99us", "aloc/sol", "http/sol");
+  for (int t = 0; t < NUM_TIPOS; t++) {
+    medidas_t *m = &medidas[t];
+
+    if (m->quantidade == 0) {
+      continue;
+    }
+    printf("%-9s %7d %6d %6d %6d %6d %9.1f %9.1f %9.1f %9.1f %8.2f %8.2f\n", nomes_tipos[t],
+           m->quantidade, m->classes[2], m->classes[3], m->classes[4], m->classes[5],
+           percentil(m->atendimento_us, m->quantidade, 50),
+           percentil(m->atendimento_us, m->quantidade, 99),
+           percentil(m->cliente_us, m->quantidade, 50),
+           percentil(m->cliente_us, m->quantidade, 99),
+           (double)m->alocacoes / m->quantidade,
+           (double)m->solicitacoes_http / m->quantidade);
+  }
+  printf("total: %d solicitações HTTP em %.1f ms, %.0f solicitações/s, %d conexões, "
+         "%d reconexões, %d autenticações\n",
+         solicitacoes_http, duracao_us / 1000, solicitacoes_http / (duracao_us / 1e6),
+         num_conexoes, reconexoes, autenticacoes);
+}
+
+
+/*  Compara o p50 do atendimento de uma atualização da tela por GET
+    /snapshot e por uma solicitação por periférico. Devolve 1 se o
+    snapshot não foi mais barato.
+ */
+static int comparar_painel(void) {
+  medidas_t *painel = &medidas[TIPO_PAINEL];
+  medidas_t *snapshot = &medidas[TIPO_SNAPSHOT];
+
+  if (painel->quantidade == 0 || snapshot->quantidade == 0) {
+    printf("falha: -p exige painel e snapshot na mistura\n");
+    return 1;
+  }
+  double p50_painel = percentil(painel->atendimento_us, painel->quantidade, 50);
+  double p50_snapshot = percentil(snapshot->atendimento_us, snapshot->quantidade, 50);
+
+  printf("atualização da tela: painel %.1f us (%.0f/s), snapshot %.1f us (%.0f/s)\n",
+         p50_painel, 1e6 / p50_painel, p50_snapshot, 1e6 / p50_snapshot);
+  if (p50_snapshot >= p50_painel) {
+    printf("falha: GET /snapshot não é mais barato que uma solicitação por periférico\n");
+    return 1;
+  }
+  return 0;
+}
+
+
+int main(int argc, char *argv[]) {
+  int total = 10000;
+  int ms_por_solicitacao = 10;
+  unsigned semente = 1;
+  const char *roteiro = NULL;
+  bool exigir_sem_alocacao = false;
+  bool exigir_sessoes = false;
+  bool comparar_snapshot = false;
+  int opcao;
+
+  while ((opcao = getopt(argc, argv, "n:c:m:v:s:r:eap")) != -1) {
+    switch (opcao) {
+      case 'n': total = atoi(optarg); break;
+      case 'c': num_conexoes = atoi(optarg); break;
+      case 'm':
+        if (!ler_mistura(optarg)) {
+          fprintf(stderr, "carga_http: mistura inválida\n");
+          return 2;
+        }
+        break;
+      case 'v': ms_por_solicitacao = atoi(optarg); break;
+      case 's': semente = (unsigned)strtoul(optarg, NULL, 10); break;
+      case 'r': roteiro = optarg; break;
+      case 'e': exigir_sem_alocacao = true; break;
+      case 'a': exigir_sessoes = true; break;
+      case 'p': comparar_snapshot = true; break;
+      default:
+        fprintf(stderr, "uso: %s [-n solicitações] [-c conexões] [-m tipo=peso,...] "
+                "[-v ms] [-s semente] [-r roteiro] [-e] [-a] [-p]\n", argv[0]);
+        return 2;
+    }
+  }
+  if (total < 1 || num_conexoes < 1 || num_conexoes > MAX_CONEXOES || ms_por_solicitacao < 0) {
+    fprintf(stderr, "carga_http: parâmetros inválidos\n");
+    return 2;
+  }
+  srand(semente);
+  esp_log_level_set("*", ESP_LOG_ERROR);
+
+  // Mesma ordem de app_main(), sem a rede
+  app_config_ler();
+  app_config_iniciar_tarefa_gravacao();
+  controle_gpio_iniciar();
+  regras_iniciar();
+  controle_gpio_ativar_timer();
+  if (!carregar_roteiro(roteiro)) {
+    fprintf(stderr, "carga_http: roteiro inválido\n");
+    return 2;
+  }
+  if (start_webserver() == NULL) {
+    fprintf(stderr, "carga_http: servidor não iniciado\n");
+    return 2;
+  }
+
+  for (int t = 0; t < NUM_TIPOS; t++) {
+    medidas[t].atendimento_us = calloc(total, sizeof(double));
+    medidas[t].cliente_us = calloc(total, sizeof(double));
+  }
+  double *janela = calloc(num_conexoes, sizeof(double));
+
+  // Aquecimento: autenticação e uma solicitação de cada tipo por conexão
+  for (int c = 0; c < num_conexoes; c++) {
+    conectar(&conexoes[c]);
+    autenticar(&conexoes[c]);
+    for (int t = 0; t < NUM_TIPOS; t++) {
+      solicitar(&conexoes[c], (enum tipo_solicitacao)t, c);
+    }
+  }
+
+  int http_aquecimento = solicitacoes_http;
+  double soma_janela = 0;
+  double inicio = agora_real_us();
+
+  for (int i = 0; i < total; i++) {
+    conexao_t *conexao = &conexoes[i % num_conexoes];
+    enum tipo_solicitacao tipo = sortear_tipo();
+    medidas_t *m = &medidas[tipo];
+
+    // O servidor pode ter fechado a conexão (descarte da menos usada)
+    if (!servidor_local_conectado(conexao->sockfd)) {
+      conectar(conexao);
+      reconexoes++;
+    }
+
+    uint64_t alocacoes_antes = alocacoes;
+    int http_antes = solicitacoes_http;
+    double antes = agora_real_us();
+
+    solicitar(conexao, tipo, i);
+    if (resposta.status == 401) {
+      autenticar(conexao);
+      solicitar(conexao, tipo, i);
+    }
+
+    double atendimento = agora_real_us() - antes;
+
+    m->solicitacoes_http += solicitacoes_http - http_antes;
+
+    m->alocacoes += alocacoes - alocacoes_antes;
+    m->atendimento_us[m->quantidade] = atendimento;
+    soma_janela += atendimento - janela[i % num_conexoes];
+    janela[i % num_conexoes] = atendimento;
+    m->cliente_us[m->quantidade] = soma_janela;
+    m->quantidade++;
+
+    int classe = resposta.status / 100;
+
+    if (classe >= 1 && classe <= 5) {
+      m->classes[classe]++;
+    }
+    if (classe >= 4) {
+      m->inesperadas++;
+      fprintf(stderr, "carga_http: %s -> %d %s\n", nomes_tipos[tipo], resposta.status,
+              resposta.corpo);
+    }
+
+    // Tempo virtual entre as solicitações, fora da medida
+    double pausa = agora_real_us();
+
+    controle_gpio_simular_ate(simulacao_gpio_agora_us() + (int64_t)ms_por_solicitacao * 1000);
+    inicio += agora_real_us() - pausa;
+  }
+  double duracao = agora_real_us() - inicio;
+
+  solicitacoes_http -= http_aquecimento;
+  relatar(duracao);
+
+  int falhas = conferir_metricas(&conexoes[0]);
+  uint64_t alocacoes_medidas = 0;
+
+  for (int t = 0; t < NUM_TIPOS; t++) {
+    falhas += medidas[t].inesperadas;
+    alocacoes_medidas += medidas[t].alocacoes;
+  }
+  if (falhas > 0) {
+    printf("falha: %d respostas 4xx/5xx ou métricas divergentes\n", falhas);
+    return 1;
+  }
+  if (exigir_sessoes && autenticacoes > num_conexoes) {
+    printf("falha: %d novas autenticações\n", autenticacoes - num_conexoes);
+    return 1;
+  }
+  if (comparar_snapshot && comparar_painel() != 0) {
+    return 1;
+  }
+  if (exigir_sem_alocacao && alocacoes_medidas > 0) {
+    printf("falha: %" PRIu64 " alocações depois do aquecimento\n", alocacoes_medidas);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,19 @@
+/** @file console_local.c - Console web vazio, para os testes no computador.
+
+    No firmware, os arquivos de client/ são embutidos comprimidos por
+    target_add_binary_data() (main/CMakeLists.txt), que define os símbolos
+    _binary_(arquivo)_start e _end. Aqui, cada arquivo tem tamanho zero.
+*/
+#define ARQUIVO_VAZIO(nome)                     \
+  __asm__(".section .rodata\n"                  \
+          ".globl _binary_" nome "_start\n"     \
+          ".globl _binary_" nome "_end\n"       \
+          "_binary_" nome "_start:\n"           \
+          "_binary_" nome "_end:\n"             \
+          ".byte 0\n"                           \
+          ".previous\n")
+
+ARQUIVO_VAZIO("index_html_gz");
+ARQUIVO_VAZIO("portaria_remota_js_gz");
+ARQUIVO_VAZIO("estilos_css_gz");
+ARQUIVO_VAZIO("portaria_png");
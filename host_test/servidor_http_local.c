@@ -0,0 +1,813 @@
+/** @file servidor_http_local.c - Servidor HTTP em processo, para os testes no computador.
+
+    Reproduz o comportamento do esp_http_server que importa para
+    app_web_server.c:
+
+      - URIs comparados na ordem de registro, com uri_match_fn (o caminho,
+        sem a query string); 404 se nenhum corresponde, 405 se só o
+        método é diferente;
+      - Contexto de sessão por conexão (sess_ctx e free_ctx), guardado ao
+        fim de cada solicitação e liberado quando a conexão fecha;
+      - Até max_resp_headers cabeçalhos por resposta, guardados como
+        ponteiros até o envio;
+      - Tratamento que retorna erro fecha a conexão;
+      - max_open_sockets conexões, com descarte da usada há mais tempo
+        (lru_purge_enable), chamando close_fn;
+      - Trabalhos de httpd_queue_work() executados depois de cada
+        solicitação, na mesma linha de execução, ou quando o teste pede
+        (servidor_local_executar_trabalhos), como o servidor ocioso;
+      - Bytes de httpd_socket_send() guardados por conexão, para o teste
+        ler os eventos enviados fora das respostas;
+      - Com CONFIG_HTTPD_WS_SUPPORT, GET em um URI is_websocket abre o
+        canal (101), e cada quadro enviado pelo teste chama o tratamento
+        fora de GET. O conteúdo que o tratamento não lê dessincronizaria
+        os quadros seguintes: a conexão é fechada.
+
+    @see servidor_http_local.h
+*/
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+
+#include "esp_http_server.h"
+
+#include "servidor_http_local.h"
+
+#define MAX_CONEXOES_LOCAIS     (16)
+#define MAX_URIS_LOCAIS         (32)
+#define MAX_TRABALHOS_LOCAIS    (8)
+#define MAX_CABECALHOS_LOCAIS   (16)
+#define PRIMEIRO_SOCKET_LOCAL   (54)
+
+
+typedef struct {
+  bool                aberta;
+  int                 sockfd;
+  void                *ctx;
+  httpd_free_ctx_fn_t free_ctx;
+  bool                ignorar_mudancas_ctx;
+  unsigned            uso;                      // Para o descarte da menos usada
+  bool                fechar;                   // httpd_sess_trigger_close()
+  size_t              bytes_assincronos;
+  char                assincronos[TAM_ASSINCRONOS_LOCAL];   // Ainda não lidos pelo teste
+  size_t              len_assincronos;
+  const httpd_uri_t   *websocket;               // Tratamento dos quadros, depois do handshake
+} conexao_local_t;
+
+// Solicitação em andamento; req deve ser o primeiro campo
+typedef struct {
+  httpd_req_t       req;
+  conexao_local_t   *conexao;
+  const char        *cabecalhos;
+  const char        *conteudo;
+  size_t            lido;
+  resposta_local_t  *resposta;
+  const char        *status;
+  const char        *tipo;
+  const char        *nomes[MAX_CABECALHOS_LOCAIS];
+  const char        *valores[MAX_CABECALHOS_LOCAIS];
+  int               num_cabecalhos;
+  bool              em_partes;
+  bool              terminada;
+#if CONFIG_HTTPD_WS_SUPPORT
+  const httpd_ws_frame_t *quadro;             // Quadro WebSocket em tratamento
+  bool              quadro_lido;
+#endif
+} requisicao_local_t;
+
+typedef struct {
+  httpd_work_fn_t   funcao;
+  void              *arg;
+} trabalho_local_t;
+
+static struct {
+  bool              ativo;
+  httpd_config_t    config;
+  httpd_uri_t       uris[MAX_URIS_LOCAIS];
+  int               num_uris;
+  conexao_local_t   conexoes[MAX_CONEXOES_LOCAIS];
+  int               proximo_sockfd;
+  unsigned          contador_uso;
+  trabalho_local_t  trabalhos[MAX_TRABALHOS_LOCAIS];
+  int               num_trabalhos;
+  size_t            segmento;
+} servidor;
+
+
+static conexao_local_t *achar_conexao(int sockfd) {
+  for (int i = 0; i < MAX_CONEXOES_LOCAIS; i++) {
+    if (servidor.conexoes[i].aberta && servidor.conexoes[i].sockfd == sockfd) {
+      return &servidor.conexoes[i];
+    }
+  }
+  return NULL;
+}
+
+
+static void fechar_conexao(conexao_local_t *conexao) {
+  if (!conexao->aberta) {
+    return;
+  }
+  if (servidor.config.close_fn != NULL) {
+    servidor.config.close_fn(&servidor, conexao->sockfd);
+  }
+  if (conexao->ctx != NULL && conexao->free_ctx != NULL) {
+    conexao->free_ctx(conexao->ctx);
+  } else {
+    free(conexao->ctx);
+  }
+  memset(conexao, 0, sizeof(*conexao));
+}
+
+
+static void executar_pendencias(void) {
+  while (servidor.num_trabalhos > 0) {
+    trabalho_local_t trabalho = servidor.trabalhos[0];
+
+    servidor.num_trabalhos--;
+    memmove(&servidor.trabalhos[0], &servidor.trabalhos[1],
+            servidor.num_trabalhos * sizeof(trabalho_local_t));
+    trabalho.funcao(trabalho.arg);
+  }
+  for (int i = 0; i < MAX_CONEXOES_LOCAIS; i++) {
+    if (servidor.conexoes[i].aberta && servidor.conexoes[i].fechar) {
+      fechar_conexao(&servidor.conexoes[i]);
+    }
+  }
+}
+
+
+/*  Procura "nome: valor" em linhas terminadas por '\n' (ou "\r\n").
+
+    Devolve o início do valor, sem espaços, e seu tamanho em *len.
+ */
+static const char *achar_cabecalho(const char *linhas, const char *nome, size_t *len) {
+  size_t len_nome = strlen(nome);
+
+  while (linhas != NULL && *linhas != '\0') {
+    const char *fim = strchr(linhas, '\n');
+    size_t len_linha = (fim != NULL) ? (size_t)(fim - linhas) : strlen(linhas);
+
+    if (len_linha > len_nome && linhas[len_nome] == ':' && strncasecmp(linhas, nome, len_nome) == 0) {
+      const char *valor = linhas + len_nome + 1;
+      const char *fim_valor = linhas + len_linha;
+
+      while (valor < fim_valor && *valor == ' ') {
+        valor++;
+      }
+      while (fim_valor > valor && (fim_valor[-1] == '\r' || fim_valor[-1] == ' ')) {
+        fim_valor--;
+      }
+      *len = fim_valor - valor;
+      return valor;
+    }
+    linhas = (fim != NULL) ? fim + 1 : NULL;
+  }
+  return NULL;
+}
+
+
+/*  Copia um texto com tamanho, truncando como o ESP-IDF.
+ */
+static esp_err_t copiar_truncando(char *destino, size_t tamanho, const char *origem, size_t len) {
+  if (tamanho == 0) {
+    return ESP_ERR_HTTPD_RESULT_TRUNC;
+  }
+  size_t n = (len < tamanho - 1) ? len : tamanho - 1;
+
+  memcpy(destino, origem, n);
+  destino[n] = '\0';
+  return (n < len) ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+
+static void acrescentar_corpo(resposta_local_t *resposta, const char *buf, size_t len) {
+  size_t cabe = TAM_CORPO_LOCAL - resposta->len_corpo;
+
+  if (len > cabe) {
+    resposta->truncada = true;
+    len = cabe;
+  }
+  memcpy(resposta->corpo + resposta->len_corpo, buf, len);
+  resposta->len_corpo += len;
+  resposta->corpo[resposta->len_corpo] = '\0';
+}
+
+
+/*  Monta status e cabeçalhos na primeira parte enviada.
+ */
+static void iniciar_resposta(requisicao_local_t *r) {
+  resposta_local_t *resposta = r->resposta;
+  size_t len = 0;
+
+  resposta->status = atoi(r->status);
+  resposta->enviada = true;
+  len += snprintf(resposta->cabecalhos + len, sizeof(resposta->cabecalhos) - len,
+                  "Content-Type: %s\n", r->tipo);
+  for (int i = 0; i < r->num_cabecalhos && len < sizeof(resposta->cabecalhos); i++) {
+    len += snprintf(resposta->cabecalhos + len, sizeof(resposta->cabecalhos) - len,
+                    "%s: %s\n", r->nomes[i], r->valores[i]);
+  }
+}
+
+
+static void guardar_assincronos(conexao_local_t *conexao, const void *buf, size_t len) {
+  size_t livres = sizeof(conexao->assincronos) - conexao->len_assincronos;
+  size_t copiar = (len < livres) ? len : livres;
+
+  conexao->bytes_assincronos += len;
+  memcpy(conexao->assincronos + conexao->len_assincronos, buf, copiar);
+  conexao->len_assincronos += copiar;
+}
+
+
+/*  Chama o tratamento e, como httpd_req_cleanup(), guarda o contexto da
+    sessão; fecha a conexão se o tratamento retornar erro.
+ */
+static esp_err_t executar_tratamento(requisicao_local_t *r, const httpd_uri_t *tratamento) {
+  conexao_local_t *conexao = r->conexao;
+
+  r->req.user_ctx = tratamento->user_ctx;
+  esp_err_t ret = tratamento->handler(&r->req);
+
+  // Um novo contexto substitui (e libera) o anterior
+  if (!r->req.ignore_sess_ctx_changes && conexao->ctx != NULL && conexao->ctx != r->req.sess_ctx) {
+    if (conexao->free_ctx != NULL) {
+      conexao->free_ctx(conexao->ctx);
+    } else {
+      free(conexao->ctx);
+    }
+  }
+  conexao->ctx = r->req.sess_ctx;
+  conexao->free_ctx = r->req.free_ctx;
+  conexao->ignorar_mudancas_ctx = r->req.ignore_sess_ctx_changes;
+
+  if (ret != ESP_OK) {
+    fechar_conexao(conexao);
+  }
+  return ret;
+}
+
+
+/*  Prepara uma solicitação na conexão, com o contexto da sessão.
+ */
+static void iniciar_requisicao(requisicao_local_t *r, conexao_local_t *conexao, httpd_method_t metodo,
+                               const char *uri, resposta_local_t *resposta) {
+  memset(r, 0, sizeof(*r));
+  r->req.handle = &servidor;
+  r->req.method = metodo;
+  strncpy((char *)r->req.uri, uri, HTTPD_MAX_URI_LEN);
+  r->req.sess_ctx = conexao->ctx;
+  r->req.free_ctx = conexao->free_ctx;
+  r->req.ignore_sess_ctx_changes = conexao->ignorar_mudancas_ctx;
+  r->conexao = conexao;
+  r->resposta = resposta;
+  r->status = HTTPD_200;
+  r->tipo = "text/html";
+}
+
+
+// Interface do esp_http_server ----------------------------------------------
+
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config) {
+  if (servidor.ativo) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  memset(&servidor, 0, sizeof(servidor));
+  servidor.ativo = true;
+  servidor.config = *config;
+  if (servidor.config.max_open_sockets > MAX_CONEXOES_LOCAIS) {
+    servidor.config.max_open_sockets = MAX_CONEXOES_LOCAIS;
+  }
+  servidor.proximo_sockfd = PRIMEIRO_SOCKET_LOCAL;
+  *handle = &servidor;
+  return ESP_OK;
+}
+
+
+esp_err_t httpd_stop(httpd_handle_t handle) {
+  for (int i = 0; i < MAX_CONEXOES_LOCAIS; i++) {
+    fechar_conexao(&servidor.conexoes[i]);
+  }
+  servidor.ativo = false;
+  return ESP_OK;
+}
+
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler) {
+  if (servidor.num_uris >= servidor.config.max_uri_handlers || servidor.num_uris >= MAX_URIS_LOCAIS) {
+    return ESP_ERR_HTTPD_HANDLERS_FULL;
+  }
+  for (int i = 0; i < servidor.num_uris; i++) {
+    if (servidor.uris[i].method == uri_handler->method &&
+        strcmp(servidor.uris[i].uri, uri_handler->uri) == 0) {
+      return ESP_ERR_HTTPD_HANDLER_EXISTS;
+    }
+  }
+  servidor.uris[servidor.num_uris++] = *uri_handler;
+  return ESP_OK;
+}
+
+
+/*  Como no ESP-IDF: '*' no fim aceita qualquer continuação, e '?' no fim
+    (ou antes do '*') torna opcional o caractere anterior.
+ */
+bool httpd_uri_match_wildcard(const char *modelo, const char *uri, size_t len) {
+  size_t len_modelo = strlen(modelo);
+  char ultimo = (len_modelo > 0) ? modelo[len_modelo - 1] : '\0';
+  char penultimo = (len_modelo > 1) ? modelo[len_modelo - 2] : '\0';
+  bool asterisco = (ultimo == '*' || (penultimo == '*' && ultimo == '?'));
+  bool interrogacao = (ultimo == '?' || (penultimo == '?' && ultimo == '*'));
+  size_t especiais = (asterisco ? 1 : 0) + (interrogacao ? 2 : 0);
+
+  if (len_modelo < especiais) {
+    return false;
+  }
+  size_t exatos = len_modelo - especiais;
+
+  if (len < exatos || strncmp(modelo, uri, exatos) != 0) {
+    return false;
+  }
+  if (!interrogacao) {
+    return asterisco || len == exatos;
+  }
+  if (len > exatos && modelo[exatos] != uri[exatos]) {
+    return false;
+  }
+  return asterisco || len <= exatos + 1;
+}
+
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *req, const char *campo) {
+  requisicao_local_t *r = (requisicao_local_t *)req;
+  size_t len = 0;
+
+  return (achar_cabecalho(r->cabecalhos, campo, &len) != NULL) ? len : 0;
+}
+
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *req, const char *campo, char *val, size_t val_size) {
+  requisicao_local_t *r = (requisicao_local_t *)req;
+  size_t len = 0;
+  const char *valor = achar_cabecalho(r->cabecalhos, campo, &len);
+
+  if (valor == NULL) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  return copiar_truncando(val, val_size, valor, len);
+}
+
+
+size_t httpd_req_get_url_query_len(httpd_req_t *req) {
+  const char *query = strchr(req->uri, '?');
+
+  return (query != NULL) ? strlen(query + 1) : 0;
+}
+
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *req, char *buf, size_t buf_len) {
+  const char *query = strchr(req->uri, '?');
+
+  if (query == NULL) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  return copiar_truncando(buf, buf_len, query + 1, strlen(query + 1));
+}
+
+
+esp_err_t httpd_query_key_value(const char *qry, const char *chave, char *val, size_t val_size) {
+  size_t len_chave = strlen(chave);
+
+  while (qry != NULL && *qry != '\0') {
+    const char *fim = strchr(qry, '&');
+    size_t len_par = (fim != NULL) ? (size_t)(fim - qry) : strlen(qry);
+
+    if (len_par >= len_chave && strncmp(qry, chave, len_chave) == 0 &&
+        (len_par == len_chave || qry[len_chave] == '=')) {
+      const char *valor = (len_par > len_chave) ? qry + len_chave + 1 : qry + len_par;
+
+      return copiar_truncando(val, val_size, valor, qry + len_par - valor);
+    }
+    qry = (fim != NULL) ? fim + 1 : NULL;
+  }
+  return ESP_ERR_NOT_FOUND;
+}
+
+
+esp_err_t httpd_req_get_cookie_val(httpd_req_t *req, const char *nome, char *val, size_t *val_size) {
+  requisicao_local_t *r = (requisicao_local_t *)req;
+  size_t len = 0;
+  const char *cookies = achar_cabecalho(r->cabecalhos, "Cookie", &len);
+  size_t len_nome = strlen(nome);
+
+  if (cookies == NULL) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  const char *fim = cookies + len;
+
+  while (cookies < fim) {
+    while (cookies < fim && (*cookies == ' ' || *cookies == ';')) {
+      cookies++;
+    }
+    const char *fim_cookie = memchr(cookies, ';', fim - cookies);
+
+    if (fim_cookie == NULL) {
+      fim_cookie = fim;
+    }
+    if ((size_t)(fim_cookie - cookies) > len_nome && cookies[len_nome] == '=' &&
+        strncmp(cookies, nome, len_nome) == 0) {
+      const char *valor = cookies + len_nome + 1;
+      size_t len_valor = fim_cookie - valor;
+      esp_err_t ret = copiar_truncando(val, *val_size, valor, len_valor);
+
+      *val_size = len_valor + 1;
+      return ret;
+    }
+    cookies = fim_cookie;
+  }
+  return ESP_ERR_NOT_FOUND;
+}
+
+
+int httpd_req_recv(httpd_req_t *req, char *buf, size_t buf_len) {
+  requisicao_local_t *r = (requisicao_local_t *)req;
+  size_t restante = req->content_len - r->lido;
+  size_t n = (buf_len < restante) ? buf_len : restante;
+
+  if (servidor.segmento > 0 && n > servidor.segmento) {
+    n = servidor.segmento;
+  }
+  memcpy(buf, r->conteudo + r->lido, n);
+  r->lido += n;
+  return (int)n;
+}
+
+
+int httpd_req_to_sockfd(httpd_req_t *req) {
+  return ((requisicao_local_t *)req)->conexao->sockfd;
+}
+
+
+esp_err_t httpd_resp_set_status(httpd_req_t *req, const char *status) {
+  ((requisicao_local_t *)req)->status = status;
+  return ESP_OK;
+}
+
+
+esp_err_t httpd_resp_set_type(httpd_req_t *req, const char *tipo) {
+  ((requisicao_local_t *)req)->tipo = tipo;
+  return ESP_OK;
+}
+
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *req, const char *campo, const char *valor) {
+  requisicao_local_t *r = (requisicao_local_t *)req;
+
+  if (r->num_cabecalhos >= servidor.config.max_resp_headers || r->num_cabecalhos >= MAX_CABECALHOS_LOCAIS) {
+    return ESP_ERR_HTTPD_RESP_HDR;
+  }
+  r->nomes[r->num_cabecalhos] = campo;
+  r->valores[r->num_cabecalhos] = valor;
+  r->num_cabecalhos++;
+  return ESP_OK;
+}
+
+
+esp_err_t httpd_resp_send(httpd_req_t *req, const char *buf, ssize_t buf_len) {
+  requisicao_local_t *r = (requisicao_local_t *)req;
+
+  if (r->terminada || r->em_partes) {
+    return ESP_ERR_HTTPD_RESP_SEND;
+  }
+  if (buf_len == HTTPD_RESP_USE_STRLEN) {
+    buf_len = (buf != NULL) ? (ssize_t)strlen(buf) : 0;
+  }
+  iniciar_resposta(r);
+  if (buf != NULL && buf_len > 0) {
+    acrescentar_corpo(r->resposta, buf, buf_len);
+  }
+  r->terminada = true;
+  return ESP_OK;
+}
+
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *req, const char *buf, ssize_t buf_len) {
+  requisicao_local_t *r = (requisicao_local_t *)req;
+
+  if (r->terminada) {
+    return ESP_ERR_HTTPD_RESP_SEND;
+  }
+  if (buf_len == HTTPD_RESP_USE_STRLEN) {
+    buf_len = (buf != NULL) ? (ssize_t)strlen(buf) : 0;
+  }
+  if (!r->em_partes) {
+    iniciar_resposta(r);
+    r->em_partes = true;
+  }
+  if (buf == NULL || buf_len == 0) {
+    r->terminada = true;
+    return ESP_OK;
+  }
+  acrescentar_corpo(r->resposta, buf, buf_len);
+  return ESP_OK;
+}
+
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t erro, const char *msg) {
+  static const struct {
+    httpd_err_code_t  erro;
+    const char        *status;
+    const char        *msg;
+  } erros[] = {
+    { HTTPD_500_INTERNAL_SERVER_ERROR,    "500 Internal Server Error",  "Server has encountered an unexpected error" },
+    { HTTPD_501_METHOD_NOT_IMPLEMENTED,   "501 Method Not Implemented", "Server does not support this method" },
+    { HTTPD_505_VERSION_NOT_SUPPORTED,    "505 Version Not Supported",  "HTTP version not supported by server" },
+    { HTTPD_400_BAD_REQUEST,              "400 Bad Request",            "Bad request syntax" },
+    { HTTPD_401_UNAUTHORIZED,             "401 Unauthorized",           "No permission -- see authorization schemes" },
+    { HTTPD_403_FORBIDDEN,                "403 Forbidden",              "Request forbidden -- authorization will not help" },
+    { HTTPD_404_NOT_FOUND,                "404 Not Found",              "Nothing matches the given URI" },
+    { HTTPD_405_METHOD_NOT_ALLOWED,       "405 Method Not Allowed",     "Specified method is invalid for this resource" },
+    { HTTPD_408_REQ_TIMEOUT,              "408 Request Timeout",        "Server closed this connection" },
+    { HTTPD_411_LENGTH_REQUIRED,          "411 Length Required",        "Client must specify Content-Length" },
+    { HTTPD_414_URI_TOO_LONG,             "414 URI Too Long",           "URI is too long" },
+    { HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE, "431 Request Header Fields Too Large", "Header fields are too long" },
+  };
+  requisicao_local_t *r = (requisicao_local_t *)req;
+
+  for (size_t i = 0; i < sizeof(erros) / sizeof(erros[0]); i++) {
+    if (erros[i].erro == erro) {
+      r->status = erros[i].status;
+      r->tipo = "text/html";
+      return httpd_resp_send(req, (msg != NULL) ? msg : erros[i].msg, HTTPD_RESP_USE_STRLEN);
+    }
+  }
+  return ESP_ERR_INVALID_ARG;
+}
+
+
+int httpd_socket_send(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags) {
+  conexao_local_t *conexao = achar_conexao(sockfd);
+
+  if (conexao == NULL || conexao->fechar) {
+    return HTTPD_SOCK_ERR_FAIL;
+  }
+  guardar_assincronos(conexao, buf, buf_len);
+  return (int)buf_len;
+}
+
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg) {
+  if (!servidor.ativo || servidor.num_trabalhos >= MAX_TRABALHOS_LOCAIS) {
+    return ESP_FAIL;
+  }
+  servidor.trabalhos[servidor.num_trabalhos].funcao = work;
+  servidor.trabalhos[servidor.num_trabalhos].arg = arg;
+  servidor.num_trabalhos++;
+  return ESP_OK;
+}
+
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd) {
+  conexao_local_t *conexao = achar_conexao(sockfd);
+
+  if (conexao == NULL) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  conexao->fechar = true;
+  return ESP_OK;
+}
+
+
+#if CONFIG_HTTPD_WS_SUPPORT
+
+/*  Como no ESP-IDF: com max_len 0, informa só o tipo e o tamanho; depois,
+    o conteúdo precisa caber inteiro em max_len.
+ */
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len) {
+  requisicao_local_t *r = (requisicao_local_t *)req;
+
+  if (r->quadro == NULL || r->quadro_lido) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  pkt->final = true;
+  pkt->fragmented = false;
+  pkt->type = r->quadro->type;
+  pkt->len = r->quadro->len;
+  if (max_len == 0) {
+    return ESP_OK;
+  }
+  if (max_len < r->quadro->len || pkt->payload == NULL) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  memcpy(pkt->payload, r->quadro->payload, r->quadro->len);
+  r->quadro_lido = true;
+  return ESP_OK;
+}
+
+
+esp_err_t httpd_ws_send_frame(httpd_req_t *req, httpd_ws_frame_t *pkt) {
+  return httpd_ws_send_frame_async(req->handle, httpd_req_to_sockfd(req), pkt);
+}
+
+
+/*  Guarda só o conteúdo do quadro, para o teste ler como os eventos.
+ */
+esp_err_t httpd_ws_send_frame_async(httpd_handle_t hd, int fd, httpd_ws_frame_t *frame) {
+  conexao_local_t *conexao = achar_conexao(fd);
+
+  if (conexao == NULL || conexao->fechar || conexao->websocket == NULL) {
+    return ESP_FAIL;
+  }
+  guardar_assincronos(conexao, frame->payload, frame->len);
+  return ESP_OK;
+}
+#endif
+
+
+// Interface para os programas de teste --------------------------------------
+
+
+int servidor_local_conectar(void) {
+  conexao_local_t *livre = NULL;
+  conexao_local_t *menos_usada = NULL;
+  int abertas = 0;
+
+  if (!servidor.ativo) {
+    return -1;
+  }
+  for (int i = 0; i < MAX_CONEXOES_LOCAIS; i++) {
+    conexao_local_t *conexao = &servidor.conexoes[i];
+
+    if (!conexao->aberta) {
+      if (livre == NULL) {
+        livre = conexao;
+      }
+    } else {
+      abertas++;
+      if (menos_usada == NULL || conexao->uso < menos_usada->uso) {
+        menos_usada = conexao;
+      }
+    }
+  }
+  if (abertas >= servidor.config.max_open_sockets) {
+    if (!servidor.config.lru_purge_enable) {
+      return -1;
+    }
+    fechar_conexao(menos_usada);
+    livre = menos_usada;
+  }
+  memset(livre, 0, sizeof(*livre));
+  livre->aberta = true;
+  livre->sockfd = servidor.proximo_sockfd++;
+  livre->uso = ++servidor.contador_uso;
+  return livre->sockfd;
+}
+
+
+void servidor_local_desconectar(int sockfd) {
+  conexao_local_t *conexao = achar_conexao(sockfd);
+
+  if (conexao != NULL) {
+    fechar_conexao(conexao);
+  }
+}
+
+
+bool servidor_local_conectado(int sockfd) {
+  return (achar_conexao(sockfd) != NULL);
+}
+
+
+void servidor_local_definir_segmento(size_t bytes) {
+  servidor.segmento = bytes;
+}
+
+
+esp_err_t servidor_local_atender(int sockfd, httpd_method_t metodo, const char *uri,
+                                 const char *cabecalhos, const char *conteudo,
+                                 resposta_local_t *resposta) {
+  conexao_local_t *conexao = achar_conexao(sockfd);
+  requisicao_local_t r;
+  size_t len_caminho = strcspn(uri, "?");
+  const httpd_uri_t *tratamento = NULL;
+  bool outro_metodo = false;
+
+  memset(resposta, 0, sizeof(*resposta));
+  if (conexao == NULL) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  conexao->uso = ++servidor.contador_uso;
+
+  iniciar_requisicao(&r, conexao, metodo, uri, resposta);
+  r.req.content_len = (conteudo != NULL) ? strlen(conteudo) : 0;
+  r.cabecalhos = cabecalhos;
+  r.conteudo = conteudo;
+
+  for (int i = 0; i < servidor.num_uris && tratamento == NULL; i++) {
+    const httpd_uri_t *registrado = &servidor.uris[i];
+    bool corresponde = (servidor.config.uri_match_fn != NULL)
+                         ? servidor.config.uri_match_fn(registrado->uri, uri, len_caminho)
+                         : (strlen(registrado->uri) == len_caminho &&
+                            strncmp(registrado->uri, uri, len_caminho) == 0);
+
+    if (corresponde && registrado->method == metodo) {
+      tratamento = registrado;
+    } else if (corresponde) {
+      outro_metodo = true;
+    }
+  }
+  if (tratamento == NULL) {
+    httpd_resp_send_err(&r.req, outro_metodo ? HTTPD_405_METHOD_NOT_ALLOWED : HTTPD_404_NOT_FOUND, NULL);
+    return ESP_ERR_NOT_FOUND;
+  }
+
+  esp_err_t ret = executar_tratamento(&r, tratamento);
+
+  #if CONFIG_HTTPD_WS_SUPPORT
+  // Handshake aceito: o servidor responde 101 antes do tratamento
+  if (ret == ESP_OK && tratamento->is_websocket && !resposta->enviada) {
+    resposta->status = 101;
+    resposta->enviada = true;
+    conexao->websocket = tratamento;
+  }
+  #endif
+  executar_pendencias();
+  return ret;
+}
+
+
+#if CONFIG_HTTPD_WS_SUPPORT
+
+esp_err_t servidor_local_enviar_quadro(int sockfd, httpd_ws_type_t tipo, const void *conteudo, size_t len) {
+  static resposta_local_t descartada;         // Quadros não têm resposta HTTP
+  conexao_local_t *conexao = achar_conexao(sockfd);
+  httpd_ws_frame_t quadro = {
+    .final = true,
+    .type = tipo,
+    .payload = (uint8_t *)conteudo,
+    .len = len
+  };
+  requisicao_local_t r;
+
+  if (conexao == NULL || conexao->websocket == NULL) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  conexao->uso = ++servidor.contador_uso;
+
+  // Fora do handshake, o método da solicitação não é GET
+  iniciar_requisicao(&r, conexao, HTTP_DELETE, conexao->websocket->uri, &descartada);
+  r.quadro = &quadro;
+  r.quadro_lido = (len == 0);
+
+  esp_err_t ret = executar_tratamento(&r, conexao->websocket);
+
+  if (ret == ESP_OK && !r.quadro_lido) {
+    fechar_conexao(conexao);
+    ret = ESP_ERR_INVALID_STATE;
+  }
+  executar_pendencias();
+  return ret;
+}
+#endif
+
+
+size_t servidor_local_bytes_assincronos(int sockfd) {
+  conexao_local_t *conexao = achar_conexao(sockfd);
+
+  return (conexao != NULL) ? conexao->bytes_assincronos : 0;
+}
+
+
+size_t servidor_local_ler_assincronos(int sockfd, char *buf, size_t tamanho) {
+  conexao_local_t *conexao = achar_conexao(sockfd);
+
+  if (conexao == NULL || tamanho == 0) {
+    return 0;
+  }
+  size_t len = (conexao->len_assincronos < tamanho - 1) ? conexao->len_assincronos : tamanho - 1;
+
+  memcpy(buf, conexao->assincronos, len);
+  buf[len] = '\0';
+  memmove(conexao->assincronos, conexao->assincronos + len, conexao->len_assincronos - len);
+  conexao->len_assincronos -= len;
+  return len;
+}
+
+
+void servidor_local_executar_trabalhos(void) {
+  executar_pendencias();
+}
+
+
+const char *servidor_local_cabecalho(const resposta_local_t *resposta, const char *nome,
+                                     char *valor, size_t tamanho) {
+  size_t len = 0;
+  const char *encontrado = achar_cabecalho(resposta->cabecalhos, nome, &len);
+
+  if (encontrado == NULL) {
+    return NULL;
+  }
+  copiar_truncando(valor, tamanho, encontrado, len);
+  return valor;
+}
@@ -0,0 +1,127 @@
+/** @file servidor_http_local.h - Servidor HTTP em processo, para os testes no computador.
+
+    Implementa a interface do esp_http_server (stubs/esp_http_server.h)
+    sem sockets: o programa de teste abre conexões simuladas e entrega
+    cada solicitação já separada em método, URI, cabeçalhos e conteúdo.
+    O tratamento registrado por app_web_server.c é chamado como na tarefa
+    do servidor do ESP-IDF, com o mesmo contexto de sessão por conexão,
+    o mesmo limite de sockets (com descarte do menos usado) e os
+    trabalhos de httpd_queue_work() executados entre as solicitações.
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "esp_http_server.h"
+
+#define TAM_CORPO_LOCAL         (96 * 1024)   ///< Maior resposta guardada
+#define TAM_CABECALHOS_LOCAL    (1024)        ///< Cabeçalhos da resposta, "Nome: valor\n"
+#define TAM_ASSINCRONOS_LOCAL   (4096)        ///< Bytes enviados fora das respostas, ainda não lidos
+
+
+/** Resposta de uma solicitação.
+*/
+typedef struct {
+  int     status;                             ///< Código HTTP (200, 304, ...)
+  char    cabecalhos[TAM_CABECALHOS_LOCAL];   ///< Cabeçalhos, inclusive Content-Type
+  char    corpo[TAM_CORPO_LOCAL + 1];         ///< Conteúdo, terminado em '\0'
+  size_t  len_corpo;                          ///< Bytes do conteúdo
+  bool    truncada;                           ///< O conteúdo não coube em corpo
+  bool    enviada;                            ///< O tratamento enviou a resposta
+} resposta_local_t;
+
+
+/** Abrir uma conexão com o servidor iniciado por httpd_start().
+
+    Com todos os sockets ocupados e lru_purge_enable, fecha a conexão
+    usada há mais tempo (como o ESP-IDF); sem ele, recusa.
+
+    @return Número do socket, ou -1 se recusada.
+*/
+int servidor_local_conectar(void);
+
+
+/** Fechar uma conexão, como se o cliente desconectasse.
+*/
+void servidor_local_desconectar(int sockfd);
+
+
+/** Indicar se uma conexão continua aberta (o servidor pode tê-la fechado).
+*/
+bool servidor_local_conectado(int sockfd);
+
+
+/** Limitar os bytes entregues por chamada a httpd_req_recv(), para que
+    o conteúdo chegue em pedaços, como pela rede (0: sem limite).
+*/
+void servidor_local_definir_segmento(size_t bytes);
+
+
+/** Atender uma solicitação em uma conexão aberta.
+
+    @param sockfd       Conexão
+    @param metodo       HTTP_GET, HTTP_POST, ...
+    @param uri          Caminho, com a query string
+    @param cabecalhos   Linhas "Nome: valor\\n" (ou NULL)
+    @param conteudo     Conteúdo do POST (ou NULL)
+    @param resposta     Recebe a resposta
+
+    @return O retorno do tratamento (se não for ESP_OK, o servidor fecha
+            a conexão), ESP_ERR_NOT_FOUND se nenhum URI registrado
+            corresponde (a resposta é 404 ou 405), ou ESP_ERR_INVALID_STATE
+            se a conexão está fechada.
+*/
+esp_err_t servidor_local_atender(int sockfd, httpd_method_t metodo, const char *uri,
+                                 const char *cabecalhos, const char *conteudo,
+                                 resposta_local_t *resposta);
+
+
+#if CONFIG_HTTPD_WS_SUPPORT
+/** Enviar um quadro WebSocket em uma conexão já aberta por GET em um URI
+    is_websocket (resposta 101). O conteúdo dos quadros enviados pelo
+    servidor é lido com servidor_local_ler_assincronos().
+
+    @param sockfd     Conexão
+    @param tipo       HTTPD_WS_TYPE_BINARY, HTTPD_WS_TYPE_TEXT, ...
+    @param conteudo   Conteúdo do quadro
+    @param len        Bytes do conteúdo
+
+    @return O retorno do tratamento; ESP_ERR_INVALID_STATE se a conexão
+            não é WebSocket ou se o tratamento não leu todo o conteúdo.
+            Fora ESP_OK, o servidor fecha a conexão.
+*/
+esp_err_t servidor_local_enviar_quadro(int sockfd, httpd_ws_type_t tipo, const void *conteudo, size_t len);
+#endif
+
+
+/** Bytes enviados fora das respostas (httpd_socket_send) em uma conexão,
+    como os eventos de GET /eventos.
+*/
+size_t servidor_local_bytes_assincronos(int sockfd);
+
+
+/** Ler e retirar os bytes enviados fora das respostas em uma conexão
+    (até TAM_ASSINCRONOS_LOCAL guardados; o excesso é descartado).
+
+    @param sockfd   Conexão
+    @param buf      Recebe os bytes, terminados em '\0'
+    @param tamanho  Tamanho de buf
+
+    @return Bytes copiados (sem o '\0').
+*/
+size_t servidor_local_ler_assincronos(int sockfd, char *buf, size_t tamanho);
+
+
+/** Executar os trabalhos de httpd_queue_work() pendentes, como o servidor
+    ocioso, sem uma solicitação.
+*/
+void servidor_local_executar_trabalhos(void);
+
+
+/** Procurar um cabeçalho na resposta.
+
+    @return Valor do cabeçalho, copiado para valor, ou NULL se não existe.
+*/
+const char *servidor_local_cabecalho(const resposta_local_t *resposta, const char *nome,
+                                     char *valor, size_t tamanho);
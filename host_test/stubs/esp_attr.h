@@ -0,0 +1,7 @@
+/** @file esp_attr.h - Atributos de seção do ESP-IDF, sem efeito no computador.
+*/
+#pragma once
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_NOINIT_ATTR
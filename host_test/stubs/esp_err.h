@@ -0,0 +1,32 @@
+/** @file esp_err.h - Códigos de erro do ESP-IDF para os testes no computador.
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK                    0
+#define ESP_FAIL                  -1
+#define ESP_ERR_NO_MEM            0x101
+#define ESP_ERR_INVALID_ARG       0x102
+#define ESP_ERR_INVALID_STATE     0x103
+#define ESP_ERR_INVALID_SIZE      0x104
+#define ESP_ERR_NOT_FOUND         0x105
+#define ESP_ERR_NOT_SUPPORTED     0x106
+#define ESP_ERR_TIMEOUT           0x107
+#define ESP_ERR_NOT_FINISHED      0x10C
+
+const char *esp_err_to_name(esp_err_t codigo);
+
+#define ESP_ERROR_CHECK(x)  do {                                                    \
+    esp_err_t erro_ = (x);                                                          \
+    if (erro_ != ESP_OK) {                                                          \
+      fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, esp_err_to_name(erro_));   \
+      abort();                                                                      \
+    }                                                                               \
+  } while (0)
@@ -0,0 +1,186 @@
+/** @file esp_http_server.h - Interface do esp_http_server para os testes no computador.
+
+    Mesmos tipos e funções do ESP-IDF usados por app_web_server.c,
+    inclusive os quadros WebSocket (com CONFIG_HTTPD_WS_SUPPORT). A
+    implementação (servidor_http_local.c) não abre sockets:
+    as solicitações são entregues pelo próprio programa de teste, em
+    conexões simuladas, e atendidas uma de cada vez, como na tarefa única
+    do servidor do ESP-IDF.
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "esp_err.h"
+
+#define HTTPD_MAX_URI_LEN         (512)
+
+#define ESP_ERR_HTTPD_BASE        (0xb000)
+#define ESP_ERR_HTTPD_HANDLERS_FULL (ESP_ERR_HTTPD_BASE + 1)
+#define ESP_ERR_HTTPD_HANDLER_EXISTS (ESP_ERR_HTTPD_BASE + 2)
+#define ESP_ERR_HTTPD_INVALID_REQ (ESP_ERR_HTTPD_BASE + 3)
+#define ESP_ERR_HTTPD_RESULT_TRUNC (ESP_ERR_HTTPD_BASE + 4)
+#define ESP_ERR_HTTPD_RESP_HDR    (ESP_ERR_HTTPD_BASE + 5)
+#define ESP_ERR_HTTPD_RESP_SEND   (ESP_ERR_HTTPD_BASE + 6)
+
+#define HTTPD_RESP_USE_STRLEN     (-1)
+#define HTTPD_SOCK_ERR_FAIL       (-1)
+#define HTTPD_SOCK_ERR_INVALID    (-2)
+#define HTTPD_SOCK_ERR_TIMEOUT    (-3)
+
+#define HTTPD_200   "200 OK"
+#define HTTPD_204   "204 No Content"
+#define HTTPD_207   "207 Multi-Status"
+#define HTTPD_400   "400 Bad Request"
+#define HTTPD_404   "404 Not Found"
+#define HTTPD_408   "408 Request Timeout"
+#define HTTPD_500   "500 Internal Server Error"
+
+typedef void *httpd_handle_t;
+
+typedef enum {
+  HTTP_DELETE = 0,
+  HTTP_GET = 1,
+  HTTP_HEAD = 2,
+  HTTP_POST = 3,
+  HTTP_PUT = 4,
+  HTTP_OPTIONS = 6
+} httpd_method_t;
+
+typedef enum {
+  HTTPD_500_INTERNAL_SERVER_ERROR = 0,
+  HTTPD_501_METHOD_NOT_IMPLEMENTED,
+  HTTPD_505_VERSION_NOT_SUPPORTED,
+  HTTPD_400_BAD_REQUEST,
+  HTTPD_401_UNAUTHORIZED,
+  HTTPD_403_FORBIDDEN,
+  HTTPD_404_NOT_FOUND,
+  HTTPD_405_METHOD_NOT_ALLOWED,
+  HTTPD_408_REQ_TIMEOUT,
+  HTTPD_411_LENGTH_REQUIRED,
+  HTTPD_414_URI_TOO_LONG,
+  HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE
+} httpd_err_code_t;
+
+typedef void (*httpd_free_ctx_fn_t)(void *ctx);
+
+typedef struct httpd_req {
+  httpd_handle_t      handle;
+  int                 method;
+  const char          uri[HTTPD_MAX_URI_LEN + 1];
+  size_t              content_len;
+  void                *aux;
+  void                *user_ctx;
+  void                *sess_ctx;
+  httpd_free_ctx_fn_t free_ctx;
+  bool                ignore_sess_ctx_changes;
+} httpd_req_t;
+
+typedef struct httpd_uri {
+  const char      *uri;
+  httpd_method_t  method;
+  esp_err_t       (*handler)(httpd_req_t *r);
+  void            *user_ctx;
+#if CONFIG_HTTPD_WS_SUPPORT
+  bool            is_websocket;
+#endif
+} httpd_uri_t;
+
+#if CONFIG_HTTPD_WS_SUPPORT
+typedef enum {
+  HTTPD_WS_TYPE_CONTINUE = 0x0,
+  HTTPD_WS_TYPE_TEXT = 0x1,
+  HTTPD_WS_TYPE_BINARY = 0x2,
+  HTTPD_WS_TYPE_CLOSE = 0x8,
+  HTTPD_WS_TYPE_PING = 0x9,
+  HTTPD_WS_TYPE_PONG = 0xA
+} httpd_ws_type_t;
+
+typedef struct httpd_ws_frame {
+  bool            final;
+  bool            fragmented;
+  httpd_ws_type_t type;
+  uint8_t         *payload;
+  size_t          len;
+} httpd_ws_frame_t;
+#endif
+
+typedef bool (*httpd_uri_match_func_t)(const char *modelo, const char *uri, size_t len);
+typedef void (*httpd_close_func_t)(httpd_handle_t hd, int sockfd);
+typedef void (*httpd_work_fn_t)(void *arg);
+
+typedef struct httpd_config {
+  unsigned                task_priority;
+  size_t                  stack_size;
+  int                     core_id;
+  uint16_t                server_port;
+  uint16_t                ctrl_port;
+  uint16_t                max_open_sockets;
+  uint16_t                max_uri_handlers;
+  uint16_t                max_resp_headers;
+  uint16_t                backlog_conn;
+  bool                    lru_purge_enable;
+  uint16_t                recv_wait_timeout;
+  uint16_t                send_wait_timeout;
+  httpd_close_func_t      close_fn;
+  httpd_uri_match_func_t  uri_match_fn;
+} httpd_config_t;
+
+#define HTTPD_DEFAULT_CONFIG() {          \
+    .task_priority      = 5,              \
+    .stack_size         = 4096,           \
+    .core_id            = 0x7fffffff,     \
+    .server_port        = 80,             \
+    .ctrl_port          = 32768,          \
+    .max_open_sockets   = 7,              \
+    .max_uri_handlers   = 8,              \
+    .max_resp_headers   = 8,              \
+    .backlog_conn       = 5,              \
+    .lru_purge_enable   = false,          \
+    .recv_wait_timeout  = 5,              \
+    .send_wait_timeout  = 5,              \
+    .close_fn           = NULL,           \
+    .uri_match_fn       = NULL            \
+}
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config);
+esp_err_t httpd_stop(httpd_handle_t handle);
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler);
+bool httpd_uri_match_wildcard(const char *modelo, const char *uri, size_t len);
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *campo);
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *campo, char *val, size_t val_size);
+size_t httpd_req_get_url_query_len(httpd_req_t *r);
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len);
+esp_err_t httpd_query_key_value(const char *qry, const char *chave, char *val, size_t val_size);
+esp_err_t httpd_req_get_cookie_val(httpd_req_t *req, const char *nome, char *val, size_t *val_size);
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len);
+int httpd_req_to_sockfd(httpd_req_t *r);
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status);
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *tipo);
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *campo, const char *valor);
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len);
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len);
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t erro, const char *msg);
+
+static inline esp_err_t httpd_resp_sendstr(httpd_req_t *r, const char *str) {
+  return httpd_resp_send(r, str, (str == NULL) ? 0 : HTTPD_RESP_USE_STRLEN);
+}
+
+static inline esp_err_t httpd_resp_sendstr_chunk(httpd_req_t *r, const char *str) {
+  return httpd_resp_send_chunk(r, str, (str == NULL) ? 0 : HTTPD_RESP_USE_STRLEN);
+}
+
+int httpd_socket_send(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags);
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg);
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd);
+
+#if CONFIG_HTTPD_WS_SUPPORT
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len);
+esp_err_t httpd_ws_send_frame(httpd_req_t *req, httpd_ws_frame_t *pkt);
+esp_err_t httpd_ws_send_frame_async(httpd_handle_t hd, int fd, httpd_ws_frame_t *frame);
+#endif
@@ -0,0 +1,24 @@
+/** @file esp_littlefs.h - Montagem do littlefs, substituída por um diretório comum.
+
+    Os módulos abrem os arquivos em DIRETORIO_ARMAZENAMENTO (app_config.h),
+    que nos testes é um diretório da compilação; montar apenas confere
+    que ele existe.
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+typedef struct {
+  const char  *base_path;
+  const char  *partition_label;
+  unsigned    format_if_mount_failed : 1;
+  unsigned    dont_mount : 1;
+} esp_vfs_littlefs_conf_t;
+
+esp_err_t esp_vfs_littlefs_register(const esp_vfs_littlefs_conf_t *conf);
+esp_err_t esp_vfs_littlefs_unregister(const char *particao);
+esp_err_t esp_littlefs_info(const char *particao, size_t *total, size_t *usado);
+esp_err_t esp_littlefs_format(const char *particao);
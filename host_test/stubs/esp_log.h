@@ -0,0 +1,33 @@
+/** @file esp_log.h - Registro (log) do ESP-IDF para os testes no computador.
+
+    Escreve em stderr as mensagens até o nível definido com
+    esp_log_level_set() (padrão: avisos). A etiqueta é ignorada.
+*/
+#pragma once
+
+#include <stdio.h>
+
+typedef enum {
+  ESP_LOG_NONE,
+  ESP_LOG_ERROR,
+  ESP_LOG_WARN,
+  ESP_LOG_INFO,
+  ESP_LOG_DEBUG,
+  ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+extern esp_log_level_t nivel_log_local;
+
+void esp_log_level_set(const char *etiqueta, esp_log_level_t nivel);
+
+#define ESP_LOG_LOCAL(nivel, letra, etiqueta, formato, ...) do {                    \
+    if ((nivel) <= nivel_log_local) {                                               \
+      fprintf(stderr, letra " (%s) " formato "\n", etiqueta, ##__VA_ARGS__);        \
+    }                                                                               \
+  } while (0)
+
+#define ESP_LOGE(etiqueta, formato, ...)  ESP_LOG_LOCAL(ESP_LOG_ERROR, "E", etiqueta, formato, ##__VA_ARGS__)
+#define ESP_LOGW(etiqueta, formato, ...)  ESP_LOG_LOCAL(ESP_LOG_WARN, "W", etiqueta, formato, ##__VA_ARGS__)
+#define ESP_LOGI(etiqueta, formato, ...)  ESP_LOG_LOCAL(ESP_LOG_INFO, "I", etiqueta, formato, ##__VA_ARGS__)
+#define ESP_LOGD(etiqueta, formato, ...)  ESP_LOG_LOCAL(ESP_LOG_DEBUG, "D", etiqueta, formato, ##__VA_ARGS__)
+#define ESP_LOGV(etiqueta, formato, ...)  ESP_LOG_LOCAL(ESP_LOG_VERBOSE, "V", etiqueta, formato, ##__VA_ARGS__)
@@ -0,0 +1,11 @@
+/** @file esp_rom_crc.h - CRC da ROM do ESP32, calculado em software.
+
+    Mesmos polinômios e convenções da ROM: o CRC-32 é o do zlib e o
+    CRC-16 é o CCITT refletido, ambos com inversão na entrada e na saída.
+*/
+#pragma once
+
+#include <stdint.h>
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
+uint16_t esp_rom_crc16_le(uint16_t crc, const uint8_t *buf, uint32_t len);
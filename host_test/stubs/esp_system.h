@@ -0,0 +1,11 @@
+/** @file esp_system.h - Funções do sistema do ESP-IDF para os testes no computador.
+
+    O heap do computador não tem limite útil: os valores são fixos.
+*/
+#pragma once
+
+#include <stdint.h>
+
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
+void esp_restart(void);
@@ -0,0 +1,8 @@
+/** @file esp_timer.h - Relógio do ESP-IDF para os testes no computador.
+*/
+#pragma once
+
+#include <stdint.h>
+
+/** Microssegundos desde o início do programa (CLOCK_MONOTONIC). */
+int64_t esp_timer_get_time(void);
@@ -0,0 +1,9 @@
+/** @file esp_tls_crypto.h - Codificação base64 do esp-tls, para os testes no computador.
+*/
+#pragma once
+
+#include <stddef.h>
+
+/** Mesmo contrato do ESP-IDF: 0 se codificou, -0x002A se dst é pequeno. */
+int esp_crypto_base64_encode(unsigned char *dst, size_t dlen, size_t *olen,
+                             const unsigned char *src, size_t slen);
@@ -0,0 +1,45 @@
+/** @file FreeRTOS.h - Substituto do FreeRTOS para os testes no computador.
+
+    Os testes rodam em uma única linha de execução: as seções críticas
+    não fazem nada e as tarefas criadas nunca são executadas. Apenas o
+    necessário para compilar os módulos de main/.
+
+    @see idf_local.c
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_attr.h"
+
+typedef uint32_t  TickType_t;
+typedef int       BaseType_t;
+typedef unsigned  UBaseType_t;
+
+#define pdTRUE                1
+#define pdFALSE               0
+#define pdPASS                pdTRUE
+#define pdFAIL                pdFALSE
+
+#define portMAX_DELAY         ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS    (10)
+#define pdMS_TO_TICKS(ms)     ((TickType_t)((ms) / portTICK_PERIOD_MS))
+#define portNUM_PROCESSORS    (1)
+
+#define configMAX_PRIORITIES  (25)
+#define tskIDLE_PRIORITY      (0)
+#define tskNO_AFFINITY        (0x7fffffff)
+
+typedef struct {
+  int     trava;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED  { 0 }
+
+#define portENTER_CRITICAL(mux)       ((void)(mux))
+#define portEXIT_CRITICAL(mux)        ((void)(mux))
+#define portENTER_CRITICAL_ISR(mux)   ((void)(mux))
+#define portEXIT_CRITICAL_ISR(mux)    ((void)(mux))
+#define portYIELD_FROM_ISR(acordou)   ((void)(acordou))
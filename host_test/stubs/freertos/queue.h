@@ -0,0 +1,15 @@
+/** @file queue.h - Substituto das filas do FreeRTOS para os testes no computador.
+
+    Sem tarefas para consumi-las, as filas nunca são criadas.
+*/
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef void *QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t tamanho, UBaseType_t tamanho_item);
+void vQueueDelete(QueueHandle_t fila);
+BaseType_t xQueueSend(QueueHandle_t fila, const void *item, TickType_t espera);
+BaseType_t xQueueSendFromISR(QueueHandle_t fila, const void *item, BaseType_t *acordou);
+BaseType_t xQueueReceive(QueueHandle_t fila, void *item, TickType_t espera);
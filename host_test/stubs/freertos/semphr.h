@@ -0,0 +1,16 @@
+/** @file semphr.h - Substituto dos semáforos do FreeRTOS para os testes no computador.
+
+    Sem outras tarefas, um semáforo indisponível nunca será liberado:
+    xSemaphoreTake() retorna pdFALSE imediatamente, sem esperar.
+*/
+#pragma once
+
+#include "freertos/queue.h"
+
+typedef void *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+void vSemaphoreDelete(SemaphoreHandle_t semaforo);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaforo, TickType_t espera);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaforo);
@@ -0,0 +1,35 @@
+/** @file task.h - Substituto das tarefas do FreeRTOS para os testes no computador.
+*/
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+typedef enum {
+  eNoAction,
+  eSetBits,
+  eIncrement,
+  eSetValueWithOverwrite,
+  eSetValueWithoutOverwrite
+} eNotifyAction;
+
+/** Não executa a tarefa: os testes chamam diretamente o que ela faria. */
+BaseType_t xTaskCreate(TaskFunction_t funcao, const char *nome, uint32_t pilha, void *parametros,
+                       UBaseType_t prioridade, TaskHandle_t *tarefa);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t funcao, const char *nome, uint32_t pilha,
+                                   void *parametros, UBaseType_t prioridade, TaskHandle_t *tarefa,
+                                   BaseType_t nucleo);
+void vTaskDelete(TaskHandle_t tarefa);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t tarefa);
+
+BaseType_t xTaskNotifyGive(TaskHandle_t tarefa);
+void vTaskNotifyGiveFromISR(TaskHandle_t tarefa, BaseType_t *acordou);
+uint32_t ulTaskNotifyTake(BaseType_t zerar, TickType_t espera);
+BaseType_t xTaskNotify(TaskHandle_t tarefa, uint32_t valor, eNotifyAction acao);
+BaseType_t xTaskNotifyWait(uint32_t zerar_entrada, uint32_t zerar_saida, uint32_t *valor,
+                           TickType_t espera);
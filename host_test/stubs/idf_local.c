@@ -0,0 +1,340 @@
+/** @file idf_local.c - Implementação dos substitutos do ESP-IDF e do FreeRTOS.
+
+    Suficiente para os módulos de main/ rodarem em um programa de teste,
+    em uma única linha de execução:
+
+      - Tarefas criadas não são executadas, e filas não são criadas;
+      - Um semáforo ocupado não é esperado: xSemaphoreTake() falha;
+      - esp_timer_get_time() é o relógio monotônico do computador;
+      - O littlefs é um diretório comum (DIRETORIO_ARMAZENAMENTO).
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_rom_crc.h"
+#include "esp_random.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+#include "esp_littlefs.h"
+#include "esp_tls_crypto.h"
+
+// Valores fixos do heap informados aos módulos
+#define HEAP_LOCAL_BYTES    (160 * 1024)
+
+esp_log_level_t nivel_log_local = ESP_LOG_WARN;
+
+// Tarefa "corrente": qualquer valor diferente de NULL
+static int tarefa_local;
+
+
+// FreeRTOS ------------------------------------------------------------------
+
+BaseType_t xTaskCreate(TaskFunction_t funcao, const char *nome, uint32_t pilha, void *parametros,
+                       UBaseType_t prioridade, TaskHandle_t *tarefa) {
+  if (tarefa != NULL) {
+    *tarefa = &tarefa_local;
+  }
+  return pdPASS;
+}
+
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t funcao, const char *nome, uint32_t pilha,
+                                   void *parametros, UBaseType_t prioridade, TaskHandle_t *tarefa,
+                                   BaseType_t nucleo) {
+  return xTaskCreate(funcao, nome, pilha, parametros, prioridade, tarefa);
+}
+
+
+void vTaskDelete(TaskHandle_t tarefa) {
+}
+
+
+void vTaskDelay(TickType_t ticks) {
+}
+
+
+TickType_t xTaskGetTickCount(void) {
+  return (TickType_t)(esp_timer_get_time() / 1000 / portTICK_PERIOD_MS);
+}
+
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+  return &tarefa_local;
+}
+
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t tarefa) {
+  return 0;
+}
+
+
+BaseType_t xTaskNotifyGive(TaskHandle_t tarefa) {
+  return pdPASS;
+}
+
+
+void vTaskNotifyGiveFromISR(TaskHandle_t tarefa, BaseType_t *acordou) {
+}
+
+
+uint32_t ulTaskNotifyTake(BaseType_t zerar, TickType_t espera) {
+  return 0;
+}
+
+
+BaseType_t xTaskNotify(TaskHandle_t tarefa, uint32_t valor, eNotifyAction acao) {
+  return pdPASS;
+}
+
+
+BaseType_t xTaskNotifyWait(uint32_t zerar_entrada, uint32_t zerar_saida, uint32_t *valor,
+                           TickType_t espera) {
+  return pdFALSE;
+}
+
+
+QueueHandle_t xQueueCreate(UBaseType_t tamanho, UBaseType_t tamanho_item) {
+  return NULL;
+}
+
+
+void vQueueDelete(QueueHandle_t fila) {
+}
+
+
+BaseType_t xQueueSend(QueueHandle_t fila, const void *item, TickType_t espera) {
+  return pdFAIL;
+}
+
+
+BaseType_t xQueueSendFromISR(QueueHandle_t fila, const void *item, BaseType_t *acordou) {
+  return pdFAIL;
+}
+
+
+BaseType_t xQueueReceive(QueueHandle_t fila, void *item, TickType_t espera) {
+  return pdFAIL;
+}
+
+
+typedef struct {
+  int   disponivel;
+} semaforo_local_t;
+
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+  semaforo_local_t *semaforo = malloc(sizeof(semaforo_local_t));
+
+  if (semaforo != NULL) {
+    semaforo->disponivel = 1;
+  }
+  return semaforo;
+}
+
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+  semaforo_local_t *semaforo = malloc(sizeof(semaforo_local_t));
+
+  if (semaforo != NULL) {
+    semaforo->disponivel = 0;
+  }
+  return semaforo;
+}
+
+
+void vSemaphoreDelete(SemaphoreHandle_t semaforo) {
+  free(semaforo);
+}
+
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaforo, TickType_t espera) {
+  semaforo_local_t *s = semaforo;
+
+  if (s->disponivel == 0) {
+    return pdFALSE;
+  }
+  s->disponivel--;
+  return pdTRUE;
+}
+
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaforo) {
+  semaforo_local_t *s = semaforo;
+
+  if (s->disponivel > 0) {
+    return pdFALSE;
+  }
+  s->disponivel++;
+  return pdTRUE;
+}
+
+
+// ESP-IDF -------------------------------------------------------------------
+
+const char *esp_err_to_name(esp_err_t codigo) {
+  switch (codigo) {
+    case ESP_OK:                return "ESP_OK";
+    case ESP_FAIL:              return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:   return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_NOT_FOUND:     return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_TIMEOUT:       return "ESP_ERR_TIMEOUT";
+    default:                    return "ERRO";
+  }
+}
+
+
+void esp_log_level_set(const char *etiqueta, esp_log_level_t nivel) {
+  nivel_log_local = nivel;
+}
+
+
+int64_t esp_timer_get_time(void) {
+  static int64_t inicio = -1;
+  struct timespec agora;
+
+  clock_gettime(CLOCK_MONOTONIC, &agora);
+  int64_t us = (int64_t)agora.tv_sec * 1000000 + agora.tv_nsec / 1000;
+
+  if (inicio < 0) {
+    inicio = us;
+  }
+  return us - inicio;
+}
+
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len) {
+  crc = ~crc;
+  for (uint32_t i = 0; i < len; i++) {
+    crc ^= buf[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320u : 0);
+    }
+  }
+  return ~crc;
+}
+
+
+uint16_t esp_rom_crc16_le(uint16_t crc, const uint8_t *buf, uint32_t len) {
+  crc = ~crc;
+  for (uint32_t i = 0; i < len; i++) {
+    crc ^= buf[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ ((crc & 1) ? 0x8408u : 0);
+    }
+  }
+  return ~crc;
+}
+
+
+uint32_t esp_random(void) {
+  return ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+}
+
+
+void esp_fill_random(void *buf, size_t len) {
+  uint8_t *bytes = buf;
+
+  for (size_t i = 0; i < len; i++) {
+    bytes[i] = (uint8_t)rand();
+  }
+}
+
+
+uint32_t esp_get_free_heap_size(void) {
+  return HEAP_LOCAL_BYTES;
+}
+
+
+uint32_t esp_get_minimum_free_heap_size(void) {
+  return HEAP_LOCAL_BYTES;
+}
+
+
+void esp_restart(void) {
+  fprintf(stderr, "esp_restart()\n");
+  exit(1);
+}
+
+
+size_t heap_caps_get_free_size(uint32_t capacidades) {
+  return HEAP_LOCAL_BYTES;
+}
+
+
+size_t heap_caps_get_minimum_free_size(uint32_t capacidades) {
+  return HEAP_LOCAL_BYTES;
+}
+
+
+size_t heap_caps_get_largest_free_block(uint32_t capacidades) {
+  return HEAP_LOCAL_BYTES;
+}
+
+
+esp_err_t esp_vfs_littlefs_register(const esp_vfs_littlefs_conf_t *conf) {
+  struct stat st;
+
+  if (stat(conf->base_path, &st) != 0 && mkdir(conf->base_path, 0755) != 0) {
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+
+esp_err_t esp_vfs_littlefs_unregister(const char *particao) {
+  return ESP_OK;
+}
+
+
+esp_err_t esp_littlefs_info(const char *particao, size_t *total, size_t *usado) {
+  *total = 1024 * 1024;
+  *usado = 0;
+  return ESP_OK;
+}
+
+
+esp_err_t esp_littlefs_format(const char *particao) {
+  return ESP_OK;
+}
+
+
+int esp_crypto_base64_encode(unsigned char *dst, size_t dlen, size_t *olen,
+                             const unsigned char *src, size_t slen) {
+  static const char alfabeto[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  size_t necessario = 4 * ((slen + 2) / 3) + 1;
+  size_t n = 0;
+
+  *olen = necessario;
+  if (dlen < necessario) {
+    return -0x002A;
+  }
+  for (size_t i = 0; i < slen; i += 3) {
+    uint32_t bloco = (uint32_t)src[i] << 16;
+
+    if (i + 1 < slen) {
+      bloco |= (uint32_t)src[i + 1] << 8;
+    }
+    if (i + 2 < slen) {
+      bloco |= src[i + 2];
+    }
+    dst[n++] = alfabeto[(bloco >> 18) & 0x3F];
+    dst[n++] = alfabeto[(bloco >> 12) & 0x3F];
+    dst[n++] = (i + 1 < slen) ? alfabeto[(bloco >> 6) & 0x3F] : '=';
+    dst[n++] = (i + 2 < slen) ? alfabeto[bloco & 0x3F] : '=';
+  }
+  dst[n] = '\0';
+  *olen = n;
+  return 0;
+}
@@ -0,0 +1,3 @@
+/** @file soc_caps.h - Recursos do chip: o computador não tem PCNT nem ADC contínuo.
+*/
+#pragma once
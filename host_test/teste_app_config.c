@@ -0,0 +1,82 @@
+/** @file teste_app_config.c - Testes da carga de configuração de POST /config.
+
+    Uma carga com qualquer linha inválida não altera nada; uma carga
+    válida substitui todos os parâmetros de uma vez.
+
+    @see app_config.c
+*/
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "app_config.h"
+#include "leitor_parametros.h"
+
+
+/*  Lê o texto como o servidor, em pedaços pequenos; devolve true se a
+    carga foi aceita.
+ */
+static bool carregar(const char *texto) {
+  carga_config_t carga;
+  leitor_parametros_t leitor;
+  size_t len = strlen(texto);
+
+  app_config_iniciar_carga(&carga);
+  leitor_parametros_iniciar(&leitor, app_config_tratar_parametro, &carga);
+  for (size_t i = 0; i < len; i += 5) {
+    leitor_parametros_consumir(&leitor, texto + i, (len - i < 5) ? len - i : 5);
+  }
+  int erros = leitor_parametros_terminar(&leitor);
+
+  return app_config_concluir_carga(&carga, erros == 0);
+}
+
+
+static void testar_carga_valida(void) {
+  assert(carregar("hostname = modulo-teste\nssid = rede\npassword = \nmodo_wifi = STA\n"));
+  assert(strcmp(app_config_hostname(), "modulo-teste") == 0);
+  assert(strcmp(app_config_wifi_ssid(), "rede") == 0);
+  assert(strcmp(app_config_wifi_password(), "") == 0);
+  assert(app_config_modo_wifi() == MODO_WIFI_STA);
+}
+
+
+/*  Cada carga tem uma linha inválida depois de linhas válidas: nenhuma
+    das linhas válidas pode ter efeito.
+ */
+static void testar_carga_invalida(void) {
+  char ssid_longo[MAX_SSID_LEN + 2];
+  char texto[256];
+
+  memset(ssid_longo, 's', MAX_SSID_LEN + 1);
+  ssid_longo[MAX_SSID_LEN + 1] = '\0';
+
+  snprintf(texto, sizeof(texto), "hostname = outro\nssid = %s\n", ssid_longo);
+  assert(!carregar(texto));
+  assert(!carregar("hostname = outro\nmodo_wifi = XYZ\n"));
+  assert(!carregar("hostname = outro\ndesconhecido = 1\n"));
+  assert(!carregar("hostname = outro\nlinha sem igual\n"));
+
+  assert(strcmp(app_config_hostname(), "modulo-teste") == 0);
+  assert(strcmp(app_config_wifi_ssid(), "rede") == 0);
+  assert(app_config_modo_wifi() == MODO_WIFI_STA);
+
+  // No limite, o ssid é aceito
+  ssid_longo[MAX_SSID_LEN] = '\0';
+  snprintf(texto, sizeof(texto), "ssid = %s\n", ssid_longo);
+  assert(carregar(texto));
+  assert(strcmp(app_config_wifi_ssid(), ssid_longo) == 0);
+}
+
+
+int main(void) {
+  esp_log_level_set("*", ESP_LOG_NONE);
+  app_config_ler();
+
+  testar_carga_valida();
+  testar_carga_invalida();
+  printf("app_config: ok\n");
+  return 0;
+}
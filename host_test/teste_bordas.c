@@ -0,0 +1,88 @@
+/** @file teste_bordas.c - Testes do registro circular de bordas.
+
+    Carrega o roteiro roteiros/bordas.txt, que gera mais bordas do que
+    cabem no registro, e confere em controle_gpio_ler_bordas() a ordem
+    das sequências, os instantes e a contagem dos eventos perdidos.
+
+    @see controle_gpio.c
+*/
+#include <assert.h>
+#include <stdio.h>
+
+#include "esp_log.h"
+
+#include "controle_gpio.h"
+#include "simulacao_gpio.h"
+
+#define ROTEIRO           "roteiros/bordas.txt"
+#define BORDAS            (100)     // Duas por pulso do roteiro
+#define TAM_REGISTRO      (64)      // TAM_REGISTRO_BORDAS em controle_gpio.c
+#define INICIO_US         (100 * 1000)
+#define PASSO_US          (10 * 1000)
+
+#define MAX_LIDAS         (128)
+
+
+/*  Confere uma borda do roteiro pela sequência: descidas nas pares.
+ */
+static void conferir_borda(const borda_gpio_t *borda, uint32_t seq) {
+  assert(borda->seq == seq);
+  assert(borda->classe == PRF_SENSOR && borda->id == 1);
+  assert(borda->nivel == (seq & 1));
+  assert(borda->instante_us == INICIO_US + (int64_t)seq * PASSO_US);
+}
+
+
+int main(void) {
+  borda_gpio_t bordas[MAX_LIDAS];
+  uint32_t proximo;
+  uint32_t perdidos;
+  int n;
+
+  esp_log_level_set("*", ESP_LOG_NONE);
+
+  FILE *roteiro = fopen(ROTEIRO, "r");
+
+  assert(roteiro != NULL);
+  assert(simulacao_gpio_carregar(roteiro) == 0);
+  fclose(roteiro);
+
+  controle_gpio_iniciar();
+  assert(controle_gpio_ativar_timer());
+
+  // Leitor em dia: lê as bordas em blocos pequenos, sem perder nenhuma
+  controle_gpio_simular_ate(INICIO_US + 20 * PASSO_US);
+  uint32_t cursor = 0;
+
+  while ((n = controle_gpio_ler_bordas(cursor, bordas, 3, &proximo, &perdidos)) > 0) {
+    assert(perdidos == 0);
+    for (int i = 0; i < n; i++) {
+      conferir_borda(&bordas[i], cursor + i);
+    }
+    cursor = proximo;
+  }
+  assert(cursor == 21);
+
+  // Registro cheio: o leitor parado perde as mais antigas e recebe as
+  // últimas TAM_REGISTRO, em ordem
+  controle_gpio_simular_ate(1200 * 1000);
+  n = controle_gpio_ler_bordas(0, bordas, MAX_LIDAS, &proximo, &perdidos);
+  assert(n == TAM_REGISTRO);
+  assert(perdidos == BORDAS - TAM_REGISTRO);
+  assert(proximo == BORDAS);
+  for (int i = 0; i < n; i++) {
+    conferir_borda(&bordas[i], BORDAS - TAM_REGISTRO + i);
+  }
+
+  // O cursor do leitor em dia também ficou para trás
+  n = controle_gpio_ler_bordas(cursor, bordas, MAX_LIDAS, &proximo, &perdidos);
+  assert(n == TAM_REGISTRO && perdidos == BORDAS - TAM_REGISTRO - cursor);
+  assert(bordas[0].seq == BORDAS - TAM_REGISTRO);
+
+  // Nada novo depois da última
+  n = controle_gpio_ler_bordas(proximo, bordas, MAX_LIDAS, &proximo, &perdidos);
+  assert(n == 0 && perdidos == 0 && proximo == BORDAS);
+
+  printf("bordas: ok\n");
+  return 0;
+}
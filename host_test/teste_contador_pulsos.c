@@ -0,0 +1,76 @@
+/** @file teste_contador_pulsos.c - Contagem por hardware de um trem de pulsos rápido.
+
+    Carrega o roteiro roteiros/trem_rapido.txt, que aplica o mesmo trem
+    de pulsos ao contador 1, contado pelo hardware (a unidade PCNT, que
+    na simulação conta as bordas do roteiro), e ao sensor 1, amostrado
+    a cada tick como os contadores por software. Os pulsos (4 ms a cada
+    25 ms) são mais curtos que o tick de 10 ms: a amostragem perde
+    metade deles, e o hardware conta todos.
+
+    @see simulacao_gpio.c
+    @see controle_gpio.c
+*/
+#include <assert.h>
+#include <stdio.h>
+
+#include "esp_log.h"
+
+#include "controle_gpio.h"
+#include "simulacao_gpio.h"
+
+#define ROTEIRO           "roteiros/trem_rapido.txt"
+#define PULSOS            (400)
+#define FIM_TREM_MS       (1000 + PULSOS * 25)
+
+static int descidas_sensor = 0;
+
+
+static void observar(enum periferico classe, int id, int valor) {
+  if (classe == PRF_SENSOR && id == 1 && valor == 0) {
+    descidas_sensor++;
+  }
+}
+
+
+int main(void) {
+  estatisticas_simulacao_t simulacao;
+  estatisticas_contador_t estatisticas;
+
+  esp_log_level_set("*", ESP_LOG_NONE);
+
+  FILE *roteiro = fopen(ROTEIRO, "r");
+
+  assert(roteiro != NULL);
+  assert(simulacao_gpio_carregar(roteiro) == 0);
+  fclose(roteiro);
+
+  controle_gpio_iniciar();
+  assert(controle_gpio_ativar_timer());
+  controle_gpio_registrar_observador(observar);
+
+  // A menor janela de debouncing (um tick), para a amostragem perder o mínimo
+  assert(controle_gpio_definir_debounce(PRF_SENSOR, 1, 1));
+
+  controle_gpio_simular_ate((int64_t)(FIM_TREM_MS + 100) * 1000);
+  simulacao_gpio_estatisticas(&simulacao);
+  assert(simulacao.pulsos_entrada == 2 * PULSOS);
+
+  // Hardware: nenhum pulso perdido, também na contagem de 64 bits
+  int contagem = controle_gpio_ler_contador(1);
+
+  assert(contagem == PULSOS);
+  assert(controle_gpio_estatisticas_contador(1, &estatisticas));
+  assert(estatisticas.contagem == PULSOS);
+
+  // Amostragem no tick: um pulso sim, outro não começa 5 ms depois de
+  // um tick e termina antes do seguinte
+  assert(descidas_sensor == PULSOS / 2);
+
+  // Zerar não perde a posição do hardware: conta só os pulsos seguintes
+  assert(controle_gpio_reiniciar_contador(1));
+  assert(controle_gpio_ler_contador(1) == 0);
+
+  printf("contador_pulsos: %d pulsos, hardware %d, amostragem %d\n",
+         PULSOS, contagem, descidas_sensor);
+  return 0;
+}
@@ -0,0 +1,142 @@
+/** @file teste_eventos.c - Ida e volta dos eventos de GET /eventos.
+
+    Executa o servidor de app_web_server.c sobre servidor_http_local.c,
+    com os pinos simulados em tempo virtual, e confere os eventos
+    recebidos por um assinante de GET /eventos:
+
+      - Sem mudanças, nenhum byte é enviado (a leitura periódica faria
+        uma solicitação por segundo);
+      - A campainha (sensor 1) chega no tick que a detecta, depois do
+        debouncing, e não até 1 s depois, como na leitura periódica;
+      - Um comando POST /atuador1 em outra conexão chega ao assinante
+        logo depois da resposta, na mesma volta da tarefa do servidor.
+
+    @see app_web_server.c
+*/
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "esp_tls_crypto.h"
+
+#include "app_config.h"
+#include "app_web_server.h"
+#include "controle_gpio.h"
+#include "simulacao_gpio.h"
+#include "servidor_http_local.h"
+
+// Campainha pressionada de 1000 a 1300 ms
+#define ROTEIRO           "nivel = 1000,32,0\nnivel = 1300,32,1\n"
+#define INICIO_CAMPAINHA_MS (1000)
+
+// Janela de debouncing das entradas, mais um tick
+#define ATRASO_MAX_MS     (40)
+#define PASSO_MS          (10)
+
+#define TAM_COOKIE        (64)
+
+static resposta_local_t resposta;
+
+
+static double agora_real_us(void) {
+  struct timespec agora;
+
+  clock_gettime(CLOCK_MONOTONIC, &agora);
+  return (double)agora.tv_sec * 1e6 + (double)agora.tv_nsec / 1e3;
+}
+
+
+/*  GET /basic_auth com a credencial; devolve o cabeçalho Cookie da sessão.
+ */
+static void autenticar(int sockfd, char *cabecalho_cookie, size_t tamanho) {
+  static const char credencial[] = CONFIG_EXAMPLE_BASIC_AUTH_USERNAME ":" CONFIG_EXAMPLE_BASIC_AUTH_PASSWORD;
+  unsigned char base64[128];
+  char cabecalhos[192];
+  char valor[TAM_CABECALHOS_LOCAL];
+  size_t len;
+
+  esp_crypto_base64_encode(base64, sizeof(base64), &len, (const unsigned char *)credencial,
+                           sizeof(credencial) - 1);
+  snprintf(cabecalhos, sizeof(cabecalhos), "Authorization: Basic %s\n", base64);
+
+  servidor_local_atender(sockfd, HTTP_GET, "/basic_auth", cabecalhos, NULL, &resposta);
+  assert(resposta.status == 200);
+  assert(servidor_local_cabecalho(&resposta, "Set-Cookie", valor, sizeof(valor)) != NULL);
+  valor[strcspn(valor, ";")] = '\0';
+  snprintf(cabecalho_cookie, tamanho, "Cookie: %.*s\n", TAM_COOKIE, valor);
+}
+
+
+/*  Avança o tempo virtual, com o servidor ocioso entre os ticks.
+ */
+static void avancar_ate(int64_t fim_ms) {
+  while (simulacao_gpio_agora_us() < fim_ms * 1000) {
+    controle_gpio_simular_ate(simulacao_gpio_agora_us() + PASSO_MS * 1000);
+    servidor_local_executar_trabalhos();
+  }
+}
+
+
+int main(void) {
+  char cookie_assinante[TAM_COOKIE + 16];
+  char cookie_comando[TAM_COOKIE + 16];
+  char recebido[TAM_ASSINCRONOS_LOCAL];
+
+  esp_log_level_set("*", ESP_LOG_NONE);
+
+  app_config_ler();
+  controle_gpio_iniciar();
+  controle_gpio_ativar_timer();
+
+  FILE *roteiro = fmemopen((void *)ROTEIRO, strlen(ROTEIRO), "r");
+
+  assert(roteiro != NULL && simulacao_gpio_carregar(roteiro) == 0);
+  fclose(roteiro);
+  assert(start_webserver() != NULL);
+
+  // Assinante: o cabeçalho do fluxo sai logo, e a conexão fica aberta
+  int assinante = servidor_local_conectar();
+
+  autenticar(assinante, cookie_assinante, sizeof(cookie_assinante));
+  servidor_local_atender(assinante, HTTP_GET, "/eventos", cookie_assinante, NULL, &resposta);
+  assert(servidor_local_conectado(assinante));
+  servidor_local_ler_assincronos(assinante, recebido, sizeof(recebido));
+  assert(strstr(recebido, "Content-Type: text/event-stream") != NULL);
+
+  // Ocioso: nada é enviado enquanto nada muda
+  avancar_ate(INICIO_CAMPAINHA_MS - PASSO_MS);
+  assert(servidor_local_ler_assincronos(assinante, recebido, sizeof(recebido)) == 0);
+
+  // Campainha: o evento chega no tick que detecta a borda
+  int64_t chegada_ms = 0;
+
+  while (chegada_ms == 0 && simulacao_gpio_agora_us() < (INICIO_CAMPAINHA_MS + 1000) * 1000) {
+    avancar_ate(simulacao_gpio_agora_us() / 1000 + PASSO_MS);
+    if (servidor_local_ler_assincronos(assinante, recebido, sizeof(recebido)) > 0) {
+      chegada_ms = simulacao_gpio_agora_us() / 1000;
+    }
+  }
+  assert(strcmp(recebido, "event: sensor\ndata: 1=0\n\n") == 0);
+  assert(chegada_ms - INICIO_CAMPAINHA_MS <= ATRASO_MAX_MS);
+
+  // Comando em outra conexão: o assinante recebe a mudança do atuador
+  int comando = servidor_local_conectar();
+
+  autenticar(comando, cookie_comando, sizeof(cookie_comando));
+  double antes = agora_real_us();
+
+  servidor_local_atender(comando, HTTP_POST, "/atuador1", cookie_comando, "action=on\n", &resposta);
+  servidor_local_ler_assincronos(assinante, recebido, sizeof(recebido));
+  double ida_e_volta_us = agora_real_us() - antes;
+
+  assert(resposta.status == 201);
+  assert(strcmp(recebido, "event: atuador\ndata: 1=1\n\n") == 0);
+
+  printf("eventos: campainha em %lld ms virtuais (leitura a cada 1 s: até 1000 ms), "
+         "comando e evento em %.1f us\n",
+         (long long)(chegada_ms - INICIO_CAMPAINHA_MS), ida_e_volta_us);
+  return 0;
+}
@@ -0,0 +1,112 @@
+/** @file teste_expansor.c - Transações por tick no barramento dos expansores.
+
+    Executa a tarefa de controle em tempo virtual com dois MCP23017, no
+    modelo em memória de expansor_gpio.c, e confere nas estatísticas do
+    barramento (expansor_gpio_estatisticas):
+
+      - Ocioso, as entradas só são lidas na leitura forçada (a cada
+        100 ticks), e não uma vez por tick em cada expansor;
+      - Uma mudança em uma entrada (linha INT) causa uma leitura por
+        expansor com entradas, no tick seguinte;
+      - Um lote de atuadores nos dois expansores custa uma escrita por
+        expansor, e não uma por atuador.
+
+    @see expansor_gpio.c
+*/
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "controle_gpio.h"
+#include "expansor_gpio.h"
+
+#define TICK_US               (10 * 1000)   // INTERVALO_TICK_MS em controle_gpio.c
+#define TICKS_OCIOSOS         (1000)
+#define TICKS_LEITURA_FORCADA (100)         // Em expansor_gpio.c
+#define NUM_EXPANSORES        (CONFIG_EXPANSOR_QUANTIDADE)
+
+// Primeiro sensor do segundo expansor (porta B) e primeiro atuador dos expansores (porta A)
+#define SENSOR_EXPANSOR1      (SENSORES_CHIP + 8 + 1)
+#define PRIMEIRO_ATUADOR_EXP  (ATUADORES_CHIP + 1)
+
+static int64_t agora_us = 0;
+
+
+static void avancar_ticks(int ticks) {
+  agora_us += (int64_t)ticks * TICK_US;
+  controle_gpio_simular_ate(agora_us);
+}
+
+
+int main(void) {
+  estatisticas_expansor_t inicio;
+  estatisticas_expansor_t fim;
+
+  esp_log_level_set("*", ESP_LOG_NONE);
+
+  controle_gpio_iniciar();
+  controle_gpio_ativar_timer();
+
+  // Ocioso: a primeira leitura limpa as interrupções; depois, só as forçadas
+  expansor_gpio_estatisticas(&inicio);
+  avancar_ticks(TICKS_OCIOSOS);
+  expansor_gpio_estatisticas(&fim);
+
+  uint32_t ticks = fim.ticks - inicio.ticks;
+  uint32_t leituras = fim.leituras - inicio.leituras;
+  uint32_t transacoes_ociosas = fim.transacoes - inicio.transacoes;
+  uint32_t max_leituras = NUM_EXPANSORES * (TICKS_OCIOSOS / TICKS_LEITURA_FORCADA + 1);
+
+  assert(ticks == TICKS_OCIOSOS);
+  assert(leituras <= max_leituras && transacoes_ociosas == leituras);
+  assert(fim.leituras_evitadas - inicio.leituras_evitadas >=
+         ticks - (TICKS_OCIOSOS / TICKS_LEITURA_FORCADA + 1));
+  assert(fim.escritas == inicio.escritas && fim.falhas == 0);
+
+  // Mudança em uma entrada: uma leitura por expansor no tick seguinte
+  int nivel_sensor = controle_gpio_ler_sensor(SENSOR_EXPANSOR1);
+
+  expansor_gpio_estatisticas(&inicio);
+  expansor_gpio_definir_pinos(1, nivel_sensor ? 0x0000 : 0x0100);
+  avancar_ticks(1);
+  expansor_gpio_estatisticas(&fim);
+  assert(fim.leituras - inicio.leituras == NUM_EXPANSORES);
+  assert(fim.transacoes - inicio.transacoes == NUM_EXPANSORES);
+
+  // Depois do 'debouncing', o sensor muda, sem outras leituras
+  expansor_gpio_estatisticas(&inicio);
+  avancar_ticks(5);
+  expansor_gpio_estatisticas(&fim);
+  assert(controle_gpio_ler_sensor(SENSOR_EXPANSOR1) == !nivel_sensor);
+  assert(fim.transacoes == inicio.transacoes);
+
+  // Lote com os 16 atuadores dos expansores: uma escrita por expansor
+  lote_atuadores_t lote;
+
+  memset(&lote, 0, sizeof(lote));
+  for (int id = PRIMEIRO_ATUADOR_EXP; id < PRIMEIRO_ATUADOR_EXP + 8 * NUM_EXPANSORES; id++) {
+    lote.ligar |= 1ULL << id;
+  }
+  expansor_gpio_estatisticas(&inicio);
+  assert(controle_gpio_aplicar_lote(&lote));
+  expansor_gpio_estatisticas(&fim);
+  assert(fim.escritas - inicio.escritas == NUM_EXPANSORES);
+  assert(fim.transacoes - inicio.transacoes == NUM_EXPANSORES);
+  for (int id = PRIMEIRO_ATUADOR_EXP; id < PRIMEIRO_ATUADOR_EXP + 8 * NUM_EXPANSORES; id++) {
+    assert(controle_gpio_ler_atuador(id) == 1);
+  }
+
+  // Ticks sem mudanças nas saídas não escrevem
+  expansor_gpio_estatisticas(&inicio);
+  avancar_ticks(TICKS_LEITURA_FORCADA - 10);
+  expansor_gpio_estatisticas(&fim);
+  assert(fim.escritas == inicio.escritas);
+
+  printf("expansor: %.3f transações por tick ocioso com %d expansores (lendo a cada tick: %d); "
+         "lote de %d atuadores em %d escritas\n",
+         (double)transacoes_ociosas / ticks, NUM_EXPANSORES, NUM_EXPANSORES,
+         8 * NUM_EXPANSORES, NUM_EXPANSORES);
+  return 0;
+}
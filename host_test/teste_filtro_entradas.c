@@ -0,0 +1,186 @@
+/** @file teste_filtro_entradas.c - Testes e custo do 'debouncing' por contador vertical.
+
+    Confere o filtro contra um modelo com um contador por pino (como a
+    leitura pino a pino, antes do contador vertical), amostra por amostra,
+    com todos os 64 pinos trepidando e janelas diferentes por pino.
+
+    Depois mede o custo por amostra (um tick da tarefa de controle) dos
+    dois, de 1 a 64 pinos: o do modelo cresce com o número de pinos, o do
+    filtro não.
+
+    @see filtro_entradas.c
+*/
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "filtro_entradas.h"
+
+#define NUM_AMOSTRAS      (4096)        // Amostras geradas, repetidas na medição
+#define REPETICOES        (128)
+#define MAX_PINOS         (64)
+
+
+// Modelo: um contador por pino
+typedef struct {
+  int       num_pinos;
+  int       contador[MAX_PINOS];
+  int       janela[MAX_PINOS];
+  uint64_t  estavel;
+  uint64_t  subidas;
+  uint64_t  descidas;
+} modelo_t;
+
+static uint64_t amostras[NUM_AMOSTRAS];
+
+
+static void processar_modelo(modelo_t *m, uint64_t amostra) {
+  m->subidas = 0;
+  m->descidas = 0;
+  for (int p = 0; p < m->num_pinos; p++) {
+    uint64_t bit = (uint64_t)1 << p;
+
+    if ((amostra & bit) == (m->estavel & bit)) {
+      m->contador[p] = 0;
+    } else if (++m->contador[p] >= m->janela[p]) {
+      m->contador[p] = 0;
+      m->estavel ^= bit;
+      if (amostra & bit) {
+        m->subidas |= bit;
+      } else {
+        m->descidas |= bit;
+      }
+    }
+  }
+}
+
+
+/*  Gerador congruencial de 64 bits, para sequências reproduzíveis.
+ */
+static uint64_t sortear(uint64_t *semente) {
+  *semente = *semente * 6364136223846793005ull + 1442695040888963407ull;
+  return *semente;
+}
+
+
+/*  Sinais trepidando: cada pino muda com probabilidade 1/8 a cada amostra,
+    às vezes por mais amostras que a janela, às vezes por menos.
+ */
+static void gerar_amostras(void) {
+  uint64_t semente = 2024;
+  uint64_t nivel = 0;
+
+  for (int i = 0; i < NUM_AMOSTRAS; i++) {
+    nivel ^= sortear(&semente) & sortear(&semente) & sortear(&semente);
+    amostras[i] = nivel;
+  }
+}
+
+
+static uint64_t mascara_pinos(int num_pinos) {
+  return (num_pinos >= 64) ? UINT64_MAX : (((uint64_t)1 << num_pinos) - 1);
+}
+
+
+static void iniciar(filtro_entradas_t *f, modelo_t *m, int num_pinos) {
+  memset(f, 0, sizeof(*f));
+  memset(m, 0, sizeof(*m));
+  f->mascara = mascara_pinos(num_pinos);
+  m->num_pinos = num_pinos;
+  for (int p = 0; p < num_pinos; p++) {
+    int janela = 1 + p % MAX_JANELA_DEBOUNCE;
+
+    filtro_entradas_definir_janela(f, (uint64_t)1 << p, janela);
+    m->janela[p] = janela;
+  }
+}
+
+
+static double agora_ns(void) {
+  struct timespec agora;
+
+  clock_gettime(CLOCK_MONOTONIC, &agora);
+  return (double)agora.tv_sec * 1e9 + (double)agora.tv_nsec;
+}
+
+
+int main(void) {
+  filtro_entradas_t filtro;
+  modelo_t modelo;
+  int bordas = 0;
+
+  gerar_amostras();
+
+  // Janela de 3 amostras: trepidação de 2 é ignorada, a terceira muda o nível
+  iniciar(&filtro, &modelo, 1);
+  filtro_entradas_definir_janela(&filtro, 1, 3);
+  filtro_entradas_processar(&filtro, 1);
+  filtro_entradas_processar(&filtro, 1);
+  filtro_entradas_processar(&filtro, 0);
+  assert(filtro.estavel == 0 && filtro.subidas == 0);
+  filtro_entradas_processar(&filtro, 1);
+  filtro_entradas_processar(&filtro, 1);
+  assert(filtro.estavel == 0);
+  filtro_entradas_processar(&filtro, 1);
+  assert(filtro.estavel == 1 && filtro.subidas == 1 && filtro.descidas == 0);
+
+  // Janelas fora dos limites
+  filtro_entradas_definir_janela(&filtro, 1, 0);
+  filtro_entradas_processar(&filtro, 0);
+  assert(filtro.estavel == 0 && filtro.descidas == 1);
+  filtro_entradas_definir_janela(&filtro, 1, 100);
+  for (int i = 0; i < MAX_JANELA_DEBOUNCE - 1; i++) {
+    filtro_entradas_processar(&filtro, 1);
+  }
+  assert(filtro.estavel == 0);
+  filtro_entradas_processar(&filtro, 1);
+  assert(filtro.estavel == 1);
+
+  // Mesmo resultado que o modelo, amostra por amostra, em 64 pinos
+  iniciar(&filtro, &modelo, MAX_PINOS);
+  for (int i = 0; i < NUM_AMOSTRAS; i++) {
+    filtro_entradas_processar(&filtro, amostras[i]);
+    processar_modelo(&modelo, amostras[i]);
+    assert(filtro.estavel == modelo.estavel);
+    assert(filtro.subidas == modelo.subidas && filtro.descidas == modelo.descidas);
+    bordas += __builtin_popcountll(filtro.subidas | filtro.descidas);
+  }
+  assert(bordas > 0);
+
+  // Custo por amostra, conforme o número de pinos
+  static const int pinos[] = { 1, 8, 16, 32, 64 };
+  double ns_filtro = 0;
+  double ns_modelo = 0;
+  volatile uint64_t resultado = 0;
+
+  printf("filtro_entradas: ns por amostra (contador vertical / um contador por pino)\n");
+  for (size_t k = 0; k < sizeof(pinos) / sizeof(pinos[0]); k++) {
+    iniciar(&filtro, &modelo, pinos[k]);
+
+    double inicio = agora_ns();
+
+    for (int r = 0; r < REPETICOES; r++) {
+      for (int i = 0; i < NUM_AMOSTRAS; i++) {
+        filtro_entradas_processar(&filtro, amostras[i]);
+      }
+    }
+    ns_filtro = (agora_ns() - inicio) / ((double)REPETICOES * NUM_AMOSTRAS);
+    resultado += filtro.estavel;
+
+    inicio = agora_ns();
+    for (int r = 0; r < REPETICOES; r++) {
+      for (int i = 0; i < NUM_AMOSTRAS; i++) {
+        processar_modelo(&modelo, amostras[i]);
+      }
+    }
+    ns_modelo = (agora_ns() - inicio) / ((double)REPETICOES * NUM_AMOSTRAS);
+    resultado += modelo.estavel;
+
+    printf("  %2d pinos: %6.1f / %6.1f\n", pinos[k], ns_filtro, ns_modelo);
+  }
+
+  // Com 64 pinos, o filtro custa menos que o modelo
+  assert(ns_filtro < ns_modelo);
+  return 0;
+}
@@ -0,0 +1,141 @@
+/** @file teste_historico.c - Testes da redução de resolução do histórico.
+
+    Alimenta o histórico com 1000 s de ticks de 10 ms, como a tarefa de
+    controle, e confere os resumos por segundo e por minuto e o registro
+    de mudanças, inclusive depois que os registros circulares dão a volta.
+
+    @see historico.c
+*/
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "historico.h"
+
+#define TICK_MS           (10)
+#define DURACAO_MS        (1000 * 1000)
+
+// Sensor 1 ligado neste intervalo (ms)
+#define SENSOR_LIGA_MS    (1500)
+#define SENSOR_DESLIGA_MS (2500)
+
+// Atuador 1 ligado por um tick neste instante (ms)
+#define PULSO_MS          (61000)
+
+
+/*  Estado da placa em um instante: o contador 1 conta um evento a cada
+    100 ms.
+ */
+static void estado_em(int64_t instante_ms, estado_placa_t *estado) {
+  memset(estado, 0, sizeof(*estado));
+  estado->sensores[1] = (instante_ms >= SENSOR_LIGA_MS && instante_ms < SENSOR_DESLIGA_MS);
+  estado->atuadores[1] = (instante_ms == PULSO_MS);
+  estado->contadores[1] = (int)(instante_ms / 100);
+}
+
+
+/*  Lê todas as amostras de um intervalo, em blocos pequenos, como o servidor.
+ */
+static int ler_tudo(enum resolucao_historico resolucao, int64_t desde_ms, int64_t ate_ms,
+                    amostra_historico_t *amostras, int max) {
+  uint32_t cursor = 0;
+  int total = 0;
+  int n;
+
+  while ((n = historico_ler(resolucao, desde_ms, ate_ms, &cursor, amostras + total,
+                            (max - total < 3) ? max - total : 3)) > 0) {
+    total += n;
+  }
+  return total;
+}
+
+
+static void testar_segundos(void) {
+  amostra_historico_t amostras[1000];
+  int n;
+
+  // 1000 s em um registro de 900: restam os mais recentes, até o segundo corrente (999)
+  assert(historico_mais_antigo_ms(HIST_SEGUNDOS) == 99 * 1000);
+  n = ler_tudo(HIST_SEGUNDOS, 0, DURACAO_MS, amostras, 1000);
+  assert(n == 900);
+  assert(amostras[0].instante_ms == 99 * 1000);
+  for (int i = 0; i < n; i++) {
+    assert(amostras[i].duracao_ms == 1000);
+    assert(amostras[i].instante_ms == (99 + i) * 1000);
+    assert(amostras[i].eventos[1] == 10);
+    assert(amostras[i].sensores == 0 && amostras[i].sensores_ligados == 0);
+  }
+
+  // Intervalo limitado por desde e ate (inclusive)
+  n = ler_tudo(HIST_SEGUNDOS, 500 * 1000, 502 * 1000, amostras, 1000);
+  assert(n == 3);
+  assert(amostras[0].instante_ms == 500 * 1000 && amostras[2].instante_ms == 502 * 1000);
+}
+
+
+static void testar_minutos(void) {
+  amostra_historico_t amostras[20];
+  int n = ler_tudo(HIST_MINUTOS, 0, DURACAO_MS, amostras, 20);
+
+  // Minutos 0 a 15 fechados; o 16 ainda está em formação
+  assert(historico_mais_antigo_ms(HIST_MINUTOS) == 0);
+  assert(n == 16);
+
+  // Minuto 0: o primeiro tick (instante 0) não tem eventos; o sensor
+  // ligou e desligou, e terminou desligado
+  assert(amostras[0].duracao_ms == 60 * 1000);
+  assert(amostras[0].eventos[1] == 599);
+  assert(amostras[0].sensores == 0);
+  assert(amostras[0].sensores_ligados == (1 << 1));
+  assert(amostras[0].atuadores_ligados == 0);
+
+  // Minuto 1: o pulso de um tick do atuador aparece apenas como ligado
+  assert(amostras[1].instante_ms == 60 * 1000);
+  assert(amostras[1].eventos[1] == 600);
+  assert(amostras[1].atuadores == 0);
+  assert(amostras[1].atuadores_ligados == (1 << 1));
+  assert(amostras[1].sensores_ligados == 0);
+
+  for (int i = 2; i < n; i++) {
+    assert(amostras[i].eventos[1] == 600);
+    assert(amostras[i].atuadores_ligados == 0);
+  }
+}
+
+
+static void testar_mudancas(void) {
+  amostra_historico_t amostras[300];
+  int n = ler_tudo(HIST_MUDANCAS, 0, DURACAO_MS, amostras, 300);
+
+  // Um evento do contador a cada 100 ms: restam as 256 últimas mudanças,
+  // com o instante exato de cada uma
+  assert(n == 256);
+  assert(amostras[n - 1].instante_ms == DURACAO_MS - 100);
+  assert(historico_mais_antigo_ms(HIST_MUDANCAS) == amostras[0].instante_ms);
+  for (int i = 0; i < n; i++) {
+    assert(amostras[i].duracao_ms == 0);
+    assert(amostras[i].eventos[1] == 1);
+    assert(amostras[i].instante_ms == DURACAO_MS - 100 * (n - i));
+  }
+}
+
+
+int main(void) {
+  estado_placa_t estado;
+
+  esp_log_level_set("*", ESP_LOG_NONE);
+  assert(historico_mais_antigo_ms(HIST_SEGUNDOS) == -1);
+
+  for (int64_t instante_ms = 0; instante_ms < DURACAO_MS; instante_ms += TICK_MS) {
+    estado_em(instante_ms, &estado);
+    historico_registrar(instante_ms * 1000, &estado);
+  }
+
+  testar_segundos();
+  testar_minutos();
+  testar_mudancas();
+  printf("historico: ok\n");
+  return 0;
+}
@@ -0,0 +1,191 @@
+/** @file teste_leitor_parametros.c - Testes do leitor de parâmetros 'nome = valor'.
+
+    O mesmo texto é entregue inteiro e em pedaços de todos os tamanhos,
+    como chega pela rede: o resultado não pode depender da divisão.
+
+    @see leitor_parametros.c
+*/
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "leitor_parametros.h"
+
+#define MAX_LIDOS   (16)
+
+
+// Parâmetros repassados pelo leitor
+typedef struct {
+  int   quantidade;
+  char  nome[MAX_LIDOS][MAX_NOME_PARAMETRO + 1];
+  char  valor[MAX_LIDOS][MAX_VALOR_PARAMETRO + 1];
+} lidos_t;
+
+
+static void guardar_parametro(const char *nome, const char *valor, void *contexto) {
+  lidos_t *lidos = contexto;
+
+  assert(lidos->quantidade < MAX_LIDOS);
+  assert(strlen(nome) <= MAX_NOME_PARAMETRO);
+  assert(strlen(valor) <= MAX_VALOR_PARAMETRO);
+  strcpy(lidos->nome[lidos->quantidade], nome);
+  strcpy(lidos->valor[lidos->quantidade], valor);
+  lidos->quantidade++;
+}
+
+
+/*  Lê o texto em pedaços de tamanho_pedaco bytes; devolve o número de erros.
+ */
+static int ler_texto(const char *texto, size_t tamanho_pedaco, lidos_t *lidos) {
+  leitor_parametros_t leitor;
+  size_t len = strlen(texto);
+
+  memset(lidos, 0, sizeof(*lidos));
+  leitor_parametros_iniciar(&leitor, guardar_parametro, lidos);
+  for (size_t i = 0; i < len; i += tamanho_pedaco) {
+    size_t n = (len - i < tamanho_pedaco) ? len - i : tamanho_pedaco;
+
+    leitor_parametros_consumir(&leitor, texto + i, n);
+  }
+  return leitor_parametros_terminar(&leitor);
+}
+
+
+static void conferir(const lidos_t *lidos, int indice, const char *nome, const char *valor) {
+  assert(indice < lidos->quantidade);
+  if (strcmp(lidos->nome[indice], nome) != 0 || strcmp(lidos->valor[indice], valor) != 0) {
+    fprintf(stderr, "parâmetro %d: esperado [%s]=[%s], lido [%s]=[%s]\n", indice, nome, valor,
+            lidos->nome[indice], lidos->valor[indice]);
+    assert(0);
+  }
+}
+
+
+/*  Espaços, CR LF, comentários, linhas vazias e valor vazio.
+ */
+static void testar_formato(void) {
+  const char *texto =
+    "action = pulse\r\n"
+    "duration=500\n"
+    "\n"
+    "# comentário = ignorado\n"
+    "   # comentário indentado\n"
+    "password=\n"
+    "  ssid =  minha rede  \n"
+    "nota = a # b\n";
+  lidos_t lidos;
+
+  for (size_t pedaco = 1; pedaco <= strlen(texto); pedaco++) {
+    assert(ler_texto(texto, pedaco, &lidos) == 0);
+    assert(lidos.quantidade == 5);
+    conferir(&lidos, 0, "action", "pulse");
+    conferir(&lidos, 1, "duration", "500");
+    conferir(&lidos, 2, "password", "");
+    conferir(&lidos, 3, "ssid", "minha rede");
+    // '#' só inicia comentário no começo da linha
+    conferir(&lidos, 4, "nota", "a # b");
+  }
+}
+
+
+/*  Linhas malformadas são descartadas inteiras, sem afetar as seguintes.
+ */
+static void testar_linhas_invalidas(void) {
+  const char *texto =
+    "semigual\n"
+    "nome com espaco = 1\n"
+    "= sem nome\n"
+    "ok = 1\n";
+  lidos_t lidos;
+
+  for (size_t pedaco = 1; pedaco <= strlen(texto); pedaco++) {
+    assert(ler_texto(texto, pedaco, &lidos) == 3);
+    assert(lidos.quantidade == 1);
+    conferir(&lidos, 0, "ok", "1");
+  }
+}
+
+
+/*  Nome e valor no limite são aceitos; um caractere a mais descarta a
+    linha inteira (nunca trunca).
+ */
+static void testar_linhas_longas(void) {
+  char nome_limite[MAX_NOME_PARAMETRO + 1];
+  char nome_longo[MAX_NOME_PARAMETRO + 2];
+  char valor_limite[MAX_VALOR_PARAMETRO + 1];
+  char valor_longo[MAX_VALOR_PARAMETRO + 2 + 200];
+  char texto[1024];
+  lidos_t lidos;
+
+  memset(nome_limite, 'n', MAX_NOME_PARAMETRO);
+  nome_limite[MAX_NOME_PARAMETRO] = '\0';
+  memset(nome_longo, 'n', MAX_NOME_PARAMETRO + 1);
+  nome_longo[MAX_NOME_PARAMETRO + 1] = '\0';
+  memset(valor_limite, 'v', MAX_VALOR_PARAMETRO);
+  valor_limite[MAX_VALOR_PARAMETRO] = '\0';
+  // Bem maior que o limite, com '=' e '\r' no meio do excesso
+  memset(valor_longo, 'v', sizeof(valor_longo) - 1);
+  valor_longo[MAX_VALOR_PARAMETRO + 10] = '=';
+  valor_longo[MAX_VALOR_PARAMETRO + 20] = '\r';
+  valor_longo[sizeof(valor_longo) - 1] = '\0';
+
+  snprintf(texto, sizeof(texto), "%s = 1\n%s = 2\na = %s\nb = %s\nc = 3\n",
+           nome_longo, nome_limite, valor_longo, valor_limite);
+
+  for (size_t pedaco = 1; pedaco <= strlen(texto); pedaco++) {
+    assert(ler_texto(texto, pedaco, &lidos) == 2);
+    assert(lidos.quantidade == 3);
+    conferir(&lidos, 0, nome_limite, "2");
+    conferir(&lidos, 1, "b", valor_limite);
+    conferir(&lidos, 2, "c", "3");
+  }
+}
+
+
+/*  A última linha, sem '\n', é tratada por leitor_parametros_terminar().
+ */
+static void testar_fim_sem_quebra(void) {
+  lidos_t lidos;
+
+  assert(ler_texto("a = 1\nultimo = 2  ", 4, &lidos) == 0);
+  assert(lidos.quantidade == 2);
+  conferir(&lidos, 1, "ultimo", "2");
+
+  assert(ler_texto("a = 1\nsem_igual", 4, &lidos) == 1);
+  assert(lidos.quantidade == 1);
+
+  assert(ler_texto("a = 1\n# comentário no fim", 4, &lidos) == 0);
+  assert(lidos.quantidade == 1);
+
+  assert(ler_texto("", 1, &lidos) == 0);
+  assert(lidos.quantidade == 0);
+}
+
+
+/*  O mesmo leitor pode ser reiniciado para outro texto.
+ */
+static void testar_reinicio(void) {
+  leitor_parametros_t leitor;
+  lidos_t lidos = {0};
+
+  leitor_parametros_iniciar(&leitor, guardar_parametro, &lidos);
+  leitor_parametros_consumir(&leitor, "x = 1\nlixo", 10);
+  assert(leitor_parametros_terminar(&leitor) == 1);
+
+  leitor_parametros_iniciar(&leitor, guardar_parametro, &lidos);
+  leitor_parametros_consumir(&leitor, "y = 2\n", 6);
+  assert(leitor_parametros_terminar(&leitor) == 0);
+  assert(lidos.quantidade == 2);
+  conferir(&lidos, 1, "y", "2");
+}
+
+
+int main(void) {
+  testar_formato();
+  testar_linhas_invalidas();
+  testar_linhas_longas();
+  testar_fim_sem_quebra();
+  testar_reinicio();
+  printf("leitor_parametros: ok\n");
+  return 0;
+}
@@ -0,0 +1,162 @@
+/** @file teste_persistencia.c - Testes do diário de estado na FLASH.
+
+    Cada partida do módulo roda em um processo filho criado por fork() a
+    partir do processo principal, que nunca usa a persistência: o filho
+    começa com a memória zerada, como depois de uma falta de energia
+    (sem a cópia na memória RTC), e só encontra o que ficou no diário.
+
+    @see persistencia.c
+*/
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+
+#include "persistencia.h"
+
+#define ARQUIVO_DIARIO    DIRETORIO_ARMAZENAMENTO "/estado.jnl"
+#define TAM_REGISTRO      (8)
+#define TAM_RETRATO       ((MAX_CONTADORES + MAX_ATUADORES) * TAM_REGISTRO)
+
+
+/*  Roda uma partida em um processo novo e espera o seu fim.
+ */
+static void partida(void (*funcao)(void)) {
+  pid_t filho = fork();
+  int status;
+
+  assert(filho >= 0);
+  if (filho == 0) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+    funcao();
+    exit(0);
+  }
+  assert(waitpid(filho, &status, 0) == filho);
+  assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+
+static long tamanho_diario(void) {
+  struct stat st;
+
+  return (stat(ARQUIVO_DIARIO, &st) == 0) ? (long)st.st_size : -1;
+}
+
+
+static void registrar(int contagem, int atuador1, int atuador2) {
+  estado_placa_t estado = { 0 };
+
+  estado.contadores[1] = contagem;
+  estado.atuadores[1] = atuador1;
+  estado.atuadores[2] = atuador2;
+  persistencia_registrar(&estado);
+  persistencia_gravar();
+}
+
+
+/*  Sem diário: estado zerado. A primeira gravação cria o diário com um
+    retrato; depois, grava somas, uma contagem menor (contador zerado) e
+    mudanças nos atuadores.
+ */
+static void gravar_primeira_partida(void) {
+  estado_placa_t estado;
+  estatisticas_persistencia_t estatisticas;
+
+  assert(!persistencia_restaurar(&estado));
+  assert(estado.contadores[1] == 0 && estado.atuadores[1] == 0);
+
+  registrar(5, 1, 1);
+  registrar(12, 1, 1);
+  registrar(3, 1, 0);
+  registrar(3, 1, 0);     // Sem mudança: nada é gravado
+
+  persistencia_estatisticas(&estatisticas);
+  assert(estatisticas.gravacoes == 3);
+  assert(estatisticas.compactacoes == 1);
+  assert(estatisticas.bytes_registros == 6 * TAM_REGISTRO);
+  assert(tamanho_diario() == TAM_RETRATO + 6 * TAM_REGISTRO);
+}
+
+
+static void conferir_restaurado(int contagem, int atuador1, int atuador2, uint32_t invalidos) {
+  estado_placa_t estado;
+  estatisticas_persistencia_t estatisticas;
+
+  assert(persistencia_restaurar(&estado));
+  persistencia_estatisticas(&estatisticas);
+  assert(!estatisticas.restaurado_rtc);
+  assert(estatisticas.registros_invalidos == invalidos);
+  assert(estado.contadores[1] == contagem);
+  assert(estado.atuadores[1] == atuador1);
+  assert(estado.atuadores[2] == atuador2);
+}
+
+
+static void conferir_segunda_partida(void) {
+  conferir_restaurado(3, 1, 0, 0);
+}
+
+
+/*  Um lote interrompido no meio de um registro: só ele é perdido, e o
+    diário é reescrito antes da gravação seguinte. Depois, as mudanças
+    fazem o diário passar do limite e ser compactado.
+ */
+static void compactar_terceira_partida(void) {
+  estatisticas_persistencia_t estatisticas;
+
+  conferir_restaurado(3, 1, 0, 1);
+
+  for (int contagem = 4; contagem <= 1003; contagem++) {
+    registrar(contagem, 1, 0);
+  }
+  persistencia_estatisticas(&estatisticas);
+  assert(estatisticas.compactacoes >= 2);
+  assert(estatisticas.tamanho_diario <= 4096);
+  assert(tamanho_diario() == (long)estatisticas.tamanho_diario);
+}
+
+
+static void conferir_quarta_partida(void) {
+  conferir_restaurado(1003, 1, 0, 0);
+}
+
+
+/*  Último registro (a soma de um evento) com CRC errado: é descartado.
+ */
+static void conferir_crc_quinta_partida(void) {
+  conferir_restaurado(1002, 1, 0, 1);
+}
+
+
+int main(void) {
+  unlink(ARQUIVO_DIARIO);
+
+  partida(gravar_primeira_partida);
+  partida(conferir_segunda_partida);
+
+  // Lote interrompido: meio registro no final do diário
+  FILE *f = fopen(ARQUIVO_DIARIO, "ab");
+  assert(f != NULL);
+  fwrite("\x01\x01\x00\x00", 1, 4, f);
+  fclose(f);
+  partida(compactar_terceira_partida);
+  partida(conferir_quarta_partida);
+
+  // Corrompe o valor do último registro, que vem depois do retrato
+  assert(tamanho_diario() > TAM_RETRATO);
+  f = fopen(ARQUIVO_DIARIO, "r+b");
+  assert(f != NULL);
+  fseek(f, tamanho_diario() - TAM_REGISTRO + 4, SEEK_SET);
+  fputc(0x55, f);
+  fclose(f);
+  partida(conferir_crc_quinta_partida);
+
+  unlink(ARQUIVO_DIARIO);
+  printf("persistencia: ok\n");
+  return 0;
+}
@@ -0,0 +1,123 @@
+/** @file teste_pulsos.c - Largura e jitter dos pulsos dos atuadores.
+
+    Pulsa todos os atuadores ao mesmo tempo, muitas vezes, com inícios
+    fora dos ticks e durações que não são múltiplas do tick, e mede nas
+    saídas simuladas a largura de cada pulso (simulacao_gpio_estatisticas):
+    a diferença entre a maior e a menor largura é o jitter, que deve ser
+    zero em tempo virtual, como o atraso registrado pela tarefa de controle.
+
+    Depois confere o cancelamento: desligar ou alternar um atuador no meio
+    do pulso encerra o pulso, sem um desligamento atrasado.
+
+    @see controle_gpio.c
+*/
+#include <assert.h>
+#include <stdio.h>
+
+#include "esp_log.h"
+
+#include "controle_gpio.h"
+#include "simulacao_gpio.h"
+
+#define NUM_RODADAS       (250)
+#define DURACAO_MS        (150)         // Não é múltiplo do tick
+#define INTERVALO_MS      (400)         // Entre rodadas, maior que o pulso
+#define TICK_MS           (10)          // INTERVALO_TICK_MS em controle_gpio.c
+
+// Pinos dos atuadores 1 e 2 (mapa_atuadores em controle_gpio.c)
+#define GPIO_ATUADOR1     (18)
+#define GPIO_ATUADOR2     (19)
+
+#define MAX_TRANSICOES    (16)
+
+
+/*  Gerador congruencial, para deslocamentos reproduzíveis dentro do tick.
+ */
+static uint32_t sortear(uint32_t *semente, uint32_t limite) {
+  *semente = *semente * 1103515245u + 12345u;
+  return (*semente >> 16) % limite;
+}
+
+
+/*  Lê as transições de um pino desde a sequência indicada.
+ */
+static int transicoes_do_pino(uint32_t desde, int pino, transicao_simulada_t *saida, int max) {
+  transicao_simulada_t transicoes[MAX_TRANSICOES];
+  uint32_t proximo;
+  uint32_t perdidas;
+  int n = simulacao_gpio_ler_transicoes(desde, transicoes, MAX_TRANSICOES, &proximo, &perdidas);
+  int lidas = 0;
+
+  assert(perdidas == 0 && n < MAX_TRANSICOES);
+  for (int i = 0; i < n && lidas < max; i++) {
+    if (transicoes[i].pino == pino) {
+      saida[lidas++] = transicoes[i];
+    }
+  }
+  return lidas;
+}
+
+
+int main(void) {
+  estatisticas_simulacao_t simulacao;
+  estatisticas_comandos_t comandos;
+  transicao_simulada_t t[MAX_TRANSICOES];
+  uint32_t semente = 17;
+
+  esp_log_level_set("*", ESP_LOG_NONE);
+
+  controle_gpio_iniciar();
+  controle_gpio_ativar_timer();
+
+  // Pulsos simultâneos em todos os atuadores, iniciados em instantes
+  // diferentes dentro do tick
+  for (int rodada = 0; rodada < NUM_RODADAS; rodada++) {
+    int64_t inicio_us = (int64_t)rodada * INTERVALO_MS * 1000;
+
+    for (int id = 1; id <= MAX_ATUADORES; id++) {
+      controle_gpio_simular_ate(inicio_us + id * 1000 + sortear(&semente, TICK_MS * 1000));
+      assert(controle_gpio_pulsar_atuador(id, DURACAO_MS));
+    }
+  }
+  controle_gpio_simular_ate((int64_t)NUM_RODADAS * INTERVALO_MS * 1000);
+
+  simulacao_gpio_estatisticas(&simulacao);
+  controle_gpio_estatisticas_comandos(&comandos);
+  assert(simulacao.larguras == NUM_RODADAS * MAX_ATUADORES);
+  assert(simulacao.largura_min_us == DURACAO_MS * 1000);
+  assert(simulacao.largura_max_us == DURACAO_MS * 1000);
+  assert(comandos.pulsos == NUM_RODADAS * MAX_ATUADORES);
+  assert(comandos.atraso_max_pulso_us == 0);
+
+  // Cancelamento: off no atuador 1 e toggle no 2, antes do fim dos pulsos
+  uint32_t desde = simulacao.transicoes;
+  int64_t inicio_us = simulacao.agora_us + 3700;
+
+  controle_gpio_simular_ate(inicio_us);
+  assert(controle_gpio_pulsar_atuador(1, DURACAO_MS));
+  assert(controle_gpio_pulsar_atuador(2, DURACAO_MS));
+  controle_gpio_simular_ate(inicio_us + 60 * 1000);
+  assert(controle_gpio_mudar_atuador(1, 0));
+  controle_gpio_simular_ate(inicio_us + 90 * 1000);
+  assert(controle_gpio_alternar_atuador(2));
+  controle_gpio_simular_ate(inicio_us + 2 * DURACAO_MS * 1000);
+
+  assert(transicoes_do_pino(desde, GPIO_ATUADOR1, t, MAX_TRANSICOES) == 2);
+  assert(t[0].nivel == 1 && t[1].nivel == 0);
+  assert(t[1].instante_us - t[0].instante_us == 60 * 1000);
+  assert(transicoes_do_pino(desde, GPIO_ATUADOR2, t, MAX_TRANSICOES) == 2);
+  assert(t[1].nivel == 0 && t[1].instante_us - t[0].instante_us == 90 * 1000);
+  assert(controle_gpio_ler_atuador(1) == 0 && controle_gpio_ler_atuador(2) == 0);
+
+  // Só os pulsos da primeira parte terminaram pelo temporizador
+  controle_gpio_estatisticas_comandos(&comandos);
+  assert(comandos.pulsos == NUM_RODADAS * MAX_ATUADORES);
+
+  printf("pulsos: %d de %d ms, largura de %lld a %lld us (jitter %lld us; "
+         "no tick de %d ms, até %d us)\n",
+         NUM_RODADAS * MAX_ATUADORES, DURACAO_MS,
+         (long long)simulacao.largura_min_us, (long long)simulacao.largura_max_us,
+         (long long)(simulacao.largura_max_us - simulacao.largura_min_us),
+         TICK_MS, TICK_MS * 1000);
+  return 0;
+}
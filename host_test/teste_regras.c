@@ -0,0 +1,162 @@
+/** @file teste_regras.c - Testes da compilação e da avaliação das regras.
+
+    As cargas são lidas em pedaços pequenos, como chegam por POST /regras;
+    a avaliação recebe as entradas montadas pelo próprio teste, no lugar
+    da tarefa de controle.
+
+    @see regras.c
+*/
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+
+#include "regras.h"
+
+#define ARQUIVO_REGRAS    DIRETORIO_ARMAZENAMENTO "/regras.txt"
+
+
+/*  Carrega o texto como o servidor; devolve true se as regras foram instaladas.
+ */
+static bool carregar(const char *texto, carga_regras_t *carga) {
+  leitor_parametros_t leitor;
+  size_t len = strlen(texto);
+
+  assert(regras_iniciar_carga(carga));
+  regras_iniciar_leitor(carga, &leitor);
+  for (size_t i = 0; i < len; i += 7) {
+    leitor_parametros_consumir(&leitor, texto + i, (len - i < 7) ? len - i : 7);
+  }
+  int erros = leitor_parametros_terminar(&leitor);
+
+  return regras_concluir_carga(carga, erros == 0);
+}
+
+
+/*  Avalia as regras e devolve as ações; instante em ms.
+ */
+static int avaliar(int64_t instante_ms, const entradas_regras_t *entradas, acao_regra_t *acoes) {
+  int num_acoes;
+
+  regras_avaliar(instante_ms * 1000, entradas, acoes, &num_acoes);
+  return num_acoes;
+}
+
+
+/*  Cada linha inválida é rejeitada pelo número, inclusive as descartadas
+    pelo leitor; uma regra mais longa que um parâmetro comum é aceita.
+ */
+static void testar_compilacao(void) {
+  char longa[MAX_VALOR_REGRA + 2];
+  char texto[1024];
+  carga_regras_t carga;
+
+  memset(longa, 'x', sizeof(longa) - 1);
+  longa[sizeof(longa) - 1] = '\0';
+  snprintf(texto, sizeof(texto),
+           "regra = sensor1 desce -> pulsar atuador2 1000\n"
+           "acao = ligar atuador1\n"
+           "regra = sensor9 sobe -> ligar atuador1\n"
+           "# comentário\n"
+           "\n"
+           "regra = sensor1 sobe e atuador1 desligado ou sensor2 desce e atuador2 ligado"
+           " -> pulsar atuador3 1000\n"
+           "regra sem igual\n"
+           "regra = %s\n"
+           "regra = sensor1 sobe -> ligar atuador1 500\n"
+           "regra = contador1 >= 0 -> ligar atuador1\n"
+           "regra = tempo1 expira -> iniciar tempo1\n"
+           "regra = sensor1 sobe -> zerar contador1",
+           longa);
+
+  assert(!carregar(texto, &carga));
+  assert(carga.regras == 3);
+  assert(carga.erros == 7);
+  int esperadas[] = { 2, 3, 7, 8, 9, 10, 11 };
+
+  for (int i = 0; i < carga.erros; i++) {
+    assert(carga.linhas_rejeitadas[i] == esperadas[i]);
+  }
+
+  // Mais de MAX_REGRAS: as que sobram são rejeitadas
+  texto[0] = '\0';
+  for (int i = 0; i < MAX_REGRAS + 1; i++) {
+    strcat(texto, "regra = sensor1 sobe -> ligar atuador1\n");
+  }
+  assert(!carregar(texto, &carga));
+  assert(carga.regras == MAX_REGRAS && carga.erros == 1);
+  assert(carga.linhas_rejeitadas[0] == MAX_REGRAS + 1);
+}
+
+
+static void testar_avaliacao(void) {
+  int contagens[MAX_CONTADORES + 1] = { 0 };
+  entradas_regras_t entradas = { .contagens = contagens };
+  acao_regra_t acoes[MAX_REGRAS];
+  carga_regras_t carga;
+
+  assert(carregar("regra = sensor1 desce -> pulsar atuador2 1000\n"
+                  "regra = contador1 >= 3 -> ligar atuador1\n"
+                  "regra = sensor2 ligado e atuador1 ligado -> iniciar tempo1 500\n"
+                  "regra = tempo1 expira -> alternar atuador3\n"
+                  "regra = sensor2 desligado ou tempo1 inativo -> desligar atuador4\n",
+                  &carga));
+  assert(carga.regras == 5 && carga.erros == 0);
+
+  // Instalação: as regras de nível só registram o estado corrente
+  assert(avaliar(0, &entradas, acoes) == 0);
+
+  // Borda: dispara a cada evento
+  entradas.eventos[REGRA_DESCIDAS] = REGRA_BIT(1);
+  assert(avaliar(10, &entradas, acoes) == 1);
+  assert(acoes[0].tipo == ACAO_REGRA_PULSAR && acoes[0].id == 2 && acoes[0].valor == 1000);
+  assert(avaliar(20, &entradas, acoes) == 1);
+  entradas.eventos[REGRA_DESCIDAS] = 0;
+
+  // Contagem: dispara quando a condição passa a ser verdadeira, uma vez
+  contagens[1] = 2;
+  assert(avaliar(30, &entradas, acoes) == 0);
+  contagens[1] = 3;
+  assert(avaliar(40, &entradas, acoes) == 1);
+  assert(acoes[0].tipo == ACAO_REGRA_LIGAR && acoes[0].id == 1);
+  contagens[1] = 4;
+  assert(avaliar(50, &entradas, acoes) == 0);
+
+  // Temporizador: iniciado pela regra, vence depois de 500 ms. Enquanto
+  // ativo, as duas cláusulas da última regra são falsas; no vencimento,
+  // 'tempo1 inativo' volta a valer e ela dispara junto
+  entradas.niveis[REGRA_SENSORES] = REGRA_BIT(2);
+  entradas.niveis[REGRA_ATUADORES] = REGRA_BIT(1);
+  assert(avaliar(100, &entradas, acoes) == 0);
+  assert(avaliar(599, &entradas, acoes) == 0);
+  assert(avaliar(600, &entradas, acoes) == 2);
+  assert(acoes[0].tipo == ACAO_REGRA_ALTERNAR && acoes[0].id == 3);
+  assert(acoes[1].tipo == ACAO_REGRA_DESLIGAR && acoes[1].id == 4);
+  assert(avaliar(610, &entradas, acoes) == 0);
+
+  estatisticas_regras_t estatisticas;
+
+  regras_estatisticas(&estatisticas);
+  assert(estatisticas.regras == 5);
+  assert(estatisticas.disparos_regra[1] == 2);
+  assert(estatisticas.disparos_regra[2] == 1);
+  assert(estatisticas.disparos_regra[3] == 1);
+  assert(estatisticas.disparos_regra[4] == 1);
+  assert(estatisticas.disparos_regra[5] == 1);
+}
+
+
+int main(void) {
+  esp_log_level_set("*", ESP_LOG_NONE);
+  unlink(ARQUIVO_REGRAS);
+  regras_iniciar();
+
+  testar_compilacao();
+  testar_avaliacao();
+
+  unlink(ARQUIVO_REGRAS);
+  printf("regras: ok\n");
+  return 0;
+}
@@ -0,0 +1,132 @@
+/** @file teste_sensor_adc.c - Filtro e vazão dos sensores analógicos.
+
+    Entrega ao filtro de sensor_adc.c blocos de amostras sintéticas, como
+    o DMA entrega à tarefa do ADC, e confere:
+
+      - Ruído alternado em torno de um nível some na decimação;
+      - Um degrau passa pelo IIR aos poucos e chega ao novo nível em
+        menos de 1 s (corte de 5 Hz); mínimo e máximo cobrem a janela;
+      - Sem IIR (corte 0), a saída é a média de cada bloco.
+
+    Depois mede a vazão do filtro em amostras por segundo, comparada com
+    a taxa do conversor.
+
+    @see sensor_adc.c
+*/
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "esp_log.h"
+
+#include "sensor_adc.h"
+
+// Taxas de sensor_adc.c
+#define TAXA_AMOSTRAGEM_HZ    (20000)
+#define FATOR_DECIMACAO       (100)
+
+#define AMOSTRAS_BLOCO        (64)        // Amostras em um quadro de 256 bytes do DMA
+#define NUM_AMOSTRAS_VAZAO    (20000000)
+#define VAZAO_MINIMA          (100)       // Vezes a taxa do conversor
+
+static uint16_t sinal[TAXA_AMOSTRAGEM_HZ];     // 1 segundo de amostras
+
+
+/*  Entrega o sinal em blocos do tamanho de um quadro do DMA.
+ */
+static void entregar(const uint16_t *amostras, size_t quantidade) {
+  for (size_t i = 0; i < quantidade; i += AMOSTRAS_BLOCO) {
+    size_t n = (quantidade - i < AMOSTRAS_BLOCO) ? quantidade - i : AMOSTRAS_BLOCO;
+
+    assert(sensor_adc_simular(1, amostras + i, n));
+  }
+}
+
+
+/*  Nível com ruído de +-amplitude, alternado a cada amostra.
+ */
+static void gerar_nivel(int nivel, int amplitude) {
+  for (int i = 0; i < TAXA_AMOSTRAGEM_HZ; i++) {
+    sinal[i] = (uint16_t)(nivel + ((i % 2 == 0) ? amplitude : -amplitude));
+  }
+}
+
+
+static double agora_s(void) {
+  struct timespec agora;
+
+  clock_gettime(CLOCK_MONOTONIC, &agora);
+  return (double)agora.tv_sec + (double)agora.tv_nsec / 1e9;
+}
+
+
+int main(void) {
+  leitura_adc_t leitura;
+
+  esp_log_level_set("*", ESP_LOG_NONE);
+
+  assert(sensor_adc_iniciar());
+  assert(!sensor_adc_ler(1, &leitura));
+  assert(!sensor_adc_simular(MAX_SENSORES_ADC + 1, sinal, 1));
+
+  // 1 s de ruído alternado: a média de cada bloco é exata
+  gerar_nivel(2048, 500);
+  entregar(sinal, TAXA_AMOSTRAGEM_HZ);
+  assert(sensor_adc_ler(1, &leitura));
+  assert(leitura.valor == 2048 && leitura.minimo == 2048 && leitura.maximo == 2048);
+  assert(leitura.media == 2048);
+  assert(leitura.saidas == TAXA_AMOSTRAGEM_HZ / FATOR_DECIMACAO);
+  assert(leitura.amostras == TAXA_AMOSTRAGEM_HZ);
+
+  // Degrau de 1000: a primeira saída só se aproxima do novo nível
+  gerar_nivel(3048, 500);
+  entregar(sinal, FATOR_DECIMACAO);
+  assert(sensor_adc_ler(1, &leitura));
+  assert(leitura.valor > 2048 && leitura.valor < 2548);
+  assert(leitura.minimo == 2048 && leitura.maximo == leitura.valor);
+
+  // Em 1 s (200 saídas, constante de tempo de 32 ms), chega ao novo nível
+  entregar(sinal + FATOR_DECIMACAO, TAXA_AMOSTRAGEM_HZ - FATOR_DECIMACAO);
+  assert(sensor_adc_ler(1, &leitura));
+  assert(leitura.valor == 3048 && leitura.maximo == 3048);
+  assert(leitura.minimo > 2048 && leitura.media > 2900 && leitura.media < 3048);
+
+  // Sem IIR: a saída é a média do bloco
+  assert(sensor_adc_definir_corte(1, 0));
+  gerar_nivel(1000, 300);
+  entregar(sinal, FATOR_DECIMACAO);
+  assert(sensor_adc_ler(1, &leitura));
+  assert(leitura.valor == 1000);
+
+  // Vazão: senoide de 50 Hz com ruído, corte de volta a 5 Hz
+  uint32_t semente = 7;
+
+  for (int i = 0; i < TAXA_AMOSTRAGEM_HZ; i++) {
+    semente = semente * 1103515245u + 12345u;
+    sinal[i] = (uint16_t)(2048 + 1000 * sin(2 * M_PI * 50 * i / TAXA_AMOSTRAGEM_HZ) +
+                          (int)((semente >> 16) % 201) - 100);
+  }
+  assert(sensor_adc_definir_corte(1, 5.0f));
+
+  uint64_t antes = leitura.amostras;
+  double inicio = agora_s();
+
+  for (int n = 0; n < NUM_AMOSTRAS_VAZAO; n += TAXA_AMOSTRAGEM_HZ) {
+    entregar(sinal, TAXA_AMOSTRAGEM_HZ);
+  }
+  double duracao = agora_s() - inicio;
+  double vazao = NUM_AMOSTRAS_VAZAO / duracao;
+
+  assert(sensor_adc_ler(1, &leitura));
+  assert(leitura.amostras - antes == NUM_AMOSTRAS_VAZAO);
+  // O IIR atenua os 50 Hz: a saída fica perto do nível médio
+  assert(leitura.minimo > 1848 && leitura.maximo < 2248);
+
+  printf("sensor_adc: %.1f milhões de amostras/s (%.0f vezes os %d Hz do conversor), "
+         "saída de %u a %u\n",
+         vazao / 1e6, vazao / (TAXA_AMOSTRAGEM_HZ * MAX_SENSORES_ADC), TAXA_AMOSTRAGEM_HZ,
+         leitura.minimo, leitura.maximo);
+  assert(vazao > (double)VAZAO_MINIMA * TAXA_AMOSTRAGEM_HZ * MAX_SENSORES_ADC);
+  return 0;
+}
@@ -0,0 +1,133 @@
+/** @file teste_simulacao.c - Testes da tarefa de controle em tempo virtual.
+
+    Carrega o roteiro roteiros/portaria.txt (campainha e medidor de
+    pulsos), instala regras que acionam os relés e confere, nas transições
+    das saídas simuladas, os instantes das bordas e a largura dos pulsos.
+
+    @see simulacao_gpio.c
+    @see controle_gpio.c
+*/
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+
+#include "controle_gpio.h"
+#include "regras.h"
+#include "simulacao_gpio.h"
+
+#define ROTEIRO           "roteiros/portaria.txt"
+#define ARQUIVO_REGRAS    DIRETORIO_ARMAZENAMENTO "/regras.txt"
+
+// Pinos dos atuadores 1, 2 e 3 (mapa_atuadores em controle_gpio.c)
+#define GPIO_ATUADOR1     (18)
+#define GPIO_ATUADOR2     (19)
+#define GPIO_ATUADOR3     (22)
+
+// Janela de debouncing das entradas, mais um tick
+#define ATRASO_MAX_MS     (40)
+
+#define MS(us)            ((us) / 1000)
+
+#define MAX_TRANSICOES    (32)
+
+
+static void instalar_regras(const char *texto) {
+  carga_regras_t carga;
+  leitor_parametros_t leitor;
+
+  assert(regras_iniciar_carga(&carga));
+  regras_iniciar_leitor(&carga, &leitor);
+  leitor_parametros_consumir(&leitor, texto, strlen(texto));
+  assert(leitor_parametros_terminar(&leitor) == 0);
+  assert(regras_concluir_carga(&carga, true));
+}
+
+
+/*  Lê as transições de um pino, desde o início da simulação.
+ */
+static int transicoes_do_pino(int pino, transicao_simulada_t *saida, int max) {
+  transicao_simulada_t transicoes[MAX_TRANSICOES];
+  uint32_t proximo;
+  uint32_t perdidas;
+  int n = simulacao_gpio_ler_transicoes(0, transicoes, MAX_TRANSICOES, &proximo, &perdidas);
+  int lidas = 0;
+
+  assert(perdidas == 0 && n < MAX_TRANSICOES);
+  for (int i = 0; i < n; i++) {
+    if (transicoes[i].pino == pino) {
+      assert(lidas < max);
+      saida[lidas++] = transicoes[i];
+    }
+  }
+  return lidas;
+}
+
+
+int main(void) {
+  transicao_simulada_t t[MAX_TRANSICOES];
+  estado_placa_t estado;
+  int n;
+
+  esp_log_level_set("*", ESP_LOG_NONE);
+  unlink(ARQUIVO_REGRAS);
+
+  FILE *roteiro = fopen(ROTEIRO, "r");
+
+  assert(roteiro != NULL);
+  assert(simulacao_gpio_carregar(roteiro) == 0);
+  fclose(roteiro);
+
+  controle_gpio_iniciar();
+  regras_iniciar();
+  assert(controle_gpio_ativar_timer());
+  instalar_regras("regra = sensor1 desce -> pulsar atuador2 250\n"
+                  "regra = contador1 >= 10 -> ligar atuador1\n");
+
+  // Campainha: pulso de 250 ms no relé 2, depois do debouncing
+  controle_gpio_simular_ate(3000 * 1000);
+  n = transicoes_do_pino(GPIO_ATUADOR2, t, MAX_TRANSICOES);
+  assert(n == 2);
+  assert(t[0].nivel == 1 && t[1].nivel == 0);
+  assert(MS(t[0].instante_us) > 100 && MS(t[0].instante_us) <= 100 + ATRASO_MAX_MS);
+  assert(t[1].instante_us - t[0].instante_us == 250 * 1000);
+
+  // Medidor: o relé 1 liga na décima contagem, e fica ligado. O contador
+  // é por hardware, sem debouncing: conta no primeiro tick após a borda
+  controle_gpio_ler_estado(&estado);
+  assert(estado.contadores[1] == 10);
+  n = transicoes_do_pino(GPIO_ATUADOR1, t, MAX_TRANSICOES);
+  assert(n == 1 && t[0].nivel == 1);
+  assert(MS(t[0].instante_us) >= 1900 && MS(t[0].instante_us) <= 1900 + ATRASO_MAX_MS);
+
+  // Pulso pedido pelo servidor: largura exata, sem esperar o tick
+  assert(controle_gpio_pulsar_atuador(3, 500));
+  controle_gpio_simular_ate(5000 * 1000);
+
+  // Um novo pulso substitui o anterior: fica ligado até 200 + 500 ms
+  assert(controle_gpio_pulsar_atuador(3, 500));
+  controle_gpio_simular_ate(5200 * 1000);
+  assert(controle_gpio_pulsar_atuador(3, 500));
+  controle_gpio_simular_ate(7000 * 1000);
+
+  n = transicoes_do_pino(GPIO_ATUADOR3, t, MAX_TRANSICOES);
+  assert(n == 4);
+  assert(t[0].nivel == 1 && t[0].instante_us == 3000 * 1000);
+  assert(t[1].nivel == 0 && t[1].instante_us == 3500 * 1000);
+  assert(t[2].nivel == 1 && t[2].instante_us == 5000 * 1000);
+  assert(t[3].nivel == 0 && t[3].instante_us == 5700 * 1000);
+
+  estatisticas_simulacao_t estatisticas;
+
+  simulacao_gpio_estatisticas(&estatisticas);
+  assert(estatisticas.degraus == 2 && estatisticas.pulsos_entrada == 10);
+  assert(estatisticas.larguras == 3);
+  assert(estatisticas.largura_min_us == 250 * 1000);
+  assert(estatisticas.largura_max_us == 700 * 1000);
+
+  unlink(ARQUIVO_REGRAS);
+  printf("simulacao: ok\n");
+  return 0;
+}
@@ -0,0 +1,179 @@
+/** @file teste_websocket.c - Ida e volta do canal WebSocket /controle.
+
+    Executa o servidor de app_web_server.c sobre servidor_http_local.c e
+    confere o canal binário de comandos dos atuadores:
+
+      - Cada quadro de comando é respondido com um quadro de estado, com
+        o mesmo número de sequência, seguido da notificação da mudança;
+      - Uma mudança por POST /atuador1 em outra conexão chega ao cliente
+        WebSocket como notificação (sequência 0);
+      - Um quadro de outro tipo ou tamanho é lido e ignorado, e o canal
+        continua sincronizado; um quadro grande demais fecha a conexão.
+
+    Também compara o tempo de um comando pelo canal com POST /atuador1.
+
+    @see app_web_server.c
+*/
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "esp_tls_crypto.h"
+
+#include "app_config.h"
+#include "app_web_server.h"
+#include "controle_gpio.h"
+#include "servidor_http_local.h"
+
+#define TAM_COOKIE        (64)
+#define NUM_COMANDOS      (2000)
+
+// Códigos das ações nos quadros (ordem de ACOES_ATUADOR em app_web_server.c)
+#define ACAO_LIGAR        (1)
+#define ACAO_ALTERNAR     (2)
+
+// Cópias dos quadros de app_web_server.c
+typedef struct __attribute__((packed)) {
+  uint8_t   id;
+  uint8_t   acao;
+  uint16_t  sequencia;
+  uint32_t  duracao;
+} quadro_comando_t;
+
+typedef struct __attribute__((packed)) {
+  uint8_t   classe;
+  uint8_t   id;
+  uint16_t  sequencia;
+  int32_t   valor;
+} quadro_estado_t;
+
+static resposta_local_t resposta;
+
+
+static double agora_real_us(void) {
+  struct timespec agora;
+
+  clock_gettime(CLOCK_MONOTONIC, &agora);
+  return (double)agora.tv_sec * 1e6 + (double)agora.tv_nsec / 1e3;
+}
+
+
+/*  GET /basic_auth com a credencial; devolve o cabeçalho Cookie da sessão.
+ */
+static void autenticar(int sockfd, char *cabecalho_cookie, size_t tamanho) {
+  static const char credencial[] = CONFIG_EXAMPLE_BASIC_AUTH_USERNAME ":" CONFIG_EXAMPLE_BASIC_AUTH_PASSWORD;
+  unsigned char base64[128];
+  char cabecalhos[192];
+  char valor[TAM_CABECALHOS_LOCAL];
+  size_t len;
+
+  esp_crypto_base64_encode(base64, sizeof(base64), &len, (const unsigned char *)credencial,
+                           sizeof(credencial) - 1);
+  snprintf(cabecalhos, sizeof(cabecalhos), "Authorization: Basic %s\n", base64);
+
+  servidor_local_atender(sockfd, HTTP_GET, "/basic_auth", cabecalhos, NULL, &resposta);
+  assert(resposta.status == 200);
+  assert(servidor_local_cabecalho(&resposta, "Set-Cookie", valor, sizeof(valor)) != NULL);
+  valor[strcspn(valor, ";")] = '\0';
+  snprintf(cabecalho_cookie, tamanho, "Cookie: %.*s\n", TAM_COOKIE, valor);
+}
+
+
+/*  Lê os quadros de estado recebidos pelo cliente; devolve quantos.
+ */
+static int ler_estados(int sockfd, quadro_estado_t *estados, int max) {
+  char recebido[TAM_ASSINCRONOS_LOCAL];
+  size_t len = servidor_local_ler_assincronos(sockfd, recebido, sizeof(recebido));
+
+  assert(len % sizeof(quadro_estado_t) == 0);
+  assert(len / sizeof(quadro_estado_t) <= (size_t)max);
+  memcpy(estados, recebido, len);
+  return (int)(len / sizeof(quadro_estado_t));
+}
+
+
+/*  Envia um comando pelo canal e confere a resposta e a notificação.
+ */
+static void comandar(int sockfd, uint8_t acao, uint16_t sequencia, int32_t esperado) {
+  quadro_comando_t comando = { .id = 1, .acao = acao, .sequencia = sequencia, .duracao = 0 };
+  quadro_estado_t estados[4];
+
+  assert(servidor_local_enviar_quadro(sockfd, HTTPD_WS_TYPE_BINARY, &comando, sizeof(comando)) == ESP_OK);
+  assert(ler_estados(sockfd, estados, 4) == 2);
+  assert(estados[0].classe == PRF_ATUADOR && estados[0].id == 1);
+  assert(estados[0].sequencia == sequencia && estados[0].valor == esperado);
+  assert(estados[1].sequencia == 0 && estados[1].valor == esperado);
+}
+
+
+int main(void) {
+  char cookie_ws[TAM_COOKIE + 16];
+  char cookie_post[TAM_COOKIE + 16];
+  quadro_estado_t estados[4];
+
+  esp_log_level_set("*", ESP_LOG_NONE);
+
+  app_config_ler();
+  controle_gpio_iniciar();
+  controle_gpio_ativar_timer();
+  assert(start_webserver() != NULL);
+
+  // Handshake: GET /controle autenticado abre o canal
+  int ws = servidor_local_conectar();
+
+  autenticar(ws, cookie_ws, sizeof(cookie_ws));
+  assert(servidor_local_atender(ws, HTTP_GET, "/controle", cookie_ws, NULL, &resposta) == ESP_OK);
+  assert(resposta.status == 101);
+
+  // Comando e resposta com a mesma sequência
+  comandar(ws, ACAO_LIGAR, 7, 1);
+
+  // Mudança por POST em outra conexão: notificação no canal
+  int post = servidor_local_conectar();
+
+  autenticar(post, cookie_post, sizeof(cookie_post));
+  servidor_local_atender(post, HTTP_POST, "/atuador1", cookie_post, "action=off\n", &resposta);
+  assert(resposta.status == 201);
+  assert(ler_estados(ws, estados, 4) == 1);
+  assert(estados[0].sequencia == 0 && estados[0].id == 1 && estados[0].valor == 0);
+
+  // Quadros inválidos pequenos são descartados; o próximo comando funciona
+  static const char texto[] = "{\"id\":1,\"acao\":\"on\"}";
+  uint8_t comprido[sizeof(quadro_comando_t) + 4] = { 1, ACAO_LIGAR };
+
+  assert(servidor_local_enviar_quadro(ws, HTTPD_WS_TYPE_TEXT, texto, sizeof(texto) - 1) == ESP_OK);
+  assert(servidor_local_enviar_quadro(ws, HTTPD_WS_TYPE_BINARY, comprido, sizeof(comprido)) == ESP_OK);
+  assert(servidor_local_conectado(ws));
+  assert(ler_estados(ws, estados, 4) == 0);
+  assert(controle_gpio_ler_atuador(1) == 0);
+  comandar(ws, ACAO_LIGAR, 8, 1);
+
+  // Ida e volta: comando pelo canal contra POST /atuador1
+  double antes = agora_real_us();
+
+  for (int i = 0; i < NUM_COMANDOS; i++) {
+    comandar(ws, ACAO_ALTERNAR, (uint16_t)(100 + i), i % 2 == 0 ? 0 : 1);
+  }
+  double canal_us = (agora_real_us() - antes) / NUM_COMANDOS;
+
+  antes = agora_real_us();
+  for (int i = 0; i < NUM_COMANDOS; i++) {
+    servidor_local_atender(post, HTTP_POST, "/atuador1", cookie_post, "action=toggle\n", &resposta);
+    assert(resposta.status == 201);
+    assert(ler_estados(ws, estados, 4) == 1);
+  }
+  double post_us = (agora_real_us() - antes) / NUM_COMANDOS;
+
+  // Quadro maior que o descarte: a conexão é fechada
+  static uint8_t grande[1024];
+
+  assert(servidor_local_enviar_quadro(ws, HTTPD_WS_TYPE_BINARY, grande, sizeof(grande)) != ESP_OK);
+  assert(!servidor_local_conectado(ws));
+
+  printf("websocket: comando pelo canal %.2f us, POST /atuador1 %.2f us\n", canal_us, post_us);
+  return 0;
+}
@@ -17,6 +17,9 @@
     @version 0.82 03/05/2024
       - Pino do micro-controlador força retorno às configurações de fábrica.
       - Adicionado campo hostname e pequenas mudanças nos nomes dos parâmetros.
+    @version 0.83
+      - Gravação em segundo plano, por uma tarefa de baixa prioridade.
+      - Sistema de arquivos compartilhado com persistencia.c (contagem de usuários).
 
     Código de armazenamento derivado de:
     .../esp-idf/examples/storage/littlefs/main/esp_littlefs_example.c
@@ -44,26 +47,51 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
 #include "esp_err.h"
 #include "esp_log.h"
 #include "esp_littlefs.h"
 
 #include "controle_gpio.h"
+#include "leitor_parametros.h"
 #include "app_config.h"
 
 #define TAG "app config"
 
+#define ARQUIVO_CONFIG        DIRETORIO_ARMAZENAMENTO "/config.txt"
+#define ARQUIVO_BACKUP        DIRETORIO_ARMAZENAMENTO "/config.bak"
+#define ARQUIVO_TEMPORARIO    DIRETORIO_ARMAZENAMENTO "/config.tmp"
+
 
 static esp_vfs_littlefs_conf_t littlefs_conf = {
-      .base_path = "/littlefs",
+      .base_path = DIRETORIO_ARMAZENAMENTO,
       .partition_label = "storage",
       .format_if_mount_failed = true,
       .dont_mount = false,
 };
 
+/*  Módulos usando o sistema de arquivos montado.
+
+    persistencia.c monta o sistema na partida e o mantém montado; a
+    configuração monta e desmonta a cada leitura ou gravação. Só o
+    último usuário desmonta. Não há disputa: a persistência monta antes
+    de existirem as demais tarefas.
+ */
+static int usuarios_littlefs = 0;
+
+
 /*  Inicia e monta um sistema de arquivos LittleFS.
+
+    Se já estiver montado por outro módulo, apenas conta mais um usuário.
  */
-static void iniciar_littlefs() {
+static bool iniciar_littlefs() {
+  if (usuarios_littlefs > 0) {
+    usuarios_littlefs++;
+    return true;
+  }
   ESP_LOGI(TAG, "Initializing LittleFS");
 
   // Note: esp_vfs_littlefs_register is an all-in-one convenience function.
@@ -77,8 +105,9 @@ static void iniciar_littlefs() {
       } else {
           ESP_LOGE(TAG, "Failed to initialize LittleFS (%s)", esp_err_to_name(ret));
       }
-      return;
+      return false;
   }
+  usuarios_littlefs = 1;
 
   size_t total = 0, used = 0;
   ret = esp_littlefs_info(littlefs_conf.partition_label, &total, &used);
@@ -86,48 +115,86 @@ static void iniciar_littlefs() {
       ESP_LOGE(TAG, "Failed to get LittleFS partition information (%s)", esp_err_to_name(ret));
       esp_littlefs_format(littlefs_conf.partition_label);
   } else {
-      ESP_LOGI(TAG, "Partition size: total: %d, used: %d", total, used);
+      ESP_LOGI(TAG, "Partition size: total: %zu, used: %zu", total, used);
   }
+  return true;
 }
 
 
-/*  Desmonta o sistema de arquivos após utilização.
+/*  Desmonta o sistema de arquivos após utilização, se não há outros usuários.
  */
 static void terminar_littlefs() {
+  if (usuarios_littlefs == 0 || --usuarios_littlefs > 0) {
+    return;
+  }
   // All done, unmount partition and disable LittleFS
   esp_vfs_littlefs_unregister(littlefs_conf.partition_label);
   ESP_LOGI(TAG, "LittleFS unmounted");
 }
 
 
-#define MAX_CFG_PARAM_LEN 31
-
 static const char* nomes_modo_wifi[2] = {
   "STA",
   "AP"
 };
 
 
-/*  Estrutura de configuração específica do aplicativo
+/*  Dados de configuração em memória.
+    Estes dados só são gravados em memória permanente por app_config_gravar(),
+    ou pela tarefa de gravação.
+
+    Depois de iniciada a tarefa de gravação, o acesso é protegido por
+    semaforo_config: o servidor altera os dados enquanto a tarefa os copia.
+*/
+static app_config_t app_config;
+
+static SemaphoreHandle_t semaforo_config = NULL;
+
+
+/*  Tarefa de gravação em segundo plano.
+
+    Montar o sistema de arquivos, gravar e renomear os arquivos leva
+    centenas de milissegundos. A tarefa de gravação faz esse trabalho com
+    prioridade baixa, para que o servidor continue atendendo os comandos.
+
+    Cada solicitação é um aviso (notificação) para a tarefa; avisos
+    recebidos durante uma gravação resultam em uma única gravação a mais.
  */
-typedef struct {
-  char wifi_ssid[MAX_SSID_LEN + 1];             // Identificador do serviço Wifi
-  char wifi_password[MAX_CFG_VALUE_LEN + 1];     // Senha do Wifi
+#define PILHA_TAREFA_GRAVACAO       (4096)
+#define PRIORIDADE_TAREFA_GRAVACAO  (tskIDLE_PRIORITY + 1)
 
-  char hostname[MAX_CFG_VALUE_LEN + 1];          // Nome do servidor HTTP
-  int  modo_wifi;                               // Station ou AP
-  
-  bool  modified;                               // Indica se a configuração mudou
-} app_config_t;
+static TaskHandle_t tarefa_gravacao = NULL;
 
+static volatile uint32_t gravacoes_solicitadas = 0;
+static volatile uint32_t gravacoes_atendidas = 0;
+static volatile enum estado_gravacao resultado_gravacao = GRAVACAO_NENHUMA;
 
-/*  Dados de configuração em memória.
-    Estes dados só são gravados em memória permanente por app_config_gravar().
-*/
-static app_config_t app_config;
+
+static void bloquear_config(void) {
+  if (semaforo_config != NULL) {
+    xSemaphoreTake(semaforo_config, portMAX_DELAY);
+  }
+}
+
+
+static void liberar_config(void) {
+  if (semaforo_config != NULL) {
+    xSemaphoreGive(semaforo_config);
+  }
+}
 
 // Ver a descrição das funções públicas em app_config.h
 
+bool app_config_montar_armazenamento(void) {
+  return iniciar_littlefs();
+}
+
+
+void app_config_desmontar_armazenamento(void) {
+  terminar_littlefs();
+}
+
+
 enum modo_conexao_wifi app_config_modo_wifi(void) {
   return (app_config.modo_wifi);
 }
@@ -148,51 +215,125 @@ const char *app_config_hostname(void) {
 }
 
 
-void app_config_set_modo_wifi(const char* modo) {
+/*  Funções de alteração sobre uma configuração qualquer: a que está em
+    uso (app_config) ou a cópia de uma carga de POST /config.
+
+    Um valor inválido (longo demais, modo desconhecido) não altera nada,
+    e a função retorna false.
+ */
+static bool mudar_modo_wifi(app_config_t *config, const char *modo) {
   if (strcmp(modo, "STA") == 0) {
     ESP_LOGI(TAG, "Modo wifi: STA");
-    app_config.modo_wifi = MODO_WIFI_STA;
+    config->modo_wifi = MODO_WIFI_STA;
   } else if (strcmp(modo, "AP") == 0) {
     ESP_LOGI(TAG, "Modo wifi: AP");
-    app_config.modo_wifi = MODO_WIFI_AP;
+    config->modo_wifi = MODO_WIFI_AP;
   } else {
     ESP_LOGE(TAG, "Modo Wifi desconhecido: %s", modo);
-    return;  
+    return false;
   }
-  app_config.modified = true;
+  config->modified = true;
+  return true;
 }
 
 
-void app_config_set_wifi_ssid(const char *ssid) {
-  size_t len = strlen(ssid);
-  
-  if (len <= MAX_SSID_LEN ) {
-    ESP_LOGI(TAG, "Wifi ssid: '%s'", ssid);
-    strcpy(app_config.wifi_ssid, ssid);
-    app_config.modified = true;
+static bool mudar_texto(app_config_t *config, const char *nome, char *campo, size_t max_len,
+                        const char *valor) {
+  if (strlen(valor) > max_len) {
+    ESP_LOGE(TAG, "%s longo demais: '%s'", nome, valor);
+    return false;
   }
+  ESP_LOGI(TAG, "%s: '%s'", nome, valor);
+  strcpy(campo, valor);
+  config->modified = true;
+  return true;
 }
 
 
-void app_config_set_wifi_password(const char *pwd) {
-  size_t len = strlen(pwd);
-      
-  if (len <= MAX_CFG_VALUE_LEN ) {
-    ESP_LOGI(TAG, "Senha: '%s'", pwd);
-    strcpy(app_config.wifi_password, pwd);
-    app_config.modified = true;
+static bool mudar_parametro(app_config_t *config, const char *nome, const char *valor) {
+  if (strcmp(nome, "password") == 0) {
+    // Senha pode ser vazia
+    return mudar_texto(config, "Senha", config->wifi_password, MAX_CFG_VALUE_LEN, valor);
+  } else if (strcmp(nome, "ssid") == 0) {
+    return mudar_texto(config, "Wifi ssid", config->wifi_ssid, MAX_SSID_LEN, valor);
+  } else if (strcmp(nome, "hostname") == 0) {
+    return mudar_texto(config, "Hostname", config->hostname, MAX_CFG_VALUE_LEN, valor);
+  } else if (strcmp(nome, "modo_wifi") == 0) {
+    return mudar_modo_wifi(config, valor);
   }
+  ESP_LOGE(TAG, "Parâmetro de configuração desconhecido: %s", nome);
+  return false;
+}
+
+
+void app_config_set_modo_wifi(const char* modo) {
+  mudar_modo_wifi(&app_config, modo);
+}
+
+
+void app_config_set_wifi_ssid(const char *ssid) {
+  mudar_parametro(&app_config, "ssid", ssid);
+}
+
+
+void app_config_set_wifi_password(const char *pwd) {
+  mudar_parametro(&app_config, "password", pwd);
 }
 
 
 void app_config_set_hostname(const char *nome) {
-  size_t len = strlen(nome);
-      
-  if (len <= MAX_CFG_VALUE_LEN ) {
-    ESP_LOGI(TAG, "Hostname: '%s'", nome);
-    strcpy(app_config.hostname, nome);
-    app_config.modified = true;
+  mudar_parametro(&app_config, "hostname", nome);
+}
+
+
+bool app_config_aplicar_parametro(const char *nome, const char *valor) {
+  bloquear_config();
+  bool aceito = mudar_parametro(&app_config, nome, valor);
+  liberar_config();
+
+  return aceito;
+}
+
+
+void app_config_iniciar_carga(carga_config_t *carga) {
+  bloquear_config();
+  carga->config = app_config;
+  liberar_config();
+
+  carga->config.modified = false;
+  carga->parametros = 0;
+  carga->erros = 0;
+}
+
+
+void app_config_tratar_parametro(const char *nome, const char *valor, void *contexto) {
+  carga_config_t *carga = (carga_config_t *)contexto;
+
+  if (mudar_parametro(&carga->config, nome, valor)) {
+    carga->parametros++;
+  } else {
+    carga->erros++;
+  }
+}
+
+
+bool app_config_concluir_carga(carga_config_t *carga, bool aplicar) {
+  if (!aplicar || carga->erros > 0) {
+    return false;
+  }
+  if (carga->config.modified) {
+    bloquear_config();
+    app_config = carga->config;
+    liberar_config();
   }
+  return true;
+}
+
+
+/*  Trata cada parâmetro lido do arquivo de configuração.
+ */
+static void tratar_parametro_arquivo(const char *nome, const char *valor, void *contexto) {
+  app_config_aplicar_parametro(nome, valor);
 }
 
 
@@ -213,46 +354,32 @@ void app_config_ler(void) {
 
   ESP_LOGI(TAG, "Lendo config na memória FLASH...");
 
-  FILE *f = fopen("/littlefs/config.txt", "r");
+  FILE *f = fopen(ARQUIVO_CONFIG, "r");
 
-  char line[128];
-  char param[MAX_CFG_PARAM_LEN + 1];
-  char value[MAX_CFG_VALUE_LEN + 1];
+  char bloco[64];
+  size_t lidos;
+  leitor_parametros_t leitor;
   
   if (f == NULL) {
     // Se arquivo principal apresenta falha, tenta backup.
     ESP_LOGI(TAG, "Erro abrindo arquivo. Tentando backup...");
-    f =  fopen("/littlefs/config.bak", "r");
+    f =  fopen(ARQUIVO_BACKUP, "r");
   }
 
   if (f == NULL) {
     ESP_LOGE(TAG, "Failed to open file for reading");
+    terminar_littlefs();
     return;
   }
 
-  while(fgets(line, sizeof(line), f) != NULL) {
-    // ESP_LOGI(TAG, "Read from file: '%s'", line);
-    
-    // Linhas de configuração válidas são da forma: nome = valor
-    int count = sscanf(line, "%31[^= ] = %63[^\n]", param, value);
-    
-    if(count > 1) {
-      if (strcmp(param, "password") == 0) {
-        if (count == 1) {
-          // Senha pode ser vazia
-          value[0] = 0;
-        }
-        app_config_set_wifi_password(value);
-      } else if (count == 2) {
-        if (strcmp(param, "ssid") == 0) {
-          app_config_set_wifi_ssid(value);
-        } else if (strcmp(param, "hostname") == 0) {
-          app_config_set_hostname(value);
-        } else if (strcmp(param, "modo_wifi") == 0) {
-          app_config_set_modo_wifi(value);
-        }
-      }
-    }
+  // Linhas de configuração válidas são da forma: nome = valor
+  leitor_parametros_iniciar(&leitor, tratar_parametro_arquivo, NULL);
+
+  while ((lidos = fread(bloco, 1, sizeof(bloco), f)) > 0) {
+    leitor_parametros_consumir(&leitor, bloco, lidos);
+  }
+  if (leitor_parametros_terminar(&leitor) > 0) {
+    ESP_LOGE(TAG, "Linhas inválidas no arquivo de configuração: %d", leitor.erros);
   }
   fclose(f);
   
@@ -264,20 +391,28 @@ void app_config_ler(void) {
   app_config.modified = false;
 }
 
-esp_err_t app_config_gravar(void) {
-  if (! app_config.modified) {
-    // Se não houve modificação...
-    return ESP_FAIL;
-  }
+/*  Grava uma cópia da configuração no arquivo.
+
+    O arquivo anterior é mantido como config.bak.
+ */
+static esp_err_t gravar_arquivo(const app_config_t *config) {
+  esp_err_t ret = ESP_OK;
+
   ESP_LOGI(TAG, "Salvando configuração para memória FLASH");
   iniciar_littlefs();
 
-  FILE *f = fopen("/littlefs/config.tmp", "w");
+  FILE *f = fopen(ARQUIVO_TEMPORARIO, "w");
+
+  if (f == NULL) {
+    ESP_LOGE(TAG, "Falha criando arquivo de configuração.");
+    terminar_littlefs();
+    return ESP_ERR_NOT_FINISHED;
+  }
   
-  fprintf(f, "ssid=%s\n",  app_config.wifi_ssid);
-  fprintf(f, "password=%s\n",  app_config.wifi_password);
-  fprintf(f, "hostname=%s\n",  app_config.hostname);
-  fprintf(f, "modo_wifi=%s\n",  nomes_modo_wifi[app_config.modo_wifi]);
+  fprintf(f, "ssid=%s\n",  config->wifi_ssid);
+  fprintf(f, "password=%s\n",  config->wifi_password);
+  fprintf(f, "hostname=%s\n",  config->hostname);
+  fprintf(f, "modo_wifi=%s\n",  nomes_modo_wifi[config->modo_wifi]);
   fprintf(f, "\n");
   
   fclose(f);
@@ -285,24 +420,104 @@ esp_err_t app_config_gravar(void) {
   // Check if destination file exists before renaming
   struct stat st;
 
-  if (stat("/littlefs/config.bak", &st) == 0) {
+  if (stat(ARQUIVO_BACKUP, &st) == 0) {
       // Delete it if it exists
-      unlink("/littlefs/config.bak");
+      unlink(ARQUIVO_BACKUP);
   }
 
   // Rename original file
   ESP_LOGI(TAG, "Renaming file");
-  if (rename("/littlefs/config.txt", "/littlefs/config.bak") != 0) {
+  if (rename(ARQUIVO_CONFIG, ARQUIVO_BACKUP) != 0) {
       ESP_LOGE(TAG, "Falha criando backup");
-      return ESP_ERR_NOT_FINISHED;
+      ret = ESP_ERR_NOT_FINISHED;
   } else {
-    if (rename("/littlefs/config.tmp", "/littlefs/config.txt") != 0) {
+    if (rename(ARQUIVO_TEMPORARIO, ARQUIVO_CONFIG) != 0) {
       ESP_LOGE(TAG, "Falha salvando arquivo de configuração.");
-      return ESP_ERR_NOT_FINISHED;
+      ret = ESP_ERR_NOT_FINISHED;
     }
   }
   terminar_littlefs();
 
+  return ret;
+}
+
+
+/*  Copia a configuração, se modificada, e grava a cópia.
+
+    Se a gravação falhar, a configuração volta a ser marcada como
+    modificada, para que uma próxima gravação tente novamente.
+ */
+static esp_err_t gravar_se_modificada(void) {
+  app_config_t copia;
+
+  bloquear_config();
+  copia = app_config;
   app_config.modified = false;
-  return ESP_OK;
+  liberar_config();
+
+  if (!copia.modified) {
+    // Se não houve modificação...
+    return ESP_FAIL;
+  }
+
+  esp_err_t ret = gravar_arquivo(&copia);
+
+  if (ret != ESP_OK) {
+    bloquear_config();
+    app_config.modified = true;
+    liberar_config();
+  }
+  return ret;
+}
+
+
+esp_err_t app_config_gravar(void) {
+  return gravar_se_modificada();
+}
+
+
+static void executar_tarefa_gravacao(void *parametros) {
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    // Atende todas as solicitações feitas até aqui
+    uint32_t solicitadas = gravacoes_solicitadas;
+    esp_err_t ret = gravar_se_modificada();
+
+    resultado_gravacao = (ret == ESP_OK || ret == ESP_FAIL) ? GRAVACAO_CONCLUIDA : GRAVACAO_FALHOU;
+    gravacoes_atendidas = solicitadas;
+  }
+}
+
+
+bool app_config_iniciar_tarefa_gravacao(void) {
+  if (tarefa_gravacao != NULL) {
+    return true;
+  }
+  semaforo_config = xSemaphoreCreateMutex();
+  if (semaforo_config == NULL) {
+    return false;
+  }
+  return (xTaskCreate(executar_tarefa_gravacao, "config", PILHA_TAREFA_GRAVACAO, NULL,
+                      PRIORIDADE_TAREFA_GRAVACAO, &tarefa_gravacao) == pdPASS);
+}
+
+
+bool app_config_solicitar_gravacao(void) {
+  if (tarefa_gravacao == NULL) {
+    return false;
+  }
+  // Apenas o servidor solicita gravações
+  gravacoes_solicitadas++;
+  xTaskNotifyGive(tarefa_gravacao);
+
+  return true;
+}
+
+
+enum estado_gravacao app_config_estado_gravacao(void) {
+  if (gravacoes_atendidas != gravacoes_solicitadas) {
+    return GRAVACAO_PENDENTE;
+  }
+  return resultado_gravacao;
 }
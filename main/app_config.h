@@ -2,9 +2,20 @@
 */
 #pragma once
 
+#include <stdbool.h>
+#include "esp_err.h"
+
 #define MAX_SSID_LEN 32
 #define MAX_CFG_VALUE_LEN 63
 
+/** Diretório onde o sistema de arquivos da memória FLASH é montado.
+
+    Os testes no computador (host_test) indicam outro diretório.
+*/
+#ifndef DIRETORIO_ARMAZENAMENTO
+#define DIRETORIO_ARMAZENAMENTO "/littlefs"
+#endif
+
 
 /** Modo da conexão Wifi (STAtion ou Access Point).
  */
@@ -14,6 +25,31 @@ enum modo_conexao_wifi {
 };
 
 
+/** Estrutura de configuração específica do aplicativo.
+ */
+typedef struct {
+  char wifi_ssid[MAX_SSID_LEN + 1];             ///< Identificador do serviço Wifi
+  char wifi_password[MAX_CFG_VALUE_LEN + 1];    ///< Senha do Wifi
+
+  char hostname[MAX_CFG_VALUE_LEN + 1];         ///< Nome do servidor HTTP
+  int  modo_wifi;                               ///< Station ou AP (enum modo_conexao_wifi)
+
+  bool  modified;                               ///< Indica se a configuração mudou
+} app_config_t;
+
+
+/** Carga de uma nova configuração, de POST /config.
+
+    Os parâmetros são validados em uma cópia da configuração em uso; a
+    cópia só a substitui se todos forem válidos.
+ */
+typedef struct {
+  app_config_t  config;       ///< Cópia com os parâmetros já lidos
+  int           parametros;   ///< Parâmetros aceitos
+  int           erros;        ///< Nomes desconhecidos ou valores inválidos
+} carga_config_t;
+
+
 /** Ler configuração do aplicativo da memória FLASH.
 
   NOTA: Se o pino de voltar à configuração original estiver ligado (ON),
@@ -29,6 +65,56 @@ void app_config_ler(void);
 esp_err_t app_config_gravar(void);
 
 
+/** Situação da gravação em segundo plano.
+ */
+enum estado_gravacao {
+  GRAVACAO_NENHUMA,       ///< Nenhuma gravação solicitada
+  GRAVACAO_PENDENTE,      ///< Solicitada e ainda não terminada
+  GRAVACAO_CONCLUIDA,     ///< Última gravação terminou (ou não havia o que gravar)
+  GRAVACAO_FALHOU         ///< Última gravação falhou
+};
+
+
+/** Criar a tarefa que grava a configuração em segundo plano.
+
+    Deve ser chamada após app_config_ler().
+
+    @return true se a tarefa foi criada.
+*/
+bool app_config_iniciar_tarefa_gravacao(void);
+
+
+/** Solicitar a gravação da configuração em segundo plano.
+
+    Retorna imediatamente; a tarefa de gravação executa app_config_gravar().
+
+    @return false se a tarefa de gravação não foi iniciada.
+    @see app_config_estado_gravacao()
+*/
+bool app_config_solicitar_gravacao(void);
+
+
+/** Obter a situação da última gravação solicitada.
+*/
+enum estado_gravacao app_config_estado_gravacao(void);
+
+
+/** Montar o sistema de arquivos da memória FLASH (em DIRETORIO_ARMAZENAMENTO) para
+    uso de outro módulo.
+
+    O sistema fica montado até a chamada correspondente a
+    app_config_desmontar_armazenamento().
+
+    @return false se não foi possível montar.
+*/
+bool app_config_montar_armazenamento(void);
+
+
+/** Liberar o sistema de arquivos montado por app_config_montar_armazenamento().
+*/
+void app_config_desmontar_armazenamento(void);
+
+
 /** Indica se modo Wifi deve ser Access Point (AP) ou Station (STA)
 */
 enum modo_conexao_wifi app_config_modo_wifi(void);
@@ -76,6 +162,54 @@ void app_config_set_wifi_ssid(const char *ssid);
 void app_config_set_wifi_password(const char *pwd);
 
 
+/** Altera um parâmetro de configuração a partir de seu nome.
+
+    Nomes conhecidos: ssid, password, hostname e modo_wifi, os mesmos
+    usados no arquivo de configuração e em POST /config.
+
+    @param nome  Nome do parâmetro
+    @param valor Novo valor (pode ser vazio, no caso da senha)
+
+    @return true se o parâmetro foi alterado, false se o nome é
+            desconhecido ou o valor é inválido.
+ */
+bool app_config_aplicar_parametro(const char *nome, const char *valor);
+
+
+/** Iniciar a carga de uma nova configuração, copiando a atual.
+
+    @param carga Estado da carga
+ */
+void app_config_iniciar_carga(carga_config_t *carga);
+
+
+/** Tratar um parâmetro da carga (leitor_parametros_cb_t).
+
+    Mesmos nomes de app_config_aplicar_parametro(); o parâmetro altera
+    apenas a cópia. Nomes desconhecidos e valores inválidos são contados
+    como erro.
+
+    @param nome     Nome do parâmetro
+    @param valor    Novo valor
+    @param contexto Carga iniciada por app_config_iniciar_carga()
+ */
+void app_config_tratar_parametro(const char *nome, const char *valor, void *contexto);
+
+
+/** Concluir a carga.
+
+    Se aplicar e não houve erros, a cópia substitui a configuração em
+    uso, de uma só vez. A gravação na FLASH deve ser solicitada à parte
+    (app_config_solicitar_gravacao).
+
+    @param carga    Estado da carga
+    @param aplicar  false para descartar a carga
+
+    @return true se a carga foi aceita.
+ */
+bool app_config_concluir_carga(carga_config_t *carga, bool aplicar);
+
+
 /** Altera o nome do servidor HTTP (mDNS).
 
     @param nome Nome do servidor
@@ -12,16 +12,116 @@
     
       Para obter um texto indicando o status do controlador.
       
+    GET /status?mem=1
+
+      Para obter os contadores de uso de memória do servidor (heap livre,
+      maior bloco livre, uso das arenas de cada conexão), a memória fixa
+      ocupada pelo histórico e as gravações do estado na FLASH (lotes,
+      bytes gravados e de registros, compactações, tamanho do diário,
+      duração da restauração na partida).
+
+    Respostas condicionais:
+
+      GET /status, /sensor, /contador e /snapshot devolvem um cabeçalho ETag
+      com a versão do estado dos periféricos. Se a solicitação trouxer
+      If-None-Match com essa mesma versão, a resposta é 304, sem conteúdo.
+
+    GET /metrics
+
+      Métricas do servidor, no formato texto do Prometheus: respostas por
+      URI e classe de status, histogramas de latência, bytes recebidos,
+      parâmetros inválidos, heap livre, pilha do servidor e ticks
+      atrasados, latência dos comandos e atraso no fim dos pulsos dos
+      atuadores. Com expansores de GPIO, também as leituras, escritas e
+      transações no barramento I2C.
+
     GET /sensor?id=(identificador)
     
       Para ler o estado de um sensor (porta de entrada do módulo),
       Onde id indica o sensor para o qual se deseja obter o valor.
       
+    GET /sensor?adc=(identificador)
+
+      Para ler um sensor analógico, já filtrado, na escala do conversor
+      (0 a 4095). Não aguarda conversões; mínimo, máximo e média se
+      referem ao último segundo:
+
+        valor=(última saída do filtro)
+        minimo=(menor)
+        maximo=(maior)
+        media=(média)
+        amostras=(amostras convertidas desde o início)
+
     GET /contador?id=(identificador)
     
       Para ler a contagem de eventos de um contador (porta de entrada do módulo),
       Onde id indica o contador para o qual se deseja obter o valor.
       
+    GET /contador?id=(identificador)&stats=1
+
+      Para ler as estatísticas de um contador, calculadas no módulo a
+      cada tick: eventos no último segundo, minuto e hora, médias
+      exponenciais (1, 5 e 15 minutos) em eventos por minuto, e o
+      histograma dos intervalos entre eventos:
+
+        total=(contagem)
+        ultimo_segundo=(eventos)
+        ultimo_minuto=(eventos)
+        ultima_hora=(eventos)
+        taxa_1min=(eventos/min)
+        taxa_5min=(eventos/min)
+        taxa_15min=(eventos/min)
+        faixas_ms=(limite superior de cada faixa; 0 = sem limite)
+        intervalos=(eventos em cada faixa)
+
+    GET /snapshot
+
+      Para ler, em uma única solicitação, o estado de todos os periféricos.
+      A resposta tem uma linha por classe de periférico, com os valores
+      separados por vírgula, em ordem de identificador:
+
+        sensores=(valor sensor 1),(valor sensor 2),...
+        contadores=(contagem contador 1),...
+        atuadores=(valor atuador 1),(valor atuador 2),...
+
+    GET /eventos
+
+      Mantém a conexão aberta (Server-Sent Events, text/event-stream) e
+      envia uma mensagem a cada mudança de estado de um periférico:
+
+        event: (sensor, contador ou atuador)
+        data: (identificador)=(novo valor)
+
+    GET /eventos?desde=(sequência)
+
+      Lê uma página do registro de bordas dos sensores e contadores,
+      capturadas por interrupção, com o instante de cada uma em us.
+      Cada leitor guarda seu cursor: a próxima página começa em proximo.
+
+        proximo=(sequência)
+        perdidos=(eventos sobrescritos antes de serem lidos)
+        borda=(sequência),(instante),(sensor ou contador),(id),(nível)
+
+    GET /historico?desde=(ms)&ate=(ms)&res=(0, 1 ou 60)
+
+      Lê o histórico dos periféricos guardado em RAM, com instantes em ms
+      desde a partida do módulo. res=0 devolve cada mudança (resolução do
+      tick), res=1 um resumo por segundo (últimos 15 minutos) e res=60 um
+      resumo por minuto (últimas 24 horas; com expansores, 10 minutos e
+      12 horas). Sem desde e ate, devolve todo o histórico da resolução.
+      A resposta é enviada em partes (chunked), sem montar o texto
+      inteiro na memória:
+
+        res=(resolução)
+        agora=(instante atual)
+        mais_antigo=(instante da amostra mais antiga, ou -1)
+        amostra=(instante),(duração),(sensores),(sensores ligados),
+                (atuadores),(atuadores ligados),(eventos contador 1),...
+
+      Sensores e atuadores são mapas de bits (bit 1 para o periférico 1,
+      etc.): o nível no fim do intervalo e os que estiveram ligados em
+      algum momento dele.
+
     POST /contador(id)
     
       action=reset
@@ -36,7 +136,59 @@
       Para alterar o estado de um atuador (porta de saída do módulo),
       Onde off desliga, on liga, toggle alterna o estado e
       pulse liga e desliga após duração de tempo determinada.
+
+      Em POST /contador, /atuador e /lote, a resposta 503 indica que a
+      tarefa de controle descartou o comando sem executá-lo (fila cheia
+      ou mais de 50 ms de espera); o cliente pode repetir o pedido.
     
+    POST /lote
+
+      atuador(id)=("off", "on", "toggle" ou "pulse")[,(tempo em ms)]
+      ...
+
+      Para alterar vários atuadores ao mesmo tempo, com uma linha por
+      atuador. Os comandos só são aplicados se todos forem válidos.
+      A resposta traz o resultado de cada linha: atuador(id)=(status).
+
+    POST /regras
+
+      regra=(condição) -> (ação)
+      ...
+
+      Para substituir as regras de automação, avaliadas no próprio módulo
+      a cada mudança dos periféricos (sintaxe em regras.c). As regras só
+      são substituídas se todas forem válidas; o texto é gravado na FLASH
+      e recarregado na partida. Sem nenhuma linha, apaga as regras. Cada
+      regra tem até 191 caracteres. A resposta traz regras=(compiladas),
+      erros=(linhas inválidas) e o número de cada linha inválida, em
+      rejeitada=(linha), até as 8 primeiras.
+
+    GET /regras
+
+      Estatísticas das regras em vigor: regras, avaliacoes, disparos,
+      passos_excedidos (cadeias interrompidas), latência máxima e média
+      em us, da amostragem das entradas até a escrita das saídas, e
+      disparos_regra=(disparos da regra 1),... em ordem.
+
+    GET /controle (WebSocket)
+
+      Canal persistente para comandos dos atuadores, com quadros binários
+      de tamanho fixo (little-endian). Cada comando:
+
+        byte 0     identificador do atuador
+        byte 1     ação (0 off, 1 on, 2 toggle, 3 pulse)
+        bytes 2-3  número de sequência, devolvido na confirmação
+        bytes 4-7  duração do pulso em ms
+
+      é confirmado com um quadro de estado, que também é enviado, com
+      sequência 0, a cada mudança de estado de um periférico:
+
+        byte 0     classe do periférico (1 atuador, 2 contador, 3 sensor)
+        byte 1     identificador do periférico
+        bytes 2-3  número de sequência do comando confirmado
+        bytes 4-7  novo valor, -1 se o comando foi rejeitado, ou -2 se
+                   foi descartado sem ser executado (como a resposta 503)
+
     POST /config
     
       ssid=(ssid do Wifi)
@@ -44,7 +196,19 @@
       wifi_mode=(STA/AP)
       hostname=(nome do servidor HTTP)
 
-      Para alterar a configuração do módulo.
+      Para alterar a configuração do módulo. A configuração é gravada em
+      segundo plano: a resposta é 202, e a gravação pode ser acompanhada
+      com GET /config.
+
+    GET /config
+
+      Situação da última gravação: gravacao=(nenhuma, pendente, concluida
+      ou falhou). A nova configuração vale após reiniciar o módulo.
+
+    GET / (ou /index.html, /portaria_remota.js, /estilos.css, /portaria.png)
+
+      Console web (pasta client), embutido no firmware e enviado
+      comprimido (Content-Encoding: gzip), com ETag e Cache-Control.
 
     Base do código - Exemplos da biblioteca esp-idf
     Derivado de Simple HTTPD Server Example e RESTful Server
@@ -53,6 +217,26 @@
       - Versão 0.82 Modificação do protocolo, aproximando-se mais do modelo RESTful,
         com a diferença de que o conteúdo das mensagens é em texto (text/plain).
       - Versão 0.85 Implementados contadores de eventos
+      - Versão 0.86 GET /snapshot, lendo todos os periféricos em uma só solicitação
+      - Versão 0.87 GET /eventos, avisando as mudanças de estado sem polling
+      - Versão 0.88 Canal WebSocket /controle, com quadros binários
+      - Versão 0.89 Um único tratamento, com curinga no URI, por classe de periférico
+      - Versão 0.90 Conteúdo dos POST lido em blocos, sem limite de tamanho nem truncamento
+      - Versão 0.91 Arena de memória por conexão, no lugar do buffer global e de malloc/free
+      - Versão 0.92 POST /lote, aplicando comandos a vários atuadores ao mesmo tempo
+      - Versão 0.93 ETag e respostas 304 para leituras cujo estado não mudou
+      - Versão 0.94 Console web (pasta client) embutido e servido comprimido
+      - Versão 0.95 Autenticação aplicada a todos os URIs, com credencial pré-calculada
+        e cookie de sessão
+      - Versão 0.96 GET /metrics, com contadores e histogramas de latência por URI
+      - Versão 0.97 POST /config grava em segundo plano (202), GET /config acompanha
+      - Versão 0.98 GET /eventos?desde=, registro de bordas dos pinos de entrada
+      - Versão 0.99 GET /sensor?adc=, sensores analógicos filtrados
+      - Versão 1.0 GET /contador?id=&stats=1, taxas e intervalos dos contadores
+      - Versão 1.01 GET /historico, histórico dos periféricos em RAM (chunked)
+      - Versão 1.02 GET /status?mem=1 inclui as gravações do estado persistente
+      - Versão 1.03 POST /regras e GET /regras, regras de automação no módulo
+      - Versão 1.04 GET /metrics inclui o barramento dos expansores de GPIO
 
     @see app_config.h
  */
@@ -68,27 +252,40 @@
    CONDITIONS OF ANY KIND, either express or implied.
 */
 #include <stdio.h>
+#include <stdarg.h>
+#include <stdatomic.h>
 #include <string.h>
 #include <ctype.h>
+#include <inttypes.h>
+#include <sys/param.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
 #include "esp_err.h"
 #include "esp_log.h"
 
 #include "esp_system.h"
-#include "esp_event.h"
-#include "nvs_flash.h"
-#include "esp_wifi.h"
-#include "esp_netif.h"
-#include "esp_eth.h"
 #include "esp_tls_crypto.h"
 #include "esp_http_server.h"
-#include "esp_vfs.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_crc.h"
+#include "esp_random.h"
+#include "esp_timer.h"
 // #include "cJSON.h"
 
 #include "controle_gpio.h"
+#include "sensor_adc.h"
+#include "historico.h"
+#include "persistencia.h"
+#include "regras.h"
+#if CONFIG_CONTROLE_GPIO_EXPANSOR
+#include "expansor_gpio.h"
+#endif
 #include "app_config.h"
+#include "leitor_parametros.h"
 #include "app_web_server.h"
 
 static const char *TAG = "app-web-server";
@@ -99,8 +296,10 @@ enum msg_local {
   MSGL_1,
   MSGL_OK,
   MSGL_CREATED,
+  MSGL_ACEITO,
   MSGL_FALTAM_PARAMETROS,
-  MSGL_PARAMETRO_INVALIDO
+  MSGL_PARAMETRO_INVALIDO,
+  MSGL_INDISPONIVEL
 };
 
 // Nota: as mensagens abaixo têm que corresponder ao enumerado msg_local
@@ -109,8 +308,10 @@ static const char *mensagens_locais[] = {
   "1",
   "200 Ok",
   "201 Created",
+  "202 Aceito",
   "400 Faltam Parametros",
-  "400 Parametro invalido"
+  "400 Parametro invalido",
+  "503 Servico indisponivel"
 };
 
 
@@ -127,180 +328,623 @@ static int valor_sensor_para_msg(int valor) {
 }
 
 
-#if CONFIG_EXAMPLE_BASIC_AUTH
+// Métricas do servidor ------------------------------------------------------
 
-/*  Código de autenticação básica, caso seja configurada.
+/*  Contadores de cada URI registrado, atualizados em tratar_uri_registrado()
+    e lidos em GET /metrics.
+
+    A latência de cada solicitação vai para um histograma de faixas fixas,
+    em escala logarítmica (potências de 2, em microssegundos): a faixa é
+    calculada com uma contagem de bits, e a atualização é um incremento
+    atômico. O custo da medida fica em duas leituras do relógio.
+
+    O status de cada resposta é anotado por definir_status() e
+    enviar_erro(), que substituem httpd_resp_set_status() e
+    httpd_resp_send_err() neste arquivo. Sem nenhum dos dois, o status
+    é 200. A classe do status fica na arena da conexão (req->sess_ctx),
+    não em uma variável global, e assim pertence sempre à solicitação
+    que a anotou.
  */
+#define MAX_URIS_INSTRUMENTADOS   (20)
+#define NUM_FAIXAS_LATENCIA       (12)    // < 256us, < 512us, ..., < 262ms, acima
+#define BITS_PRIMEIRA_FAIXA       (8)     // Primeira faixa: até 2^8 us
+
+enum classe_status {
+  CLS_2XX,
+  CLS_3XX,
+  CLS_4XX,
+  CLS_5XX,
+  NUM_CLASSES_STATUS
+};
+
+typedef struct {
+  const httpd_uri_t *original;                      // URI e tratamento originais
+  atomic_uint respostas[NUM_CLASSES_STATUS];        // Por classe de status
+  atomic_uint falhas;                               // Tratamento retornou erro
+  atomic_uint faixas_latencia[NUM_FAIXAS_LATENCIA];
+  atomic_ullong soma_latencia_us;
+  atomic_ullong bytes_conteudo;                     // Soma dos Content-Length
+} metricas_uri_t;
 
 typedef struct {
-    char    *username;
-    char    *password;
-} basic_auth_info_t;
+  atomic_uint parametros_invalidos;                 // Linhas descartadas nos POST
+  atomic_uint nao_autenticadas;                     // Respostas 401
+} metricas_gerais_t;
+
+static metricas_uri_t uris_instrumentados[MAX_URIS_INSTRUMENTADOS + 1];
+static int num_uris_instrumentados = 0;
+
+static metricas_gerais_t metricas_gerais;
+
+static void anotar_classe_status(httpd_req_t *req, enum classe_status classe);
+
+
+/*  Substitui httpd_resp_set_status(), anotando a classe do status.
+ */
+static void definir_status(httpd_req_t *req, const char *status)
+{
+  switch (status[0]) {
+    case '3':  anotar_classe_status(req, CLS_3XX); break;
+    case '4':  anotar_classe_status(req, CLS_4XX); break;
+    case '5':  anotar_classe_status(req, CLS_5XX); break;
+    default:   anotar_classe_status(req, CLS_2XX); break;
+  }
+  httpd_resp_set_status(req, status);
+}
+
+
+/*  Substitui httpd_resp_send_err(), anotando a classe do status.
+ */
+static esp_err_t enviar_erro(httpd_req_t *req, httpd_err_code_t erro, const char *msg)
+{
+  switch (erro) {
+    case HTTPD_500_INTERNAL_SERVER_ERROR:
+    case HTTPD_501_METHOD_NOT_IMPLEMENTED:
+    case HTTPD_505_VERSION_NOT_SUPPORTED:
+      anotar_classe_status(req, CLS_5XX);
+      break;
+    default:
+      anotar_classe_status(req, CLS_4XX);
+      break;
+  }
+  return httpd_resp_send_err(req, erro, msg);
+}
+
+
+static inline int faixa_latencia(int64_t us)
+{
+  int bits = (us <= 0) ? 0 : 64 - __builtin_clzll((unsigned long long)us);
+  int faixa = bits - BITS_PRIMEIRA_FAIXA;
+
+  if (faixa < 0) {
+    return 0;
+  }
+  return (faixa >= NUM_FAIXAS_LATENCIA) ? NUM_FAIXAS_LATENCIA - 1 : faixa;
+}
+
+
+#if CONFIG_EXAMPLE_BASIC_AUTH
+
+/*  Código de autenticação básica, caso seja configurada.
+
+    Todos os URIs registrados passam por autenticar(), exceto
+    OPTIONS (verificação prévia dos navegadores, que nunca traz credenciais).
+
+    A credencial esperada ("Basic " + base64 de usuário:senha) é montada uma
+    única vez, ao iniciar o servidor; usuário e senha vêm da configuração
+    de compilação e não mudam com o servidor em funcionamento. A comparação
+    com o cabeçalho Authorization leva sempre o mesmo tempo, qualquer que
+    seja a posição do primeiro caractere diferente.
+
+    Ao aceitar a credencial, o servidor devolve um cookie de sessão de
+    curta duração. As solicitações seguintes com esse cookie são aceitas
+    comparando apenas o token, sem ler o cabeçalho Authorization.
+ */
 
 #define HTTPD_401      "401 UNAUTHORIZED"                   // HTTP Response 401
 
 #define BASIC_REALM    "Basic realm=\"controle Wifi\""
 
-static char *http_auth_basic(const char *username, const char *password)
+#define TAM_CREDENCIAL          (200)       // "Basic " + base64 de usuário:senha
+#define TAM_TOKEN_SESSAO        (16)        // Caracteres hexadecimais
+#define MAX_SESSOES_AUTENTICADAS CONFIG_EXAMPLE_BASIC_AUTH_SESSOES
+#define DURACAO_SESSAO_S        (300)
+
+#define NOME_COOKIE_SESSAO      "sessao"
+
+// "sessao=" + token + "; Max-Age=300; Path=/; HttpOnly; SameSite=Strict"
+#define TAM_COOKIE_SESSAO       (80)
+
+typedef struct {
+  char    cookie[TAM_COOKIE_SESSAO]; // Valor de Set-Cookie; o token vem após "sessao="
+  int64_t expira_us;            // 0 se a posição está livre
+} sessao_autenticada_t;
+
+static char credencial_esperada[TAM_CREDENCIAL];
+static size_t len_credencial_esperada = 0;
+
+// Acessadas apenas pela tarefa do servidor
+static sessao_autenticada_t sessoes_autenticadas[MAX_SESSOES_AUTENTICADAS + 1];
+
+
+/*  Monta a credencial esperada a partir da configuração.
+ */
+static void preparar_credencial(void)
+{
+  char usuario_senha[TAM_CREDENCIAL];
+  const char *prefixo = "Basic ";
+  size_t len_prefixo = strlen(prefixo);
+  size_t n = 0;
+
+  int len = snprintf(usuario_senha, sizeof(usuario_senha), "%s:%s",
+                     CONFIG_EXAMPLE_BASIC_AUTH_USERNAME, CONFIG_EXAMPLE_BASIC_AUTH_PASSWORD);
+
+  strcpy(credencial_esperada, prefixo);
+  if (len < 0 || len >= (int)sizeof(usuario_senha) ||
+      esp_crypto_base64_encode((unsigned char *)credencial_esperada + len_prefixo,
+                               sizeof(credencial_esperada) - len_prefixo, &n,
+                               (const unsigned char *)usuario_senha, len) != 0) {
+    // Nenhuma credencial será aceita
+    ESP_LOGE(TAG, "Usuario e senha longos demais para a autenticacao");
+    len_credencial_esperada = 0;
+  } else {
+    len_credencial_esperada = len_prefixo + n;
+  }
+  credencial_esperada[len_credencial_esperada] = '\0';
+
+  for (int i = 1; i <= MAX_SESSOES_AUTENTICADAS; i++) {
+    sessoes_autenticadas[i].expira_us = 0;
+  }
+}
+
+
+/*  Compara dois textos de mesmo tamanho em tempo constante.
+ */
+static bool iguais_tempo_constante(const char *a, const char *b, size_t len)
+{
+  unsigned char diferenca = 0;
+
+  for (size_t i = 0; i < len; i++) {
+    diferenca |= (unsigned char)a[i] ^ (unsigned char)b[i];
+  }
+  return (diferenca == 0);
+}
+
+
+/*  Verifica o cookie de sessão, se houver.
+ */
+static bool sessao_valida(httpd_req_t *req)
 {
-    int out;
-    char *user_info = NULL;
-    char *digest = NULL;
-    size_t n = 0;
-    asprintf(&user_info, "%s:%s", username, password);
-    if (!user_info) {
-        ESP_LOGE(TAG, "No enough memory for user information");
-        return NULL;
+  char token[TAM_TOKEN_SESSAO + 1];
+  size_t len = sizeof(token);
+  int64_t agora = esp_timer_get_time();
+
+  if (httpd_req_get_cookie_val(req, NOME_COOKIE_SESSAO, token, &len) != ESP_OK ||
+      strlen(token) != TAM_TOKEN_SESSAO) {
+    return false;
+  }
+
+  for (int i = 1; i <= MAX_SESSOES_AUTENTICADAS; i++) {
+    sessao_autenticada_t *sessao = &sessoes_autenticadas[i];
+
+    if (sessao->expira_us > agora &&
+        iguais_tempo_constante(sessao->cookie + strlen(NOME_COOKIE_SESSAO "="), token, TAM_TOKEN_SESSAO)) {
+      return true;
     }
-    esp_crypto_base64_encode(NULL, 0, &n, (const unsigned char *)user_info, strlen(user_info));
+  }
+  return false;
+}
+
+
+/*  Cria uma sessão e acrescenta o cookie à resposta.
+
+    Usa uma posição livre ou expirada; só se todas as sessões estiverem
+    em uso substitui a que expira primeiro.
+ */
+static void criar_sessao(httpd_req_t *req)
+{
+  int64_t agora = esp_timer_get_time();
+  int escolhida = 1;
 
-    /* 6: The length of the "Basic " string
-     * n: Number of bytes for a base64 encode format
-     * 1: Number of bytes for a reserved which be used to fill zero
-    */
-    digest = calloc(1, 6 + n + 1);
-    if (digest) {
-        strcpy(digest, "Basic ");
-        esp_crypto_base64_encode((unsigned char *)digest + 6, n, (size_t *)&out, (const unsigned char *)user_info, strlen(user_info));
+  for (int i = 1; i <= MAX_SESSOES_AUTENTICADAS; i++) {
+    if (sessoes_autenticadas[i].expira_us <= agora) {
+      escolhida = i;
+      break;
+    }
+    if (sessoes_autenticadas[i].expira_us < sessoes_autenticadas[escolhida].expira_us) {
+      escolhida = i;
     }
-    free(user_info);
-    return digest;
+  }
+
+  sessao_autenticada_t *sessao = &sessoes_autenticadas[escolhida];
+
+  snprintf(sessao->cookie, sizeof(sessao->cookie),
+           NOME_COOKIE_SESSAO "=%08" PRIx32 "%08" PRIx32 "; Max-Age=%d; Path=/; HttpOnly; SameSite=Strict",
+           esp_random(), esp_random(), DURACAO_SESSAO_S);
+  sessao->expira_us = agora + (int64_t)DURACAO_SESSAO_S * 1000000;
+
+  // O texto fica na tabela de sessões, válido até o envio da resposta
+  httpd_resp_set_hdr(req, "Set-Cookie", sessao->cookie);
 }
 
-/* An HTTP GET handler */
-static esp_err_t basic_auth_get_handler(httpd_req_t *req)
+
+/*  Verifica o cabeçalho Authorization.
+ */
+static bool credencial_valida(httpd_req_t *req)
 {
-    char *buf = NULL;
-    size_t buf_len = 0;
-    basic_auth_info_t *basic_auth_info = req->user_ctx;
+  char buf[TAM_CREDENCIAL];
+  size_t len = httpd_req_get_hdr_value_len(req, "Authorization");
 
-    buf_len = httpd_req_get_hdr_value_len(req, "Authorization") + 1;
-    if (buf_len > 1) {
-        buf = calloc(1, buf_len);
-        if (!buf) {
-            ESP_LOGE(TAG, "No enough memory for basic authorization");
-            return ESP_ERR_NO_MEM;
-        }
+  // O tamanho da credencial não é segredo: compara apenas se for igual
+  if (len_credencial_esperada == 0 || len != len_credencial_esperada ||
+      httpd_req_get_hdr_value_str(req, "Authorization", buf, sizeof(buf)) != ESP_OK) {
+    return false;
+  }
+  return iguais_tempo_constante(buf, credencial_esperada, len);
+}
 
-        if (httpd_req_get_hdr_value_str(req, "Authorization", buf, buf_len) == ESP_OK) {
-            ESP_LOGI(TAG, "Found header => Authorization: %s", buf);
-        } else {
-            ESP_LOGE(TAG, "No auth value received");
-        }
 
-        char *auth_credentials = http_auth_basic(basic_auth_info->username, basic_auth_info->password);
-        if (!auth_credentials) {
-            ESP_LOGE(TAG, "No enough memory for basic authorization credentials");
-            free(buf);
-            return ESP_ERR_NO_MEM;
-        }
+/*  Verifica se a solicitação está autenticada.
 
-        if (strncmp(auth_credentials, buf, buf_len)) {
-            ESP_LOGE(TAG, "Not authenticated");
-            httpd_resp_set_status(req, HTTPD_401);
-            httpd_resp_set_type(req, "application/json");
-            httpd_resp_set_hdr(req, "Connection", "keep-alive");
-            httpd_resp_set_hdr(req, "WWW-Authenticate", BASIC_REALM);
-            httpd_resp_send(req, NULL, 0);
-        } else {
-            ESP_LOGI(TAG, "Authenticated!");
-            char *basic_auth_resp = NULL;
-            httpd_resp_set_status(req, HTTPD_200);
-            httpd_resp_set_type(req, "application/json");
-            httpd_resp_set_hdr(req, "Connection", "keep-alive");
-            asprintf(&basic_auth_resp, "{\"authenticated\": true,\"user\": \"%s\"}", basic_auth_info->username);
-            if (!basic_auth_resp) {
-                ESP_LOGE(TAG, "No enough memory for basic authorization response");
-                free(auth_credentials);
-                free(buf);
-                return ESP_ERR_NO_MEM;
-            }
-            httpd_resp_send(req, basic_auth_resp, strlen(basic_auth_resp));
-            free(basic_auth_resp);
-        }
-        free(auth_credentials);
-        free(buf);
-    } else {
-        ESP_LOGE(TAG, "No auth header received");
-        httpd_resp_set_status(req, HTTPD_401);
-        httpd_resp_set_type(req, "application/json");
-        httpd_resp_set_hdr(req, "Connection", "keep-alive");
-        httpd_resp_set_hdr(req, "WWW-Authenticate", BASIC_REALM);
-        httpd_resp_send(req, NULL, 0);
-    }
+    Caso não esteja, envia a resposta 401 e retorna false.
+ */
+static bool autenticar(httpd_req_t *req, const httpd_uri_t *original)
+{
+  // Quadros WebSocket chegam depois do handshake, já autenticado
+  #if CONFIG_HTTPD_WS_SUPPORT
+  if (original->is_websocket && req->method != HTTP_GET) {
+    return true;
+  }
+  #endif
+
+  if (sessao_valida(req)) {
+    return true;
+  }
+  if (!credencial_valida(req)) {
+    ESP_LOGW(TAG, "Nao autenticado: %s", req->uri);
+    atomic_fetch_add_explicit(&metricas_gerais.nao_autenticadas, 1, memory_order_relaxed);
+    definir_status(req, HTTPD_401);
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_set_hdr(req, "WWW-Authenticate", BASIC_REALM);
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_send(req, NULL, 0);
+    return false;
+  }
+  criar_sessao(req);
+  return true;
+}
+
+
+/*  GET /basic_auth: confirma as credenciais (já verificadas em autenticar()).
+ */
+static esp_err_t basic_auth_get_handler(httpd_req_t *req)
+{
+    static const char resposta[] =
+      "{\"authenticated\": true,\"user\": \"" CONFIG_EXAMPLE_BASIC_AUTH_USERNAME "\"}";
+
+    definir_status(req, HTTPD_200);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Connection", "keep-alive");
+    httpd_resp_send(req, resposta, sizeof(resposta) - 1);
 
     return ESP_OK;
 }
 
-static httpd_uri_t basic_auth = {
+static const httpd_uri_t basic_auth = {
     .uri       = "/basic_auth",
     .method    = HTTP_GET,
-    .handler   = basic_auth_get_handler,
+    .handler   = basic_auth_get_handler
 };
 
-static void httpd_register_basic_auth(httpd_handle_t server)
-{
-    basic_auth_info_t *basic_auth_info = calloc(1, sizeof(basic_auth_info_t));
-    if (basic_auth_info) {
-        basic_auth_info->username = CONFIG_EXAMPLE_BASIC_AUTH_USERNAME;
-        basic_auth_info->password = CONFIG_EXAMPLE_BASIC_AUTH_PASSWORD;
+#endif
+
+// Arena de memória por conexão ----------------------------------------------
+
+/*  Cada conexão recebe, na primeira requisição, uma arena de memória
+    guardada no contexto da sessão (req->sess_ctx). As áreas de que uma
+    requisição precisa (query string, cabeçalhos, resposta) são tiradas
+    da arena por simples incremento, e a arena volta a ficar vazia no
+    início da requisição seguinte. A arena é liberada quando a conexão
+    é fechada.
+
+    Assim, não há malloc/free a cada requisição, e cada conexão tem sua
+    própria área de trabalho.
+ */
+
+// Amostras do histórico lidas e enviadas de cada vez
+#define AMOSTRAS_BLOCO_HISTORICO  (8)
+
+// Dígitos de um mapa de bits do histórico (o tipo depende do maior id)
+#define DIGITOS_MAPA_HISTORICO    (sizeof(mapa_historico_t) == 1 ? 3 : \
+                                   sizeof(mapa_historico_t) == 2 ? 5 : \
+                                   sizeof(mapa_historico_t) == 4 ? 10 : 20)
+
+// Tamanho de uma linha 'amostra=' de GET /historico: instante, duração,
+// quatro mapas de bits e os eventos de cada contador
+#define TAM_LINHA_HISTORICO       (40 + 4 * (1 + DIGITOS_MAPA_HISTORICO) + 11 * MAX_CONTADORES)
+#define TAM_BLOCO_HISTORICO       (AMOSTRAS_BLOCO_HISTORICO * TAM_LINHA_HISTORICO)
+
+// A arena comporta um bloco do histórico e a query string da requisição
+#define TAM_ARENA_SESSAO  MAX(1024, TAM_BLOCO_HISTORICO + 256)
+
+typedef struct {
+  size_t  usado;                        // Bytes ocupados na requisição corrente
+  enum classe_status classe_status;     // Status da resposta em andamento (métricas)
+  char    memoria[TAM_ARENA_SESSAO];
+} arena_sessao_t;
+
+
+// Tamanho do texto de um número inteiro seguido de '\n'
+#define TAM_NUMERO_TEXTO    (16)
+
+// Tamanho do texto de GET /status?mem=1
+#define TAM_ESTATISTICAS_MEMORIA  (576)
+
+// Tamanho do texto de GET /sensor?adc=: cinco linhas 'nome=número'
+#define TAM_LEITURA_ADC     (5 * (10 + TAM_NUMERO_TEXTO))
+
+// Tamanho do texto de GET /contador?stats=1: sete linhas 'nome=número' e o histograma
+#define TAM_ESTATISTICAS_CONTADOR  (7 * (16 + TAM_NUMERO_TEXTO) + 2 * (16 + FAIXAS_INTERVALO * 8))
+
+// Tamanho do texto de POST /regras: duas linhas 'nome=número' e as linhas rejeitadas
+#define TAM_RESPOSTA_REGRAS  ((2 + MAX_LINHAS_REJEITADAS) * (10 + TAM_NUMERO_TEXTO))
+
+// Tamanho do texto de GET /regras: seis linhas 'nome=número' e os disparos de cada regra
+#define TAM_ESTATISTICAS_REGRAS  (6 * (20 + TAM_NUMERO_TEXTO) + 16 + MAX_REGRAS * 12)
+
+// Tamanho do texto de GET /snapshot: nome da classe e um número por periférico
+#define TAM_SNAPSHOT_TEXTO  (3 * 16 + (MAX_SENSORES + MAX_CONTADORES + MAX_ATUADORES) * TAM_NUMERO_TEXTO)
+
+/*  Contadores de uso da memória, apresentados em GET /status?mem=1
+ */
+typedef struct {
+  uint32_t  arenas_criadas;             // Arenas alocadas (uma por conexão)
+  uint32_t  arenas_liberadas;           // Arenas liberadas ao fechar a conexão
+  uint32_t  alocacoes;                  // Áreas fornecidas pelas arenas
+  uint32_t  falhas;                     // Pedidos que não couberam na arena
+  uint32_t  maior_uso;                  // Maior ocupação de uma arena, em bytes
+} estatisticas_memoria_t;
+
+static estatisticas_memoria_t estatisticas_memoria = { 0 };
+
+
+/*  Libera a arena quando o servidor fecha a sessão.
+ */
+static void liberar_arena_sessao(void *ctx) {
+  estatisticas_memoria.arenas_liberadas++;
+  free(ctx);
+}
+
 
-        basic_auth.user_ctx = basic_auth_info;
-        httpd_register_uri_handler(server, &basic_auth);
+/*  Obtém a arena da conexão, vazia, para uma nova requisição.
+
+    Retorna NULL se não há memória para criar a arena.
+ */
+static arena_sessao_t *iniciar_arena(httpd_req_t *req) {
+  arena_sessao_t *arena = (arena_sessao_t *)req->sess_ctx;
+
+  if (arena == NULL) {
+    arena = malloc(sizeof(arena_sessao_t));
+    if (arena == NULL) {
+      ESP_LOGE(TAG, "Sem memória para a arena da conexão");
+      return NULL;
     }
+    estatisticas_memoria.arenas_criadas++;
+    req->sess_ctx = arena;
+    req->free_ctx = liberar_arena_sessao;
+  }
+  arena->usado = 0;
+  return arena;
 }
-#endif
 
-// Buffer que vai de servir de contexto para as mensagens, com área de rascunho.
-#define SCRATCH_BUFSIZE (4096)
 
-typedef struct rest_server_context {
-    char scratch[SCRATCH_BUFSIZE];
-} rest_server_context_t;
+/*  Anota a classe do status da resposta na arena da conexão.
+
+    Sem arena (faltou memória para criá-la), a resposta é contada como 2xx.
+ */
+static void anotar_classe_status(httpd_req_t *req, enum classe_status classe) {
+  arena_sessao_t *arena = (arena_sessao_t *)req->sess_ctx;
+
+  if (arena != NULL) {
+    arena->classe_status = classe;
+  }
+}
+
+
+/*  Reserva uma área na arena, válida até o fim da requisição.
+
+    Retorna NULL se a arena não existe ou não há espaço suficiente.
+ */
+static void *alocar_na_arena(arena_sessao_t *arena, size_t tamanho) {
+  // Mantém o alinhamento de 4 bytes para as próximas áreas
+  size_t tamanho_alinhado = (tamanho + 3) & ~((size_t)3);
+
+  if (arena == NULL || tamanho_alinhado > TAM_ARENA_SESSAO - arena->usado) {
+    estatisticas_memoria.falhas++;
+    return NULL;
+  }
+  void *area = &arena->memoria[arena->usado];
 
-static rest_server_context_t rest_context = { 0 };
+  arena->usado += tamanho_alinhado;
+  estatisticas_memoria.alocacoes++;
+  if (arena->usado > estatisticas_memoria.maior_uso) {
+    estatisticas_memoria.maior_uso = arena->usado;
+  }
+  return area;
+}
 
 
-/*  Preenche buffer com conteúdo de uma mensagem POST.
+/*  Obtém a query string da requisição, copiada para a arena.
 
-    Retorna o número de bytes lidos, ou -1 se houve erro.
+    Retorna NULL se não há query string ou se ela não coube na arena.
  */
-static int ler_conteudo_post(httpd_req_t *req, char *buf, int buf_size) {
-  int total_len = req->content_len;
-  int cur_len = 0;
-  
-  int received = 0;
-  
-  if (total_len >= buf_size) {
-    /* Respond with 500 Internal Server Error */
-    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Content too long");
-    return -1;
+static char *obter_query_na_arena(httpd_req_t *req, arena_sessao_t *arena) {
+  size_t buf_len = httpd_req_get_url_query_len(req) + 1;
+
+  if (buf_len <= 1) {
+    return NULL;
   }
-  while (cur_len < total_len) {
-    received = httpd_req_recv(req, buf + cur_len, total_len - cur_len);
+  char *buf = alocar_na_arena(arena, buf_len);
+
+  if (buf != NULL && httpd_req_get_url_query_str(req, buf, buf_len) != ESP_OK) {
+    return NULL;
+  }
+  return buf;
+}
+
+
+/*  Preenche o texto com os contadores de uso de memória.
+ */
+static void imprimir_estatisticas_memoria(char *buf, size_t buf_size) {
+  estatisticas_persistencia_t persistencia;
+  persistencia_estatisticas(&persistencia);
+
+  snprintf(buf, buf_size,
+           "heap_livre=%u\n"
+           "heap_minimo=%u\n"
+           "maior_bloco=%u\n"
+           "arenas_ativas=%u\n"
+           "arenas_criadas=%u\n"
+           "alocacoes_arena=%u\n"
+           "falhas_arena=%u\n"
+           "maior_uso_arena=%u\n"
+           "historico_bytes=%u\n"
+           "persist_gravacoes=%u\n"
+           "persist_bytes_registros=%u\n"
+           "persist_bytes_gravados=%u\n"
+           "persist_compactacoes=%u\n"
+           "persist_diario_bytes=%u\n"
+           "persist_registros_invalidos=%u\n"
+           "persist_restauracao_us=%lld\n"
+           "persist_restaurado_rtc=%d\n",
+           (unsigned)heap_caps_get_free_size(MALLOC_CAP_8BIT),
+           (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT),
+           (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT),
+           (unsigned)(estatisticas_memoria.arenas_criadas - estatisticas_memoria.arenas_liberadas),
+           (unsigned)estatisticas_memoria.arenas_criadas,
+           (unsigned)estatisticas_memoria.alocacoes,
+           (unsigned)estatisticas_memoria.falhas,
+           (unsigned)estatisticas_memoria.maior_uso,
+           (unsigned)historico_memoria(),
+           (unsigned)persistencia.gravacoes,
+           (unsigned)persistencia.bytes_registros,
+           (unsigned)persistencia.bytes_gravados,
+           (unsigned)persistencia.compactacoes,
+           (unsigned)persistencia.tamanho_diario,
+           (unsigned)persistencia.registros_invalidos,
+           (long long)persistencia.restauracao_us,
+           persistencia.restaurado_rtc ? 1 : 0);
+}
+
+
+/*  Lê o conteúdo de uma mensagem POST, repassando ao leitor os parâmetros
+    'nome = valor' à medida que os blocos chegam da conexão.
+
+    Não há limite para o tamanho do conteúdo, e nada é alocado.
+
+    Retorna o número de linhas descartadas pelo leitor, ou -1 se houve erro
+    de comunicação (nesse caso, a resposta de erro já foi enviada).
+ */
+static int receber_parametros(httpd_req_t *req, leitor_parametros_t *leitor) {
+  char   bloco[128];
+  size_t restante = req->content_len;
+
+  while (restante > 0) {
+    int received = httpd_req_recv(req, bloco, MIN(restante, sizeof(bloco)));
+
+    if (received == HTTPD_SOCK_ERR_TIMEOUT) {
+      // Tenta novamente, a conexão pode estar apenas lenta
+      continue;
+    }
     if (received <= 0) {
         /* Respond with 500 Internal Server Error */
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Client failed to post request content");
+        enviar_erro(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Client failed to post request content");
         return -1;
     }
-    cur_len += received;
+    leitor_parametros_consumir(leitor, bloco, received);
+    restante -= received;
   }
-  buf[total_len] = '\0';
 
-  return total_len;
+  int erros = leitor_parametros_terminar(leitor);
+
+  if (erros > 0) {
+    atomic_fetch_add_explicit(&metricas_gerais.parametros_invalidos, erros, memory_order_relaxed);
+  }
+  return erros;
 }
 
 
+/*  Como receber_parametros, com um leitor comum que repassa cada
+    parâmetro a tratar.
+ */
+static int ler_parametros_post(httpd_req_t *req, leitor_parametros_cb_t tratar, void *contexto) {
+  leitor_parametros_t leitor;
+
+  leitor_parametros_iniciar(&leitor, tratar, contexto);
+  return receber_parametros(req, &leitor);
+}
+
 /*  Preencher os cabeçalhos padrão de uma resposta de tipo texto.
     Acrescenta permissões de controle de acesso.
  */
 static void preencher_cabecalho_text_plain(httpd_req_t *req) {
     httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-    httpd_resp_set_hdr(req, "Access-Control-Allow-Methods", "GET,HEAD,POST");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Methods", "GET,HEAD,POST,OPTIONS");
+    httpd_resp_set_hdr(req, "Access-Control-Expose-Headers", "ETag");
     httpd_resp_set_hdr(req, "Content-Type", "text/plain");
 }
 
 
+#define HTTPD_304   "304 Not Modified"
+
+#define TAM_ETAG    (16)        // "v" + versão em decimal, entre aspas
+
+/*  Resposta condicional (ETag / If-None-Match).
+
+    etag_corresponde() verifica se o cliente já tem a resposta com o ETag
+    indicado. responder_se_nao_modificado() usa como ETag a versão do
+    estado dos periféricos.
+
+    O ETag de uma resposta é a versão do estado dos periféricos lida antes
+    de montar o conteúdo. Se o cliente já tem essa versão (If-None-Match),
+    responde 304 sem conteúdo e retorna true; o handler não deve enviar
+    mais nada. Caso contrário, acrescenta o ETag à resposta e retorna false.
+ */
+static bool etag_corresponde(httpd_req_t *req, arena_sessao_t *arena, const char *etag) {
+  size_t buf_len = httpd_req_get_hdr_value_len(req, "If-None-Match") + 1;
+
+  if (buf_len > 1) {
+    char *buf = alocar_na_arena(arena, buf_len);
+
+    // Aceita listas de ETags e ETags fracos (W/"...")
+    return (buf != NULL && httpd_req_get_hdr_value_str(req, "If-None-Match", buf, buf_len) == ESP_OK &&
+            strstr(buf, etag) != NULL);
+  }
+  return false;
+}
+
+
+static bool responder_se_nao_modificado(httpd_req_t *req, arena_sessao_t *arena, uint32_t versao) {
+  char *etag = alocar_na_arena(arena, TAM_ETAG);
+
+  if (etag == NULL) {
+    // Sem ETag, a resposta segue completa
+    return false;
+  }
+  snprintf(etag, TAM_ETAG, "\"v%" PRIu32 "\"", versao);
+
+  if (etag_corresponde(req, arena, etag)) {
+    preencher_cabecalho_text_plain(req);
+    httpd_resp_set_hdr(req, "ETag", etag);
+    definir_status(req, HTTPD_304);
+    httpd_resp_send(req, NULL, 0);
+    return true;
+  }
+  httpd_resp_set_hdr(req, "ETag", etag);
+  return false;
+}
+
+
 /*  Trata GET /status[?<dev>=<id>].
 
     Retorna texto descrevendo o status do micro-controlador.
@@ -313,27 +957,25 @@ static esp_err_t get_status_handler(httpd_req_t *req)
     int periferico = PRF_NDEF;
     int id_perif = 0;
 
-    // Resposta padrão, a que veio no contexto do pedido.
-    const char* resp_str = (const char*) req->user_ctx;
+    arena_sessao_t *arena = iniciar_arena(req);
+
+    // Resposta padrão, caso nenhum parâmetro conhecido seja indicado.
+    const char* resp_str = "";
 
     /* Get header value string length and allocate memory for length + 1,
      * extra byte for null termination */
     buf_len = httpd_req_get_hdr_value_len(req, "Host") + 1;
     if (buf_len > 1) {
-        buf = malloc(buf_len);
+        buf = alocar_na_arena(arena, buf_len);
         /* Copy null terminated value string into buffer */
-        if (httpd_req_get_hdr_value_str(req, "Host", buf, buf_len) == ESP_OK) {
+        if (buf != NULL && httpd_req_get_hdr_value_str(req, "Host", buf, buf_len) == ESP_OK) {
             // ESP_LOGI(TAG, "Found header => Host: %s", buf);
         }
-        free(buf);
     }
 
-    /* Read URL query string length and allocate memory for length + 1,
-     * extra byte for null termination */
-    buf_len = httpd_req_get_url_query_len(req) + 1;
-    if (buf_len > 1) {
-        buf = malloc(buf_len);
-        if (httpd_req_get_url_query_str(req, buf, buf_len) == ESP_OK) {
+    if (httpd_req_get_url_query_len(req) > 0) {
+        buf = obter_query_na_arena(req, arena);
+        if (buf != NULL) {
             // ESP_LOGI(TAG, "Found URL query => %s", buf);
             char param[32];
 
@@ -372,19 +1014,31 @@ static esp_err_t get_status_handler(httpd_req_t *req)
               ESP_LOGD(TAG, "Valor do sensor %d: %d", id_perif, valor);
               resp_str = mensagens_locais[valor_sensor_para_msg(valor)];
             }
+
+            if (httpd_query_key_value(buf, "mem", param, sizeof(param)) == ESP_OK) {
+              // GET /status?mem=1 - Uso da memória pelo servidor
+              char *texto = alocar_na_arena(arena, TAM_ESTATISTICAS_MEMORIA);
+
+              if (texto != NULL) {
+                imprimir_estatisticas_memoria(texto, TAM_ESTATISTICAS_MEMORIA);
+                resp_str = texto;
+              }
+            }
+        } else {
+            resp_str = mensagens_locais[MSGL_PARAMETRO_INVALIDO];
         }
-        free(buf);
     } else {
       /* GET /status (sem parâmetros)
          Devolvemos o status da placa de controle
       */
+      if (responder_se_nao_modificado(req, arena, controle_gpio_versao())) {
+        return ESP_OK;
+      }
       resp_str = controle_gpio_status();
     }
 
     preencher_cabecalho_text_plain(req);
 
-    /* Send response with custom headers and body set as the
-     * string passed in user context*/
     httpd_resp_send(req, resp_str, HTTPD_RESP_USE_STRLEN);
     return ESP_OK;
 }
@@ -392,50 +1046,89 @@ static esp_err_t get_status_handler(httpd_req_t *req)
 static const httpd_uri_t get_status_uri = {
     .uri       = "/status",
     .method    = HTTP_GET,
-    .handler   = get_status_handler,
-    .user_ctx  = &rest_context
+    .handler   = get_status_handler
 };
 
 
-/*  Trata GET /sensor?id=<identificador>.
+/*  Trata GET /sensor?adc=<identificador>.
 
-    Lê o valor de um sensor, retornando 0 se desligado e 1 se ligado.
+    Lê a última leitura publicada de um sensor analógico, sem aguardar
+    conversões.
+ */
+static esp_err_t get_sensor_adc(httpd_req_t *req, arena_sessao_t *arena, const char *param)
+{
+  leitura_adc_t leitura;
+  int id_sensor = atoi(param);
+  char *resposta = NULL;
+
+  preencher_cabecalho_text_plain(req);
+
+  if (id_sensor < 1 || id_sensor > MAX_SENSORES_ADC) {
+    definir_status(req, mensagens_locais[MSGL_PARAMETRO_INVALIDO]);
+    httpd_resp_send(req, "\n", HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+  }
+  // Sem saídas do filtro: conversor ausente ou ainda iniciando
+  if (!sensor_adc_ler(id_sensor, &leitura) ||
+      (resposta = alocar_na_arena(arena, TAM_LEITURA_ADC)) == NULL) {
+    definir_status(req, mensagens_locais[MSGL_INDISPONIVEL]);
+    httpd_resp_send(req, "\n", HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+  }
+  snprintf(resposta, TAM_LEITURA_ADC,
+           "valor=%u\nminimo=%u\nmaximo=%u\nmedia=%u\namostras=%" PRIu64 "\n",
+           leitura.valor, leitura.minimo, leitura.maximo, leitura.media, leitura.amostras);
+
+  httpd_resp_send(req, resposta, HTTPD_RESP_USE_STRLEN);
+  return ESP_OK;
+}
+
+
+/*  Trata GET /sensor?id=<identificador>.
+
+    Lê o valor de um sensor, retornando 0 se desligado e 1 se ligado.
     id é o identificador do sensor a ser lido, começando de 1
+
+    Com adc=<identificador>, lê um sensor analógico (get_sensor_adc).
  */
 static esp_err_t get_sensor_handler(httpd_req_t *req)
 {
   char*  buf;
-  size_t buf_len;
   
   int resposta = MSGL_OK;
+
+  arena_sessao_t *arena = iniciar_arena(req);
   
-  /* Read URL query string length and allocate memory for length + 1,
-   * extra byte for null termination */
-  buf_len = httpd_req_get_url_query_len(req) + 1;
-  if (buf_len > 1) {
-    buf = malloc(buf_len);
-
-    if (httpd_req_get_url_query_str(req, buf, buf_len) == ESP_OK) {
-      char param[32];
-
-      // ESP_LOGI(TAG, "Found URL query => %s", buf);
-
-      /* Obter id do sensor a ser lido */
-      if (httpd_query_key_value(buf, "id", param, sizeof(param)) == ESP_OK) {
-        int id_sensor = atoi(param);
-        int valor = controle_gpio_ler_sensor(id_sensor);
-        
-        // ESP_LOGI(TAG, "Valor do sensor %d: %d", id_sensor, valor);
-        
-        if (valor == 0 || valor == 1 ) {
-          // Nota: Apenas 0 e 1 são valores válidos nesta implementação.
-          resposta = valor_sensor_para_msg(valor);
+  buf = obter_query_na_arena(req, arena);
+  if (buf != NULL) {
+    char param[32];
+
+    // ESP_LOGI(TAG, "Found URL query => %s", buf);
+
+    if (httpd_query_key_value(buf, "adc", param, sizeof(param)) == ESP_OK) {
+      return get_sensor_adc(req, arena, param);
+    }
+
+    /* Obter id do sensor a ser lido */
+    if (httpd_query_key_value(buf, "id", param, sizeof(param)) == ESP_OK) {
+      estado_placa_t estado;
+      int id_sensor = atoi(param);
+      // Valor e versão (ETag) da mesma publicação do estado
+      uint32_t versao = controle_gpio_ler_estado(&estado);
+      int valor = (id_sensor > 0 && id_sensor <= MAX_SENSORES) ? estado.sensores[id_sensor] : -1;
+      
+      // ESP_LOGI(TAG, "Valor do sensor %d: %d", id_sensor, valor);
+      
+      if (valor == 0 || valor == 1 ) {
+        // Nota: Apenas 0 e 1 são valores válidos nesta implementação.
+        if (responder_se_nao_modificado(req, arena, versao)) {
+          return ESP_OK;
         }
-      } else {
-        resposta = MSGL_FALTAM_PARAMETROS;
+        resposta = valor_sensor_para_msg(valor);
       }
+    } else {
+      resposta = MSGL_FALTAM_PARAMETROS;
     }
-    free(buf);
   } else {
     resposta = MSGL_FALTAM_PARAMETROS;
   }
@@ -444,7 +1137,7 @@ static esp_err_t get_sensor_handler(httpd_req_t *req)
   preencher_cabecalho_text_plain(req);
 
   if (resposta > MSGL_OK) {
-    httpd_resp_set_status(req, "400 BAD REQUEST");
+    definir_status(req, "400 BAD REQUEST");
   }
   httpd_resp_send(req, mensagens_locais[resposta], HTTPD_RESP_USE_STRLEN);
   return ESP_OK;
@@ -454,46 +1147,127 @@ static esp_err_t get_sensor_handler(httpd_req_t *req)
 static const httpd_uri_t get_sensor_uri = {
     .uri       = "/sensor",
     .method    = HTTP_GET,
-    .handler   = get_sensor_handler,
-    .user_ctx  = &rest_context
+    .handler   = get_sensor_handler
 };
 
 
+/*  Acrescenta ao texto uma linha 'nome=v1,v2,...' com os valores indicados.
+
+    valores[1..quantidade] são impressos; valores[0] não é utilizado.
+    Retorna o número de caracteres escritos no buffer.
+ */
+static int imprimir_lista_valores(char *buf, size_t buf_size, const char *nome,
+                                  const int *valores, int quantidade) {
+  int total = snprintf(buf, buf_size, "%s=", nome);
+
+  for (int id = 1; id <= quantidade && total < (int)buf_size; id++) {
+    total += snprintf(buf + total, buf_size - total, (id > 1) ? ",%d" : "%d", valores[id]);
+  }
+  if (total < (int)buf_size) {
+    total += snprintf(buf + total, buf_size - total, "\n");
+  }
+  return total;
+}
+
+
+/*  Trata GET /contador?id=<identificador>&stats=1.
+
+    Lê as estatísticas publicadas de um contador.
+ */
+static esp_err_t get_contador_estatisticas(httpd_req_t *req, arena_sessao_t *arena, int id_contador)
+{
+  estatisticas_contador_t estatisticas;
+  char *resposta = NULL;
+  int len = 0;
+
+  preencher_cabecalho_text_plain(req);
+
+  if (!controle_gpio_estatisticas_contador(id_contador, &estatisticas)) {
+    definir_status(req, mensagens_locais[MSGL_PARAMETRO_INVALIDO]);
+    httpd_resp_send(req, "\n", HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+  }
+  resposta = alocar_na_arena(arena, TAM_ESTATISTICAS_CONTADOR);
+  if (resposta == NULL) {
+    definir_status(req, mensagens_locais[MSGL_INDISPONIVEL]);
+    httpd_resp_send(req, "\n", HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+  }
+
+  len = snprintf(resposta, TAM_ESTATISTICAS_CONTADOR,
+                 "total=%" PRId64 "\nultimo_segundo=%" PRIu32 "\nultimo_minuto=%" PRIu32
+                 "\nultima_hora=%" PRIu32 "\ntaxa_1min=%.2f\ntaxa_5min=%.2f\ntaxa_15min=%.2f\n",
+                 estatisticas.contagem, estatisticas.ultimo_segundo, estatisticas.ultimo_minuto,
+                 estatisticas.ultima_hora, estatisticas.taxa_1min, estatisticas.taxa_5min,
+                 estatisticas.taxa_15min);
+
+  // imprimir_lista_valores usa os índices de 1 em diante, como as tabelas de periféricos
+  int valores[FAIXAS_INTERVALO + 1];
+
+  for (int faixa = 0; faixa < FAIXAS_INTERVALO; faixa++) {
+    valores[faixa + 1] = (int)controle_gpio_faixas_intervalo_ms[faixa];
+  }
+  len += imprimir_lista_valores(resposta + len, TAM_ESTATISTICAS_CONTADOR - len, "faixas_ms",
+                                valores, FAIXAS_INTERVALO);
+  for (int faixa = 0; faixa < FAIXAS_INTERVALO; faixa++) {
+    valores[faixa + 1] = (int)estatisticas.intervalos[faixa];
+  }
+  imprimir_lista_valores(resposta + len, TAM_ESTATISTICAS_CONTADOR - len, "intervalos",
+                         valores, FAIXAS_INTERVALO);
+
+  httpd_resp_send(req, resposta, HTTPD_RESP_USE_STRLEN);
+  return ESP_OK;
+}
+
+
 /*  Trata GET /contador?id=<identificador>.
 
     Lê a contagem de eventos de um contador.
     id é o identificador do contador a ser lido, começando de 1
+
+    Com stats=1, lê as estatísticas do contador (get_contador_estatisticas).
  */
 static esp_err_t get_contador_handler(httpd_req_t *req)
 {
   char*  buf;
-  size_t buf_len;
   
   int status =  MSGL_OK;
-  char*  resposta = ((rest_server_context_t *)(req->user_ctx))->scratch;
+  char*  resposta = NULL;
+
+  arena_sessao_t *arena = iniciar_arena(req);
   
-  /* Read URL query string length and allocate memory for length + 1,
-   * extra byte for null termination */
-  buf_len = httpd_req_get_url_query_len(req) + 1;
-  if (buf_len > 1) {
-    buf = malloc(buf_len);
+  buf = obter_query_na_arena(req, arena);
+  if (buf != NULL) {
+    char param[32];
+
+    /* Obter id do contador a ser lido */
+    if (httpd_query_key_value(buf, "id", param, sizeof(param)) == ESP_OK) {
+      int id_contador = atoi(param);
+
+      if (httpd_query_key_value(buf, "stats", param, sizeof(param)) == ESP_OK &&
+          strcmp(param, "1") == 0) {
+        return get_contador_estatisticas(req, arena, id_contador);
+      }
 
-    if (httpd_req_get_url_query_str(req, buf, buf_len) == ESP_OK) {
-      char param[32];
+      estado_placa_t estado;
+      uint32_t versao = controle_gpio_ler_estado(&estado);
+      int valor = (id_contador > 0 && id_contador <= MAX_CONTADORES) ? estado.contadores[id_contador] : -1;
 
-      /* Obter id do contador a ser lido */
-      if (httpd_query_key_value(buf, "id", param, sizeof(param)) == ESP_OK) {
-        int id_contador = atoi(param);
-        int valor = controle_gpio_ler_contador(id_contador);
-        
-        // ESP_LOGI(TAG, "Valor do contador %d: %d", id_contador, valor);
+      if (valor >= 0 && responder_se_nao_modificado(req, arena, versao)) {
+        return ESP_OK;
+      }
+      
+      // ESP_LOGI(TAG, "Valor do contador %d: %d", id_contador, valor);
 
-        snprintf(resposta, SCRATCH_BUFSIZE, "%d\n", valor);       
+      resposta = alocar_na_arena(arena, TAM_NUMERO_TEXTO);
+      if (resposta != NULL) {
+        snprintf(resposta, TAM_NUMERO_TEXTO, "%d\n", valor);
       } else {
-        status = MSGL_FALTAM_PARAMETROS;
+        status = MSGL_INDISPONIVEL;
       }
+    } else {
+      status = MSGL_FALTAM_PARAMETROS;
     }
-    free(buf);
   } else {
     status = MSGL_FALTAM_PARAMETROS;
   }
@@ -503,7 +1277,7 @@ static esp_err_t get_contador_handler(httpd_req_t *req)
 
   if (status > MSGL_OK) {
     resposta = "\n";
-    httpd_resp_set_status(req, mensagens_locais[status]);
+    definir_status(req, mensagens_locais[status]);
   }
   httpd_resp_send(req, resposta, HTTPD_RESP_USE_STRLEN);
   return ESP_OK;
@@ -513,390 +1287,1736 @@ static esp_err_t get_contador_handler(httpd_req_t *req)
 static const httpd_uri_t get_contador_uri = {
     .uri       = "/contador",
     .method    = HTTP_GET,
-    .handler   = get_contador_handler,
-    .user_ctx  = &rest_context
+    .handler   = get_contador_handler
 };
 
 
-/*  Trata POST /contador(id)
-
-    action=reset
-
-    Reinicia a contagem de eventos.
-    id é o identificador do contador, começando em 1.
+/*  Trata GET /snapshot
 
-    Parâmetros:
-      id_perif - identificador do periférico.
-      req - requisição de serviço vinda do cliente.
+    Lê todos os sensores, contadores e atuadores de uma só vez, evitando
+    que o cliente faça uma solicitação para cada periférico.
  */
-static esp_err_t post_contador_n_handler(int id_perif, httpd_req_t *req) {
-  // Prepara área de rascunho
-  char*  buf = ((rest_server_context_t *)(req->user_ctx))->scratch;
-  char*  saved_ptr;
-  
-  bool aplicar_reset = false;
-  
-  int resposta = MSGL_CREATED;
-  
-  int received = ler_conteudo_post(req, buf, SCRATCH_BUFSIZE);
-  
-  if (received < 0) {
-    return ESP_FAIL;
-  }
-  
-  // Percorrendo linhas do conteúdo
-  char *linha = strtok_r(buf, "\n", &saved_ptr);
-  
-  while (linha != NULL) {
+static esp_err_t get_snapshot_handler(httpd_req_t *req)
+{
+  estado_placa_t estado;
+  int    len = 0;
 
-    if (strcmp(linha, "action=reset") == 0) {
-      aplicar_reset = true;
+  arena_sessao_t *arena = iniciar_arena(req);
+  char*  resposta = alocar_na_arena(arena, TAM_SNAPSHOT_TEXTO);
 
-      // ESP_LOGI(TAG, "Ação sobre contador: reset");
-    } else if (strlen(linha) > 0) {
-      ESP_LOGE(TAG, "Parâmetro desconhecido por contador: %s", linha);
-    }
-    linha = strtok_r(NULL, "\n", &saved_ptr);
+  if (resposta == NULL) {
+    enviar_erro(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Sem memoria");
+    return ESP_OK;
   }
 
-  if (aplicar_reset) {
-        controle_gpio_reiniciar_contador(id_perif);
+  // A versão vem da mesma publicação do estado: o ETag corresponde
+  // sempre ao conteúdo enviado.
+  if (responder_se_nao_modificado(req, arena, controle_gpio_ler_estado(&estado))) {
+    return ESP_OK;
   }
+
+  len += imprimir_lista_valores(resposta + len, TAM_SNAPSHOT_TEXTO - len, "sensores",
+                                estado.sensores, MAX_SENSORES);
+  len += imprimir_lista_valores(resposta + len, TAM_SNAPSHOT_TEXTO - len, "contadores",
+                                estado.contadores, MAX_CONTADORES);
+  len += imprimir_lista_valores(resposta + len, TAM_SNAPSHOT_TEXTO - len, "atuadores",
+                                estado.atuadores, MAX_ATUADORES);
+
   // Preparar cabeçalhos da resposta
   preencher_cabecalho_text_plain(req);
 
-  if (resposta >= MSGL_OK) {
-    httpd_resp_set_status(req, mensagens_locais[resposta]);
-  }
-  httpd_resp_sendstr(req, mensagens_locais[resposta]);
+  httpd_resp_send(req, resposta, HTTPD_RESP_USE_STRLEN);
   return ESP_OK;
 }
 
 
-static esp_err_t post_contador1_handler(httpd_req_t *req) {
-  return post_contador_n_handler(1, req);
-}
-
-
-static const httpd_uri_t post_contador1_uri = {
-    .uri       = "/contador1",
-    .method    = HTTP_POST,
-    .handler   = post_contador1_handler,
-    .user_ctx  = &rest_context
+static const httpd_uri_t get_snapshot_uri = {
+    .uri       = "/snapshot",
+    .method    = HTTP_GET,
+    .handler   = get_snapshot_handler
 };
 
 
-// Tratamento de Atuadores ----------------------------------------------------
-enum acao_atuador {
-  ACAO_ATUADOR_OFF,             // Esta deve ser sempre a primeira
-  ACAO_ATUADOR_ON,
-  ACAO_ATUADOR_TOGGLE,
-  ACAO_ATUADOR_PULSE,
-  ACAO_ATUADOR_NOP              // Esta deve ser sempre a última
-};
+// Eventos enviados aos clientes (Server-Sent Events) -------------------------
 
+#define MAX_ASSINANTES_EVENTOS  4       // Conexões GET /eventos simultâneas
+#define MAX_EVENTOS_PENDENTES   32      // Eventos aguardando envio pela tarefa do servidor
+#define PILHA_TAREFA_EVENTOS    (2048)
+#define PRIORIDADE_TAREFA_EVENTOS (tskIDLE_PRIORITY + 5)  // A mesma do servidor
 
-// Este array deve coincidir com o enumerado acima.
-const char *acoes_conhecidas [] = {
-  "off",
-  "on",
-  "toggle",
-  "pulse",
-  "no action"
+typedef struct {
+  enum periferico classe;
+  int   id;
+  int   valor;
+} evento_periferico_t;
+
+// Nomes dos eventos enviados. Deve coincidir com o enumerado periferico.
+static const char *nomes_eventos[] = {
+  "ndef",
+  "atuador",
+  "contador",
+  "sensor"
 };
 
+#define CABECALHO_EVENTOS "HTTP/1.1 200 OK\r\n" \
+                          "Content-Type: text/event-stream\r\n" \
+                          "Cache-Control: no-cache\r\n" \
+                          "Access-Control-Allow-Origin: *\r\n" \
+                          "Connection: keep-alive\r\n\r\n"
 
-/*  Trata POST /atuador(id)
+// Servidor em execução, para onde os eventos são enviados.
+static httpd_handle_t servidor_ativo = NULL;
 
-    action=(on/off/toggle/pulse)
-    duration=(tempo em ms)
+// Sockets das conexões que assinaram os eventos (-1 indica posição livre)
+static int assinantes_eventos[MAX_ASSINANTES_EVENTOS];
+static int num_assinantes_eventos = 0;
 
-    Modifica o estado de um atuador.
-    id é o identificador do atuador, começando em 1.
+#if CONFIG_HTTPD_WS_SUPPORT
 
-    Parâmetros:
-      id_perif - identificador do periférico.
-      req - requisição de serviço vinda do cliente.
+#define MAX_CLIENTES_WS   4             // Conexões WebSocket /controle simultâneas
+#define TAM_QUADRO_DESCARTE 64          // Maior quadro inválido descartado sem fechar a conexão
+
+/*  Quadro binário de comando recebido pelo canal WebSocket.
  */
-static esp_err_t post_atuador_n_handler(int id_perif, httpd_req_t *req) {
-  // Prepara área de rascunho
-  char*  buf = ((rest_server_context_t *)(req->user_ctx))->scratch;
-  char*  saved_ptr;
+typedef struct __attribute__((packed)) {
+  uint8_t   id;                         // Identificador do atuador
+  uint8_t   acao;                       // Ação (enum acao_atuador)
+  uint16_t  sequencia;                  // Número de sequência do comando
+  uint32_t  duracao;                    // Duração do pulso em ms
+} quadro_comando_t;
+
+/*  Quadro binário de estado enviado pelo canal WebSocket.
+ */
+typedef struct __attribute__((packed)) {
+  uint8_t   classe;                     // Classe do periférico (enum periferico)
+  uint8_t   id;                         // Identificador do periférico
+  uint16_t  sequencia;                  // Comando confirmado, ou 0 em notificações
+  int32_t   valor;                      // Novo valor, -1 se o comando foi rejeitado ou
+                                        // -2 se foi descartado sem execução (HTTP 503)
+} quadro_estado_t;
 
-  char   param[16];
-  char   valor[16];
-  
-  int acao = ACAO_ATUADOR_NOP;
-  int duracao = 0;
-  
-  int resposta = MSGL_CREATED;
-  
-  int received = ler_conteudo_post(req, buf, SCRATCH_BUFSIZE);
-  
-  if (received < 0) {
-    return ESP_FAIL;
-  }
-  
-  // Percorrendo linhas do conteúdo
-  char *linha = strtok_r(buf, "\n", &saved_ptr);
-  
-  while (linha != NULL) {
+// Sockets das conexões WebSocket abertas (-1 indica posição livre)
+static int clientes_ws[MAX_CLIENTES_WS];
+static int num_clientes_ws = 0;
 
-    // Lê diretivas do tipo 'param = valor'
-    int count = sscanf(linha, "%15[^= ] = %15[^\n]", param, valor);
-    
-    if (count == 2) {
-      if (strcmp(param, "action") == 0) {
-        // ESP_LOGI(TAG, "Ação sobre atuador: %s", param);
-        
-        acao = ACAO_ATUADOR_OFF;    // Começa da primeira ação conhecida
-        
-        while (acao < ACAO_ATUADOR_NOP) {
-          if (strcmp(acoes_conhecidas[acao], valor) == 0) {
-            break;
-          }
-          acao++;
-        }      
-      } else if (strcmp(param, "duration") == 0) {
-        // ESP_LOGI(TAG, "Duração: %s", valor);
-        duracao = atoi(valor);
-      } else if (strlen(linha) > 0) {
-        ESP_LOGE(TAG, "Parâmetro desconhecido por atuador: %s", linha);
-      }
+
+/*  Retira um cliente WebSocket da lista, quando sua conexão é fechada.
+ */
+static void remover_cliente_ws(int sockfd) {
+  for (int i = 0; i < MAX_CLIENTES_WS; i++) {
+    if (clientes_ws[i] == sockfd) {
+      clientes_ws[i] = -1;
+      num_clientes_ws--;
     }
-    linha = strtok_r(NULL, "\n", &saved_ptr);
   }
+}
 
-  switch (acao) {
-    case ACAO_ATUADOR_OFF:
-        controle_gpio_mudar_atuador(id_perif, 0);
-      break;
-    case ACAO_ATUADOR_ON:
-        controle_gpio_mudar_atuador(id_perif, 1);
-      break;
-    case ACAO_ATUADOR_TOGGLE:
-        controle_gpio_alternar_atuador(id_perif);
-      break;
-    case ACAO_ATUADOR_PULSE:
-        if (duracao > 0) {
-          controle_gpio_pulsar_atuador(id_perif, duracao);
-        } else {
-          ESP_LOGE(TAG, "Duração inválida para pulso do atuador.");
-        }
-      break;
-    case ACAO_ATUADOR_NOP:
-      ESP_LOGE(TAG, "Ação desconhecida por atuador.");
-      break;
-  }
-  // Preparar cabeçalhos da resposta
-  preencher_cabecalho_text_plain(req);
 
-  if (resposta >= MSGL_OK) {
-    httpd_resp_set_status(req, mensagens_locais[resposta]);
+/*  Envia um evento a todos os clientes WebSocket, como quadro de estado.
+ */
+static void enviar_evento_ws(const evento_periferico_t *evento) {
+  quadro_estado_t estado = {
+    .classe = evento->classe,
+    .id = evento->id,
+    .sequencia = 0,
+    .valor = evento->valor
+  };
+  httpd_ws_frame_t quadro = {
+    .final = true,
+    .type = HTTPD_WS_TYPE_BINARY,
+    .payload = (uint8_t *)&estado,
+    .len = sizeof(estado)
+  };
+
+  for (int i = 0; i < MAX_CLIENTES_WS; i++) {
+    int sockfd = clientes_ws[i];
+
+    if (sockfd >= 0 && httpd_ws_send_frame_async(servidor_ativo, sockfd, &quadro) != ESP_OK) {
+      ESP_LOGI(TAG, "Cliente WebSocket desconectado: %d", sockfd);
+      remover_cliente_ws(sockfd);
+      httpd_sess_trigger_close(servidor_ativo, sockfd);
+    }
   }
-  httpd_resp_sendstr(req, mensagens_locais[resposta]);
-  return ESP_OK;
 }
+#endif
 
+// Fila circular de eventos, preenchida pelo observador dos periféricos
+static evento_periferico_t eventos_pendentes[MAX_EVENTOS_PENDENTES];
+static int  inicio_eventos = 0;
+static int  num_eventos = 0;
+static bool envio_agendado = false;
+static portMUX_TYPE trava_eventos = portMUX_INITIALIZER_UNLOCKED;
 
-static esp_err_t post_atuador1_handler(httpd_req_t *req) {
-  return post_atuador_n_handler(1, req);
-}
+// Tarefa que agenda o envio na tarefa do servidor (NULL na simulação)
+static TaskHandle_t tarefa_eventos = NULL;
 
 
-static const httpd_uri_t post_atuador1_uri = {
-    .uri       = "/atuador1",
-    .method    = HTTP_POST,
-    .handler   = post_atuador1_handler,
-    .user_ctx  = &rest_context
-};
+/*  Retira um assinante da lista, quando sua conexão é fechada.
+ */
+static void remover_assinante_eventos(int sockfd) {
+  for (int i = 0; i < MAX_ASSINANTES_EVENTOS; i++) {
+    if (assinantes_eventos[i] == sockfd) {
+      assinantes_eventos[i] = -1;
+      num_assinantes_eventos--;
+    }
+  }
+}
 
 
-static esp_err_t post_atuador2_handler(httpd_req_t *req) {
-  return post_atuador_n_handler(2, req);
-}
+/*  Envia os eventos pendentes a todos os assinantes.
 
+    Executada na tarefa do servidor HTTP, através de httpd_queue_work().
+ */
+static void enviar_eventos(void *arg) {
+  evento_periferico_t evento;
+  char linha[64];
+
+  for (;;) {
+    portENTER_CRITICAL(&trava_eventos);
+    if (num_eventos == 0) {
+      envio_agendado = false;
+      portEXIT_CRITICAL(&trava_eventos);
+      break;
+    }
+    evento = eventos_pendentes[inicio_eventos];
+    inicio_eventos = (inicio_eventos + 1) % MAX_EVENTOS_PENDENTES;
+    num_eventos--;
+    portEXIT_CRITICAL(&trava_eventos);
 
-static const httpd_uri_t post_atuador2_uri = {
-    .uri       = "/atuador2",
-    .method    = HTTP_POST,
-    .handler   = post_atuador2_handler,
-    .user_ctx  = &rest_context
-};
+    int len = snprintf(linha, sizeof(linha), "event: %s\ndata: %d=%d\n\n",
+                       nomes_eventos[evento.classe], evento.id, evento.valor);
 
+    for (int i = 0; i < MAX_ASSINANTES_EVENTOS; i++) {
+      int sockfd = assinantes_eventos[i];
 
-static esp_err_t post_atuador3_handler(httpd_req_t *req) {
-  return post_atuador_n_handler(3, req);
+      if (sockfd >= 0 && httpd_socket_send(servidor_ativo, sockfd, linha, len, 0) < 0) {
+        ESP_LOGI(TAG, "Assinante de eventos desconectado: %d", sockfd);
+        remover_assinante_eventos(sockfd);
+        httpd_sess_trigger_close(servidor_ativo, sockfd);
+      }
+    }
+    #if CONFIG_HTTPD_WS_SUPPORT
+    enviar_evento_ws(&evento);
+    #endif
+  }
 }
 
 
-static const httpd_uri_t post_atuador3_uri = {
-    .uri       = "/atuador3",
-    .method    = HTTP_POST,
-    .handler   = post_atuador3_handler,
-    .user_ctx  = &rest_context
-};
+/*  Agenda enviar_eventos() na tarefa do servidor. httpd_queue_work()
+    avisa o servidor pelo seu socket de controle, e pode bloquear.
+ */
+static void agendar_envio_eventos(void) {
+  httpd_handle_t servidor = servidor_ativo;
+
+  if (servidor == NULL || httpd_queue_work(servidor, enviar_eventos, NULL) != ESP_OK) {
+    // Os eventos ficam na fila até a próxima mudança
+    portENTER_CRITICAL(&trava_eventos);
+    envio_agendado = false;
+    portEXIT_CRITICAL(&trava_eventos);
+  }
+}
 
 
-static esp_err_t post_atuador4_handler(httpd_req_t *req) {
-  return post_atuador_n_handler(4, req);
+#if !CONFIG_CONTROLE_GPIO_SIMULACAO
+/*  Tarefa dos eventos: agenda o envio a cada aviso do observador.
+ */
+static void executar_tarefa_eventos(void *parametros) {
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    agendar_envio_eventos();
+  }
 }
+#endif
 
 
-static const httpd_uri_t post_atuador4_uri = {
-    .uri       = "/atuador4",
-    .method    = HTTP_POST,
-    .handler   = post_atuador4_handler,
-    .user_ctx  = &rest_context
-};
+/*  Observador das mudanças nos periféricos. Guarda o evento na fila e
+    avisa a tarefa dos eventos, sem bloquear a tarefa de controle.
 
+    Na simulação não há essa tarefa: o observador é chamado por quem
+    avança o tempo virtual, e agenda o envio diretamente.
 
-/*  Trata POST /config
+    @see controle_gpio_registrar_observador()
+ */
+static void observar_periferico(enum periferico classe, int id, int valor) {
+  bool agendar = false;
 
-    ssid=<ssid do Wifi>
-    password=<password do Wifi>
-    hostname=<nome do servidor HTTP na rede>
-    modo_wifi=<modo da conexão "AP" ou "STA">
+  int num_clientes = num_assinantes_eventos;
 
-    Salva a configuração em memória permanente.
- */
-static esp_err_t post_config_handler(httpd_req_t *req)
-{
-  char*  buf = ((rest_server_context_t *)(req->user_ctx))->scratch;
-  char*  saved_ptr;
+  #if CONFIG_HTTPD_WS_SUPPORT
+  num_clientes += num_clientes_ws;
+  #endif
 
-  char   param[16];
-  char   valor[64];
+  if (servidor_ativo == NULL || num_clientes == 0) {
+    return;
+  }
 
-  int resposta = MSGL_CREATED;
-  
-  int received = ler_conteudo_post(req, buf, SCRATCH_BUFSIZE);
-  
-  if (received < 0) {
-    return ESP_FAIL;
+  portENTER_CRITICAL(&trava_eventos);
+  if (num_eventos < MAX_EVENTOS_PENDENTES) {
+    evento_periferico_t *evento = &eventos_pendentes[(inicio_eventos + num_eventos) % MAX_EVENTOS_PENDENTES];
+
+    evento->classe = classe;
+    evento->id = id;
+    evento->valor = valor;
+    num_eventos++;
+  }
+  if (!envio_agendado) {
+    envio_agendado = true;
+    agendar = true;
   }
+  portEXIT_CRITICAL(&trava_eventos);
 
-  // Percorrendo linhas do conteúdo
-  char *linha = strtok_r(buf, "\n", &saved_ptr);
-  
-  while (linha != NULL) {
-    // @todo Mesmo fragmento de código em app_config.cpp. Deveria ser fatorado em função.
-    // Linhas de configuração válidas são da forma: nome = valor
-    int count = sscanf(linha, "%16[^= ] = %63[^\n]", param, valor);
-    
-    if(count > 1) {
-      if (strcmp(param, "password") == 0) {
-        if (count == 1) {
-          // Senha pode ser vazia
-          valor[0] = 0;
-        }
-      // ESP_LOGI(TAG, "Nova senha: '%s'", valor);
-        app_config_set_wifi_password(valor);
-      } else if (count == 2) {
-        if (strcmp(param, "ssid") == 0) {
-        // ESP_LOGI(TAG, "Novo ssid: '%s'", valor);
-          app_config_set_wifi_ssid(valor);
-        } else if (strcmp(param, "hostname") == 0) {
-          // ESP_LOGI(TAG, "Novo hostname: %s", valor);
-          app_config_set_hostname(valor);
-        } else if (strcmp(param, "modo_wifi") == 0) {
-          // ESP_LOGI(TAG, "Modo Wifi: %s", valor);
-          app_config_set_modo_wifi(valor);
-        }
-      } else if (strlen(linha) > 0) {
-        ESP_LOGE(TAG, "Parâmetro de configuração desconhecido: %s", linha);
-      }
+  if (agendar) {
+    if (tarefa_eventos != NULL) {
+      xTaskNotifyGive(tarefa_eventos);
+    } else {
+      agendar_envio_eventos();
     }
-    linha = strtok_r(NULL, "\n", &saved_ptr);
   }
+}
+
+
+#define MAX_BORDAS_PAGINA   (16)
+#define TAM_LINHA_BORDA     (48)
+#define TAM_PAGINA_BORDAS   (2 * TAM_NUMERO_TEXTO + 32 + MAX_BORDAS_PAGINA * TAM_LINHA_BORDA)
+
+/*  Trata GET /eventos?desde=(sequência)
+
+    Devolve uma página do registro de bordas dos pinos de entrada, a
+    partir da sequência indicada, com no máximo MAX_BORDAS_PAGINA eventos:
+
+      proximo=(sequência para a próxima página)
+      perdidos=(eventos sobrescritos antes de serem lidos)
+      borda=(sequência),(instante em us),(sensor ou contador),(id),(nível)
+      ...
+ */
+static esp_err_t get_eventos_pagina(httpd_req_t *req, arena_sessao_t *arena, const char *query)
+{
+  char param[TAM_NUMERO_TEXTO];
+  borda_gpio_t bordas[MAX_BORDAS_PAGINA];
+  uint32_t proximo = 0;
+  uint32_t perdidos = 0;
+  char *resposta = alocar_na_arena(arena, TAM_PAGINA_BORDAS);
 
-  // Preparar cabeçalhos da resposta
   preencher_cabecalho_text_plain(req);
+  httpd_resp_set_hdr(req, "Cache-Control", "no-store");
 
-  if (resposta >= MSGL_OK) {
-    httpd_resp_set_status(req, mensagens_locais[resposta]);
+  if (httpd_query_key_value(query, "desde", param, sizeof(param)) != ESP_OK) {
+    definir_status(req, mensagens_locais[MSGL_FALTAM_PARAMETROS]);
+    httpd_resp_sendstr(req, mensagens_locais[MSGL_FALTAM_PARAMETROS]);
+    return ESP_OK;
+  }
+  if (resposta == NULL) {
+    return enviar_erro(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Sem memoria");
   }
 
-  httpd_resp_sendstr(req, mensagens_locais[resposta]);
+  uint32_t desde = (uint32_t)strtoul(param, NULL, 10);
+  int n = controle_gpio_ler_bordas(desde, bordas, MAX_BORDAS_PAGINA, &proximo, &perdidos);
+  int len = snprintf(resposta, TAM_PAGINA_BORDAS, "proximo=%" PRIu32 "\nperdidos=%" PRIu32 "\n",
+                     proximo, perdidos);
 
-  if (resposta == MSGL_CREATED) {
-    if (app_config_gravar() == ESP_OK) {
-      // Se alterou configuração na memória FLASH, é preciso reiniciar.
-      ESP_LOGI(TAG, "Aguardando o módulo ser reiniciado");
-      // sleep(1);
-      // esp_restart();
-    }
+  for (int i = 0; i < n && len < TAM_PAGINA_BORDAS; i++) {
+    len += snprintf(resposta + len, TAM_PAGINA_BORDAS - len,
+                    "borda=%" PRIu32 ",%" PRId64 ",%s,%d,%d\n",
+                    bordas[i].seq, bordas[i].instante_us, nomes_eventos[bordas[i].classe],
+                    bordas[i].id, bordas[i].nivel);
   }
+  httpd_resp_sendstr(req, resposta);
+
   return ESP_OK;
 }
 
 
-static const httpd_uri_t post_config_uri = {
-    .uri       = "/config",
-    .method    = HTTP_POST,
-    .handler   = post_config_handler,
-    .user_ctx  = &rest_context
-};
-
+/*  Trata GET /eventos
 
-/*  Trata HEAD/
+    Envia o cabeçalho de um fluxo text/event-stream e guarda o socket da
+    conexão, que permanece aberta. Os eventos são enviados depois, por
+    enviar_eventos().
 
-    Útil para IP scanners tentando encontrar o IP do sistema.
+    Com o parâmetro desde, devolve uma página do registro de bordas
+    (get_eventos_pagina), sem manter a conexão.
  */
-static esp_err_t head_raiz_handler(httpd_req_t *req)
+static esp_err_t get_eventos_handler(httpd_req_t *req)
 {
-  int resposta = MSGL_OK;
-  
-  ESP_LOGI(TAG, "Tratando HEAD request na raiz");
+  arena_sessao_t *arena = iniciar_arena(req);
+  char *query = obter_query_na_arena(req, arena);
 
-  // Preparar cabeçalhos da resposta
-  preencher_cabecalho_text_plain(req);
+  if (query != NULL) {
+    return get_eventos_pagina(req, arena, query);
+  }
 
-  httpd_resp_send(req, mensagens_locais[resposta], HTTPD_RESP_USE_STRLEN);
+  int sockfd = httpd_req_to_sockfd(req);
+  int posicao = -1;
+
+  for (int i = 0; i < MAX_ASSINANTES_EVENTOS; i++) {
+    if (assinantes_eventos[i] < 0) {
+      posicao = i;
+      break;
+    }
+  }
+
+  if (posicao < 0) {
+    ESP_LOGE(TAG, "Número máximo de assinantes de eventos atingido");
+    preencher_cabecalho_text_plain(req);
+    definir_status(req, mensagens_locais[MSGL_INDISPONIVEL]);
+    httpd_resp_sendstr(req, mensagens_locais[MSGL_INDISPONIVEL]);
+    return ESP_OK;
+  }
+
+  if (httpd_socket_send(req->handle, sockfd, CABECALHO_EVENTOS, strlen(CABECALHO_EVENTOS), 0) < 0) {
+    return ESP_FAIL;
+  }
+  assinantes_eventos[posicao] = sockfd;
+  num_assinantes_eventos++;
 
   return ESP_OK;
 }
 
 
-static const httpd_uri_t head_raiz_uri = {
-    .uri       = "/",
-    .method    = HTTP_HEAD,
-    .handler   = head_raiz_handler,
-    .user_ctx  = &rest_context
+static const httpd_uri_t get_eventos_uri = {
+    .uri       = "/eventos",
+    .method    = HTTP_GET,
+    .handler   = get_eventos_handler
 };
 
 
-// Documentação das funções públicas no arquivo header.
 
+/*  Trata GET /historico?desde=<ms>&ate=<ms>&res=<0, 1 ou 60>
 
-httpd_handle_t start_webserver(void)
+    Lê o histórico aos poucos, AMOSTRAS_BLOCO_HISTORICO amostras de cada
+    vez, e envia cada bloco como uma parte (chunk) da resposta.
+ */
+static esp_err_t get_historico_handler(httpd_req_t *req)
 {
-  httpd_handle_t server = NULL;
-  httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+  arena_sessao_t *arena = iniciar_arena(req);
+  char *query = obter_query_na_arena(req, arena);
+  char *texto = alocar_na_arena(arena, TAM_BLOCO_HISTORICO);
+  char param[TAM_NUMERO_TEXTO];
+  int64_t agora_ms = esp_timer_get_time() / 1000;
+  int64_t desde_ms = 0;
+  int64_t ate_ms = agora_ms;
+  int res = 1;
+  enum resolucao_historico resolucao;
+
+  if (texto == NULL) {
+    return enviar_erro(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Sem memoria");
+  }
+  if (query != NULL) {
+    if (httpd_query_key_value(query, "desde", param, sizeof(param)) == ESP_OK) {
+      desde_ms = strtoll(param, NULL, 10);
+    }
+    if (httpd_query_key_value(query, "ate", param, sizeof(param)) == ESP_OK) {
+      ate_ms = strtoll(param, NULL, 10);
+    }
+    if (httpd_query_key_value(query, "res", param, sizeof(param)) == ESP_OK) {
+      res = atoi(param);
+    }
+  }
+
+  preencher_cabecalho_text_plain(req);
+  httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+
+  switch (res) {
+    case 0:
+      resolucao = HIST_MUDANCAS;
+      break;
+    case 1:
+      resolucao = HIST_SEGUNDOS;
+      break;
+    case 60:
+      resolucao = HIST_MINUTOS;
+      break;
+    default:
+      definir_status(req, mensagens_locais[MSGL_PARAMETRO_INVALIDO]);
+      httpd_resp_sendstr(req, mensagens_locais[MSGL_PARAMETRO_INVALIDO]);
+      return ESP_OK;
+  }
+
+  int len = snprintf(texto, TAM_BLOCO_HISTORICO, "res=%d\nagora=%" PRId64 "\nmais_antigo=%" PRId64 "\n",
+                     res, agora_ms, historico_mais_antigo_ms(resolucao));
+
+  if (httpd_resp_send_chunk(req, texto, len) != ESP_OK) {
+    return ESP_FAIL;
+  }
+
+  amostra_historico_t amostras[AMOSTRAS_BLOCO_HISTORICO];
+  uint32_t cursor = 0;
+  int n;
+
+  while ((n = historico_ler(resolucao, desde_ms, ate_ms, &cursor, amostras,
+                            AMOSTRAS_BLOCO_HISTORICO)) > 0) {
+    len = 0;
+    for (int i = 0; i < n; i++) {
+      const amostra_historico_t *amostra = &amostras[i];
+
+      len += snprintf(texto + len, TAM_BLOCO_HISTORICO - len,
+                      "amostra=%" PRId64 ",%" PRIu32 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64,
+                      amostra->instante_ms, amostra->duracao_ms,
+                      (uint64_t)amostra->sensores, (uint64_t)amostra->sensores_ligados,
+                      (uint64_t)amostra->atuadores, (uint64_t)amostra->atuadores_ligados);
+      for (int id = 1; id <= MAX_CONTADORES; id++) {
+        len += snprintf(texto + len, TAM_BLOCO_HISTORICO - len, ",%" PRIu32, amostra->eventos[id]);
+      }
+      len += snprintf(texto + len, TAM_BLOCO_HISTORICO - len, "\n");
+    }
+    if (httpd_resp_send_chunk(req, texto, MIN(len, TAM_BLOCO_HISTORICO - 1)) != ESP_OK) {
+      // Cliente desconectou
+      return ESP_FAIL;
+    }
+  }
+  httpd_resp_send_chunk(req, NULL, 0);
+
+  return ESP_OK;
+}
+
+
+static const httpd_uri_t get_historico_uri = {
+    .uri       = "/historico",
+    .method    = HTTP_GET,
+    .handler   = get_historico_handler
+};
+
+
+/*  Chamada pelo servidor ao fechar uma conexão.
+ */
+static void fechar_sessao(httpd_handle_t hd, int sockfd) {
+  remover_assinante_eventos(sockfd);
+  #if CONFIG_HTTPD_WS_SUPPORT
+  remover_cliente_ws(sockfd);
+  #endif
+  close(sockfd);
+}
+
+
+/*  Trata cada parâmetro de POST /contador(id).
+ */
+static void tratar_parametro_contador(const char *nome, const char *valor, void *contexto) {
+  bool *aplicar_reset = (bool *)contexto;
+
+  if (strcmp(nome, "action") == 0 && strcmp(valor, "reset") == 0) {
+    *aplicar_reset = true;
+
+    // ESP_LOGI(TAG, "Ação sobre contador: reset");
+  } else {
+    ESP_LOGE(TAG, "Parâmetro desconhecido por contador: %s", nome);
+  }
+}
+
+
+/*  Trata POST /contador(id)
+
+    action=reset
+
+    Reinicia a contagem de eventos.
+    id é o identificador do contador, começando em 1.
+
+    Parâmetros:
+      id_perif - identificador do periférico.
+      req - requisição de serviço vinda do cliente.
+ */
+static esp_err_t post_contador_n_handler(int id_perif, httpd_req_t *req) {
+  bool aplicar_reset = false;
+  
+  int resposta = MSGL_CREATED;
+  
+  int erros = ler_parametros_post(req, tratar_parametro_contador, &aplicar_reset);
+  
+  if (erros < 0) {
+    return ESP_FAIL;
+  }
+
+  if (erros > 0) {
+    resposta = MSGL_PARAMETRO_INVALIDO;
+  } else if (aplicar_reset && !controle_gpio_reiniciar_contador(id_perif)) {
+    resposta = MSGL_INDISPONIVEL;
+  }
+  // Preparar cabeçalhos da resposta
+  preencher_cabecalho_text_plain(req);
+
+  if (resposta >= MSGL_OK) {
+    definir_status(req, mensagens_locais[resposta]);
+  }
+  httpd_resp_sendstr(req, mensagens_locais[resposta]);
+  return ESP_OK;
+}
+
+// Tratamento de Atuadores ----------------------------------------------------
+
+/*  Ações conhecidas pelos atuadores: (enumerado, nome no protocolo).
+    A ordem define os códigos usados nos quadros do canal /controle.
+
+    NOTA: Os nomes devem ter tamanhos diferentes entre si. A busca em
+          procurar_acao_atuador() seleciona a ação pelo tamanho do nome,
+          e o compilador rejeita tamanhos repetidos (case duplicado).
+ */
+#define ACOES_ATUADOR(X)              \
+  X(ACAO_ATUADOR_OFF,     "off")      \
+  X(ACAO_ATUADOR_ON,      "on")       \
+  X(ACAO_ATUADOR_TOGGLE,  "toggle")   \
+  X(ACAO_ATUADOR_PULSE,   "pulse")
+
+enum acao_atuador {
+#define X(acao, nome) acao,
+  ACOES_ATUADOR(X)
+#undef X
+  ACAO_ATUADOR_NOP              // Esta deve ser sempre a última
+};
+
+
+// Gerado a partir da mesma lista, coincide sempre com o enumerado acima.
+const char *acoes_conhecidas [] = {
+#define X(acao, nome) nome,
+  ACOES_ATUADOR(X)
+#undef X
+  "no action"
+};
+
+
+/*  Converte o nome de uma ação no enumerado correspondente.
+
+    Retorna ACAO_ATUADOR_NOP se a ação é desconhecida.
+ */
+static int procurar_acao_atuador(const char *nome) {
+  size_t len = strlen(nome);
+
+  switch (len) {
+#define X(acao, nome_acao) \
+    case sizeof(nome_acao) - 1: \
+      return (memcmp(nome, nome_acao, len) == 0) ? acao : ACAO_ATUADOR_NOP;
+    ACOES_ATUADOR(X)
+#undef X
+  }
+  return ACAO_ATUADOR_NOP;
+}
+
+
+/*  Aplica uma ação a um atuador.
+
+    Retorna MSGL_CREATED se a ação foi executada, MSGL_PARAMETRO_INVALIDO
+    se era inválida, ou MSGL_INDISPONIVEL se a tarefa de controle não a
+    executou a tempo.
+ */
+static int executar_acao_atuador(int id_perif, int acao, int duracao) {
+  bool executada;
+
+  if (controle_gpio_ler_atuador(id_perif) < 0) {
+    ESP_LOGE(TAG, "Atuador inexistente: %d", id_perif);
+    return MSGL_PARAMETRO_INVALIDO;
+  }
+
+  switch (acao) {
+    case ACAO_ATUADOR_OFF:
+        executada = controle_gpio_mudar_atuador(id_perif, 0);
+      break;
+    case ACAO_ATUADOR_ON:
+        executada = controle_gpio_mudar_atuador(id_perif, 1);
+      break;
+    case ACAO_ATUADOR_TOGGLE:
+        executada = controle_gpio_alternar_atuador(id_perif);
+      break;
+    case ACAO_ATUADOR_PULSE:
+        if (duracao > 0) {
+          executada = controle_gpio_pulsar_atuador(id_perif, duracao);
+        } else {
+          ESP_LOGE(TAG, "Duração inválida para pulso do atuador.");
+          return MSGL_PARAMETRO_INVALIDO;
+        }
+      break;
+    default:
+      ESP_LOGE(TAG, "Ação desconhecida por atuador.");
+      return MSGL_PARAMETRO_INVALIDO;
+  }
+  return executada ? MSGL_CREATED : MSGL_INDISPONIVEL;
+}
+
+
+// Parâmetros de um comando POST /atuador(id)
+typedef struct {
+  int   acao;                   // Ação (enum acao_atuador)
+  int   duracao;                // Duração do pulso em ms
+} comando_atuador_t;
+
+
+/*  Trata cada parâmetro de POST /atuador(id), guardando-o no comando.
+ */
+static void tratar_parametro_atuador(const char *nome, const char *valor, void *contexto) {
+  comando_atuador_t *comando = (comando_atuador_t *)contexto;
+
+  if (strcmp(nome, "action") == 0) {
+    // ESP_LOGI(TAG, "Ação sobre atuador: %s", valor);
+    comando->acao = procurar_acao_atuador(valor);
+  } else if (strcmp(nome, "duration") == 0) {
+    // ESP_LOGI(TAG, "Duração: %s", valor);
+    comando->duracao = atoi(valor);
+  } else {
+    ESP_LOGE(TAG, "Parâmetro desconhecido por atuador: %s", nome);
+  }
+}
+
+
+/*  Trata POST /atuador(id)
+
+    action=(on/off/toggle/pulse)
+    duration=(tempo em ms)
+
+    Modifica o estado de um atuador.
+    id é o identificador do atuador, começando em 1.
+
+    Parâmetros:
+      id_perif - identificador do periférico.
+      req - requisição de serviço vinda do cliente.
+ */
+static esp_err_t post_atuador_n_handler(int id_perif, httpd_req_t *req) {
+  comando_atuador_t comando = {
+    .acao = ACAO_ATUADOR_NOP,
+    .duracao = 0
+  };
+  
+  int resposta = MSGL_CREATED;
+  
+  int erros = ler_parametros_post(req, tratar_parametro_atuador, &comando);
+  
+  if (erros < 0) {
+    return ESP_FAIL;
+  }
+
+  if (erros > 0) {
+    resposta = MSGL_PARAMETRO_INVALIDO;
+  } else {
+    resposta = executar_acao_atuador(id_perif, comando.acao, comando.duracao);
+  }
+
+  // Preparar cabeçalhos da resposta
+  preencher_cabecalho_text_plain(req);
+
+  if (resposta >= MSGL_OK) {
+    definir_status(req, mensagens_locais[resposta]);
+  }
+  httpd_resp_sendstr(req, mensagens_locais[resposta]);
+  return ESP_OK;
+}
+
+// Comandos em lote ----------------------------------------------------------
+
+#define MAX_ITENS_LOTE  (2 * MAX_ATUADORES)     // Linhas aceitas em POST /lote
+
+// Um comando de POST /lote, com o resultado de sua validação
+typedef struct {
+  int   id;                     // Identificador do atuador (0 se inválido)
+  int   acao;                   // Ação (enum acao_atuador)
+  int   duracao;                // Duração do pulso em ms
+  int   resultado;              // MSGL_CREATED ou mensagem de erro
+} item_lote_t;
+
+typedef struct {
+  item_lote_t itens[MAX_ITENS_LOTE];
+  int         num_itens;
+} lote_t;
+
+
+/*  Trata cada linha de POST /lote: atuador(id)=(ação)[,(duração em ms)]
+ */
+static void tratar_parametro_lote(const char *nome, const char *valor, void *contexto) {
+  lote_t *lote = (lote_t *)contexto;
+
+  if (lote->num_itens >= MAX_ITENS_LOTE) {
+    ESP_LOGE(TAG, "Comandos demais no lote");
+    lote->num_itens++;
+    return;
+  }
+  item_lote_t *item = &lote->itens[lote->num_itens++];
+  char  nome_acao[16];
+  char  *fim = NULL;
+
+  item->id = 0;
+  item->acao = ACAO_ATUADOR_NOP;
+  item->duracao = 0;
+  item->resultado = MSGL_PARAMETRO_INVALIDO;
+
+  if (strncmp(nome, "atuador", 7) != 0) {
+    ESP_LOGE(TAG, "Parâmetro desconhecido no lote: %s", nome);
+    return;
+  }
+  long id_perif = strtol(nome + 7, &fim, 10);
+
+  if (fim == nome + 7 || *fim != '\0' || id_perif < 1 || id_perif > MAX_ATUADORES) {
+    ESP_LOGE(TAG, "Atuador inexistente no lote: %s", nome);
+    return;
+  }
+  item->id = (int)id_perif;
+
+  // Separa a ação da duração
+  size_t len_acao = strcspn(valor, ",");
+
+  if (len_acao >= sizeof(nome_acao)) {
+    return;
+  }
+  memcpy(nome_acao, valor, len_acao);
+  nome_acao[len_acao] = '\0';
+  item->acao = procurar_acao_atuador(nome_acao);
+
+  if (valor[len_acao] == ',') {
+    item->duracao = atoi(valor + len_acao + 1);
+  }
+
+  if (item->acao == ACAO_ATUADOR_NOP ||
+      (item->acao == ACAO_ATUADOR_PULSE && item->duracao <= 0)) {
+    ESP_LOGE(TAG, "Ação inválida no lote para atuador %d: %s", item->id, valor);
+    return;
+  }
+
+  // O mesmo atuador não pode aparecer duas vezes no lote
+  for (int i = 0; i < lote->num_itens - 1; i++) {
+    if (lote->itens[i].id == item->id) {
+      ESP_LOGE(TAG, "Atuador %d repetido no lote", item->id);
+      return;
+    }
+  }
+  item->resultado = MSGL_CREATED;
+}
+
+
+/*  Trata POST /lote
+
+    atuador(id)=(off/on/toggle/pulse)[,(duração em ms)]
+    ...
+
+    Aplica vários comandos a atuadores ao mesmo tempo. Os comandos só são
+    aplicados se todos forem válidos; caso contrário, nenhum é aplicado.
+    A resposta traz uma linha com o resultado de cada comando.
+ */
+static esp_err_t post_lote_handler(httpd_req_t *req) {
+  lote_t lote = { .num_itens = 0 };
+  lote_atuadores_t mudancas = { 0 };
+
+  int resposta = MSGL_CREATED;
+
+  int erros = ler_parametros_post(req, tratar_parametro_lote, &lote);
+
+  if (erros < 0) {
+    return ESP_FAIL;
+  }
+  if (erros > 0 || lote.num_itens == 0 || lote.num_itens > MAX_ITENS_LOTE) {
+    resposta = MSGL_PARAMETRO_INVALIDO;
+  }
+
+  for (int i = 0; i < lote.num_itens && i < MAX_ITENS_LOTE; i++) {
+    item_lote_t *item = &lote.itens[i];
+    uint64_t bit = 1ULL << item->id;
+
+    if (item->resultado != MSGL_CREATED) {
+      resposta = MSGL_PARAMETRO_INVALIDO;
+      continue;
+    }
+    switch (item->acao) {
+      case ACAO_ATUADOR_OFF:
+        mudancas.desligar |= bit;
+        break;
+      case ACAO_ATUADOR_ON:
+        mudancas.ligar |= bit;
+        break;
+      case ACAO_ATUADOR_TOGGLE:
+        mudancas.alternar |= bit;
+        break;
+      case ACAO_ATUADOR_PULSE:
+        mudancas.pulsar |= bit;
+        mudancas.duracao[item->id] = item->duracao;
+        break;
+    }
+  }
+
+  if (resposta == MSGL_CREATED && !controle_gpio_aplicar_lote(&mudancas)) {
+    // Nenhum comando do lote foi confirmado
+    resposta = MSGL_INDISPONIVEL;
+    for (int i = 0; i < lote.num_itens; i++) {
+      lote.itens[i].resultado = MSGL_INDISPONIVEL;
+    }
+  }
+
+  // Resultado de cada comando, na ordem recebida
+  arena_sessao_t *arena = iniciar_arena(req);
+  size_t tam_texto = MAX_ITENS_LOTE * 48;
+  char  *texto = alocar_na_arena(arena, tam_texto);
+  size_t len = 0;
+
+  if (texto != NULL) {
+    texto[0] = '\0';
+    for (int i = 0; i < lote.num_itens && i < MAX_ITENS_LOTE && len < tam_texto; i++) {
+      len += snprintf(texto + len, tam_texto - len, "atuador%d=%s\n",
+                      lote.itens[i].id, mensagens_locais[lote.itens[i].resultado]);
+    }
+  }
+
+  // Preparar cabeçalhos da resposta
+  preencher_cabecalho_text_plain(req);
+
+  definir_status(req, mensagens_locais[resposta]);
+  httpd_resp_sendstr(req, (texto != NULL) ? texto : mensagens_locais[resposta]);
+  return ESP_OK;
+}
+
+
+static const httpd_uri_t post_lote_uri = {
+    .uri       = "/lote",
+    .method    = HTTP_POST,
+    .handler   = post_lote_handler
+};
+
+
+/*  Trata POST /regras
+
+    regra=(condição) -> (ação)
+    ...
+
+    Compila as regras à medida que o texto chega; só as instala se
+    todas forem válidas. A resposta indica as primeiras linhas rejeitadas.
+ */
+static esp_err_t post_regras_handler(httpd_req_t *req) {
+  carga_regras_t carga;
+  leitor_parametros_t leitor;
+  char resp_str[TAM_RESPOSTA_REGRAS];
+  int resposta = MSGL_CREATED;
+
+  if (!regras_iniciar_carga(&carga)) {
+    preencher_cabecalho_text_plain(req);
+    definir_status(req, mensagens_locais[MSGL_INDISPONIVEL]);
+    httpd_resp_sendstr(req, mensagens_locais[MSGL_INDISPONIVEL]);
+    return ESP_OK;
+  }
+
+  regras_iniciar_leitor(&carga, &leitor);
+  int erros = receber_parametros(req, &leitor);
+
+  if (erros < 0) {
+    regras_concluir_carga(&carga, false);
+    return ESP_FAIL;
+  }
+  if (!regras_concluir_carga(&carga, erros == 0)) {
+    resposta = MSGL_PARAMETRO_INVALIDO;
+  }
+
+  int len = snprintf(resp_str, sizeof(resp_str), "regras=%d\nerros=%d\n", carga.regras, carga.erros);
+
+  for (int i = 0; i < carga.erros && i < MAX_LINHAS_REJEITADAS; i++) {
+    len += snprintf(resp_str + len, sizeof(resp_str) - len, "rejeitada=%d\n",
+                    carga.linhas_rejeitadas[i]);
+  }
+
+  preencher_cabecalho_text_plain(req);
+  definir_status(req, mensagens_locais[resposta]);
+  httpd_resp_sendstr(req, resp_str);
+  return ESP_OK;
+}
+
+
+static const httpd_uri_t post_regras_uri = {
+    .uri       = "/regras",
+    .method    = HTTP_POST,
+    .handler   = post_regras_handler
+};
+
+
+/*  Trata GET /regras
+
+    Estatísticas das regras em vigor.
+ */
+static esp_err_t get_regras_handler(httpd_req_t *req) {
+  estatisticas_regras_t estatisticas;
+  arena_sessao_t *arena = iniciar_arena(req);
+  char *resposta = alocar_na_arena(arena, TAM_ESTATISTICAS_REGRAS);
+
+  preencher_cabecalho_text_plain(req);
+  httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+
+  if (resposta == NULL) {
+    definir_status(req, mensagens_locais[MSGL_INDISPONIVEL]);
+    httpd_resp_send(req, "\n", HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+  }
+
+  regras_estatisticas(&estatisticas);
+
+  uint32_t latencia_media = 0;
+  if (estatisticas.medicoes > 0) {
+    latencia_media = (uint32_t)(estatisticas.soma_latencia_us / estatisticas.medicoes);
+  }
+
+  int len = snprintf(resposta, TAM_ESTATISTICAS_REGRAS,
+                     "regras=%" PRIu32 "\navaliacoes=%" PRIu32 "\ndisparos=%" PRIu32
+                     "\npassos_excedidos=%" PRIu32 "\nlatencia_max_us=%" PRIu32
+                     "\nlatencia_media_us=%" PRIu32 "\n",
+                     estatisticas.regras, estatisticas.avaliacoes, estatisticas.disparos,
+                     estatisticas.passos_excedidos, estatisticas.latencia_max_us, latencia_media);
+
+  // imprimir_lista_valores usa os índices de 1 em diante, como as tabelas de regras
+  int valores[MAX_REGRAS + 1];
+
+  for (uint32_t i = 1; i <= estatisticas.regras && i <= MAX_REGRAS; i++) {
+    valores[i] = (int)estatisticas.disparos_regra[i];
+  }
+  imprimir_lista_valores(resposta + len, TAM_ESTATISTICAS_REGRAS - len, "disparos_regra",
+                         valores, (int)estatisticas.regras);
+
+  httpd_resp_send(req, resposta, HTTPD_RESP_USE_STRLEN);
+  return ESP_OK;
+}
+
+
+static const httpd_uri_t get_regras_uri = {
+    .uri       = "/regras",
+    .method    = HTTP_GET,
+    .handler   = get_regras_handler
+};
+
+
+// Roteamento dos POST por classe de periférico -------------------------------
+
+/*  Rota para uma classe de periférico: POST (prefixo)(id), com id de 1 a max_id.
+ */
+typedef struct {
+  const char  *prefixo;                           // Início do URI, antes do id
+  int         max_id;                             // Maior identificador da classe
+  esp_err_t   (*tratar)(int id_perif, httpd_req_t *req);
+} rota_periferico_t;
+
+
+static const rota_periferico_t rota_contadores = {
+  .prefixo = "/contador",
+  .max_id  = MAX_CONTADORES,
+  .tratar  = post_contador_n_handler
+};
+
+
+static const rota_periferico_t rota_atuadores = {
+  .prefixo = "/atuador",
+  .max_id  = MAX_ATUADORES,
+  .tratar  = post_atuador_n_handler
+};
+
+
+/*  Trata POST (prefixo)(id) para qualquer classe de periférico.
+
+    O URI é registrado com curinga ('/atuador*'), de modo que uma única
+    entrada no servidor atende a todos os periféricos da classe.
+    O id é obtido do próprio URI e repassado ao tratamento da classe.
+ */
+static esp_err_t post_periferico_handler(httpd_req_t *req) {
+  const rota_periferico_t *rota = (const rota_periferico_t *)req->user_ctx;
+  const char *texto_id = req->uri + strlen(rota->prefixo);
+  char *fim = NULL;
+  
+  long id_perif = strtol(texto_id, &fim, 10);
+
+  if (fim == texto_id || (*fim != '\0' && *fim != '?') ||
+      id_perif < 1 || id_perif > rota->max_id) {
+    ESP_LOGE(TAG, "Periférico inexistente: %s", req->uri);
+    preencher_cabecalho_text_plain(req);
+    definir_status(req, mensagens_locais[MSGL_PARAMETRO_INVALIDO]);
+    httpd_resp_sendstr(req, mensagens_locais[MSGL_PARAMETRO_INVALIDO]);
+    return ESP_OK;
+  }
+  return rota->tratar((int)id_perif, req);
+}
+
+
+static const httpd_uri_t post_contador_n_uri = {
+    .uri       = "/contador*",
+    .method    = HTTP_POST,
+    .handler   = post_periferico_handler,
+    .user_ctx  = (void *)&rota_contadores
+};
+
+
+static const httpd_uri_t post_atuador_n_uri = {
+    .uri       = "/atuador*",
+    .method    = HTTP_POST,
+    .handler   = post_periferico_handler,
+    .user_ctx  = (void *)&rota_atuadores
+};
+
+
+#if CONFIG_HTTPD_WS_SUPPORT
+
+/*  Trata o canal WebSocket /controle.
+
+    Na abertura (GET com upgrade), registra o cliente para receber as
+    notificações de estado. Depois, cada quadro binário recebido é um
+    comando para um atuador, respondido com um quadro de estado. Um
+    quadro de outro tipo ou tamanho é lido e ignorado; se for maior que
+    TAM_QUADRO_DESCARTE, a conexão é fechada.
+ */
+static esp_err_t ws_controle_handler(httpd_req_t *req)
+{
+  if (req->method == HTTP_GET) {
+    int sockfd = httpd_req_to_sockfd(req);
+
+    for (int i = 0; i < MAX_CLIENTES_WS; i++) {
+      if (clientes_ws[i] < 0) {
+        clientes_ws[i] = sockfd;
+        num_clientes_ws++;
+        return ESP_OK;
+      }
+    }
+    // Sem posição livre: o canal funciona, mas sem notificações.
+    ESP_LOGE(TAG, "Número máximo de clientes WebSocket atingido");
+    return ESP_OK;
+  }
+
+  quadro_comando_t comando;
+  httpd_ws_frame_t quadro = { 0 };
+
+  // Primeiro obtém apenas o tamanho do quadro
+  esp_err_t ret = httpd_ws_recv_frame(req, &quadro, 0);
+
+  if (ret != ESP_OK) {
+    return ret;
+  }
+  if (quadro.type != HTTPD_WS_TYPE_BINARY || quadro.len != sizeof(comando)) {
+    ESP_LOGE(TAG, "Quadro WebSocket inválido (tipo %d, %d bytes)", quadro.type, (int)quadro.len);
+
+    // O conteúdo precisa ser lido, ou o próximo quadro começaria no meio
+    // deste. Sem espaço para descartá-lo, fecha a conexão.
+    uint8_t descarte[TAM_QUADRO_DESCARTE];
+
+    if (quadro.len > sizeof(descarte)) {
+      return ESP_FAIL;
+    }
+    quadro.payload = descarte;
+    return httpd_ws_recv_frame(req, &quadro, sizeof(descarte));
+  }
+  quadro.payload = (uint8_t *)&comando;
+  ret = httpd_ws_recv_frame(req, &quadro, sizeof(comando));
+
+  if (ret != ESP_OK) {
+    return ret;
+  }
+
+  quadro_estado_t estado = {
+    .classe = PRF_ATUADOR,
+    .id = comando.id,
+    .sequencia = comando.sequencia,
+    .valor = -1
+  };
+
+  switch (executar_acao_atuador(comando.id, comando.acao, (int)comando.duracao)) {
+    case MSGL_CREATED:
+      estado.valor = controle_gpio_ler_atuador(comando.id);
+      break;
+    case MSGL_INDISPONIVEL:
+      estado.valor = -2;
+      break;
+  }
+
+  quadro.final = true;
+  quadro.type = HTTPD_WS_TYPE_BINARY;
+  quadro.payload = (uint8_t *)&estado;
+  quadro.len = sizeof(estado);
+
+  return httpd_ws_send_frame(req, &quadro);
+}
+
+
+static const httpd_uri_t ws_controle_uri = {
+    .uri          = "/controle",
+    .method       = HTTP_GET,
+    .handler      = ws_controle_handler,
+    .is_websocket = true
+};
+#endif
+
+
+/*  Trata POST /config
+
+    ssid=<ssid do Wifi>
+    password=<password do Wifi>
+    hostname=<nome do servidor HTTP na rede>
+    modo_wifi=<modo da conexão "AP" ou "STA">
+
+    Todo o conteúdo é lido e validado em uma cópia da configuração; se
+    alguma linha for inválida, nada muda e a resposta é 400. Caso
+    contrário, a cópia substitui a configuração em uso e é salva em
+    memória permanente, em segundo plano: responde 202 imediatamente, e
+    a situação da gravação pode ser consultada em GET /config.
+ */
+static esp_err_t post_config_handler(httpd_req_t *req)
+{
+  carga_config_t carga;
+  int resposta = MSGL_ACEITO;
+
+  app_config_iniciar_carga(&carga);
+
+  int erros = ler_parametros_post(req, app_config_tratar_parametro, &carga);
+  
+  if (erros < 0) {
+    app_config_concluir_carga(&carga, false);
+    return ESP_FAIL;
+  }
+  if (carga.erros > 0) {
+    atomic_fetch_add_explicit(&metricas_gerais.parametros_invalidos, carga.erros, memory_order_relaxed);
+  }
+  if (!app_config_concluir_carga(&carga, erros == 0)) {
+    resposta = MSGL_PARAMETRO_INVALIDO;
+  }
+
+  // Preparar cabeçalhos da resposta
+  preencher_cabecalho_text_plain(req);
+
+  if (resposta == MSGL_ACEITO && !app_config_solicitar_gravacao()) {
+    resposta = MSGL_INDISPONIVEL;
+  }
+  if (resposta == MSGL_ACEITO) {
+    httpd_resp_set_hdr(req, "Location", "/config");
+  }
+  if (resposta >= MSGL_OK) {
+    definir_status(req, mensagens_locais[resposta]);
+  }
+
+  httpd_resp_sendstr(req, mensagens_locais[resposta]);
+
+  // Após a gravação, a nova configuração vale quando o módulo for reiniciado.
+  return ESP_OK;
+}
+
+static const httpd_uri_t post_config_uri = {
+    .uri       = "/config",
+    .method    = HTTP_POST,
+    .handler   = post_config_handler
+};
+
+
+static const char *nomes_estado_gravacao[] = {
+  "nenhuma",
+  "pendente",
+  "concluida",
+  "falhou"
+};
+
+
+/*  Trata GET /config
+
+    Devolve a situação da última gravação solicitada por POST /config:
+    gravacao=(nenhuma, pendente, concluida ou falhou)
+ */
+static esp_err_t get_config_handler(httpd_req_t *req)
+{
+  char resp_str[32];
+
+  snprintf(resp_str, sizeof(resp_str), "gravacao=%s\n",
+           nomes_estado_gravacao[app_config_estado_gravacao()]);
+
+  preencher_cabecalho_text_plain(req);
+  httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+  httpd_resp_sendstr(req, resp_str);
+
+  return ESP_OK;
+}
+
+
+static const httpd_uri_t get_config_uri = {
+    .uri       = "/config",
+    .method    = HTTP_GET,
+    .handler   = get_config_handler
+};
+
+
+/*  Console web embutido.
+
+    Os arquivos da pasta client são embutidos no firmware durante a
+    compilação (veja main/CMakeLists.txt), já comprimidos com gzip.
+    Ficam na memória FLASH mapeada, e são enviados diretamente de lá,
+    sem cópia e sem descompressão no servidor.
+
+    O ETag de cada arquivo é o CRC32 do seu conteúdo, calculado uma vez,
+    ao iniciar o servidor. A página principal é sempre revalidada
+    (no-cache); os demais arquivos podem ficar no cache do navegador.
+ */
+extern const uint8_t index_html_gz_start[]          asm("_binary_index_html_gz_start");
+extern const uint8_t index_html_gz_end[]            asm("_binary_index_html_gz_end");
+extern const uint8_t portaria_remota_js_gz_start[]  asm("_binary_portaria_remota_js_gz_start");
+extern const uint8_t portaria_remota_js_gz_end[]    asm("_binary_portaria_remota_js_gz_end");
+extern const uint8_t estilos_css_gz_start[]         asm("_binary_estilos_css_gz_start");
+extern const uint8_t estilos_css_gz_end[]           asm("_binary_estilos_css_gz_end");
+extern const uint8_t portaria_png_start[]           asm("_binary_portaria_png_start");
+extern const uint8_t portaria_png_end[]             asm("_binary_portaria_png_end");
+
+#define CACHE_PAGINA    "no-cache"
+#define CACHE_RECURSO   "public, max-age=86400"
+
+typedef struct {
+  const char    *uri;
+  const uint8_t *inicio;
+  const uint8_t *fim;
+  const char    *tipo;
+  bool          comprimido;           // Enviado com Content-Encoding: gzip
+  const char    *cache;
+} arquivo_console_t;
+
+static const arquivo_console_t arquivos_console[] = {
+  {NULL,                    NULL, NULL, NULL, false, NULL},    // Índice 0 não utilizado
+  {"/index.html",           index_html_gz_start, index_html_gz_end,
+                            "text/html; charset=utf-8", true, CACHE_PAGINA},
+  {"/portaria_remota.js",   portaria_remota_js_gz_start, portaria_remota_js_gz_end,
+                            "text/javascript; charset=utf-8", true, CACHE_RECURSO},
+  {"/estilos.css",          estilos_css_gz_start, estilos_css_gz_end,
+                            "text/css; charset=utf-8", true, CACHE_RECURSO},
+  {"/portaria.png",         portaria_png_start, portaria_png_end,
+                            "image/png", false, CACHE_RECURSO}
+};
+
+#define MAX_ARQUIVOS_CONSOLE ((int)(sizeof(arquivos_console) / sizeof(arquivos_console[0])) - 1)
+
+static char etags_console[MAX_ARQUIVOS_CONSOLE + 1][TAM_ETAG];
+
+
+static void calcular_etags_console(void) {
+  for (int i = 1; i <= MAX_ARQUIVOS_CONSOLE; i++) {
+    const arquivo_console_t *arq = &arquivos_console[i];
+    uint32_t crc = esp_rom_crc32_le(0, arq->inicio, arq->fim - arq->inicio);
+
+    snprintf(etags_console[i], TAM_ETAG, "\"%08" PRIx32 "\"", crc);
+  }
+}
+
+
+/*  Trata GET de qualquer outro URI, servindo os arquivos do console.
+
+    GET / devolve index.html.
+ */
+static esp_err_t get_console_handler(httpd_req_t *req)
+{
+  arena_sessao_t *arena = iniciar_arena(req);
+  size_t len_uri = strcspn(req->uri, "?");
+  int i_arq = 1;
+
+  if (!(len_uri == 1 && req->uri[0] == '/')) {
+    for (i_arq = 1; i_arq <= MAX_ARQUIVOS_CONSOLE; i_arq++) {
+      const char *uri = arquivos_console[i_arq].uri;
+
+      if (strlen(uri) == len_uri && strncmp(req->uri, uri, len_uri) == 0) {
+        break;
+      }
+    }
+    if (i_arq > MAX_ARQUIVOS_CONSOLE) {
+      enviar_erro(req, HTTPD_404_NOT_FOUND, NULL);
+      return ESP_OK;
+    }
+  }
+
+  const arquivo_console_t *arq = &arquivos_console[i_arq];
+
+  httpd_resp_set_hdr(req, "ETag", etags_console[i_arq]);
+  httpd_resp_set_hdr(req, "Cache-Control", arq->cache);
+
+  if (etag_corresponde(req, arena, etags_console[i_arq])) {
+    definir_status(req, HTTPD_304);
+    httpd_resp_send(req, NULL, 0);
+    return ESP_OK;
+  }
+
+  httpd_resp_set_type(req, arq->tipo);
+  if (arq->comprimido) {
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+  }
+  httpd_resp_send(req, (const char *)arq->inicio, arq->fim - arq->inicio);
+
+  return ESP_OK;
+}
+
+
+/*  Registrado por último: o curinga atende apenas o que nenhum outro URI atendeu.
+ */
+static const httpd_uri_t get_console_uri = {
+    .uri       = "/*",
+    .method    = HTTP_GET,
+    .handler   = get_console_handler
+};
+
+
+/*  Trata OPTIONS para qualquer URI.
+
+    Responde às verificações prévias (preflight) dos navegadores quando o
+    cliente está em outra origem e envia cabeçalhos como If-None-Match.
+ */
+static esp_err_t options_handler(httpd_req_t *req)
+{
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Methods", "GET,HEAD,POST,OPTIONS");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Headers", "Authorization,Content-Type,If-None-Match");
+  httpd_resp_set_hdr(req, "Access-Control-Max-Age", "600");
+  definir_status(req, HTTPD_204);
+  httpd_resp_send(req, NULL, 0);
+
+  return ESP_OK;
+}
+
+
+static const httpd_uri_t options_uri = {
+    .uri       = "/*",
+    .method    = HTTP_OPTIONS,
+    .handler   = options_handler
+};
+
+
+/*  Trata HEAD/
+
+    Útil para IP scanners tentando encontrar o IP do sistema.
+ */
+static esp_err_t head_raiz_handler(httpd_req_t *req)
+{
+  int resposta = MSGL_OK;
+  
+  ESP_LOGI(TAG, "Tratando HEAD request na raiz");
+
+  // Preparar cabeçalhos da resposta
+  preencher_cabecalho_text_plain(req);
+
+  httpd_resp_send(req, mensagens_locais[resposta], HTTPD_RESP_USE_STRLEN);
+
+  return ESP_OK;
+}
+
+
+static const httpd_uri_t head_raiz_uri = {
+    .uri       = "/",
+    .method    = HTTP_HEAD,
+    .handler   = head_raiz_handler
+};
+
+
+/*  Trata qualquer URI registrado: mede, autentica e repassa ao tratamento original.
+
+    As métricas do URI são indicadas em user_ctx; o user_ctx do URI
+    original é restaurado antes de chamar seu tratamento.
+ */
+static esp_err_t tratar_uri_registrado(httpd_req_t *req)
+{
+  metricas_uri_t *metricas = (metricas_uri_t *)req->user_ctx;
+  const httpd_uri_t *original = metricas->original;
+  int64_t inicio = esp_timer_get_time();
+  esp_err_t ret = ESP_OK;
+
+  // A arena da conexão guarda a classe do status desta solicitação
+  arena_sessao_t *arena = iniciar_arena(req);
+
+  anotar_classe_status(req, CLS_2XX);
+
+  #if CONFIG_EXAMPLE_BASIC_AUTH
+  bool autorizado = (original->method == HTTP_OPTIONS || autenticar(req, original));
+  #else
+  bool autorizado = true;
+  #endif
+
+  if (autorizado) {
+    req->user_ctx = original->user_ctx;
+    ret = original->handler(req);
+  }
+
+  int64_t duracao = esp_timer_get_time() - inicio;
+  enum classe_status classe = (arena != NULL) ? arena->classe_status : CLS_2XX;
+
+  atomic_fetch_add_explicit(&metricas->respostas[classe], 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&metricas->faixas_latencia[faixa_latencia(duracao)], 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&metricas->soma_latencia_us, (unsigned long long)duracao, memory_order_relaxed);
+  atomic_fetch_add_explicit(&metricas->bytes_conteudo, req->content_len, memory_order_relaxed);
+  if (ret != ESP_OK) {
+    atomic_fetch_add_explicit(&metricas->falhas, 1, memory_order_relaxed);
+  }
+  return ret;
+}
+
+
+/*  Registra um URI, passando antes pelas métricas e pela autenticação.
+ */
+static esp_err_t registrar_uri(httpd_handle_t server, const httpd_uri_t *uri)
+{
+  if (num_uris_instrumentados >= MAX_URIS_INSTRUMENTADOS) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  metricas_uri_t *metricas = &uris_instrumentados[++num_uris_instrumentados];
+
+  metricas->original = uri;
+
+  // O servidor guarda uma cópia da estrutura; pode ficar na pilha.
+  httpd_uri_t instrumentado = *uri;
+
+  instrumentado.handler = tratar_uri_registrado;
+  instrumentado.user_ctx = metricas;
+
+  return httpd_register_uri_handler(server, &instrumentado);
+}
+
+
+#define TAM_LINHA_METRICA   (128)
+
+static const char *nome_metodo(httpd_method_t metodo)
+{
+  switch (metodo) {
+    case HTTP_GET:      return "GET";
+    case HTTP_HEAD:     return "HEAD";
+    case HTTP_POST:     return "POST";
+    case HTTP_OPTIONS:  return "OPTIONS";
+    default:            return "?";
+  }
+}
+
+
+/*  Envia uma linha de métrica como parte da resposta.
+ */
+static void enviar_linha_metrica(httpd_req_t *req, const char *formato, ...)
+{
+  char linha[TAM_LINHA_METRICA];
+  va_list args;
+
+  va_start(args, formato);
+  int len = vsnprintf(linha, sizeof(linha), formato, args);
+  va_end(args);
+
+  if (len > 0) {
+    httpd_resp_send_chunk(req, linha, MIN(len, (int)sizeof(linha) - 1));
+  }
+}
+
+
+/*  Trata GET /metrics
+
+    Texto no formato do Prometheus, enviado em partes (chunked), uma
+    linha por vez, sem montar a resposta inteira na memória.
+ */
+static esp_err_t get_metrics_handler(httpd_req_t *req)
+{
+  static const char *nomes_classes[NUM_CLASSES_STATUS] = {"2xx", "3xx", "4xx", "5xx"};
+
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  httpd_resp_set_type(req, "text/plain; version=0.0.4");
+
+  httpd_resp_sendstr_chunk(req, "# TYPE http_respostas_total counter\n");
+  for (int i = 1; i <= num_uris_instrumentados; i++) {
+    metricas_uri_t *m = &uris_instrumentados[i];
+
+    for (int c = 0; c < NUM_CLASSES_STATUS; c++) {
+      unsigned n = atomic_load_explicit(&m->respostas[c], memory_order_relaxed);
+
+      if (n > 0) {
+        enviar_linha_metrica(req, "http_respostas_total{metodo=\"%s\",uri=\"%s\",status=\"%s\"} %u\n",
+                             nome_metodo(m->original->method), m->original->uri, nomes_classes[c], n);
+      }
+    }
+  }
+
+  httpd_resp_sendstr_chunk(req, "# TYPE http_falhas_total counter\n");
+  for (int i = 1; i <= num_uris_instrumentados; i++) {
+    metricas_uri_t *m = &uris_instrumentados[i];
+
+    enviar_linha_metrica(req, "http_falhas_total{metodo=\"%s\",uri=\"%s\"} %u\n",
+                         nome_metodo(m->original->method), m->original->uri,
+                         atomic_load_explicit(&m->falhas, memory_order_relaxed));
+  }
+
+  httpd_resp_sendstr_chunk(req, "# TYPE http_conteudo_bytes_total counter\n");
+  for (int i = 1; i <= num_uris_instrumentados; i++) {
+    metricas_uri_t *m = &uris_instrumentados[i];
+
+    enviar_linha_metrica(req, "http_conteudo_bytes_total{metodo=\"%s\",uri=\"%s\"} %llu\n",
+                         nome_metodo(m->original->method), m->original->uri,
+                         atomic_load_explicit(&m->bytes_conteudo, memory_order_relaxed));
+  }
+
+  httpd_resp_sendstr_chunk(req, "# TYPE http_latencia_us histogram\n");
+  for (int i = 1; i <= num_uris_instrumentados; i++) {
+    metricas_uri_t *m = &uris_instrumentados[i];
+    const char *metodo = nome_metodo(m->original->method);
+    unsigned acumulado = 0;
+
+    for (int f = 0; f < NUM_FAIXAS_LATENCIA - 1; f++) {
+      acumulado += atomic_load_explicit(&m->faixas_latencia[f], memory_order_relaxed);
+      enviar_linha_metrica(req, "http_latencia_us_bucket{metodo=\"%s\",uri=\"%s\",le=\"%lu\"} %u\n",
+                           metodo, m->original->uri, (1UL << (f + BITS_PRIMEIRA_FAIXA)) - 1, acumulado);
+    }
+    acumulado += atomic_load_explicit(&m->faixas_latencia[NUM_FAIXAS_LATENCIA - 1], memory_order_relaxed);
+    enviar_linha_metrica(req, "http_latencia_us_bucket{metodo=\"%s\",uri=\"%s\",le=\"+Inf\"} %u\n",
+                         metodo, m->original->uri, acumulado);
+    enviar_linha_metrica(req, "http_latencia_us_sum{metodo=\"%s\",uri=\"%s\"} %llu\n",
+                         metodo, m->original->uri,
+                         atomic_load_explicit(&m->soma_latencia_us, memory_order_relaxed));
+    enviar_linha_metrica(req, "http_latencia_us_count{metodo=\"%s\",uri=\"%s\"} %u\n",
+                         metodo, m->original->uri, acumulado);
+  }
+
+  enviar_linha_metrica(req, "# TYPE http_parametros_invalidos_total counter\n"
+                            "http_parametros_invalidos_total %u\n",
+                       atomic_load_explicit(&metricas_gerais.parametros_invalidos, memory_order_relaxed));
+  enviar_linha_metrica(req, "# TYPE http_nao_autenticadas_total counter\n"
+                            "http_nao_autenticadas_total %u\n",
+                       atomic_load_explicit(&metricas_gerais.nao_autenticadas, memory_order_relaxed));
+  enviar_linha_metrica(req, "# TYPE heap_livre_bytes gauge\nheap_livre_bytes %" PRIu32 "\n",
+                       esp_get_free_heap_size());
+  enviar_linha_metrica(req, "# TYPE heap_minimo_livre_bytes gauge\nheap_minimo_livre_bytes %" PRIu32 "\n",
+                       esp_get_minimum_free_heap_size());
+  // Executado na tarefa do servidor: a pilha medida é a do httpd
+  enviar_linha_metrica(req, "# TYPE httpd_pilha_minimo_livre_bytes gauge\nhttpd_pilha_minimo_livre_bytes %u\n",
+                       (unsigned)uxTaskGetStackHighWaterMark(NULL));
+  enviar_linha_metrica(req, "# TYPE gpio_ticks_atrasados_total counter\ngpio_ticks_atrasados_total %" PRIu32 "\n",
+                       controle_gpio_ticks_atrasados());
+
+  estatisticas_comandos_t comandos;
+
+  controle_gpio_estatisticas_comandos(&comandos);
+  enviar_linha_metrica(req, "# TYPE gpio_comandos_total counter\ngpio_comandos_total %" PRIu32 "\n",
+                       comandos.executados);
+  enviar_linha_metrica(req, "# TYPE gpio_comandos_descartados_total counter\n"
+                            "gpio_comandos_descartados_total %" PRIu32 "\n",
+                       comandos.descartados);
+  enviar_linha_metrica(req, "# TYPE gpio_comando_latencia_us_sum counter\n"
+                            "gpio_comando_latencia_us_sum %" PRIu64 "\n",
+                       comandos.soma_latencia_us);
+  enviar_linha_metrica(req, "# TYPE gpio_comando_latencia_max_us gauge\n"
+                            "gpio_comando_latencia_max_us %" PRIu32 "\n",
+                       comandos.latencia_max_us);
+  enviar_linha_metrica(req, "# TYPE gpio_pulsos_total counter\ngpio_pulsos_total %" PRIu32 "\n",
+                       comandos.pulsos);
+  enviar_linha_metrica(req, "# TYPE gpio_pulso_atraso_us_sum counter\n"
+                            "gpio_pulso_atraso_us_sum %" PRIu64 "\n",
+                       comandos.soma_atraso_pulso_us);
+  enviar_linha_metrica(req, "# TYPE gpio_pulso_atraso_max_us gauge\n"
+                            "gpio_pulso_atraso_max_us %" PRIu32 "\n",
+                       comandos.atraso_max_pulso_us);
+
+#if CONFIG_CONTROLE_GPIO_EXPANSOR
+  estatisticas_expansor_t expansor;
+
+  // Transações por tick = gpio_expansor_transacoes_total / gpio_expansor_ticks_total
+  expansor_gpio_estatisticas(&expansor);
+  enviar_linha_metrica(req, "# TYPE gpio_expansor_ticks_total counter\n"
+                            "gpio_expansor_ticks_total %" PRIu32 "\n", expansor.ticks);
+  enviar_linha_metrica(req, "# TYPE gpio_expansor_leituras_total counter\n"
+                            "gpio_expansor_leituras_total %" PRIu32 "\n", expansor.leituras);
+  enviar_linha_metrica(req, "# TYPE gpio_expansor_leituras_evitadas_total counter\n"
+                            "gpio_expansor_leituras_evitadas_total %" PRIu32 "\n",
+                       expansor.leituras_evitadas);
+  enviar_linha_metrica(req, "# TYPE gpio_expansor_escritas_total counter\n"
+                            "gpio_expansor_escritas_total %" PRIu32 "\n", expansor.escritas);
+  enviar_linha_metrica(req, "# TYPE gpio_expansor_transacoes_total counter\n"
+                            "gpio_expansor_transacoes_total %" PRIu32 "\n", expansor.transacoes);
+  enviar_linha_metrica(req, "# TYPE gpio_expansor_falhas_total counter\n"
+                            "gpio_expansor_falhas_total %" PRIu32 "\n", expansor.falhas);
+#endif
+
+  httpd_resp_send_chunk(req, NULL, 0);
+
+  return ESP_OK;
+}
+
+
+static const httpd_uri_t get_metrics_uri = {
+    .uri       = "/metrics",
+    .method    = HTTP_GET,
+    .handler   = get_metrics_handler
+};
+
+
+/*  URIs atendidos pelo servidor, na ordem em que são comparados.
+ */
+static const httpd_uri_t *uris_servidor[] = {
+  &get_status_uri,
+  &get_metrics_uri,
+  &get_sensor_uri,
+  &get_contador_uri,
+  &get_snapshot_uri,
+  &get_eventos_uri,
+  &get_historico_uri,
+  &post_contador_n_uri,
+  &post_atuador_n_uri,
+  &post_lote_uri,
+  &post_regras_uri,
+  &get_regras_uri,
+  #if CONFIG_HTTPD_WS_SUPPORT
+  &ws_controle_uri,
+  #endif
+  &post_config_uri,
+  &get_config_uri,
+  &head_raiz_uri,
+  &options_uri
+};
+
+#define NUM_URIS_SERVIDOR ((int)(sizeof(uris_servidor) / sizeof(uris_servidor[0])))
+
+#define NUM_URIS_CONSOLE 1
+
+#if CONFIG_EXAMPLE_BASIC_AUTH
+#define NUM_URIS_AUTENTICACAO 1
+#else
+#define NUM_URIS_AUTENTICACAO 0
+#endif
+
+_Static_assert(NUM_URIS_SERVIDOR + NUM_URIS_AUTENTICACAO + NUM_URIS_CONSOLE <= MAX_URIS_INSTRUMENTADOS,
+               "Aumentar MAX_URIS_INSTRUMENTADOS");
+
+
+// Documentação das funções públicas no arquivo header.
+
+
+httpd_handle_t start_webserver(void)
+{
+  httpd_handle_t server = NULL;
+  httpd_config_t config = HTTPD_DEFAULT_CONFIG();
 
   config.lru_purge_enable = true;
   config.server_port = CONFIG_HTTP_SERVER_PORT;
 
+  // Cada classe de periférico ocupa uma única entrada, com curinga no URI.
+  config.uri_match_fn = httpd_uri_match_wildcard;
+  config.max_uri_handlers = NUM_URIS_SERVIDOR + NUM_URIS_AUTENTICACAO + NUM_URIS_CONSOLE;
+  config.close_fn = fechar_sessao;
+
+  #if CONFIG_EXAMPLE_BASIC_AUTH
+  preparar_credencial();
+  #endif
+
+  num_uris_instrumentados = 0;
+
+  for (int i = 0; i < MAX_ASSINANTES_EVENTOS; i++) {
+    assinantes_eventos[i] = -1;
+  }
+  num_assinantes_eventos = 0;
+
+  #if CONFIG_HTTPD_WS_SUPPORT
+  for (int i = 0; i < MAX_CLIENTES_WS; i++) {
+    clientes_ws[i] = -1;
+  }
+  num_clientes_ws = 0;
+  #endif
+
   // Start the httpd server
   ESP_LOGI(TAG, "Starting server on port: '%d'", config.server_port);
 
   if (httpd_start(&server, &config) == ESP_OK) {
       // Set URI handlers
       ESP_LOGI(TAG, "Registering URI handlers");
-      httpd_register_uri_handler(server, &get_status_uri);
-      httpd_register_uri_handler(server, &get_sensor_uri);
-      httpd_register_uri_handler(server, &get_contador_uri);
-      httpd_register_uri_handler(server, &post_contador1_uri);
-      httpd_register_uri_handler(server, &post_atuador1_uri);
-      httpd_register_uri_handler(server, &post_atuador2_uri);
-      httpd_register_uri_handler(server, &post_atuador3_uri);
-      httpd_register_uri_handler(server, &post_atuador4_uri);
-      httpd_register_uri_handler(server, &post_config_uri);
-      httpd_register_uri_handler(server, &head_raiz_uri);
+      for (int i = 0; i < NUM_URIS_SERVIDOR; i++) {
+        if (registrar_uri(server, uris_servidor[i]) != ESP_OK) {
+          ESP_LOGE(TAG, "Falha registrando %s", uris_servidor[i]->uri);
+        }
+      }
 
       #if CONFIG_EXAMPLE_BASIC_AUTH
-      httpd_register_basic_auth(server);
+      registrar_uri(server, &basic_auth);
+      #endif
+
+      // Depois de todos os outros, para não encobri-los.
+      calcular_etags_console();
+      registrar_uri(server, &get_console_uri);
+
+      servidor_ativo = server;
+
+      #if !CONFIG_CONTROLE_GPIO_SIMULACAO
+      if (tarefa_eventos == NULL &&
+          xTaskCreate(executar_tarefa_eventos, "eventos", PILHA_TAREFA_EVENTOS, NULL,
+                      PRIORIDADE_TAREFA_EVENTOS, &tarefa_eventos) != pdPASS) {
+        ESP_LOGE(TAG, "Falha ao criar a tarefa dos eventos");
+        tarefa_eventos = NULL;
+      }
       #endif
+      controle_gpio_registrar_observador(observar_periferico);
       return server;
   }
 
@@ -906,6 +3026,9 @@ httpd_handle_t start_webserver(void)
 
 esp_err_t stop_webserver(httpd_handle_t server)
 {
+  controle_gpio_registrar_observador(NULL);
+  servidor_ativo = NULL;
+
   // Stop the httpd server
   return httpd_stop(server);
 }
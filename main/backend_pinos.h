@@ -0,0 +1,45 @@
+/** @file backend_pinos.h - Acesso aos pinos dos periféricos (GPIO do chip, expansores).
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PINOS_POR_BACKEND   64    ///< Pinos atendidos por um backend.
+
+/** Número de pino de um GPIO do chip. */
+#define PINO_CHIP(gpio)             (gpio)
+
+/** Número de pino de um expansor: bit 0 a 7 na porta A, 8 a 15 na porta B. */
+#define PINO_EXPANSOR(n, bit)       (PINOS_POR_BACKEND + 16 * (n) + (bit))
+
+/** Backend que atende um pino. */
+#define BACKEND_PINO(pino)          ((pino) / PINOS_POR_BACKEND)
+
+/** Bit do pino nos mapas de bits do seu backend. */
+#define BIT_PINO(pino)              (1ULL << ((pino) % PINOS_POR_BACKEND))
+
+
+/** Operações de um backend de pinos.
+
+    Cada backend atende até PINOS_POR_BACKEND pinos, e todas as operações
+    tratam os pinos de uma vez, em mapas de bits (bit n para o pino n do
+    backend). As operações são chamadas apenas pela tarefa de controle.
+*/
+typedef struct {
+  const char *nome;                                     ///< Nome, para o log
+
+  /** Configurar os pinos, com as saídas já no nível inicial.
+      As entradas usam pull-up. */
+  bool      (*iniciar)(uint64_t saidas, uint64_t entradas, uint64_t nivel_saidas);
+
+  /** Ler o nível de todas as entradas (chamada a cada tick).
+      Pode devolver a amostra anterior, se o backend sabe que nada mudou. */
+  uint64_t  (*ler_entradas)(void);
+
+  /** Ligar e desligar saídas. */
+  void      (*escrever_saidas)(uint64_t ligar, uint64_t desligar);
+
+  /** Enviar as saídas alteradas de uma só vez (NULL se a escrita é imediata). */
+  void      (*descarregar)(void);
+} backend_pinos_t;
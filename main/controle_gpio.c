@@ -14,13 +14,29 @@
     Um pino especial oferece ao aplicativo um indicador de reconfiguração,
     para que o sistema possa ser retornado à configuração de fábrica.
     
+    Os periféricos são alterados apenas pela tarefa de controle, que recebe
+    os comandos das demais tarefas por uma fila (veja controle_gpio_ativar_timer).
+
     @author João Vianna (jvianna@gmail.com)
     @version 0.82 03/05/2024
+    @version 0.83
+      - Tarefa de controle com fila de comandos, no lugar do timer.
+      - Fim dos pulsos por esp_timer, com precisão de milissegundos.
+      - Entradas lidas de uma só vez e filtradas por contador vertical.
+      - Estatísticas dos contadores: janelas deslizantes, taxas e intervalos.
+      - Cada tick alimenta o histórico em RAM (historico.c).
+      - Contagens e atuadores restaurados na partida (persistencia.c).
+      - Regras de automação avaliadas após cada mudança (regras.c).
+      - Pinos atendidos por backends: GPIO do chip e expansores MCP23017
+        (expansor_gpio.c), com mais atuadores e sensores.
+      - Simulação em tempo virtual no Linux (simulacao_gpio.c).
     
     Código criado a partir do exemplo:
     .../esp-idf/examples/peripherals/gpio/generic_gpio/main/gpio_example_main.c  
     
-    @todo Código dos contadores
+    Os contadores usam a unidade PCNT, quando disponível no chip; senão,
+    ou se a entrada é um contato mecânico, são lidos por software a cada
+    tick, com 'debouncing'.
 */
 
 /*  Parte do comentário original
@@ -34,14 +50,38 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <stdatomic.h>
 
 #include "freertos/FreeRTOS.h"
-#include "freertos/timers.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "soc/soc_caps.h"
+#if !CONFIG_CONTROLE_GPIO_SIMULACAO
 #include "driver/gpio.h"
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+#include "esp_timer.h"
+#endif
+#if SOC_PCNT_SUPPORTED
+#include "driver/pulse_cnt.h"
+#endif
 #include <esp_log.h>
 
+#include "backend_pinos.h"
 #include "controle_gpio.h"
+#include "filtro_entradas.h"
+#if CONFIG_CONTROLE_GPIO_EXPANSOR
+#include "expansor_gpio.h"
+#endif
+#include "historico.h"
+#include "persistencia.h"
+#include "regras.h"
+#if CONFIG_CONTROLE_GPIO_SIMULACAO
+#include "simulacao_gpio.h"
+#endif
 
 /*
  * Comentário no código original
@@ -66,264 +106,1871 @@
  
  #define TAG "controle_gpio"
 
+#if CONFIG_CONTROLE_GPIO_SIMULACAO
+// Números dos GPIO usados nas tabelas (driver/gpio.h não existe no Linux)
+#define GPIO_NUM_4      4
+#define GPIO_NUM_18     18
+#define GPIO_NUM_19     19
+#define GPIO_NUM_22     22
+#define GPIO_NUM_23     23
+#define GPIO_NUM_32     32
+#define GPIO_NUM_33     33
+#define GPIO_NUM_35     35
+#endif
+
 // Um pino é usado para forçar configuração de fábrica
 #define GPIO_RECONFIG   GPIO_NUM_35
 
 // Auxiliares para configuração do micro-controlador
-#define MASCARA_ATUADORES  ((1ULL << GPIO_NUM_18) | (1ULL << GPIO_NUM_19) | (1ULL << GPIO_NUM_22) | (1ULL << GPIO_NUM_23))
-#define MASCARA_CONTADORES ((1ULL << GPIO_NUM_4))
-#define MASCARA_SENSORES   ((1ULL << GPIO_NUM_32) | (1ULL << GPIO_NUM_33))
 #define MASCARA_READ_ONLY  ((1ULL << GPIO_RECONFIG))
 
+// Backends dos pinos (veja backend_pinos.h): GPIO do chip e expansores
+#if CONFIG_CONTROLE_GPIO_EXPANSOR
+#define NUM_BACKENDS    2
+#else
+#define NUM_BACKENDS    1
+#endif
+
 // Duração do tick do temporizador local em ms
-#define INTERVALO_TICK_MS     100
+#define INTERVALO_TICK_MS     10
+
+// Contadores por hardware: a unidade PCNT, ou as bordas do roteiro na simulação
+#define CONTAGEM_HARDWARE     (SOC_PCNT_SUPPORTED || CONFIG_CONTROLE_GPIO_SIMULACAO)
+
+
+/*  Relógio da tarefa de controle: esp_timer, ou o relógio virtual da simulação.
+ */
+static inline int64_t agora_us(void) {
+#if CONFIG_CONTROLE_GPIO_SIMULACAO
+  return simulacao_gpio_agora_us();
+#else
+  return esp_timer_get_time();
+#endif
+}
+
+// Janela padrão de 'debouncing' das entradas em ms
+#define JANELA_DEBOUNCE_MS    30
 
 // Tabelas de periféricos
 
-// Mapeia pinos GPIO de entrada para id dos sensores
-static const int mapa_sensores[MAX_SENSORES + 1] = {
+// Mapeia pinos de entrada para id dos sensores (os dos expansores
+// são preenchidos por mapear_expansores)
+static int mapa_sensores[MAX_SENSORES + 1] = {
   0,
   GPIO_NUM_32,
   GPIO_NUM_33
 };
 
+// Janela de 'debouncing' de cada sensor em ms
+static int janela_sensores_ms[MAX_SENSORES + 1] = {
+  0,
+  JANELA_DEBOUNCE_MS,
+  JANELA_DEBOUNCE_MS
+};
+
+
+/*  Janela deslizante de eventos, dividida em baldes de duração fixa.
+
+    O balde corrente é o do instante atual; ao avançar o tempo, os baldes
+    que saem da janela são subtraídos da soma. Cada tick custa no máximo
+    BALDES_JANELA passos, e em geral nenhum ou um.
+ */
+#define BALDES_JANELA   60
+
+typedef struct {
+  uint32_t  baldes[BALDES_JANELA];
+  uint32_t  soma;               // Eventos em todos os baldes da janela
+  int64_t   indice;             // Número do balde corrente (instante / duração)
+  int       num_baldes;
+  int64_t   duracao_us;         // Duração de cada balde
+} janela_eventos_t;
+
+
+// Estado das estatísticas de um contador (veja atualizar_taxas)
+typedef struct {
+  janela_eventos_t  segundo;            // 10 baldes de 100 ms
+  janela_eventos_t  minuto;             // 60 baldes de 1 s
+  janela_eventos_t  hora;               // 60 baldes de 1 min
+  uint32_t          eventos_segundo;    // Eventos no segundo corrente (médias exponenciais)
+  int64_t           segundo_corrente;
+  estatisticas_contador_t publico;      // Parte publicada para os leitores
+} taxas_contador_t;
+
 
 typedef struct {
   int   gpio;                   //< Porta do ESP32 onde está ligado o contador 
-  int   contagem;               //< Contagem do número de eventos disparados
-  int   valor_anterior;          //< Valor do nível da entrada da última vez que foi lida.
+  int64_t contagem;             //< Contagem do número de eventos disparados (64 bits)
+  int   janela_ms;              //< Janela de 'debouncing' da contagem por software
+  bool  contato;                //< Contato mecânico: sempre por software, com 'debouncing'
+  taxas_contador_t taxas;       //< Estatísticas (janelas, taxas e intervalos)
+#if CONTAGEM_HARDWARE
+  bool  hardware;               //< Contado pelo hardware (veja iniciar_contagem_hardware)
+  uint32_t leitura_hardware;    //< Última leitura do hardware, módulo 2^32
+#endif
+#if SOC_PCNT_SUPPORTED
+  pcnt_unit_handle_t unidade;   //< Unidade PCNT, ou NULL se a contagem é por software
+#endif
 } estado_contador_t;
 
 
-// Mapeia pinos GPIO de entrada para id dos contadores
+// Mapeia pinos GPIO de entrada para id dos contadores. Use contato = true
+// para reed-switches, botões e relés: o filtro do PCNT (~12us) não elimina
+// os repiques desses contatos, que passam a ser contados no tick.
 static estado_contador_t mapa_contadores[MAX_CONTADORES + 1] = {
   {0},
   { .gpio = GPIO_NUM_4,
     .contagem = 0,
-    .valor_anterior = 1
+    .janela_ms = JANELA_DEBOUNCE_MS,
+    .contato = false
   }
 };
 
 
+/*  Contagem de um contador nas leituras em int: para em INT_MAX.
+ */
+static inline int contagem_int(const estado_contador_t *p_contador) {
+  return (p_contador->contagem < INT_MAX) ? (int)p_contador->contagem : INT_MAX;
+}
+
+
 typedef struct {
-  int   gpio;                   //< Porta do ESP32 onde está ligado o atuador 
+  int   pino;                   //< Pino onde está ligado o atuador (veja backend_pinos.h)
   int   valor;                  //< Último valor atribuído ao atuador
-  int   tempo_restante;         //< Tempo restante para ser desligado em TICKS
+  int64_t fim_pulso_us;         //< Instante do fim do pulso (agora_us)
+  int   posicao_heap;           //< Posição em heap_pulsos, ou 0 se não há pulso
 } estado_atuador_t;
 
 
-// Mapeia pinos GPIO de saída para id dos atuadores
+// Mapeia pinos de saída para id dos atuadores
 static estado_atuador_t mapa_atuadores[MAX_ATUADORES + 1] = {
   {0},
-  { .gpio = GPIO_NUM_18},
-  { .gpio = GPIO_NUM_19},
-  { .gpio = GPIO_NUM_22},
-  { .gpio = GPIO_NUM_23}
+  { .pino = GPIO_NUM_18},
+  { .pino = GPIO_NUM_19},
+  { .pino = GPIO_NUM_22},
+  { .pino = GPIO_NUM_23}
 };
 
 
-// Documentação das funções públicas no arquivo header.
+// Função avisada quando muda o estado de algum periférico
+static controle_gpio_observador_t observador_perifericos = NULL;
 
+// Versão do estado, incrementada a cada mudança (tarefa de controle) e
+// publicada junto com o estado, em publicar_estado()
+static uint32_t versao_estado = 1;
 
-/* Inicializa periféricos do ESP32
+// Ticks atrasados
+static atomic_uint ticks_atrasados = 0;
+
+
+/*  Tarefa de controle.
+
+    As tabelas mapa_atuadores, mapa_contadores e entradas pertencem
+    à tarefa de controle: só ela as altera. As demais tarefas (servidor
+    HTTP, etc.) enviam comandos por uma fila limitada, e a tarefa de
+    controle os executa um de cada vez, na ordem de chegada. O tick
+    (pulsos, contadores e sensores) é executado pela mesma tarefa, entre
+    os comandos, eliminando as condições de corrida entre o tick e os
+    comandos.
+
+    Quem envia um comando aguarda sua execução (com limite de tempo), de
+    modo que uma leitura logo após o comando já vê o novo estado.
+
+    Para leitura, a tarefa de controle publica uma cópia do estado,
+    protegida por um contador de sequência (seqlock): o contador é ímpar
+    durante a escrita, e o leitor repete a cópia se o contador mudou.
+    Leitores nunca bloqueiam a tarefa de controle.
  */
-void controle_gpio_iniciar(void) {
+#define TAM_FILA_COMANDOS           (16)
+#define PILHA_TAREFA_CONTROLE       (3072)
+#define PRIORIDADE_TAREFA_CONTROLE  (configMAX_PRIORITIES - 3)
+#define TEMPO_MAX_COMANDO_MS        (50)
 
-    // Configuração dos atuadores (portas de saída binária)
-    gpio_config_t io_conf = {
-      .pin_bit_mask = MASCARA_ATUADORES,
-      .mode = GPIO_MODE_OUTPUT,
-      .intr_type = GPIO_INTR_DISABLE,
-      .pull_down_en = GPIO_PULLDOWN_DISABLE,
-      .pull_up_en = GPIO_PULLUP_DISABLE
-    };
-  
-    gpio_config(&io_conf);
+#if portNUM_PROCESSORS > 1
+#define NUCLEO_TAREFA_CONTROLE      (1)     // O núcleo 0 fica com Wifi e servidor
+#else
+#define NUCLEO_TAREFA_CONTROLE      (0)
+#endif
 
-    // Configuração dos contadores
-    io_conf.pin_bit_mask = MASCARA_CONTADORES;
-    io_conf.mode = GPIO_MODE_INPUT;
-    io_conf.pull_up_en = GPIO_PULLUP_ENABLE;
-    // Contador implementado por software - os pinos serâo simplesmente pinos de entrada
-    io_conf.intr_type = GPIO_INTR_DISABLE,
-    gpio_config(&io_conf);
-    
-    // Configuração dos sensores (entradas binárias simpĺes, com pullup)
-    io_conf.pin_bit_mask = MASCARA_SENSORES;
-    //set as input mode
-    io_conf.mode = GPIO_MODE_INPUT;
-    //enable pull-up mode
-    io_conf.pull_up_en = GPIO_PULLUP_ENABLE;
-    io_conf.intr_type = GPIO_INTR_DISABLE;
-    gpio_config(&io_conf);
-    
-    // Sensores Read Only e Pino de reconfiguração
-    // O circuito PULL_UP/PULL_DOWN deve ser implementado em hardware externo.
-    io_conf.pin_bit_mask = MASCARA_READ_ONLY;
-    io_conf.mode = GPIO_MODE_INPUT;
-    io_conf.pull_down_en = GPIO_PULLDOWN_DISABLE;
-    io_conf.pull_up_en = GPIO_PULLUP_DISABLE;
-    io_conf.intr_type = GPIO_INTR_DISABLE;
-    gpio_config(&io_conf);
+enum tipo_comando {
+  CMD_MUDAR_ATUADOR,
+  CMD_ALTERNAR_ATUADOR,
+  CMD_PULSAR_ATUADOR,
+  CMD_REINICIAR_CONTADOR,
+  CMD_APLICAR_LOTE,
+  CMD_DEFINIR_DEBOUNCE,
+  CMD_EXPIRAR_PULSOS            // Interno, enviado pelo temporizador dos pulsos
+};
+
+typedef struct {
+  enum tipo_comando tipo;
+  int               id;
+  int               valor;          // Valor do atuador, duração do pulso ou janela em ms
+  enum periferico   classe;         // Apenas para CMD_DEFINIR_DEBOUNCE
+  lote_atuadores_t  lote;           // Apenas para CMD_APLICAR_LOTE
+  TaskHandle_t      origem;         // Tarefa a avisar quando executado (ou NULL)
+  uint32_t          sequencia;      // Número do comando, devolvido no aviso à origem
+  int               vaga;           // Índice em situacao_comandos (se origem != NULL)
+  int64_t           instante_us;    // Momento do envio, para medir a latência
+} comando_gpio_t;
+
+// Estado publicado pela tarefa de controle para os leitores
+typedef struct {
+  uint32_t                versao;           // versao_estado no momento da publicação
+  estado_placa_t          estado;
+  estatisticas_comandos_t comandos;
+  estatisticas_contador_t contadores[MAX_CONTADORES + 1];
+} estado_publicado_t;
+
+// Passos de uma cadeia de regras (ações que disparam outras regras)
+#define MAX_PASSOS_REGRAS           (4)
+
+static QueueHandle_t fila_comandos = NULL;
+#if !CONFIG_CONTROLE_GPIO_SIMULACAO
+static TaskHandle_t tarefa_controle = NULL;
+#endif
+
+static atomic_uint sequencia_publicada = 0;
+static estado_publicado_t estado_publicado;
+
+// Estatísticas, alteradas apenas pela tarefa de controle e publicadas
+static estatisticas_comandos_t estatisticas_comandos;
+
+// Comandos descartados por fila cheia ou tempo esgotado (alterado por quem envia)
+static atomic_uint comandos_descartados = 0;
+
+/*  Situação dos comandos que aguardam confirmação.
+
+    Quem envia ocupa uma vaga com o número do comando e a situação
+    PENDENTE. A tarefa de controle só executa o comando se conseguir
+    trocar PENDENTE por EXECUTANDO; quem envia, ao esgotar o tempo, tenta
+    trocar PENDENTE por CANCELADO. Apenas um dos dois consegue: o comando
+    cancelado é descartado ao sair da fila, e quem perdeu a troca aguarda
+    o fim da execução. O número no valor da vaga evita confundir um
+    comando com outro que ocupou a mesma vaga depois.
+ */
+#define MAX_COMANDOS_PENDENTES      (2 * TAM_FILA_COMANDOS)
+
+enum situacao_comando {
+  CMD_LIVRE,
+  CMD_PENDENTE,
+  CMD_EXECUTANDO,
+  CMD_CANCELADO
+};
+
+#define SITUACAO_COMANDO(seq, sit)  (((seq) << 2) | (sit))
+#define SITUACAO(valor)             ((valor) & 3)
+
+static atomic_uint situacao_comandos[MAX_COMANDOS_PENDENTES];
+static atomic_uint proxima_sequencia = 0;
+
+
+/*  Amostragem e 'debouncing' das entradas.
+
+    A cada tick, as entradas de cada backend são lidas uma única vez, em
+    um mapa de bits com um bit por pino, e filtradas todas juntas por um
+    contador vertical (filtro_entradas.c), com a janela de cada pino em
+    ticks.
+
+    Sensores e contadores por software apenas consultam os mapas de bits,
+    sem acessar o hardware. O registro de bordas (interrupção) continua
+    vendo o sinal elétrico, sem filtro.
+ */
+
+// Entradas de cada backend
+static filtro_entradas_t entradas[NUM_BACKENDS];
+
+
+#if !CONFIG_CONTROLE_GPIO_SIMULACAO
+/*  Lê os registradores de entrada (todos os GPIO de uma vez).
+ */
+static inline uint64_t ler_registradores_entrada(void) {
+#if SOC_GPIO_PIN_COUNT > 32
+  return ((uint64_t)REG_READ(GPIO_IN1_REG) << 32) | REG_READ(GPIO_IN_REG);
+#else
+  return REG_READ(GPIO_IN_REG);
+#endif
 }
 
 
-const char *controle_gpio_status(void) {
-  return "Modulo de Controle\nVersao:1.0\nAtuadores:4\nSensores:2\nContadores:1\n\n";
+/*  Altera várias saídas GPIO com uma escrita em cada registrador set/clear.
+
+    Os bits das máscaras são os números dos pinos GPIO.
+ */
+static void escrever_saidas(uint64_t pinos_ligar, uint64_t pinos_desligar) {
+  REG_WRITE(GPIO_OUT_W1TS_REG, (uint32_t)pinos_ligar);
+  REG_WRITE(GPIO_OUT_W1TC_REG, (uint32_t)pinos_desligar);
+#if SOC_GPIO_PIN_COUNT > 32
+  // Pinos a partir de 32 ficam no segundo banco de registradores
+  REG_WRITE(GPIO_OUT1_W1TS_REG, (uint32_t)(pinos_ligar >> 32));
+  REG_WRITE(GPIO_OUT1_W1TC_REG, (uint32_t)(pinos_desligar >> 32));
+#endif
 }
 
 
-int controle_gpio_ler_sensor(int id) {
-  if((id > 0) && (id <= MAX_SENSORES)) {
-    return gpio_get_level(mapa_sensores[id]);
-  } else {
-    // Condição de erro: id inválido
-    return -1;
+/*  Configura os GPIO do chip: saídas já no nível inicial e entradas
+    (sensores e contadores) com pull-up.
+ */
+static bool iniciar_gpio_chip(uint64_t saidas, uint64_t pinos_entrada, uint64_t nivel_saidas) {
+  // Nível inicial dos atuadores, antes de habilitar as saídas
+  escrever_saidas(nivel_saidas & saidas, saidas & ~nivel_saidas);
+
+  gpio_config_t io_conf = {
+    .pin_bit_mask = saidas,
+    .mode = GPIO_MODE_OUTPUT,
+    .intr_type = GPIO_INTR_DISABLE,
+    .pull_down_en = GPIO_PULLDOWN_DISABLE,
+    .pull_up_en = GPIO_PULLUP_DISABLE
+  };
+  bool ok = (gpio_config(&io_conf) == ESP_OK);
+
+  // Contadores por software e sensores são simplesmente pinos de entrada
+  io_conf.pin_bit_mask = pinos_entrada;
+  io_conf.mode = GPIO_MODE_INPUT;
+  io_conf.pull_up_en = GPIO_PULLUP_ENABLE;
+  return (gpio_config(&io_conf) == ESP_OK) && ok;
+}
+
+
+static const backend_pinos_t backend_gpio_chip = {
+  .nome = "gpio",
+  .iniciar = iniciar_gpio_chip,
+  .ler_entradas = ler_registradores_entrada,
+  .escrever_saidas = escrever_saidas,
+  .descarregar = NULL                 // Escrita imediata nos registradores
+};
+#endif
+
+
+// Backend de cada faixa de PINOS_POR_BACKEND pinos
+static const backend_pinos_t *const backends[NUM_BACKENDS] = {
+#if CONFIG_CONTROLE_GPIO_SIMULACAO
+  &backend_simulado,                  // No lugar dos GPIO do chip
+#else
+  &backend_gpio_chip,
+#endif
+#if CONFIG_CONTROLE_GPIO_EXPANSOR
+  &backend_expansor
+#endif
+};
+
+
+/*  Define a janela de 'debouncing' de um pino (em ms, arredondada para ticks).
+ */
+static void definir_janela(int pino, int janela_ms) {
+  int ticks = (janela_ms + INTERVALO_TICK_MS - 1) / INTERVALO_TICK_MS;
+
+  filtro_entradas_definir_janela(&entradas[BACKEND_PINO(pino)], BIT_PINO(pino), ticks);
+}
+
+
+static inline int nivel_entrada(int pino) {
+  return (entradas[BACKEND_PINO(pino)].estavel & BIT_PINO(pino)) ? 1 : 0;
+}
+
+
+// Borda (após o 'debouncing') no último tick
+static inline bool mudou_entrada(int pino) {
+  const filtro_entradas_t *e = &entradas[BACKEND_PINO(pino)];
+
+  return ((e->subidas | e->descidas) & BIT_PINO(pino)) != 0;
+}
+
+
+static inline bool desceu_entrada(int pino) {
+  return (entradas[BACKEND_PINO(pino)].descidas & BIT_PINO(pino)) != 0;
+}
+
+
+/*  Escreve uma saída no seu backend.
+ */
+static inline void escrever_pino(int pino, int valor) {
+  uint64_t bit = BIT_PINO(pino);
+
+  backends[BACKEND_PINO(pino)]->escrever_saidas(valor ? bit : 0, valor ? 0 : bit);
+}
+
+
+/*  Envia as saídas acumuladas pelos backends que não escrevem de imediato.
+ */
+static void descarregar_saidas(void) {
+  for (int b = 0; b < NUM_BACKENDS; b++) {
+    if (backends[b]->descarregar != NULL) {
+      backends[b]->descarregar();
+    }
   }
 }
 
 
-int controle_gpio_ler_contador(int id) {
-  if((id > 0) && (id <= MAX_CONTADORES)) {
-    return mapa_contadores[id].contagem;
-  } else {
-    // Condição de erro: id inválido
-    return -1;
+#if CONFIG_CONTROLE_GPIO_EXPANSOR
+/*  Numera os pinos dos expansores depois dos pinos do ESP32: atuadores
+    na porta A e sensores na porta B de cada expansor.
+ */
+static void mapear_expansores(void) {
+  for (int n = 0; n < CONFIG_EXPANSOR_QUANTIDADE; n++) {
+    for (int bit = 0; bit < 8; bit++) {
+      int id_sensor = SENSORES_CHIP + 8 * n + bit + 1;
+
+      mapa_atuadores[ATUADORES_CHIP + 8 * n + bit + 1].pino = PINO_EXPANSOR(n, bit);
+      mapa_sensores[id_sensor] = PINO_EXPANSOR(n, 8 + bit);
+      janela_sensores_ms[id_sensor] = JANELA_DEBOUNCE_MS;
+    }
   }
 }
+#endif
 
 
-void controle_gpio_reiniciar_contador(int id) {
-  if((id > 0) && (id <= MAX_CONTADORES)) {
-    mapa_contadores[id].contagem = 0;
-    mapa_contadores[id].valor_anterior = 1;
+/*  Estatísticas dos contadores.
+
+    Atualizadas pela tarefa de controle a cada tick, com custo constante
+    por tick e por evento, sem guardar os eventos individualmente:
+      - Janelas deslizantes do último segundo, minuto e hora;
+      - Médias exponenciais da contagem por segundo, com constantes de
+        tempo de 1, 5 e 15 minutos, atualizadas a cada segundo completo;
+      - Histograma dos intervalos entre eventos, com a resolução do tick:
+        eventos contados no mesmo tick (PCNT) caem na primeira faixa.
+ */
+const uint32_t controle_gpio_faixas_intervalo_ms[FAIXAS_INTERVALO] = {
+  10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 60000, 0
+};
+
+// exp(-1 s / constante de tempo) para 1, 5 e 15 minutos
+#define DECAIMENTO_1MIN     (0.98347145f)
+#define DECAIMENTO_5MIN     (0.99667221f)
+#define DECAIMENTO_15MIN    (0.99888951f)
+
+
+static void iniciar_janela(janela_eventos_t *janela, int num_baldes, int64_t duracao_us,
+                           int64_t agora) {
+  memset(janela->baldes, 0, sizeof(janela->baldes));
+  janela->soma = 0;
+  janela->num_baldes = num_baldes;
+  janela->duracao_us = duracao_us;
+  janela->indice = agora / duracao_us;
+}
+
+
+static void avancar_janela(janela_eventos_t *janela, int64_t agora) {
+  int64_t indice = agora / janela->duracao_us;
+  int64_t passos = indice - janela->indice;
+
+  if (passos > janela->num_baldes) {
+    passos = janela->num_baldes;
+  }
+  for (int64_t i = 1; i <= passos; i++) {
+    uint32_t *balde = &janela->baldes[(janela->indice + i) % janela->num_baldes];
+
+    janela->soma -= *balde;
+    *balde = 0;
   }
+  janela->indice = indice;
 }
 
 
-void controle_gpio_mudar_atuador(int id, int valor) {
-  if((id > 0) && (id <= MAX_ATUADORES)) {
-    if ((valor >= 0) && (valor <= 1)) {
-      mapa_atuadores[id].tempo_restante = 0;
-      mapa_atuadores[id].valor = valor;
-      gpio_set_level(mapa_atuadores[id].gpio, valor);
-    }
+static inline void somar_na_janela(janela_eventos_t *janela, uint32_t eventos) {
+  janela->baldes[janela->indice % janela->num_baldes] += eventos;
+  janela->soma += eventos;
+}
+
+
+static void iniciar_taxas(taxas_contador_t *taxas, int64_t agora) {
+  iniciar_janela(&taxas->segundo, 10, 100000, agora);
+  iniciar_janela(&taxas->minuto, 60, 1000000, agora);
+  iniciar_janela(&taxas->hora, 60, 60000000, agora);
+  taxas->eventos_segundo = 0;
+  taxas->segundo_corrente = agora / 1000000;
+  memset(&taxas->publico, 0, sizeof(taxas->publico));
+}
+
+
+static inline float media_exponencial(float media, float amostra, float decaimento,
+                                      int64_t segundos) {
+  media = amostra + (media - amostra) * decaimento;
+  if (segundos > 1) {
+    // Segundos sem nenhum tick (atraso): nenhum evento neles
+    media *= powf(decaimento, (float)(segundos - 1));
   }
+  return media;
 }
 
 
-void controle_gpio_alternar_atuador(int id) {
-  if((id > 0) && (id <= MAX_ATUADORES)) {
-    int novo_valor = 1 - mapa_atuadores[id].valor; 
+static int faixa_intervalo(int64_t intervalo_us) {
+  int faixa = 0;
 
-    mapa_atuadores[id].tempo_restante = 0;
-    mapa_atuadores[id].valor = novo_valor;
-    gpio_set_level(mapa_atuadores[id].gpio, novo_valor);
+  while (faixa < FAIXAS_INTERVALO - 1 &&
+         intervalo_us >= (int64_t)controle_gpio_faixas_intervalo_ms[faixa] * 1000) {
+    faixa++;
   }
+  return faixa;
 }
 
 
-void controle_gpio_pulsar_atuador(int id, int duracao) {
-  int num_ticks;
+/*  Avança as estatísticas até o instante atual e soma os eventos novos.
+ */
+static void atualizar_taxas(taxas_contador_t *taxas, int64_t agora, int eventos) {
+  estatisticas_contador_t *publico = &taxas->publico;
+  int64_t segundo = agora / 1000000;
 
-  if((id > 0) && (id <= MAX_ATUADORES)) {
-    // A duração é em milissegundos. Internamente, trabalhamos com ticks do timer.
-    num_ticks = duracao / (int)INTERVALO_TICK_MS;
-    
-    if (num_ticks < 1) {
-      num_ticks = 1;
+  if (segundo > taxas->segundo_corrente) {
+    // Fecha o segundo corrente nas médias exponenciais (eventos por minuto)
+    float amostra = 60.0f * (float)taxas->eventos_segundo;
+    int64_t segundos = segundo - taxas->segundo_corrente;
+
+    publico->taxa_1min = media_exponencial(publico->taxa_1min, amostra, DECAIMENTO_1MIN, segundos);
+    publico->taxa_5min = media_exponencial(publico->taxa_5min, amostra, DECAIMENTO_5MIN, segundos);
+    publico->taxa_15min = media_exponencial(publico->taxa_15min, amostra, DECAIMENTO_15MIN, segundos);
+    taxas->eventos_segundo = 0;
+    taxas->segundo_corrente = segundo;
+  }
+  avancar_janela(&taxas->segundo, agora);
+  avancar_janela(&taxas->minuto, agora);
+  avancar_janela(&taxas->hora, agora);
+
+  if (eventos > 0) {
+    somar_na_janela(&taxas->segundo, eventos);
+    somar_na_janela(&taxas->minuto, eventos);
+    somar_na_janela(&taxas->hora, eventos);
+    taxas->eventos_segundo += eventos;
+
+    if (publico->ultimo_evento_us != 0) {
+      publico->intervalos[faixa_intervalo(agora - publico->ultimo_evento_us)]++;
     }
-    mapa_atuadores[id].valor = 1;
-    gpio_set_level(mapa_atuadores[id].gpio, 1);
-    mapa_atuadores[id].tempo_restante = num_ticks;
+    publico->intervalos[0] += eventos - 1;
+    publico->ultimo_evento_us = agora;
   }
+  publico->ultimo_segundo = taxas->segundo.soma;
+  publico->ultimo_minuto = taxas->minuto.soma;
+  publico->ultima_hora = taxas->hora.soma;
 }
 
 
-bool controle_gpio_reconfig(void) {
-  // Um pino é usado para forçar modo Soft AP, com ssid de fábrica e senha vazia.
-  if (gpio_get_level(GPIO_RECONFIG) == 0) {
+#if CONTAGEM_HARDWARE
+
+/*  Contadores por hardware (PCNT).
+
+    Nos chips com a unidade contadora de pulsos, cada borda de descida no
+    pino do contador é contada pelo hardware, sem depender do tick: não se
+    perdem eventos, por mais rápidos que sejam. O filtro da unidade ignora
+    pulsos mais curtos que FILTRO_CONTADOR_NS (o limite do hardware é de
+    cerca de 12us), o que não basta para contatos mecânicos: esses
+    contadores são marcados como contato e ficam na contagem por software,
+    com a janela de 'debouncing' (veja mapa_contadores).
+
+    A unidade conta até LIMITE_PCNT e volta a zero; com accum_count, o
+    próprio driver acumula os estouros em um int, e pcnt_unit_get_count()
+    devolve o total desde o último pcnt_unit_clear_count(). A cada tick,
+    a tarefa de controle soma a diferença para a leitura anterior, módulo
+    2^32, à contagem de 64 bits do contador: a volta do int do driver não
+    perde eventos. As leituras em int (estado_placa_t, regras e diário)
+    param em INT_MAX; a contagem completa está em estatisticas_contador_t.
+
+    Na simulação, o hardware é o próprio roteiro: cada borda de descida
+    no pino é contada no instante virtual em que ocorre, mesmo entre dois
+    ticks (simulacao_gpio_contar_descidas).
+
+    Nos chips sem PCNT, ou se a unidade não puder ser criada, a contagem
+    continua por software, no tick.
+ */
+#define LIMITE_PCNT           (32000)
+#define FILTRO_CONTADOR_NS    (10000)
+
+
+#if SOC_PCNT_SUPPORTED
+/*  Cria a unidade PCNT de um contador.
+
+    @return false se não foi possível (a contagem fica por software).
+ */
+static bool iniciar_pcnt(estado_contador_t *p_contador) {
+  pcnt_unit_config_t config_unidade = {
+    .low_limit = -1,
+    .high_limit = LIMITE_PCNT,
+    .flags.accum_count = 1
+  };
+  pcnt_chan_config_t config_canal = {
+    .edge_gpio_num = p_contador->gpio,
+    .level_gpio_num = -1
+  };
+  pcnt_glitch_filter_config_t config_filtro = {
+    .max_glitch_ns = FILTRO_CONTADOR_NS
+  };
+  pcnt_unit_handle_t unidade = NULL;
+  pcnt_channel_handle_t canal = NULL;
+
+  if (pcnt_new_unit(&config_unidade, &unidade) != ESP_OK) {
     return false;
-  } else {
-    return true;
   }
+  // Conta apenas as bordas de descida (nível 1 para 0), como na contagem por software.
+  // O ponto de observação no limite é o que faz o driver acumular os estouros.
+  if (pcnt_unit_set_glitch_filter(unidade, &config_filtro) != ESP_OK ||
+      pcnt_new_channel(unidade, &config_canal, &canal) != ESP_OK ||
+      pcnt_channel_set_edge_action(canal, PCNT_CHANNEL_EDGE_ACTION_HOLD,
+                                   PCNT_CHANNEL_EDGE_ACTION_INCREASE) != ESP_OK ||
+      pcnt_unit_add_watch_point(unidade, LIMITE_PCNT) != ESP_OK ||
+      pcnt_unit_enable(unidade) != ESP_OK ||
+      pcnt_unit_clear_count(unidade) != ESP_OK ||
+      pcnt_unit_start(unidade) != ESP_OK) {
+    ESP_LOGE(TAG, "Falha ao iniciar PCNT no GPIO %d; contagem por software", p_contador->gpio);
+    return false;
+  }
+  p_contador->unidade = unidade;
+  return true;
+}
+#endif
+
+
+/*  Lê o total de bordas contadas pelo hardware, módulo 2^32.
+ */
+static uint32_t ler_hardware(const estado_contador_t *p_contador) {
+#if CONFIG_CONTROLE_GPIO_SIMULACAO
+  return simulacao_gpio_contar_descidas(p_contador->gpio);
+#else
+  int contagem = 0;
+
+  pcnt_unit_get_count(p_contador->unidade, &contagem);
+  return (uint32_t)contagem;
+#endif
+}
+
+
+/*  Passa um contador para o hardware, se possível, mantendo a contagem
+    restaurada (controle_gpio_restaurar).
+ */
+static void iniciar_contagem_hardware(estado_contador_t *p_contador) {
+#if SOC_PCNT_SUPPORTED
+  p_contador->hardware = iniciar_pcnt(p_contador);
+#else
+  p_contador->hardware = true;
+#endif
+  if (p_contador->hardware) {
+    p_contador->leitura_hardware = ler_hardware(p_contador);
+  }
+}
+
+
+/*  Lê os eventos contados pelo hardware desde a leitura anterior.
+ */
+static uint32_t eventos_hardware(estado_contador_t *p_contador) {
+  uint32_t leitura = ler_hardware(p_contador);
+  uint32_t eventos = leitura - p_contador->leitura_hardware;
 
+  p_contador->leitura_hardware = leitura;
+  return eventos;
 }
 
+#endif
+
+
+/*  Registro de bordas nos pinos de entrada.
+
+    Cada mudança de nível nos pinos dos sensores e contadores gera uma
+    interrupção, que grava o instante (us), o periférico e o novo nível
+    em um registro circular. A interrupção é o único produtor: não aloca
+    memória, não bloqueia, e sempre grava (sobrescrevendo o evento mais
+    antigo). O leitor (servidor HTTP) copia os eventos e confere, pela
+    sequência, se algum foi sobrescrito durante a cópia.
 
-/*  Código do timer, baseado no exemplo em Timer_test.c (https://gist.github.com/shirish47)
+    Na simulação não há interrupções: a cada tick, a tarefa de controle
+    grava as mudanças de nível vistas na amostra dos pinos do chip, com
+    o instante virtual do tick.
  */
+#define TAM_REGISTRO_BORDAS   (64)      // Potência de 2
 
-static TimerHandle_t temporizador_local;
+typedef struct {
+  int     gpio;
+  uint8_t classe;
+  uint8_t id;
+} pino_borda_t;
 
-static int id_temporizador_local = 1;
+// Pinos com interrupção de borda
+static pino_borda_t pinos_bordas[MAX_SENSORES + MAX_CONTADORES + 1];
+static int          num_pinos_bordas = 0;
 
+static borda_gpio_t registro_bordas[TAM_REGISTRO_BORDAS];
 
-void callback_temporizador(TimerHandle_t xTimer) {
-  // Tarefas do temporizador
-  // TODO: Utilizar semáforos para seções críticas
-  int tempo;
-  int valor;
+// Total de bordas gravadas; a próxima borda recebe esta sequência
+static atomic_uint cabeca_bordas = 0;
 
-  estado_atuador_t *p_atuador = NULL;
-  estado_contador_t *p_contador = NULL;
 
-  int id_perif = MAX_ATUADORES;
+/*  Grava uma borda no registro (único produtor: a interrupção ou, na
+    simulação, a tarefa de controle).
+ */
+static void IRAM_ATTR gravar_borda(const pino_borda_t *pino, int nivel, int64_t instante_us) {
+  uint32_t seq = atomic_load_explicit(&cabeca_bordas, memory_order_relaxed);
+  borda_gpio_t *borda = &registro_bordas[seq & (TAM_REGISTRO_BORDAS - 1)];
 
-  // Trata atuadores que estão gerando um pulso
-  while (id_perif > 0) {
-    p_atuador = &mapa_atuadores[id_perif];
-    tempo = p_atuador->tempo_restante;
+  // Marca a posição como em escrita antes de alterá-la
+  borda->seq = UINT32_MAX;
+  atomic_thread_fence(memory_order_release);
+  borda->instante_us = instante_us;
+  borda->classe = pino->classe;
+  borda->id = pino->id;
+  borda->nivel = nivel;
+  atomic_thread_fence(memory_order_release);
+  borda->seq = seq;
 
-    if (tempo > 0) {
-      if (tempo <= 1) {
-        // Tempo expirou para este atuador. Retornar ao estado desligado
-        p_atuador->tempo_restante = 0;
-        p_atuador->valor = 0;
-        gpio_set_level(p_atuador->gpio, 0);
-      } else {
-        p_atuador->tempo_restante = tempo - 1;
-      }
+  atomic_store_explicit(&cabeca_bordas, seq + 1, memory_order_release);
+}
+
+
+#if !CONFIG_CONTROLE_GPIO_SIMULACAO
+static void IRAM_ATTR tratar_borda(void *arg) {
+  const pino_borda_t *pino = (const pino_borda_t *)arg;
+
+  // Leitura direta do registrador: gpio_get_level() pode não estar na IRAM
+  uint32_t entradas = (pino->gpio < 32) ? REG_READ(GPIO_IN_REG) : REG_READ(GPIO_IN1_REG);
+
+  gravar_borda(pino, (entradas >> (pino->gpio & 31)) & 1, esp_timer_get_time());
+}
+#else
+// Níveis dos pinos do chip na amostra anterior
+static uint64_t niveis_bordas = UINT64_MAX;
+
+
+/*  Grava as mudanças de nível nos pinos com captura de bordas desde a
+    amostra anterior (apenas pela tarefa de controle).
+ */
+static void gravar_bordas_simuladas(uint64_t niveis) {
+  uint64_t mudancas = niveis ^ niveis_bordas;
+
+  niveis_bordas = niveis;
+  for (int posicao = 1; mudancas != 0 && posicao <= num_pinos_bordas; posicao++) {
+    const pino_borda_t *pino = &pinos_bordas[posicao];
+
+    if ((mudancas >> pino->gpio) & 1) {
+      gravar_borda(pino, (int)((niveis >> pino->gpio) & 1), agora_us());
     }
-    id_perif--;
   }
-  
-  id_perif = MAX_CONTADORES;
+}
+#endif
 
-  /*  Trata contadores que mudaram de nível 1 para 0
-      NOTA: Nesta implementação por software, embora se possam perder eventos
-            com pulsos muito rápidos, fica resolvido o problema de 'debouncing'
-            do sinal elétrico, pelo tempo grande entre medições (100ms).
-   */
-  while (id_perif > 0) {
-    p_contador = &mapa_contadores[id_perif];
 
-    valor = gpio_get_level(p_contador->gpio);
-    
-    if (p_contador->valor_anterior > 0 && valor == 0) {
-      p_contador->contagem++;
+/*  Ativa a interrupção de borda em um pino de entrada.
+ */
+static void capturar_bordas(int gpio, enum periferico classe, int id) {
+  pino_borda_t *pino = &pinos_bordas[++num_pinos_bordas];
+
+  pino->gpio = gpio;
+  pino->classe = classe;
+  pino->id = id;
+
+#if !CONFIG_CONTROLE_GPIO_SIMULACAO
+  gpio_set_intr_type(gpio, GPIO_INTR_ANYEDGE);
+  if (gpio_isr_handler_add(gpio, tratar_borda, pino) != ESP_OK) {
+    ESP_LOGE(TAG, "Falha ao capturar bordas no GPIO %d", gpio);
+  }
+#endif
+}
+
+
+int controle_gpio_ler_bordas(uint32_t desde, borda_gpio_t *bordas, int max,
+                             uint32_t *proximo, uint32_t *perdidos) {
+  uint32_t cabeca = atomic_load_explicit(&cabeca_bordas, memory_order_acquire);
+  uint32_t mais_antigo = (cabeca > TAM_REGISTRO_BORDAS) ? cabeca - TAM_REGISTRO_BORDAS : 0;
+  int n = 0;
+
+  *perdidos = 0;
+  if (desde > cabeca) {
+    // Cursor de antes de reiniciar o módulo: recomeça do mais antigo
+    desde = mais_antigo;
+  }
+  if (desde < mais_antigo) {
+    *perdidos = mais_antigo - desde;
+    desde = mais_antigo;
+  }
+
+  while (desde < cabeca && n < max) {
+    const borda_gpio_t *borda = &registro_bordas[desde & (TAM_REGISTRO_BORDAS - 1)];
+
+    bordas[n] = *borda;
+    atomic_thread_fence(memory_order_acquire);
+    if (bordas[n].seq != desde || borda->seq != desde) {
+      // Sobrescrito durante a cópia: o leitor ficou para trás
+      uint32_t novo_mais_antigo = atomic_load_explicit(&cabeca_bordas, memory_order_acquire) - TAM_REGISTRO_BORDAS;
+
+      *perdidos += novo_mais_antigo - desde;
+      desde = novo_mais_antigo;
+      continue;
     }
-    p_contador->valor_anterior = valor;
+    n++;
+    desde++;
+  }
+  *proximo = desde;
+
+  return n;
+}
+
+
+// Bordas e contagens para a próxima avaliação das regras (REGRA_BIT)
+static mapa_perifericos_t eventos_regras[NUM_EVENTOS_REGRA];
+
 
-    id_perif--;
+/*  Avisa o observador registrado sobre a mudança de estado de um periférico.
+ */
+static void notificar_mudanca(enum periferico classe, int id, int valor) {
+  controle_gpio_observador_t observador = observador_perifericos;
+
+  versao_estado++;
+
+  if (classe == PRF_SENSOR) {
+    eventos_regras[valor ? REGRA_SUBIDAS : REGRA_DESCIDAS] |= REGRA_BIT(id);
+  } else if (classe == PRF_CONTADOR && valor != 0) {
+    eventos_regras[REGRA_CONTAGENS] |= REGRA_BIT(id);
+  }
+
+  if (observador != NULL) {
+    observador(classe, id, valor);
   }
 }
 
 
-bool controle_gpio_ativar_timer(void) {
-  // Dispara continuamente a cada intervalo
-  ESP_LOGI(TAG, "Iniciando Timer GPIO com intervalo de %d ticks.",
-                (int)pdMS_TO_TICKS(INTERVALO_TICK_MS));
+/*  Publica uma cópia do estado para os leitores (seqlock).
+ */
+static void publicar_estado(void) {
+  int id;
+
+  atomic_fetch_add_explicit(&sequencia_publicada, 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  for (id = 1; id <= MAX_SENSORES; id++) {
+    estado_publicado.estado.sensores[id] = nivel_entrada(mapa_sensores[id]);
+  }
+  for (id = 1; id <= MAX_CONTADORES; id++) {
+    estado_publicado.estado.contadores[id] = contagem_int(&mapa_contadores[id]);
+    estado_publicado.contadores[id] = mapa_contadores[id].taxas.publico;
+    estado_publicado.contadores[id].contagem = mapa_contadores[id].contagem;
+  }
+  for (id = 1; id <= MAX_ATUADORES; id++) {
+    estado_publicado.estado.atuadores[id] = mapa_atuadores[id].valor;
+  }
+  estado_publicado.versao = versao_estado;
+  estado_publicado.comandos = estatisticas_comandos;
+  estado_publicado.comandos.descartados = atomic_load_explicit(&comandos_descartados, memory_order_relaxed);
+
+  atomic_thread_fence(memory_order_release);
+  atomic_fetch_add_explicit(&sequencia_publicada, 1, memory_order_relaxed);
+}
+
 
-  temporizador_local = xTimerCreate("GPIOTimer", pdMS_TO_TICKS(INTERVALO_TICK_MS), pdTRUE,
-                                    (void *)id_temporizador_local, &callback_temporizador);
+/*  Lê a cópia publicada do estado (seqlock).
+ */
+static void ler_estado_publicado(estado_publicado_t *copia) {
+  unsigned inicio;
+
+  do {
+    inicio = atomic_load_explicit(&sequencia_publicada, memory_order_acquire);
+    *copia = estado_publicado;
+    atomic_thread_fence(memory_order_acquire);
+  } while ((inicio & 1) != 0 ||
+           inicio != atomic_load_explicit(&sequencia_publicada, memory_order_relaxed));
+}
+
+
+static void iniciar_temporizador_pulsos(void);
+
+
+// Documentação das funções públicas no arquivo header.
+
+
+void controle_gpio_restaurar(const estado_placa_t *estado) {
+  for (int id = 1; id <= MAX_CONTADORES; id++) {
+    mapa_contadores[id].contagem = (estado->contadores[id] > 0) ? estado->contadores[id] : 0;
+  }
+  for (int id = 1; id <= MAX_ATUADORES; id++) {
+    mapa_atuadores[id].valor = (estado->atuadores[id] != 0) ? 1 : 0;
+  }
+}
+
+
+/* Inicializa periféricos do ESP32
+ */
+void controle_gpio_iniciar(void) {
+    uint64_t saidas[NUM_BACKENDS] = { 0 };
+    uint64_t nivel_saidas[NUM_BACKENDS] = { 0 };
+    int id;
+
+#if CONFIG_CONTROLE_GPIO_EXPANSOR
+    mapear_expansores();
+#endif
+
+    // Pinos de cada backend, com o nível inicial dos atuadores
+    for (id = 1; id <= MAX_ATUADORES; id++) {
+      int pino = mapa_atuadores[id].pino;
+
+      saidas[BACKEND_PINO(pino)] |= BIT_PINO(pino);
+      if (mapa_atuadores[id].valor) {
+        nivel_saidas[BACKEND_PINO(pino)] |= BIT_PINO(pino);
+      }
+    }
+    for (id = 1; id <= MAX_SENSORES; id++) {
+      entradas[BACKEND_PINO(mapa_sensores[id])].mascara |= BIT_PINO(mapa_sensores[id]);
+    }
+    for (id = 1; id <= MAX_CONTADORES; id++) {
+      entradas[0].mascara |= BIT_PINO(mapa_contadores[id].gpio);
+    }
+
+#if !CONFIG_CONTROLE_GPIO_SIMULACAO
+    // Interrupções das bordas e da linha INT dos expansores
+    gpio_install_isr_service(ESP_INTR_FLAG_IRAM);
+#endif
+
+    for (int b = 0; b < NUM_BACKENDS; b++) {
+      if (!backends[b]->iniciar(saidas[b], entradas[b].mascara, nivel_saidas[b])) {
+        ESP_LOGE(TAG, "Falha ao iniciar os pinos em %s", backends[b]->nome);
+      }
+    }
+
+#if !CONFIG_CONTROLE_GPIO_SIMULACAO
+    // Sensores Read Only e Pino de reconfiguração
+    // O circuito PULL_UP/PULL_DOWN deve ser implementado em hardware externo.
+    gpio_config_t io_conf = {
+      .pin_bit_mask = MASCARA_READ_ONLY,
+      .mode = GPIO_MODE_INPUT,
+      .intr_type = GPIO_INTR_DISABLE,
+      .pull_down_en = GPIO_PULLDOWN_DISABLE,
+      .pull_up_en = GPIO_PULLUP_DISABLE
+    };
+    gpio_config(&io_conf);
+#endif
+
+    // Nível inicial das entradas, sem gerar bordas
+    for (int b = 0; b < NUM_BACKENDS; b++) {
+      entradas[b].estavel = backends[b]->ler_entradas() & entradas[b].mascara;
+    }
+    for (id = 1; id <= MAX_SENSORES; id++) {
+      definir_janela(mapa_sensores[id], janela_sensores_ms[id]);
+    }
+    for (id = 1; id <= MAX_CONTADORES; id++) {
+      definir_janela(mapa_contadores[id].gpio, mapa_contadores[id].janela_ms);
+      iniciar_taxas(&mapa_contadores[id].taxas, agora_us());
+    }
+
+#if CONTAGEM_HARDWARE
+    for (id = 1; id <= MAX_CONTADORES; id++) {
+      if (!mapa_contadores[id].contato) {
+        iniciar_contagem_hardware(&mapa_contadores[id]);
+      }
+    }
+#endif
+
+    // Bordas nos sensores e contadores (depois do PCNT, que reconfigura o pino)
+    // Apenas nos GPIO do chip: os expansores não têm uma interrupção por pino
+    num_pinos_bordas = 0;
+    for (id = 1; id <= MAX_SENSORES; id++) {
+      if (BACKEND_PINO(mapa_sensores[id]) == 0) {
+        capturar_bordas(mapa_sensores[id], PRF_SENSOR, id);
+      }
+    }
+    for (id = 1; id <= MAX_CONTADORES; id++) {
+      capturar_bordas(mapa_contadores[id].gpio, PRF_CONTADOR, id);
+    }
+#if CONFIG_CONTROLE_GPIO_SIMULACAO
+    niveis_bordas = entradas[0].estavel;
+#endif
+    iniciar_temporizador_pulsos();
+    publicar_estado();
+}
+
+
+uint32_t controle_gpio_versao(void) {
+  estado_publicado_t copia;
+
+  ler_estado_publicado(&copia);
+  return copia.versao;
+}
+
+
+uint32_t controle_gpio_ticks_atrasados(void) {
+  return (uint32_t)atomic_load_explicit(&ticks_atrasados, memory_order_relaxed);
+}
+
+
+void controle_gpio_estatisticas_comandos(estatisticas_comandos_t *estatisticas) {
+  estado_publicado_t copia;
+
+  ler_estado_publicado(&copia);
+  *estatisticas = copia.comandos;
+}
+
+
+void controle_gpio_registrar_observador(controle_gpio_observador_t observador) {
+  observador_perifericos = observador;
+}
+
+
+const char *controle_gpio_status(void) {
+  static char status[80] = "";
+
+  if (status[0] == '\0') {
+    snprintf(status, sizeof(status), "Modulo de Controle\nVersao:1.0\nAtuadores:%d\nSensores:%d\nContadores:%d\n\n",
+             MAX_ATUADORES, MAX_SENSORES, MAX_CONTADORES);
+  }
+  return status;
+}
+
+
+int controle_gpio_ler_sensor(int id) {
+  if((id > 0) && (id <= MAX_SENSORES)) {
+    estado_publicado_t copia;
+
+    ler_estado_publicado(&copia);
+    return copia.estado.sensores[id];
+  } else {
+    // Condição de erro: id inválido
+    return -1;
+  }
+}
+
+
+int controle_gpio_ler_contador(int id) {
+  if((id > 0) && (id <= MAX_CONTADORES)) {
+    estado_publicado_t copia;
+
+    ler_estado_publicado(&copia);
+    return copia.estado.contadores[id];
+  } else {
+    // Condição de erro: id inválido
+    return -1;
+  }
+}
+
+
+bool controle_gpio_estatisticas_contador(int id, estatisticas_contador_t *estatisticas) {
+  if((id > 0) && (id <= MAX_CONTADORES)) {
+    estado_publicado_t copia;
+
+    ler_estado_publicado(&copia);
+    *estatisticas = copia.contadores[id];
+    return true;
+  } else {
+    // Condição de erro: id inválido
+    return false;
+  }
+}
+
+
+uint32_t controle_gpio_ler_estado(estado_placa_t *estado) {
+  estado_publicado_t copia;
+
+  ler_estado_publicado(&copia);
+  *estado = copia.estado;
+
+  estado->sensores[0] = 0;
+  estado->contadores[0] = 0;
+  estado->atuadores[0] = 0;
+  return copia.versao;
+}
+
+
+int controle_gpio_ler_atuador(int id) {
+  if((id > 0) && (id <= MAX_ATUADORES)) {
+    estado_publicado_t copia;
+
+    ler_estado_publicado(&copia);
+    return copia.estado.atuadores[id];
+  } else {
+    // Condição de erro: id inválido
+    return -1;
+  }
+}
+
+
+/*  Fim dos pulsos dos atuadores.
+
+    Os pulsos em andamento ficam em um heap de mínimo, ordenado pelo
+    instante de fim, com no máximo um pulso por atuador. Um único
+    esp_timer é programado para o fim do primeiro pulso; ao disparar,
+    pede à tarefa de controle que desligue os atuadores cujo pulso
+    terminou, e é reprogramado para o próximo.
+
+    A precisão é de cerca de 1 ms, independente do tick, e o temporizador
+    existe desde controle_gpio_iniciar(). Desligar ou alternar um atuador
+    cancela seu pulso; um novo pulso substitui o anterior.
+
+    O atraso entre o fim previsto e o desligamento (jitter) é registrado
+    nas estatísticas.
+ */
+static int heap_pulsos[MAX_ATUADORES + 1];     // Identificadores dos atuadores; 1 é a raiz
+static int num_pulsos = 0;
+
+#if !CONFIG_CONTROLE_GPIO_SIMULACAO
+static esp_timer_handle_t temporizador_pulsos = NULL;
+#endif
+
+static void executar_comando(const comando_gpio_t *comando);
+
+
+static inline int64_t fim_pulso(int posicao) {
+  return mapa_atuadores[heap_pulsos[posicao]].fim_pulso_us;
+}
+
+
+static void trocar_no_heap(int a, int b) {
+  int id_a = heap_pulsos[a];
+
+  heap_pulsos[a] = heap_pulsos[b];
+  heap_pulsos[b] = id_a;
+  mapa_atuadores[heap_pulsos[a]].posicao_heap = a;
+  mapa_atuadores[heap_pulsos[b]].posicao_heap = b;
+}
+
+
+static void subir_no_heap(int posicao) {
+  while (posicao > 1 && fim_pulso(posicao) < fim_pulso(posicao / 2)) {
+    trocar_no_heap(posicao, posicao / 2);
+    posicao /= 2;
+  }
+}
+
+
+static void descer_no_heap(int posicao) {
+  while (2 * posicao <= num_pulsos) {
+    int filho = 2 * posicao;
+
+    if (filho < num_pulsos && fim_pulso(filho + 1) < fim_pulso(filho)) {
+      filho++;
+    }
+    if (fim_pulso(posicao) <= fim_pulso(filho)) {
+      break;
+    }
+    trocar_no_heap(posicao, filho);
+    posicao = filho;
+  }
+}
+
+
+static void remover_do_heap(int id) {
+  int posicao = mapa_atuadores[id].posicao_heap;
+
+  if (posicao == 0) {
+    return;
+  }
+  trocar_no_heap(posicao, num_pulsos);
+  num_pulsos--;
+  mapa_atuadores[id].posicao_heap = 0;
+
+  if (posicao <= num_pulsos) {
+    subir_no_heap(posicao);
+    descer_no_heap(posicao);
+  }
+}
+
+
+/*  Programa o temporizador para o fim do primeiro pulso.
+ */
+static void reprogramar_temporizador_pulsos(void) {
+#if !CONFIG_CONTROLE_GPIO_SIMULACAO
+  // Na simulação, controle_gpio_simular_ate() consulta o heap diretamente
+  if (temporizador_pulsos == NULL) {
+    return;
+  }
+  esp_timer_stop(temporizador_pulsos);
+
+  if (num_pulsos > 0) {
+    int64_t espera = fim_pulso(1) - esp_timer_get_time();
+
+    esp_timer_start_once(temporizador_pulsos, (espera > 0) ? (uint64_t)espera : 0);
+  }
+#endif
+}
+
+
+static void agendar_fim_pulso(int id, int duracao_ms) {
+  estado_atuador_t *p_atuador = &mapa_atuadores[id];
+
+  remover_do_heap(id);
+
+  p_atuador->fim_pulso_us = agora_us() + (int64_t)((duracao_ms < 1) ? 1 : duracao_ms) * 1000;
+  heap_pulsos[++num_pulsos] = id;
+  p_atuador->posicao_heap = num_pulsos;
+  subir_no_heap(num_pulsos);
+
+  reprogramar_temporizador_pulsos();
+}
+
+
+static void cancelar_pulso(int id) {
+  if (mapa_atuadores[id].posicao_heap != 0) {
+    remover_do_heap(id);
+    reprogramar_temporizador_pulsos();
+  }
+}
+
+
+/*  Desliga os atuadores cujo pulso terminou (tarefa de controle).
+ */
+static void executar_expirar_pulsos(void) {
+  int64_t agora = agora_us();
+
+  while (num_pulsos > 0 && fim_pulso(1) <= agora) {
+    int id = heap_pulsos[1];
+    uint32_t atraso = (uint32_t)(agora - mapa_atuadores[id].fim_pulso_us);
+
+    remover_do_heap(id);
+
+    mapa_atuadores[id].valor = 0;
+    escrever_pino(mapa_atuadores[id].pino, 0);
+    notificar_mudanca(PRF_ATUADOR, id, 0);
+
+    estatisticas_comandos.pulsos++;
+    estatisticas_comandos.soma_atraso_pulso_us += atraso;
+    if (atraso > estatisticas_comandos.atraso_max_pulso_us) {
+      estatisticas_comandos.atraso_max_pulso_us = atraso;
+    }
+  }
+  reprogramar_temporizador_pulsos();
+}
+
+
+#if !CONFIG_CONTROLE_GPIO_SIMULACAO
+/*  Chamada pelo esp_timer no fim do primeiro pulso.
+ */
+static void tratar_fim_pulso(void *arg) {
+  comando_gpio_t comando = { .tipo = CMD_EXPIRAR_PULSOS, .origem = NULL };
+
+  if (fila_comandos == NULL) {
+    // Tarefa de controle ainda não criada
+    executar_comando(&comando);
+    descarregar_saidas();
+    publicar_estado();
+  } else if (xQueueSend(fila_comandos, &comando, 0) != pdPASS) {
+    // Fila cheia: tenta de novo em 1 ms
+    esp_timer_start_once(temporizador_pulsos, 1000);
+  }
+}
+
+
+static void iniciar_temporizador_pulsos(void) {
+  const esp_timer_create_args_t config = {
+    .callback = tratar_fim_pulso,
+    .dispatch_method = ESP_TIMER_TASK,
+    .name = "pulsos"
+  };
+
+  if (esp_timer_create(&config, &temporizador_pulsos) != ESP_OK) {
+    ESP_LOGE(TAG, "Falha ao criar temporizador dos pulsos");
+    temporizador_pulsos = NULL;
+  }
+}
+#else
+static void iniciar_temporizador_pulsos(void) {
+}
+#endif
+
+
+/*  Execução dos comandos, sempre pela tarefa de controle.
+ */
+
+static void executar_reiniciar_contador(int id) {
+  // O hardware continua contando: as próximas leituras somam a diferença
+  mapa_contadores[id].contagem = 0;
+  iniciar_taxas(&mapa_contadores[id].taxas, agora_us());
+  notificar_mudanca(PRF_CONTADOR, id, 0);
+}
+
+
+static void executar_definir_debounce(enum periferico classe, int id, int janela_ms) {
+  if (classe == PRF_SENSOR) {
+    janela_sensores_ms[id] = janela_ms;
+    definir_janela(mapa_sensores[id], janela_ms);
+  } else {
+    mapa_contadores[id].janela_ms = janela_ms;
+    definir_janela(mapa_contadores[id].gpio, janela_ms);
+  }
+}
+
+
+static void executar_mudar_atuador(int id, int valor) {
+  int valor_anterior = mapa_atuadores[id].valor;
+
+  cancelar_pulso(id);
+  mapa_atuadores[id].valor = valor;
+  escrever_pino(mapa_atuadores[id].pino, valor);
+
+  if (valor != valor_anterior) {
+    notificar_mudanca(PRF_ATUADOR, id, valor);
+  }
+}
+
+
+static void executar_alternar_atuador(int id) {
+  int novo_valor = 1 - mapa_atuadores[id].valor; 
+
+  cancelar_pulso(id);
+  mapa_atuadores[id].valor = novo_valor;
+  escrever_pino(mapa_atuadores[id].pino, novo_valor);
+  notificar_mudanca(PRF_ATUADOR, id, novo_valor);
+}
+
+
+static void executar_pulsar_atuador(int id, int duracao) {
+  int valor_anterior = mapa_atuadores[id].valor;
+
+  mapa_atuadores[id].valor = 1;
+  escrever_pino(mapa_atuadores[id].pino, 1);
+  agendar_fim_pulso(id, duracao);
+
+  if (valor_anterior != 1) {
+    notificar_mudanca(PRF_ATUADOR, id, 1);
+  }
+}
+
+
+/*  Aplica o lote com uma escrita por backend (nos GPIO do chip, uma em
+    cada registrador set/clear; nos expansores, uma por expansor alterado).
+ */
+static void executar_lote(const lote_atuadores_t *lote) {
+  uint64_t pinos_ligar[NUM_BACKENDS] = { 0 };
+  uint64_t pinos_desligar[NUM_BACKENDS] = { 0 };
+  int novo_valor[MAX_ATUADORES + 1];
+  int id;
+
+  // Calcula o novo valor de cada atuador e as máscaras dos pinos
+  for (id = 1; id <= MAX_ATUADORES; id++) {
+    uint64_t bit = 1ULL << id;
+    estado_atuador_t *p_atuador = &mapa_atuadores[id];
+
+    novo_valor[id] = p_atuador->valor;
+
+    if (lote->ligar & bit) {
+      novo_valor[id] = 1;
+      cancelar_pulso(id);
+    } else if (lote->desligar & bit) {
+      novo_valor[id] = 0;
+      cancelar_pulso(id);
+    } else if (lote->alternar & bit) {
+      novo_valor[id] = 1 - p_atuador->valor;
+      cancelar_pulso(id);
+    } else if (lote->pulsar & bit) {
+      novo_valor[id] = 1;
+      agendar_fim_pulso(id, lote->duracao[id]);
+    } else {
+      continue;
+    }
+
+    if (novo_valor[id]) {
+      pinos_ligar[BACKEND_PINO(p_atuador->pino)] |= BIT_PINO(p_atuador->pino);
+    } else {
+      pinos_desligar[BACKEND_PINO(p_atuador->pino)] |= BIT_PINO(p_atuador->pino);
+    }
+  }
+
+  for (int b = 0; b < NUM_BACKENDS; b++) {
+    if ((pinos_ligar[b] | pinos_desligar[b]) != 0) {
+      backends[b]->escrever_saidas(pinos_ligar[b], pinos_desligar[b]);
+    }
+  }
+
+  // Atualiza as tabelas e avisa as mudanças
+  for (id = 1; id <= MAX_ATUADORES; id++) {
+    if (novo_valor[id] != mapa_atuadores[id].valor) {
+      mapa_atuadores[id].valor = novo_valor[id];
+      notificar_mudanca(PRF_ATUADOR, id, novo_valor[id]);
+    }
+  }
+}
+
+
+static void executar_comando(const comando_gpio_t *comando) {
+  switch (comando->tipo) {
+    case CMD_MUDAR_ATUADOR:
+      executar_mudar_atuador(comando->id, comando->valor);
+      break;
+    case CMD_ALTERNAR_ATUADOR:
+      executar_alternar_atuador(comando->id);
+      break;
+    case CMD_PULSAR_ATUADOR:
+      executar_pulsar_atuador(comando->id, comando->valor);
+      break;
+    case CMD_REINICIAR_CONTADOR:
+      executar_reiniciar_contador(comando->id);
+      break;
+    case CMD_APLICAR_LOTE:
+      executar_lote(&comando->lote);
+      break;
+    case CMD_DEFINIR_DEBOUNCE:
+      executar_definir_debounce(comando->classe, comando->id, comando->valor);
+      break;
+    case CMD_EXPIRAR_PULSOS:
+      executar_expirar_pulsos();
+      break;
+  }
+}
+
+
+#if CONFIG_CONTROLE_GPIO_SIMULACAO
+// Tarefa de controle simulada (controle_gpio_ativar_timer)
+static bool    simulacao_ativa = false;
+static int64_t proximo_tick_simulado = 0;
+
+static void aplicar_regras(int64_t instante_us);
+static void registrar_latencia(const comando_gpio_t *comando);
+#endif
+
+
+/*  Ocupa uma vaga livre em situacao_comandos para o comando.
+
+    Retorna false se todas estão ocupadas.
+ */
+static bool reservar_vaga_comando(comando_gpio_t *comando) {
+  unsigned int pendente = SITUACAO_COMANDO(comando->sequencia, CMD_PENDENTE);
+
+  for (int i = 0; i < MAX_COMANDOS_PENDENTES; i++) {
+    unsigned int situacao = atomic_load_explicit(&situacao_comandos[i], memory_order_relaxed);
+
+    if (SITUACAO(situacao) == CMD_LIVRE &&
+        atomic_compare_exchange_strong(&situacao_comandos[i], &situacao, pendente)) {
+      comando->vaga = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+
+/*  Aguarda o aviso de execução do comando, ignorando avisos de outros.
+
+    Retorna false se o tempo de espera se esgotou.
+ */
+static bool aguardar_comando(uint32_t sequencia, TickType_t espera) {
+  TickType_t inicio = xTaskGetTickCount();
+  uint32_t valor;
+
+  while (true) {
+    TickType_t decorrido = xTaskGetTickCount() - inicio;
+
+    if (decorrido > espera ||
+        xTaskNotifyWait(0, UINT32_MAX, &valor, espera - decorrido) != pdPASS) {
+      return false;
+    }
+    if (valor == sequencia) {
+      return true;
+    }
+  }
+}
+
+
+/*  Envia um comando para a tarefa de controle e aguarda sua execução.
+
+    Antes de a tarefa ser criada (durante a inicialização), executa o
+    comando diretamente.
+
+    Retorna false se o comando não foi nem será executado: a fila estava
+    cheia, ou o comando não começou a ser executado dentro de
+    TEMPO_MAX_COMANDO_MS e foi cancelado. Se a execução já começou,
+    aguarda o seu fim.
+ */
+static bool enviar_comando(comando_gpio_t *comando) {
+#if CONFIG_CONTROLE_GPIO_SIMULACAO
+  if (simulacao_ativa) {
+    // Quem envia faz o papel da tarefa de controle, no instante virtual corrente
+    comando->instante_us = agora_us();
+    executar_comando(comando);
+    aplicar_regras(comando->instante_us);
+    registrar_latencia(comando);
+    publicar_estado();
+    return true;
+  }
+#endif
+  if (fila_comandos == NULL) {
+    executar_comando(comando);
+    descarregar_saidas();
+    publicar_estado();
+    return true;
+  }
+
+  comando->origem = xTaskGetCurrentTaskHandle();
+  comando->sequencia = atomic_fetch_add_explicit(&proxima_sequencia, 1, memory_order_relaxed);
+  comando->instante_us = agora_us();
+
+  if (!reservar_vaga_comando(comando)) {
+    atomic_fetch_add_explicit(&comandos_descartados, 1, memory_order_relaxed);
+    ESP_LOGE(TAG, "Comandos pendentes demais");
+    return false;
+  }
+  if (xQueueSend(fila_comandos, comando, pdMS_TO_TICKS(TEMPO_MAX_COMANDO_MS)) != pdPASS) {
+    atomic_store(&situacao_comandos[comando->vaga], CMD_LIVRE);
+    atomic_fetch_add_explicit(&comandos_descartados, 1, memory_order_relaxed);
+    ESP_LOGE(TAG, "Fila de comandos cheia");
+    return false;
+  }
+  if (aguardar_comando(comando->sequencia, pdMS_TO_TICKS(TEMPO_MAX_COMANDO_MS))) {
+    return true;
+  }
+
+  unsigned int pendente = SITUACAO_COMANDO(comando->sequencia, CMD_PENDENTE);
+
+  if (atomic_compare_exchange_strong(&situacao_comandos[comando->vaga], &pendente,
+                                     SITUACAO_COMANDO(comando->sequencia, CMD_CANCELADO))) {
+    // A tarefa de controle descarta o comando e libera a vaga
+    atomic_fetch_add_explicit(&comandos_descartados, 1, memory_order_relaxed);
+    ESP_LOGW(TAG, "Comando cancelado: não executado a tempo");
+    return false;
+  }
+  // Já em execução: o aviso chega em seguida
+  return aguardar_comando(comando->sequencia, portMAX_DELAY);
+}
+
+
+bool controle_gpio_reiniciar_contador(int id) {
+  if((id > 0) && (id <= MAX_CONTADORES)) {
+    comando_gpio_t comando = { .tipo = CMD_REINICIAR_CONTADOR, .id = id };
+
+    return enviar_comando(&comando);
+  }
+  return false;
+}
+
+
+bool controle_gpio_mudar_atuador(int id, int valor) {
+  if((id > 0) && (id <= MAX_ATUADORES)) {
+    if ((valor >= 0) && (valor <= 1)) {
+      comando_gpio_t comando = { .tipo = CMD_MUDAR_ATUADOR, .id = id, .valor = valor };
+
+      return enviar_comando(&comando);
+    }
+  }
+  return false;
+}
+
+
+bool controle_gpio_alternar_atuador(int id) {
+  if((id > 0) && (id <= MAX_ATUADORES)) {
+    comando_gpio_t comando = { .tipo = CMD_ALTERNAR_ATUADOR, .id = id };
+
+    return enviar_comando(&comando);
+  }
+  return false;
+}
+
+
+bool controle_gpio_pulsar_atuador(int id, int duracao) {
+  if((id > 0) && (id <= MAX_ATUADORES)) {
+    comando_gpio_t comando = { .tipo = CMD_PULSAR_ATUADOR, .id = id, .valor = duracao };
+
+    return enviar_comando(&comando);
+  }
+  return false;
+}
+
+
+bool controle_gpio_definir_debounce(enum periferico classe, int id, int janela_ms) {
+  if (janela_ms < 0 ||
+      !((classe == PRF_SENSOR && id > 0 && id <= MAX_SENSORES) ||
+        (classe == PRF_CONTADOR && id > 0 && id <= MAX_CONTADORES))) {
+    return false;
+  }
+  comando_gpio_t comando = { .tipo = CMD_DEFINIR_DEBOUNCE, .classe = classe, .id = id,
+                             .valor = janela_ms };
+
+  return enviar_comando(&comando);
+}
+
+
+bool controle_gpio_aplicar_lote(const lote_atuadores_t *lote) {
+  comando_gpio_t comando = { .tipo = CMD_APLICAR_LOTE, .lote = *lote };
+
+  return enviar_comando(&comando);
+}
+
+
+bool controle_gpio_reconfig(void) {
+#if CONFIG_CONTROLE_GPIO_SIMULACAO
+  return false;
+#else
+  // Um pino é usado para forçar modo Soft AP, com ssid de fábrica e senha vazia.
+  if (gpio_get_level(GPIO_RECONFIG) == 0) {
+    return false;
+  } else {
+    return true;
+  }
+#endif
+
+}
+
+
+static void executar_acao_regra(const acao_regra_t *acao) {
+  switch (acao->tipo) {
+    case ACAO_REGRA_LIGAR:
+      executar_mudar_atuador(acao->id, 1);
+      break;
+    case ACAO_REGRA_DESLIGAR:
+      executar_mudar_atuador(acao->id, 0);
+      break;
+    case ACAO_REGRA_ALTERNAR:
+      executar_alternar_atuador(acao->id);
+      break;
+    case ACAO_REGRA_PULSAR:
+      executar_pulsar_atuador(acao->id, acao->valor);
+      break;
+    case ACAO_REGRA_ZERAR:
+      executar_reiniciar_contador(acao->id);
+      break;
+  }
+}
+
+
+/*  Avalia as regras e executa suas ações, diretamente nos periféricos.
+
+    As ações podem disparar outras regras; a cadeia é interrompida após
+    MAX_PASSOS_REGRAS avaliações seguidas com disparos.
+
+    instante_us é o momento em que as entradas foram amostradas, ou em
+    que o comando foi recebido, para medir a latência até as saídas.
+ */
+static void aplicar_regras(int64_t instante_us) {
+  acao_regra_t acoes[MAX_REGRAS];
+  int contagens[MAX_CONTADORES + 1];
+  bool disparou = false;
+  int passo;
+  int id;
+
+  for (passo = 0; passo < MAX_PASSOS_REGRAS; passo++) {
+    entradas_regras_t entradas_regras = { .niveis = { 0 }, .contagens = contagens };
+    int num_acoes;
+
+    memcpy(entradas_regras.eventos, eventos_regras, sizeof(eventos_regras));
+    memset(eventos_regras, 0, sizeof(eventos_regras));
+    for (id = 1; id <= MAX_SENSORES; id++) {
+      if (nivel_entrada(mapa_sensores[id])) {
+        entradas_regras.niveis[REGRA_SENSORES] |= REGRA_BIT(id);
+      }
+    }
+    for (id = 1; id <= MAX_ATUADORES; id++) {
+      if (mapa_atuadores[id].valor) {
+        entradas_regras.niveis[REGRA_ATUADORES] |= REGRA_BIT(id);
+      }
+    }
+    for (id = 1; id <= MAX_CONTADORES; id++) {
+      contagens[id] = contagem_int(&mapa_contadores[id]);
+    }
+
+    if (regras_avaliar(agora_us(), &entradas_regras, acoes, &num_acoes) == 0) {
+      break;
+    }
+    for (int i = 0; i < num_acoes; i++) {
+      executar_acao_regra(&acoes[i]);
+    }
+    disparou = true;
+  }
+
+  // Saídas alteradas pelo tick ou comando e pelas regras
+  descarregar_saidas();
+
+  if (disparou) {
+    regras_registrar_latencia((uint32_t)(agora_us() - instante_us),
+                              passo == MAX_PASSOS_REGRAS);
+  }
+}
+
+
+/*  Tick da tarefa de controle: contadores e sensores.
+ */
+static void executar_tick(void) {
+  bool mudou = false;
+
+  for (int b = 0; b < NUM_BACKENDS; b++) {
+    uint64_t niveis = backends[b]->ler_entradas();
+
+#if CONFIG_CONTROLE_GPIO_SIMULACAO
+    if (b == 0) {
+      gravar_bordas_simuladas(niveis);
+    }
+#endif
+    filtro_entradas_processar(&entradas[b], niveis);
+    mudou = mudou || ((entradas[b].subidas | entradas[b].descidas) != 0);
+  }
+
+  /*  Trata contadores que mudaram de nível 1 para 0 (após o 'debouncing')
+      NOTA: Nesta implementação por software, perdem-se eventos com pulsos
+            mais curtos que a janela. Com PCNT, nenhum evento é perdido
+            (veja iniciar_pcnt).
+   */
+  int64_t agora = agora_us();
+
+  for (int id = 1; id <= MAX_CONTADORES; id++) {
+    estado_contador_t *p_contador = &mapa_contadores[id];
+    uint32_t eventos = 0;
+
+#if CONTAGEM_HARDWARE
+    if (p_contador->hardware) {
+      // Contado pelo hardware: apenas lê os eventos novos
+      eventos = eventos_hardware(p_contador);
+    } else
+#endif
+    if (desceu_entrada(p_contador->gpio)) {
+      eventos = 1;
+    }
+
+    atualizar_taxas(&p_contador->taxas, agora, eventos);
+    if (eventos != 0) {
+      p_contador->contagem += eventos;
+      notificar_mudanca(PRF_CONTADOR, id, contagem_int(p_contador));
+    }
+  }
+
+  // Trata sensores que mudaram de nível desde o último tick
+  if (mudou) {
+    for (int id = 1; id <= MAX_SENSORES; id++) {
+      if (mudou_entrada(mapa_sensores[id])) {
+        notificar_mudanca(PRF_SENSOR, id, nivel_entrada(mapa_sensores[id]));
+      }
+    }
+  }
+
+  aplicar_regras(agora);
+}
+
+
+/*  Registra a latência de um comando, do envio até a escrita nos pinos.
+ */
+static void registrar_latencia(const comando_gpio_t *comando) {
+  uint32_t latencia = (uint32_t)(agora_us() - comando->instante_us);
+
+  estatisticas_comandos.executados++;
+  estatisticas_comandos.soma_latencia_us += latencia;
+  if (latencia > estatisticas_comandos.latencia_max_us) {
+    estatisticas_comandos.latencia_max_us = latencia;
+  }
+}
+
+
+#if !CONFIG_CONTROLE_GPIO_SIMULACAO
+/*  Entrega o estado publicado à persistência, com os atuadores em pulso
+    desligados: é o valor em que ficarão, e um pulso interrompido por
+    uma partida não deve ser restaurado como ligado.
+ */
+static void registrar_persistencia(void) {
+  if (num_pulsos == 0) {
+    persistencia_registrar(&estado_publicado.estado);
+    return;
+  }
+  estado_placa_t estado = estado_publicado.estado;
+
+  for (int id = 1; id <= MAX_ATUADORES; id++) {
+    if (mapa_atuadores[id].posicao_heap != 0) {
+      estado.atuadores[id] = 0;
+    }
+  }
+  persistencia_registrar(&estado);
+}
+
+
+/*  Laço da tarefa de controle.
+
+    Aguarda comandos até o instante do próximo tick; executa o tick
+    quando chega a hora, mesmo que haja comandos na fila.
+ */
+static void executar_tarefa_controle(void *parametros) {
+  const int64_t intervalo_us = (int64_t)INTERVALO_TICK_MS * 1000;
+  int64_t proximo_tick = agora_us() + intervalo_us;
+  comando_gpio_t comando;
+
+  while (true) {
+    int64_t agora = agora_us();
+
+    if (agora >= proximo_tick) {
+      if (agora - proximo_tick > intervalo_us / 2) {
+        atomic_fetch_add_explicit(&ticks_atrasados, 1, memory_order_relaxed);
+      }
+      executar_tick();
+      publicar_estado();
+      historico_registrar(agora, &estado_publicado.estado);
+      registrar_persistencia();
+
+      proximo_tick += intervalo_us;
+      if (proximo_tick <= agora) {
+        // Muito atrasado: recomeça a contagem em vez de acumular ticks
+        proximo_tick = agora + intervalo_us;
+      }
+      continue;
+    }
+
+    TickType_t espera = pdMS_TO_TICKS((proximo_tick - agora + 999) / 1000);
+
+    if (xQueueReceive(fila_comandos, &comando, (espera > 0) ? espera : 1) == pdPASS) {
+      if (comando.origem != NULL) {
+        unsigned int pendente = SITUACAO_COMANDO(comando.sequencia, CMD_PENDENTE);
+
+        if (!atomic_compare_exchange_strong(&situacao_comandos[comando.vaga], &pendente,
+                                            SITUACAO_COMANDO(comando.sequencia, CMD_EXECUTANDO))) {
+          // Cancelado por quem enviou, que já respondeu que não foi executado
+          atomic_store(&situacao_comandos[comando.vaga], CMD_LIVRE);
+          continue;
+        }
+      }
+      executar_comando(&comando);
+      aplicar_regras(agora_us());
+      if (comando.origem != NULL) {
+        registrar_latencia(&comando);
+      }
+      publicar_estado();
+      if (comando.origem != NULL) {
+        atomic_store(&situacao_comandos[comando.vaga], CMD_LIVRE);
+        xTaskNotify(comando.origem, comando.sequencia, eSetValueWithOverwrite);
+      }
+    }
+  }
+}
+#endif
+
+
+#if CONFIG_CONTROLE_GPIO_SIMULACAO
+/*  Laço da tarefa de controle na simulação.
+
+    O relógio virtual salta direto para o próximo tick ou fim de pulso,
+    na mesma ordem de execução da tarefa real; sem esperas, um dia de
+    tráfego roda em segundos. A FLASH não é gravada.
+ */
+void controle_gpio_simular_ate(int64_t fim_us) {
+  const int64_t intervalo_us = (int64_t)INTERVALO_TICK_MS * 1000;
+
+  while (simulacao_ativa) {
+    // Pulsos que terminam junto com o tick são desligados antes dele
+    bool pulso = (num_pulsos > 0 && fim_pulso(1) <= proximo_tick_simulado);
+    int64_t proximo = pulso ? fim_pulso(1) : proximo_tick_simulado;
+
+    if (proximo > fim_us) {
+      break;
+    }
+    simulacao_gpio_avancar(proximo);
+
+    if (pulso) {
+      executar_expirar_pulsos();
+      aplicar_regras(proximo);
+      publicar_estado();
+    } else {
+      executar_tick();
+      publicar_estado();
+      historico_registrar(proximo, &estado_publicado.estado);
+      proximo_tick_simulado += intervalo_us;
+    }
+  }
+  simulacao_gpio_avancar(fim_us);
+}
+#endif
+
+
+bool controle_gpio_ativar_timer(void) {
+#if CONFIG_CONTROLE_GPIO_SIMULACAO
+  // Sem tarefa: o tempo só avança em controle_gpio_simular_ate()
+  ESP_LOGI(TAG, "Simulação em tempo virtual, tick de %d ms.", INTERVALO_TICK_MS);
+  proximo_tick_simulado = agora_us() + (int64_t)INTERVALO_TICK_MS * 1000;
+  simulacao_ativa = true;
+  return true;
+#else
+  // Dispara continuamente a cada intervalo
+  ESP_LOGI(TAG, "Iniciando tarefa de controle com intervalo de %d ms.", INTERVALO_TICK_MS);
 
-  if(temporizador_local == NULL) {
+  fila_comandos = xQueueCreate(TAM_FILA_COMANDOS, sizeof(comando_gpio_t));
+  if (fila_comandos == NULL) {
     return false;
   }
-  // Aguarda 1 intervalo de tempo antes de iniciar o temporizador.
-  if(xTimerStart(temporizador_local, pdMS_TO_TICKS(INTERVALO_TICK_MS) ) != pdPASS) {
+  if (xTaskCreatePinnedToCore(executar_tarefa_controle, "controle", PILHA_TAREFA_CONTROLE, NULL,
+                              PRIORIDADE_TAREFA_CONTROLE, &tarefa_controle,
+                              NUCLEO_TAREFA_CONTROLE) != pdPASS) {
+    vQueueDelete(fila_comandos);
+    fila_comandos = NULL;
     return false;
   }
   return true;
+#endif
 }
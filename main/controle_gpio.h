@@ -3,6 +3,9 @@
 
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
+
 /** Tipos de perifericos controlados.
 */
 enum periferico {
@@ -12,9 +15,143 @@ enum periferico {
   PRF_SENSOR                    ///< Sensor binário (0 - Off, 1 - On).
 };
 
+#define ATUADORES_CHIP  4       ///< Atuadores nos pinos do ESP32.
+#define SENSORES_CHIP   2       ///< Sensores nos pinos do ESP32.
+
 #define MAX_CONTADORES  1       ///< Máximo de contadores no módulo.
-#define MAX_ATUADORES   4       ///< Máximo de atuadores no módulo.
-#define MAX_SENSORES    2       ///< Máximo de sensores no módulo.
+
+#if CONFIG_CONTROLE_GPIO_EXPANSOR
+// Cada expansor acrescenta 8 atuadores (porta A) e 8 sensores (porta B),
+// numerados depois dos pinos do ESP32 (veja expansor_gpio.c)
+#define MAX_ATUADORES   (ATUADORES_CHIP + 8 * CONFIG_EXPANSOR_QUANTIDADE)
+#define MAX_SENSORES    (SENSORES_CHIP + 8 * CONFIG_EXPANSOR_QUANTIDADE)
+#else
+#define MAX_ATUADORES   ATUADORES_CHIP  ///< Máximo de atuadores no módulo.
+#define MAX_SENSORES    SENSORES_CHIP   ///< Máximo de sensores no módulo.
+#endif
+
+// lote_atuadores_t usa o bit id de um uint64_t
+_Static_assert(MAX_ATUADORES < 64 && MAX_SENSORES < 64, "Periféricos demais para os mapas de bits");
+
+
+/** Mapa de bits com um bit por periférico de uma classe (bit id - 1 para o
+    periférico id), no menor tipo que comporta atuadores e sensores.
+*/
+#if MAX_ATUADORES <= 32 && MAX_SENSORES <= 32
+typedef uint32_t mapa_perifericos_t;
+#else
+typedef uint64_t mapa_perifericos_t;
+#endif
+
+
+/** Fotografia do estado de todos os periféricos do módulo.
+
+    Os vetores são indexados pelo identificador do periférico (de 1 até o
+    máximo da classe). A posição 0 não é utilizada.
+*/
+typedef struct {
+  int sensores[MAX_SENSORES + 1];       ///< Nível de cada sensor (0 ou 1)
+  int contadores[MAX_CONTADORES + 1];   ///< Contagem de cada contador
+  int atuadores[MAX_ATUADORES + 1];     ///< Último valor atribuído a cada atuador
+} estado_placa_t;
+
+/** Função chamada quando o estado de um periférico muda.
+
+    @param classe Classe do periférico (PRF_SENSOR, PRF_CONTADOR ou PRF_ATUADOR)
+    @param id     Identificador do periférico na classe
+    @param valor  Novo valor (nível do sensor, contagem ou valor do atuador)
+
+    NOTA: É chamada a partir da tarefa de controle, que executa todas as
+          mudanças. Deve ser rápida e não pode bloquear.
+*/
+typedef void (*controle_gpio_observador_t)(enum periferico classe, int id, int valor);
+
+
+/** Conjunto de mudanças em atuadores, aplicadas de uma só vez.
+
+    Os bits das máscaras correspondem aos identificadores dos atuadores
+    (bit 1 para o atuador 1, etc.). Cada atuador deve aparecer em no
+    máximo uma das máscaras.
+*/
+typedef struct {
+  uint64_t  ligar;                          ///< Atuadores a ligar
+  uint64_t  desligar;                       ///< Atuadores a desligar
+  uint64_t  alternar;                       ///< Atuadores a alternar (toggle)
+  uint64_t  pulsar;                         ///< Atuadores a pulsar
+  int       duracao[MAX_ATUADORES + 1];     ///< Duração de cada pulso, em ms
+} lote_atuadores_t;
+
+
+/** Estatísticas dos comandos executados pela tarefa de controle.
+
+    A latência é medida do envio do comando até a escrita nos pinos; o
+    atraso dos pulsos, do fim previsto até o desligamento do atuador.
+*/
+typedef struct {
+  uint32_t  executados;             ///< Comandos executados
+  uint32_t  descartados;            ///< Comandos descartados (fila cheia ou tempo esgotado)
+  uint32_t  latencia_max_us;        ///< Maior latência observada
+  uint64_t  soma_latencia_us;       ///< Soma das latências (para a média)
+  uint32_t  pulsos;                 ///< Pulsos terminados pelo temporizador
+  uint32_t  atraso_max_pulso_us;    ///< Maior atraso entre o fim previsto e o desligamento
+  uint64_t  soma_atraso_pulso_us;   ///< Soma dos atrasos (para a média)
+} estatisticas_comandos_t;
+
+
+#define FAIXAS_INTERVALO  12    ///< Faixas do histograma de intervalos entre eventos.
+
+
+/** Estatísticas de um contador, atualizadas a cada tick.
+
+    As janelas deslizantes contam os eventos do último segundo (em
+    passos de 100 ms), minuto (passos de 1 s) e hora (passos de 1 min).
+    As taxas são médias exponenciais da contagem por segundo, como as
+    médias de carga do Unix, em eventos por minuto.
+
+    O histograma conta os intervalos entre eventos consecutivos, com a
+    resolução do tick; o limite superior de cada faixa está em
+    controle_gpio_faixas_intervalo_ms.
+*/
+typedef struct {
+  uint32_t  ultimo_segundo;                 ///< Eventos no último segundo
+  uint32_t  ultimo_minuto;                  ///< Eventos no último minuto
+  uint32_t  ultima_hora;                    ///< Eventos na última hora
+  float     taxa_1min;                      ///< Média exponencial (1 min), eventos/min
+  float     taxa_5min;                      ///< Média exponencial (5 min), eventos/min
+  float     taxa_15min;                     ///< Média exponencial (15 min), eventos/min
+  uint32_t  intervalos[FAIXAS_INTERVALO];   ///< Histograma dos intervalos entre eventos
+  int64_t   ultimo_evento_us;               ///< Instante do último evento (0 se nenhum)
+  int64_t   contagem;                       ///< Contagem completa (as leituras em int param em INT_MAX)
+} estatisticas_contador_t;
+
+
+/** Limite superior (ms) de cada faixa do histograma de intervalos; a
+    última faixa não tem limite (valor 0).
+*/
+extern const uint32_t controle_gpio_faixas_intervalo_ms[FAIXAS_INTERVALO];
+
+
+/** Mudança de nível em um pino de entrada, capturada por interrupção.
+*/
+typedef struct {
+  uint32_t  seq;                    ///< Número de sequência do evento
+  int64_t   instante_us;            ///< Momento da borda (esp_timer_get_time)
+  uint8_t   classe;                 ///< PRF_SENSOR ou PRF_CONTADOR
+  uint8_t   id;                     ///< Identificador do periférico na classe
+  uint8_t   nivel;                  ///< Nível do pino após a borda
+} borda_gpio_t;
+
+
+/** Restaurar contagens e atuadores salvos (persistencia.c).
+
+    Deve ser chamada antes de controle_gpio_iniciar(), que já liga as
+    saídas no estado restaurado. Atuadores em pulso são salvos como
+    desligados, e portanto nunca voltam ligados depois da partida.
+
+    @param estado Estado salvo (sensores são ignorados)
+*/
+void controle_gpio_restaurar(const estado_placa_t *estado);
+
 
 /** Preparar a placa controladora para operar com o aplicativo.
 
@@ -24,12 +161,95 @@ enum periferico {
 void controle_gpio_iniciar(void);
 
 
-/** Ativa um timer de baixa frequencia para controlar contadores e
-    a duração dos pulsos nos atuadores. 
+/** Ativa a tarefa de controle, que executa os comandos e o tick (10 ms)
+    que amostra as entradas e controla contadores e sensores.
+
+    A partir daqui, as funções que alteram periféricos enviam um comando
+    para a tarefa de controle e aguardam sua execução.
+
+    @return false se a tarefa não pôde ser criada.
  */
 bool controle_gpio_ativar_timer(void);
 
 
+#if CONFIG_CONTROLE_GPIO_SIMULACAO
+/** Executar a tarefa de controle em tempo virtual até o instante indicado.
+
+    Apenas na simulação (Linux, simulacao_gpio.h), depois de
+    controle_gpio_ativar_timer(), que não cria a tarefa. Executa os ticks
+    e os fins de pulso até fim_us, avançando o relógio virtual sem
+    esperar. Os comandos (controle_gpio_mudar_atuador, etc.) são
+    executados na hora, no instante virtual corrente.
+
+    @param fim_us Instante virtual final, em microssegundos
+*/
+void controle_gpio_simular_ate(int64_t fim_us);
+#endif
+
+
+/** Registrar função a ser avisada das mudanças de estado dos periféricos.
+
+    As mudanças nos sensores e contadores só são detectadas com o temporizador
+    ativo.
+
+    @param observador Função a ser chamada, ou NULL para cancelar o aviso.
+
+    @see controle_gpio_ativar_timer()
+*/
+void controle_gpio_registrar_observador(controle_gpio_observador_t observador);
+
+
+/** Obter a versão do estado dos periféricos.
+
+    A versão é incrementada a cada mudança de estado de qualquer periférico
+    (as mesmas mudanças avisadas ao observador). Se a versão não mudou, o
+    estado lido anteriormente continua válido.
+
+    A versão é publicada junto com o estado: para usá-la como ETag de
+    uma leitura, obtenha as duas de uma vez com controle_gpio_ler_estado().
+
+    @return Número de versão, sempre crescente (exceto ao dar a volta em 32 bits).
+*/
+uint32_t controle_gpio_versao(void);
+
+
+/** Obter o número de ticks do temporizador atrasados.
+
+    Conta os ticks que começaram mais de meio intervalo depois do previsto,
+    seja por atraso da tarefa de controle ou por um tick ou comando
+    anterior que demorou demais.
+
+    @return Total de ticks atrasados desde o início.
+*/
+uint32_t controle_gpio_ticks_atrasados(void);
+
+
+/** Obter as estatísticas dos comandos enviados à tarefa de controle.
+
+    @param estatisticas Estrutura a preencher
+*/
+void controle_gpio_estatisticas_comandos(estatisticas_comandos_t *estatisticas);
+
+
+/** Ler as bordas capturadas nos pinos dos sensores e contadores.
+
+    As bordas ficam em um registro circular de tamanho fixo, em ordem de
+    sequência. A leitura não retira eventos do registro: cada leitor
+    mantém seu próprio cursor (o valor devolvido em proximo).
+
+    @param desde    Sequência do primeiro evento desejado
+    @param bordas   Vetor a preencher
+    @param max      Tamanho do vetor
+    @param proximo  Recebe o cursor para a próxima leitura
+    @param perdidos Recebe o número de eventos a partir de 'desde' que já
+                    foram sobrescritos no registro
+
+    @return Número de eventos copiados em bordas.
+*/
+int controle_gpio_ler_bordas(uint32_t desde, borda_gpio_t *bordas, int max,
+                             uint32_t *proximo, uint32_t *perdidos);
+
+
 /** Obter status da placa controladora.
 
     @return Texto indicando o estado do módulo (número de dispositivos, etc.)
@@ -39,11 +259,14 @@ const char *controle_gpio_status(void);
 
 /** Ler valor de um sensor
 
+    O valor é o nível filtrado ('debouncing') no último tick; a leitura
+    não acessa o hardware.
+
     @param id Identificador do sensor (de 1 a MAX_SENSORES)
 
     @return 1 se o sensor está em nível ligado e 0 se está desligado.
     
-    @todo Acrescentar sensores do tipo ADC, com valores inteiros.
+    @see sensor_adc_ler() para os sensores analógicos (ADC).
 */
 int controle_gpio_ler_sensor(int id);
 
@@ -56,43 +279,123 @@ int controle_gpio_ler_sensor(int id);
 
     @param id Identificador do contador (de 1 a MAX_CONTADORES)
 
-    @return a contagem
+    @return a contagem, limitada a INT_MAX (a contagem completa, de 64
+            bits, está em controle_gpio_estatisticas_contador()).
 */
 int controle_gpio_ler_contador(int id);
 
 
+/** Ler as estatísticas de um contador (taxas, janelas e intervalos).
+
+    Não bloqueia: lê a cópia publicada pela tarefa de controle.
+
+    @param id           Identificador do contador (de 1 a MAX_CONTADORES)
+    @param estatisticas Estrutura a preencher
+
+    @return false se o id é inválido.
+*/
+bool controle_gpio_estatisticas_contador(int id, estatisticas_contador_t *estatisticas);
+
+
+/** Ler o estado de todos os periféricos de uma só vez.
+
+    Percorre as tabelas de sensores, contadores e atuadores, preenchendo
+    a estrutura indicada.
+
+    @param estado Estrutura a ser preenchida
+
+    @return Versão do estado lido (ver controle_gpio_versao()).
+*/
+uint32_t controle_gpio_ler_estado(estado_placa_t *estado);
+
+
+/** Alterar a janela de 'debouncing' de um sensor ou contador.
+
+    O nível da entrada só muda depois de se manter diferente durante a
+    janela. A janela é arredondada para o tick da tarefa de controle, de
+    1 a 15 ticks. Nos contadores por hardware (PCNT), vale apenas o
+    filtro da unidade; os contadores de contatos mecânicos (campo contato
+    em controle_gpio.c) ficam sempre na contagem por software.
+
+    @param classe     PRF_SENSOR ou PRF_CONTADOR
+    @param id         Identificador do periférico
+    @param janela_ms  Janela em milissegundos (padrão 30 ms)
+
+    @return false se a classe ou o identificador são inválidos, ou se a
+            tarefa de controle não executou o comando a tempo.
+*/
+bool controle_gpio_definir_debounce(enum periferico classe, int id, int janela_ms);
+
+
 /** Reiniciar a contagem de um contador para zero.
 
     @param id     Identificador do contador (de 1 a MAX_CONTADORES)
+
+    @return false se o identificador é inválido ou se o comando não foi
+            executado a tempo (ver controle_gpio_mudar_atuador()).
 */
-void controle_gpio_reiniciar_contador(int id);
+bool controle_gpio_reiniciar_contador(int id);
+
+
+/** Ler o último valor atribuído a um atuador.
+
+    @param id     Identificador do atuador (de 1 a MAX_ATUADORES)
+
+    @return 0 ou 1, ou -1 se o identificador for inválido.
+*/
+int controle_gpio_ler_atuador(int id);
 
 
 /** Mudar o valor de um atuador.
 
     @param id     Identificador do atuador (de 1 a MAX_ATUADORES)
     @param valor  0 para desligado; 1 para ligado
+
+    @return false se os parâmetros são inválidos, se a fila de comandos
+            da tarefa de controle está cheia ou se o comando não começou
+            a ser executado em 50 ms; nos dois casos ele é descartado e
+            nunca será executado. O servidor responde 503 nesses casos.
 */
-void controle_gpio_mudar_atuador(int id, int valor);
+bool controle_gpio_mudar_atuador(int id, int valor);
 
 
 /** Alternar o valor de um atuador entre 0 e 1 (toggle)
 
     @param id     Identificador do atuador (de 1 a MAX_ATUADORES)
+
+    @return false se o comando não foi executado (ver controle_gpio_mudar_atuador()).
  */
-void controle_gpio_alternar_atuador(int id);
+bool controle_gpio_alternar_atuador(int id);
 
 
 /** Cria um pulso positivo no valor de um atuador com certa duração
 
     O atuador é ligado por um tempo determinado, e depois desligado.
 
+    O fim do pulso é controlado por um esp_timer, com precisão de cerca
+    de 1 ms, desde controle_gpio_iniciar(). Um novo pulso no mesmo
+    atuador substitui o anterior; mudar ou alternar o atuador cancela o
+    pulso em andamento.
+
     @param id       Identificador do atuador (de 1 a MAX_ATUADORES)
-    @param duracao  Duração do pulso em milissegundos
-    
-    @todo Completar implementação utilizando um temporizador.
+    @param duracao  Duração do pulso em milissegundos (mínimo 1)
+
+    @return false se o comando não foi executado (ver controle_gpio_mudar_atuador()).
  */
-void controle_gpio_pulsar_atuador(int id, int duracao);
+bool controle_gpio_pulsar_atuador(int id, int duracao);
+
+
+/** Aplica um conjunto de mudanças em atuadores ao mesmo tempo.
+
+    Os níveis de todas as saídas envolvidas são alterados com uma única
+    escrita nos registradores de set/clear das portas GPIO (e uma por
+    expansor), de modo que nenhum outro comando se intercala entre elas.
+
+    @param lote Mudanças a aplicar
+
+    @return false se o lote não foi executado (ver controle_gpio_mudar_atuador()).
+*/
+bool controle_gpio_aplicar_lote(const lote_atuadores_t *lote);
 
 
 /** Indica se o sensor de reconfiguração está ativado.
@@ -0,0 +1,339 @@
+/** @file expansor_gpio.c - Expansores de GPIO MCP23017 (I2C).
+
+    Para placas com mais atuadores e sensores do que os pinos do ESP32,
+    cada MCP23017 acrescenta 16 pinos, em duas portas de 8 (A e B). Até
+    MAX_EXPANSORES dividem o barramento I2C, nos endereços 0x20 em diante.
+
+    Custo no barramento:
+      - Leitura: uma transação por expansor com entradas, lendo GPIOA e
+        GPIOB de uma vez (endereço incrementado pelo próprio MCP23017).
+        As saídas INT dos expansores (espelhadas, em dreno aberto) são
+        ligadas juntas a um pino do ESP32; sem interrupção, o tick usa a
+        amostra anterior, sem acessar o barramento.
+      - Escrita: as saídas ficam em cópia local (o latch), sem ler o
+        expansor antes de escrever. Ao final de cada comando ou tick, só
+        os expansores alterados são escritos, uma transação por expansor
+        para OLATA e OLATB.
+
+    No Linux (CONFIG_IDF_TARGET_LINUX), o barramento é substituído por um
+    modelo em memória dos registradores, que conta as transações como o
+    barramento real.
+
+    @author João Vianna (jvianna@gmail.com)
+    @version 0.83
+
+    @see controle_gpio.c
+    @see backend_pinos.h
+*/
+#include <string.h>
+#include <stdatomic.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_log.h"
+#include "esp_attr.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "driver/gpio.h"
+#include "driver/i2c_master.h"
+#endif
+
+#include "expansor_gpio.h"
+
+#if CONFIG_CONTROLE_GPIO_EXPANSOR
+
+#define TAG "expansor"
+
+#define ENDERECO_EXPANSOR     (0x20)
+#define TEMPO_MAX_I2C_MS      (10)
+
+// Sem interrupção, as entradas são relidas a cada TICKS_LEITURA_FORCADA ticks
+#define TICKS_LEITURA_FORCADA (100)
+
+// Registradores do MCP23017 (IOCON.BANK = 0: portas A e B alternadas)
+#define REG_IODIRA            (0x00)
+#define REG_GPINTENA          (0x04)
+#define REG_IOCON             (0x0A)
+#define REG_GPPUA             (0x0C)
+#define REG_GPIOA             (0x12)
+#define REG_OLATA             (0x14)
+#define NUM_REGISTRADORES     (0x16)
+
+#define IOCON_MIRROR          (1 << 6)    // INTA e INTB espelhadas
+#define IOCON_ODR             (1 << 2)    // INT em dreno aberto (várias ligadas juntas)
+
+_Static_assert(CONFIG_EXPANSOR_QUANTIDADE <= MAX_EXPANSORES, "Expansores demais no barramento");
+
+#define NUM_EXPANSORES        CONFIG_EXPANSOR_QUANTIDADE
+
+// Parte de um mapa de bits de 64 pinos que cabe a um expansor
+#define PORTAS(mapa, n)       ((uint16_t)((mapa) >> (16 * (n))))
+
+static uint16_t entradas_expansor[NUM_EXPANSORES];
+
+// Saídas: cópia local e último valor escrito em cada expansor
+static uint64_t latch = 0;
+static uint16_t latch_gravado[NUM_EXPANSORES];
+
+// Última amostra das entradas
+static uint64_t amostra = 0;
+static int      ticks_sem_leitura = 0;
+
+// Avisada pela linha INT dos expansores
+static atomic_bool interrupcao = true;
+
+static estatisticas_expansor_t estatisticas;
+
+static portMUX_TYPE mux_expansor = portMUX_INITIALIZER_UNLOCKED;
+
+
+#if CONFIG_IDF_TARGET_LINUX
+
+/*  Modelo dos expansores, no lugar do barramento.
+ */
+static uint8_t  registradores_modelo[NUM_EXPANSORES][NUM_REGISTRADORES];
+static uint16_t pinos_modelo[NUM_EXPANSORES];
+
+
+/*  Nível das portas: entradas vêm dos pinos externos, saídas do latch.
+ */
+static uint8_t ler_porta_modelo(int n, int porta) {
+  const uint8_t *reg = registradores_modelo[n];
+  uint8_t direcao = reg[REG_IODIRA + porta];        // 1: entrada
+  uint8_t externo = (uint8_t)(pinos_modelo[n] >> (8 * porta));
+
+  return (externo & direcao) | (reg[REG_OLATA + porta] & ~direcao);
+}
+
+
+/*  Transação no modelo: o primeiro byte escrito é o registrador; os
+    seguintes são escritos (ou lidos) em registradores consecutivos.
+ */
+static bool transferir_modelo(int n, const uint8_t *escrita, size_t len_escrita,
+                              uint8_t *leitura, size_t len_leitura) {
+  int reg = escrita[0];
+
+  for (size_t i = 1; i < len_escrita; i++, reg++) {
+    registradores_modelo[n][reg % NUM_REGISTRADORES] = escrita[i];
+  }
+  for (size_t i = 0; i < len_leitura; i++, reg++) {
+    reg %= NUM_REGISTRADORES;
+    leitura[i] = (reg == REG_GPIOA || reg == REG_GPIOA + 1) ? ler_porta_modelo(n, reg - REG_GPIOA)
+                                                            : registradores_modelo[n][reg];
+  }
+  return true;
+}
+
+
+void expansor_gpio_definir_pinos(int n, uint16_t niveis) {
+  if (n < 0 || n >= NUM_EXPANSORES) {
+    return;
+  }
+  uint16_t habilitadas = registradores_modelo[n][REG_GPINTENA] |
+                         (registradores_modelo[n][REG_GPINTENA + 1] << 8);
+  uint16_t mudancas = (pinos_modelo[n] ^ niveis) & habilitadas;
+
+  pinos_modelo[n] = niveis;
+  if (mudancas != 0) {
+    atomic_store(&interrupcao, true);
+  }
+}
+
+#else
+
+static i2c_master_bus_handle_t barramento = NULL;
+static i2c_master_dev_handle_t dispositivos[NUM_EXPANSORES];
+
+
+static void IRAM_ATTR tratar_interrupcao(void *arg) {
+  atomic_store_explicit(&interrupcao, true, memory_order_relaxed);
+}
+
+#endif
+
+
+/*  Uma transação com um expansor: escreve o registrador e os dados, e lê
+    len_leitura bytes a partir do registrador (se leitura != NULL).
+ */
+static bool transferir(int n, const uint8_t *escrita, size_t len_escrita,
+                       uint8_t *leitura, size_t len_leitura) {
+  bool ok;
+
+#if CONFIG_IDF_TARGET_LINUX
+  ok = transferir_modelo(n, escrita, len_escrita, leitura, len_leitura);
+#else
+  if (leitura == NULL) {
+    ok = (i2c_master_transmit(dispositivos[n], escrita, len_escrita, TEMPO_MAX_I2C_MS) == ESP_OK);
+  } else {
+    ok = (i2c_master_transmit_receive(dispositivos[n], escrita, len_escrita,
+                                      leitura, len_leitura, TEMPO_MAX_I2C_MS) == ESP_OK);
+  }
+#endif
+
+  portENTER_CRITICAL(&mux_expansor);
+  estatisticas.transacoes++;
+  if (!ok) {
+    estatisticas.falhas++;
+  }
+  portEXIT_CRITICAL(&mux_expansor);
+  return ok;
+}
+
+
+/*  Escreve um par de registradores (porta A e porta B) em uma transação.
+ */
+static bool escrever_par(int n, uint8_t reg, uint16_t valor) {
+  uint8_t dados[3] = { reg, (uint8_t)valor, (uint8_t)(valor >> 8) };
+
+  return transferir(n, dados, sizeof(dados), NULL, 0);
+}
+
+
+static bool iniciar_expansores(uint64_t saidas, uint64_t entradas, uint64_t nivel_saidas) {
+#if !CONFIG_IDF_TARGET_LINUX
+  i2c_master_bus_config_t config_barramento = {
+    .i2c_port = -1,
+    .sda_io_num = CONFIG_EXPANSOR_I2C_SDA,
+    .scl_io_num = CONFIG_EXPANSOR_I2C_SCL,
+    .clk_source = I2C_CLK_SRC_DEFAULT,
+    .glitch_ignore_cnt = 7,
+    .flags.enable_internal_pullup = true
+  };
+
+  if (i2c_new_master_bus(&config_barramento, &barramento) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to create I2C bus");
+    return false;
+  }
+  for (int n = 0; n < NUM_EXPANSORES; n++) {
+    i2c_device_config_t config_dispositivo = {
+      .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+      .device_address = ENDERECO_EXPANSOR + n,
+      .scl_speed_hz = CONFIG_EXPANSOR_I2C_FREQ_HZ
+    };
+    if (i2c_master_bus_add_device(barramento, &config_dispositivo, &dispositivos[n]) != ESP_OK) {
+      ESP_LOGE(TAG, "Failed to add expander %d", n);
+      return false;
+    }
+  }
+#endif
+
+  latch = nivel_saidas & saidas;
+  bool ok = true;
+
+  for (int n = 0; n < NUM_EXPANSORES; n++) {
+    uint8_t iocon[2] = { REG_IOCON, IOCON_MIRROR | IOCON_ODR };
+
+    entradas_expansor[n] = PORTAS(entradas, n);
+    latch_gravado[n] = PORTAS(latch, n);
+
+    // Latch antes da direção, para as saídas já começarem no nível certo
+    ok = transferir(n, iocon, sizeof(iocon), NULL, 0) &&
+         escrever_par(n, REG_OLATA, latch_gravado[n]) &&
+         escrever_par(n, REG_IODIRA, (uint16_t)~PORTAS(saidas, n)) &&
+         escrever_par(n, REG_GPPUA, entradas_expansor[n]) &&
+         escrever_par(n, REG_GPINTENA, entradas_expansor[n]) && ok;
+  }
+
+#if !CONFIG_IDF_TARGET_LINUX
+  gpio_config_t io_conf = {
+    .pin_bit_mask = 1ULL << CONFIG_EXPANSOR_GPIO_INT,
+    .mode = GPIO_MODE_INPUT,
+    .pull_up_en = GPIO_PULLUP_ENABLE,
+    .pull_down_en = GPIO_PULLDOWN_DISABLE,
+    .intr_type = GPIO_INTR_NEGEDGE
+  };
+  gpio_config(&io_conf);
+  if (gpio_isr_handler_add(CONFIG_EXPANSOR_GPIO_INT, tratar_interrupcao, NULL) != ESP_OK) {
+    ESP_LOGW(TAG, "No interrupt line: inputs polled every %d ticks", TICKS_LEITURA_FORCADA);
+  }
+#endif
+
+  // A primeira leitura limpa as interrupções pendentes
+  atomic_store(&interrupcao, true);
+  ESP_LOGI(TAG, "%d MCP23017 expanders %s", NUM_EXPANSORES, ok ? "ready" : "failed");
+  return ok;
+}
+
+
+static uint64_t ler_entradas_expansores(void) {
+  bool ler = atomic_exchange(&interrupcao, false) ||
+             (++ticks_sem_leitura >= TICKS_LEITURA_FORCADA);
+
+  portENTER_CRITICAL(&mux_expansor);
+  estatisticas.ticks++;
+  if (!ler) {
+    estatisticas.leituras_evitadas++;
+  }
+  portEXIT_CRITICAL(&mux_expansor);
+
+  if (!ler) {
+    // Nada mudou desde a última leitura
+    return amostra;
+  }
+  ticks_sem_leitura = 0;
+
+  for (int n = 0; n < NUM_EXPANSORES; n++) {
+    uint8_t reg = REG_GPIOA;
+    uint8_t portas[2];
+
+    if (entradas_expansor[n] == 0 || !transferir(n, &reg, 1, portas, sizeof(portas))) {
+      continue;
+    }
+    uint64_t valor = (uint64_t)(portas[0] | (portas[1] << 8)) << (16 * n);
+
+    amostra = (amostra & ~((uint64_t)0xFFFF << (16 * n))) | valor;
+    portENTER_CRITICAL(&mux_expansor);
+    estatisticas.leituras++;
+    portEXIT_CRITICAL(&mux_expansor);
+  }
+
+#if !CONFIG_IDF_TARGET_LINUX
+  // Com as INT ligadas juntas, outro expansor pode ter mantido a linha
+  // baixa durante a leitura, sem nova borda: lê de novo no próximo tick
+  if (gpio_get_level(CONFIG_EXPANSOR_GPIO_INT) == 0) {
+    atomic_store(&interrupcao, true);
+  }
+#endif
+  return amostra;
+}
+
+
+static void escrever_saidas_expansores(uint64_t ligar, uint64_t desligar) {
+  latch = (latch | ligar) & ~desligar;
+}
+
+
+static void descarregar_expansores(void) {
+  for (int n = 0; n < NUM_EXPANSORES; n++) {
+    uint16_t portas = PORTAS(latch, n);
+
+    if (portas == latch_gravado[n]) {
+      continue;
+    }
+    if (escrever_par(n, REG_OLATA, portas)) {
+      latch_gravado[n] = portas;
+      portENTER_CRITICAL(&mux_expansor);
+      estatisticas.escritas++;
+      portEXIT_CRITICAL(&mux_expansor);
+    }
+  }
+}
+
+
+// Ver a descrição das funções públicas em expansor_gpio.h
+
+const backend_pinos_t backend_expansor = {
+  .nome = "mcp23017",
+  .iniciar = iniciar_expansores,
+  .ler_entradas = ler_entradas_expansores,
+  .escrever_saidas = escrever_saidas_expansores,
+  .descarregar = descarregar_expansores
+};
+
+
+void expansor_gpio_estatisticas(estatisticas_expansor_t *saida) {
+  portENTER_CRITICAL(&mux_expansor);
+  *saida = estatisticas;
+  portEXIT_CRITICAL(&mux_expansor);
+}
+
+#endif  // CONFIG_CONTROLE_GPIO_EXPANSOR
@@ -0,0 +1,54 @@
+/** @file expansor_gpio.h - Expansores de GPIO MCP23017 (I2C).
+*/
+#pragma once
+
+#include <stdint.h>
+
+#include "backend_pinos.h"
+
+#define MAX_EXPANSORES    4     ///< Expansores no barramento (16 pinos cada).
+
+
+/** Estatísticas do barramento dos expansores.
+
+    Transações por tick = transacoes / ticks.
+*/
+typedef struct {
+  uint32_t  ticks;                ///< Leituras de entradas pedidas (uma por tick)
+  uint32_t  leituras;             ///< Leituras das portas de entrada no barramento
+  uint32_t  leituras_evitadas;    ///< Ticks sem interrupção, atendidos pela amostra anterior
+  uint32_t  escritas;             ///< Escritas das portas de saída no barramento
+  uint32_t  transacoes;           ///< Transações no barramento, incluindo a configuração
+  uint32_t  falhas;               ///< Transações com erro
+} estatisticas_expansor_t;
+
+
+/** Backend dos pinos nos expansores (PINO_EXPANSOR).
+
+    Em cada transação, lê ou escreve as duas portas de um expansor. As
+    saídas ficam em cópia local (sem ler o expansor antes de escrever) e
+    só os expansores alterados são escritos, em descarregar(). As entradas
+    só são lidas quando a linha de interrupção dos expansores avisa uma
+    mudança (e uma vez por segundo, por garantia).
+*/
+extern const backend_pinos_t backend_expansor;
+
+
+/** Ler as estatísticas do barramento.
+
+    @param estatisticas Estrutura a ser preenchida
+*/
+void expansor_gpio_estatisticas(estatisticas_expansor_t *estatisticas);
+
+
+#if CONFIG_IDF_TARGET_LINUX
+/** Alterar o nível dos pinos externos de um expansor simulado.
+
+    No Linux, os expansores são um modelo em memória dos registradores
+    do MCP23017, que conta as transações como o barramento real.
+
+    @param n      Expansor (de 0 a CONFIG_EXPANSOR_QUANTIDADE - 1)
+    @param niveis Nível de cada pino (bit 0 a 7 na porta A, 8 a 15 na porta B)
+*/
+void expansor_gpio_definir_pinos(int n, uint16_t niveis);
+#endif
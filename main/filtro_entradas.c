@@ -0,0 +1,56 @@
+/** @file filtro_entradas.c - 'Debouncing' de até 64 entradas em paralelo.
+
+    Todos os pinos são filtrados ao mesmo tempo por um contador vertical:
+    o bit b do contador de cada pino fica na palavra contador[b], e o
+    incremento e a comparação são feitos com algumas operações lógicas
+    sobre as palavras, qualquer que seja o número de pinos.
+
+    O contador de um pino avança enquanto a amostra difere do nível
+    estável e volta a zero quando concorda. Ao atingir a janela do pino,
+    o nível estável muda, gerando uma borda de subida ou de descida.
+    A janela de cada pino, em amostras, também fica em planos de bits.
+
+    @see controle_gpio.c
+ */
+#include "filtro_entradas.h"
+
+
+void filtro_entradas_processar(filtro_entradas_t *f, uint64_t amostra) {
+  uint64_t diferente = (amostra ^ f->estavel) & f->mascara;
+  uint64_t vai_um = diferente;
+  uint64_t atingiu = diferente;
+
+  // Incrementa os contadores dos pinos diferentes, zera os demais
+  for (int b = 0; b < BITS_DEBOUNCE; b++) {
+    uint64_t bit = f->contador[b];
+
+    f->contador[b] = (bit ^ vai_um) & diferente;
+    vai_um &= bit;
+    atingiu &= ~(f->contador[b] ^ f->janela[b]);
+  }
+
+  f->estavel ^= atingiu;
+  for (int b = 0; b < BITS_DEBOUNCE; b++) {
+    f->contador[b] &= ~atingiu;
+  }
+  f->subidas = atingiu & f->estavel;
+  f->descidas = atingiu & ~f->estavel;
+}
+
+
+void filtro_entradas_definir_janela(filtro_entradas_t *f, uint64_t pinos, int amostras) {
+  if (amostras < 1) {
+    amostras = 1;
+  } else if (amostras > MAX_JANELA_DEBOUNCE) {
+    amostras = MAX_JANELA_DEBOUNCE;
+  }
+  for (int b = 0; b < BITS_DEBOUNCE; b++) {
+    if (amostras & (1 << b)) {
+      f->janela[b] |= pinos;
+    } else {
+      f->janela[b] &= ~pinos;
+    }
+    // Recomeça a contagem dos pinos com a nova janela
+    f->contador[b] &= ~pinos;
+  }
+}
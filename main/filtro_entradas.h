@@ -0,0 +1,43 @@
+/** @file filtro_entradas.h - 'Debouncing' de até 64 entradas em paralelo.
+*/
+#pragma once
+
+#include <stdint.h>
+
+#define BITS_DEBOUNCE         (4)                             ///< Bits do contador de cada pino
+#define MAX_JANELA_DEBOUNCE   ((1 << BITS_DEBOUNCE) - 1)      ///< Maior janela, em amostras
+
+
+/** Estado do filtro de um conjunto de até 64 entradas (um bit por pino).
+
+    Pode ser zerado com memset; mascara e estavel são preenchidos pelo
+    usuário antes da primeira amostra.
+*/
+typedef struct {
+  uint64_t  mascara;                    ///< Pinos filtrados
+  uint64_t  estavel;                    ///< Nível filtrado de cada pino
+  uint64_t  subidas;                    ///< Bordas de subida na última amostra
+  uint64_t  descidas;                   ///< Bordas de descida na última amostra
+  uint64_t  contador[BITS_DEBOUNCE];    ///< Contador vertical (um plano por bit)
+  uint64_t  janela[BITS_DEBOUNCE];      ///< Janela de cada pino (um plano por bit)
+} filtro_entradas_t;
+
+
+/** Processar uma amostra de todas as entradas.
+
+    Atualiza estavel, subidas e descidas. O custo não depende do número
+    de pinos.
+
+    @param filtro   Estado do filtro
+    @param amostra  Nível lido de cada pino
+*/
+void filtro_entradas_processar(filtro_entradas_t *filtro, uint64_t amostra);
+
+
+/** Definir a janela de alguns pinos e recomeçar sua contagem.
+
+    @param filtro   Estado do filtro
+    @param pinos    Máscara dos pinos
+    @param amostras Janela, em amostras (limitada a 1..MAX_JANELA_DEBOUNCE)
+*/
+void filtro_entradas_definir_janela(filtro_entradas_t *filtro, uint64_t pinos, int amostras);
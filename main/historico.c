@@ -0,0 +1,361 @@
+/** @file historico.c - Histórico dos periféricos em memória RAM.
+
+    Guarda o que aconteceu com sensores, contadores e atuadores, para
+    consultar depois de uma ocorrência. A memória é fixa, definida na
+    compilação, em três registros circulares de resolução decrescente:
+
+      - Mudanças: uma amostra a cada tick em que algo mudou, com o
+        instante exato (resolução do tick). Cobre os últimos minutos,
+        conforme o movimento;
+      - Segundos: um resumo por segundo, cobrindo TAM_HIST_SEGUNDOS s;
+      - Minutos: um resumo por minuto, cobrindo TAM_HIST_MINUTOS min.
+
+    Os resumos guardam o nível no fim do intervalo, quais periféricos
+    estiveram ligados em algum momento e os eventos de cada contador.
+    Como o tick nunca para, cada resumo corresponde a um intervalo fixo:
+    a sequência do resumo é o próprio número do segundo (ou minuto) desde
+    a partida, e o instante não precisa ser gravado.
+
+    Os registros são alimentados pela tarefa de controle, a cada tick, e
+    lidos pelo servidor aos poucos; a cópia de cada trecho é feita em
+    uma seção crítica curta.
+
+    @author João Vianna (jvianna@gmail.com)
+    @version 0.83
+
+    @see controle_gpio.c
+*/
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "historico.h"
+
+#define TAM_HIST_MUDANCAS     (256)
+#if MAX_ATUADORES < 8 && MAX_SENSORES < 8
+#define TAM_HIST_SEGUNDOS     (900)       // 15 minutos
+#define TAM_HIST_MINUTOS      (1440)      // 24 horas
+#else
+// Com os expansores, os mapas de bits são maiores: guarda menos tempo
+#define TAM_HIST_SEGUNDOS     (600)       // 10 minutos
+#define TAM_HIST_MINUTOS      (720)       // 12 horas
+#endif
+
+#define MS_SEGUNDO            (1000)
+#define MS_MINUTO             (60 * 1000)
+
+
+// Mudança, com instante explícito
+typedef struct {
+  int64_t           instante_ms;
+  mapa_historico_t  sensores;
+  mapa_historico_t  atuadores;
+  uint16_t          eventos[MAX_CONTADORES + 1];
+} mudanca_t;
+
+// Resumo de um intervalo fixo; o instante vem da sequência
+typedef struct {
+  mapa_historico_t  sensores;
+  mapa_historico_t  sensores_ligados;
+  mapa_historico_t  atuadores;
+  mapa_historico_t  atuadores_ligados;
+  uint16_t          eventos[MAX_CONTADORES + 1];
+} resumo_t;
+
+// Resumo em formação
+typedef struct {
+  int64_t           indice;                 // Segundo ou minuto corrente
+  mapa_historico_t  sensores_ligados;
+  mapa_historico_t  atuadores_ligados;
+  uint32_t          eventos[MAX_CONTADORES + 1];
+} acumulador_t;
+
+// Registro circular de resumos de uma resolução
+typedef struct {
+  resumo_t      *resumos;
+  int           tamanho;
+  uint32_t      duracao_ms;
+  int64_t       inicio;                     // Primeiro intervalo registrado (-1: nenhum)
+  int64_t       fim;                        // Primeiro intervalo ainda não gravado
+  acumulador_t  acumulador;
+} registro_resumos_t;
+
+static mudanca_t  hist_mudancas[TAM_HIST_MUDANCAS];
+static resumo_t   hist_segundos[TAM_HIST_SEGUNDOS];
+static resumo_t   hist_minutos[TAM_HIST_MINUTOS];
+
+// Total de mudanças gravadas (sequência da próxima)
+static uint32_t   cabeca_mudancas = 0;
+
+static registro_resumos_t registro_segundos = {
+  .resumos = hist_segundos, .tamanho = TAM_HIST_SEGUNDOS, .duracao_ms = MS_SEGUNDO, .inicio = -1
+};
+static registro_resumos_t registro_minutos = {
+  .resumos = hist_minutos, .tamanho = TAM_HIST_MINUTOS, .duracao_ms = MS_MINUTO, .inicio = -1
+};
+
+// Último estado registrado, para detectar mudanças
+static mapa_historico_t sensores_anterior;
+static mapa_historico_t atuadores_anterior;
+static int              contadores_anterior[MAX_CONTADORES + 1];
+
+static portMUX_TYPE mux_historico = portMUX_INITIALIZER_UNLOCKED;
+
+
+static mapa_historico_t mapa_de_bits(const int *valores, int quantidade) {
+  mapa_historico_t mapa = 0;
+
+  for (int id = 1; id <= quantidade; id++) {
+    if (valores[id] != 0) {
+      mapa |= (mapa_historico_t)1 << id;
+    }
+  }
+  return mapa;
+}
+
+
+static inline uint16_t saturar(uint32_t eventos) {
+  return (eventos > UINT16_MAX) ? UINT16_MAX : (uint16_t)eventos;
+}
+
+
+/*  Grava os resumos dos intervalos terminados antes de indice.
+
+    Se houve intervalos sem tick (não deveria acontecer), eles repetem o
+    último estado, sem eventos.
+ */
+static void fechar_resumos(registro_resumos_t *registro, int64_t instante_ms,
+                           mapa_historico_t sensores, mapa_historico_t atuadores) {
+  int64_t indice = instante_ms / registro->duracao_ms;
+  acumulador_t *acumulador = &registro->acumulador;
+
+  if (registro->inicio < 0) {
+    registro->inicio = registro->fim = indice;
+    acumulador->indice = indice;
+    return;
+  }
+  if (indice - registro->fim > registro->tamanho) {
+    registro->fim = indice - registro->tamanho;
+  }
+  while (registro->fim < indice) {
+    resumo_t *resumo = &registro->resumos[registro->fim % registro->tamanho];
+    bool corrente = (registro->fim == acumulador->indice);
+
+    resumo->sensores = sensores;
+    resumo->atuadores = atuadores;
+    resumo->sensores_ligados = corrente ? acumulador->sensores_ligados : sensores;
+    resumo->atuadores_ligados = corrente ? acumulador->atuadores_ligados : atuadores;
+    for (int id = 1; id <= MAX_CONTADORES; id++) {
+      resumo->eventos[id] = corrente ? saturar(acumulador->eventos[id]) : 0;
+    }
+    registro->fim++;
+  }
+  if (registro->fim - registro->inicio > registro->tamanho) {
+    registro->inicio = registro->fim - registro->tamanho;
+  }
+  if (acumulador->indice != indice) {
+    memset(acumulador, 0, sizeof(*acumulador));
+    acumulador->indice = indice;
+  }
+}
+
+
+static void acumular(acumulador_t *acumulador, mapa_historico_t sensores, mapa_historico_t atuadores,
+                     const uint32_t *eventos) {
+  acumulador->sensores_ligados |= sensores;
+  acumulador->atuadores_ligados |= atuadores;
+  for (int id = 1; id <= MAX_CONTADORES; id++) {
+    acumulador->eventos[id] += eventos[id];
+  }
+}
+
+
+// Documentação das funções públicas no arquivo header.
+
+
+void historico_registrar(int64_t instante_us, const estado_placa_t *estado) {
+  int64_t instante_ms = instante_us / 1000;
+  mapa_historico_t sensores = mapa_de_bits(estado->sensores, MAX_SENSORES);
+  mapa_historico_t atuadores = mapa_de_bits(estado->atuadores, MAX_ATUADORES);
+  uint32_t eventos[MAX_CONTADORES + 1] = {0};
+  bool mudou = (sensores != sensores_anterior || atuadores != atuadores_anterior);
+
+  for (int id = 1; id <= MAX_CONTADORES; id++) {
+    int delta = estado->contadores[id] - contadores_anterior[id];
+
+    // Contagem menor: o contador foi reiniciado
+    eventos[id] = (delta > 0) ? (uint32_t)delta : 0;
+    mudou |= (delta > 0);
+    contadores_anterior[id] = estado->contadores[id];
+  }
+
+  portENTER_CRITICAL(&mux_historico);
+
+  // O estado anterior vale até este tick: fecha os intervalos que terminaram
+  fechar_resumos(&registro_segundos, instante_ms, sensores_anterior, atuadores_anterior);
+  fechar_resumos(&registro_minutos, instante_ms, sensores_anterior, atuadores_anterior);
+
+  acumular(&registro_segundos.acumulador, sensores, atuadores, eventos);
+  acumular(&registro_minutos.acumulador, sensores, atuadores, eventos);
+
+  if (mudou) {
+    mudanca_t *mudanca = &hist_mudancas[cabeca_mudancas % TAM_HIST_MUDANCAS];
+
+    mudanca->instante_ms = instante_ms;
+    mudanca->sensores = sensores;
+    mudanca->atuadores = atuadores;
+    for (int id = 1; id <= MAX_CONTADORES; id++) {
+      mudanca->eventos[id] = saturar(eventos[id]);
+    }
+    cabeca_mudancas++;
+  }
+
+  portEXIT_CRITICAL(&mux_historico);
+
+  sensores_anterior = sensores;
+  atuadores_anterior = atuadores;
+}
+
+
+/*  Converte um resumo na amostra pública.
+ */
+static void copiar_resumo(const resumo_t *resumo, int64_t indice, uint32_t duracao_ms,
+                          amostra_historico_t *amostra) {
+  amostra->instante_ms = indice * duracao_ms;
+  amostra->duracao_ms = duracao_ms;
+  amostra->sensores = resumo->sensores;
+  amostra->sensores_ligados = resumo->sensores_ligados;
+  amostra->atuadores = resumo->atuadores;
+  amostra->atuadores_ligados = resumo->atuadores_ligados;
+  for (int id = 1; id <= MAX_CONTADORES; id++) {
+    amostra->eventos[id] = resumo->eventos[id];
+  }
+}
+
+
+static void copiar_mudanca(const mudanca_t *mudanca, amostra_historico_t *amostra) {
+  amostra->instante_ms = mudanca->instante_ms;
+  amostra->duracao_ms = 0;
+  amostra->sensores = mudanca->sensores;
+  amostra->sensores_ligados = mudanca->sensores;
+  amostra->atuadores = mudanca->atuadores;
+  amostra->atuadores_ligados = mudanca->atuadores;
+  for (int id = 1; id <= MAX_CONTADORES; id++) {
+    amostra->eventos[id] = mudanca->eventos[id];
+  }
+}
+
+
+/*  Lê as mudanças a partir da sequência *cursor (0: a mais antiga).
+ */
+static int ler_mudancas(int64_t desde_ms, int64_t ate_ms, uint32_t *cursor,
+                        amostra_historico_t *amostras, int max) {
+  int n = 0;
+
+  portENTER_CRITICAL(&mux_historico);
+
+  uint32_t mais_antiga = (cabeca_mudancas > TAM_HIST_MUDANCAS) ? cabeca_mudancas - TAM_HIST_MUDANCAS : 0;
+  uint32_t seq = (*cursor < mais_antiga) ? mais_antiga : *cursor;
+
+  while (seq < cabeca_mudancas && n < max) {
+    const mudanca_t *mudanca = &hist_mudancas[seq % TAM_HIST_MUDANCAS];
+
+    if (mudanca->instante_ms > ate_ms) {
+      seq = cabeca_mudancas;
+      break;
+    }
+    if (mudanca->instante_ms >= desde_ms) {
+      copiar_mudanca(mudanca, &amostras[n++]);
+    }
+    seq++;
+  }
+
+  portEXIT_CRITICAL(&mux_historico);
+
+  *cursor = seq;
+  return n;
+}
+
+
+/*  Lê os resumos a partir do intervalo *cursor (0: desde_ms).
+ */
+static int ler_resumos(const registro_resumos_t *registro, int64_t desde_ms, int64_t ate_ms,
+                       uint32_t *cursor, amostra_historico_t *amostras, int max) {
+  int n = 0;
+
+  portENTER_CRITICAL(&mux_historico);
+
+  int64_t indice = desde_ms / registro->duracao_ms;
+
+  if (*cursor > indice) {
+    indice = *cursor;
+  }
+  if (indice < registro->inicio) {
+    indice = registro->inicio;
+  }
+  while (indice < registro->fim && indice * registro->duracao_ms <= ate_ms && n < max) {
+    copiar_resumo(&registro->resumos[indice % registro->tamanho], indice, registro->duracao_ms,
+                  &amostras[n++]);
+    indice++;
+  }
+  if (n == 0) {
+    // Fim da leitura
+    indice = UINT32_MAX;
+  }
+
+  portEXIT_CRITICAL(&mux_historico);
+
+  *cursor = (uint32_t)indice;
+  return n;
+}
+
+
+int historico_ler(enum resolucao_historico resolucao, int64_t desde_ms, int64_t ate_ms,
+                  uint32_t *cursor, amostra_historico_t *amostras, int max) {
+  switch (resolucao) {
+    case HIST_MUDANCAS:
+      return ler_mudancas(desde_ms, ate_ms, cursor, amostras, max);
+    case HIST_SEGUNDOS:
+      return ler_resumos(&registro_segundos, desde_ms, ate_ms, cursor, amostras, max);
+    case HIST_MINUTOS:
+      return ler_resumos(&registro_minutos, desde_ms, ate_ms, cursor, amostras, max);
+  }
+  return 0;
+}
+
+
+size_t historico_memoria(void) {
+  return sizeof(hist_mudancas) + sizeof(hist_segundos) + sizeof(hist_minutos);
+}
+
+
+int64_t historico_mais_antigo_ms(enum resolucao_historico resolucao) {
+  int64_t mais_antigo = -1;
+
+  portENTER_CRITICAL(&mux_historico);
+
+  switch (resolucao) {
+    case HIST_MUDANCAS:
+      if (cabeca_mudancas > 0) {
+        uint32_t seq = (cabeca_mudancas > TAM_HIST_MUDANCAS) ? cabeca_mudancas - TAM_HIST_MUDANCAS : 0;
+
+        mais_antigo = hist_mudancas[seq % TAM_HIST_MUDANCAS].instante_ms;
+      }
+      break;
+    case HIST_SEGUNDOS:
+      if (registro_segundos.inicio >= 0 && registro_segundos.fim > registro_segundos.inicio) {
+        mais_antigo = registro_segundos.inicio * MS_SEGUNDO;
+      }
+      break;
+    case HIST_MINUTOS:
+      if (registro_minutos.inicio >= 0 && registro_minutos.fim > registro_minutos.inicio) {
+        mais_antigo = registro_minutos.inicio * MS_MINUTO;
+      }
+      break;
+  }
+
+  portEXIT_CRITICAL(&mux_historico);
+
+  return mais_antigo;
+}
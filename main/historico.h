@@ -0,0 +1,88 @@
+/** @file historico.h - Histórico dos periféricos em memória RAM.
+*/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "controle_gpio.h"
+
+
+/** Resolução do histórico.
+ */
+enum resolucao_historico {
+  HIST_MUDANCAS,          ///< Cada mudança, com a resolução do tick
+  HIST_SEGUNDOS,          ///< Resumo de cada segundo
+  HIST_MINUTOS            ///< Resumo de cada minuto
+};
+
+
+/** Mapa de bits de sensores ou atuadores no histórico, no menor tipo que
+    comporta o bit do maior id.
+*/
+#if MAX_ATUADORES < 8 && MAX_SENSORES < 8
+typedef uint8_t   mapa_historico_t;
+#elif MAX_ATUADORES < 16 && MAX_SENSORES < 16
+typedef uint16_t  mapa_historico_t;
+#elif MAX_ATUADORES < 32 && MAX_SENSORES < 32
+typedef uint32_t  mapa_historico_t;
+#else
+typedef uint64_t  mapa_historico_t;
+#endif
+
+
+/** Amostra do histórico.
+
+    Nos mapas de bits, o bit id corresponde ao periférico id (bit 1 para
+    o sensor 1, etc.), como em lote_atuadores_t.
+*/
+typedef struct {
+  int64_t           instante_ms;                    ///< Início do intervalo (ms desde a partida)
+  uint32_t          duracao_ms;                     ///< Duração do intervalo (0 nas mudanças)
+  mapa_historico_t  sensores;                       ///< Nível dos sensores no fim do intervalo
+  mapa_historico_t  sensores_ligados;               ///< Sensores ligados em algum momento do intervalo
+  mapa_historico_t  atuadores;                      ///< Estado dos atuadores no fim do intervalo
+  mapa_historico_t  atuadores_ligados;              ///< Atuadores ligados em algum momento do intervalo
+  uint32_t          eventos[MAX_CONTADORES + 1];    ///< Eventos de cada contador no intervalo
+} amostra_historico_t;
+
+
+/** Registrar o estado dos periféricos (chamada a cada tick pela tarefa de controle).
+
+    @param instante_us  Instante do tick (esp_timer_get_time)
+    @param estado       Estado dos periféricos no tick
+*/
+void historico_registrar(int64_t instante_us, const estado_placa_t *estado);
+
+
+/** Ler amostras do histórico, em ordem cronológica.
+
+    Lê no máximo max amostras com instante entre desde_ms e ate_ms. Para
+    continuar a leitura, chame de novo com o mesmo cursor, iniciado com 0.
+    Amostras que saem do histórico durante a leitura são puladas.
+
+    @param resolucao  Resolução desejada
+    @param desde_ms   Instante inicial (ms desde a partida)
+    @param ate_ms     Instante final (ms desde a partida)
+    @param cursor     Posição da leitura, atualizada a cada chamada
+    @param amostras   Vetor a preencher
+    @param max        Tamanho do vetor
+
+    @return Número de amostras lidas; 0 quando não há mais.
+*/
+int historico_ler(enum resolucao_historico resolucao, int64_t desde_ms, int64_t ate_ms,
+                  uint32_t *cursor, amostra_historico_t *amostras, int max);
+
+
+/** Memória ocupada pelo histórico (fixa, definida na compilação).
+
+    @return Tamanho em bytes.
+*/
+size_t historico_memoria(void);
+
+
+/** Instante da amostra mais antiga disponível em uma resolução.
+
+    @return ms desde a partida, ou -1 se não há amostras.
+*/
+int64_t historico_mais_antigo_ms(enum resolucao_historico resolucao);
@@ -0,0 +1,188 @@
+/** @file leitor_parametros.c - Leitura incremental de parâmetros 'nome = valor'.
+
+    O protocolo HTTP do módulo (text/plain) e o arquivo de configuração
+    na memória FLASH usam o mesmo formato: uma linha por parâmetro, na
+    forma 'nome = valor'.
+
+    O leitor é uma máquina de estados que consome o texto byte a byte,
+    à medida que ele chega, sem precisar guardar o conteúdo inteiro nem
+    alocar memória. Não há limite para o tamanho total do texto, apenas
+    para o nome e o valor de cada parâmetro.
+
+    @see app_web_server.c
+    @see app_config.c
+ */
+#include <string.h>
+
+#include "leitor_parametros.h"
+
+
+/*  Estados da máquina de leitura
+ */
+enum estado_leitor {
+  LP_INICIO_LINHA,              // Antes do nome (ignorando espaços)
+  LP_NOME,                      // Lendo o nome
+  LP_APOS_NOME,                 // Espaços entre o nome e o '='
+  LP_ANTES_VALOR,               // Espaços entre o '=' e o valor
+  LP_VALOR,                     // Lendo o valor, até o fim da linha
+  LP_COMENTARIO,                // Linha iniciada por '#'
+  LP_DESCARTAR                  // Linha com erro, ignorada até o fim
+};
+
+
+static inline int eh_espaco(char c) {
+  return (c == ' ' || c == '\t' || c == '\r');
+}
+
+
+/*  Repassa o parâmetro lido e prepara a próxima linha.
+ */
+static void emitir_parametro(leitor_parametros_t *leitor) {
+  leitor->nome[leitor->len_nome] = '\0';
+  leitor->valor[leitor->len_valor_util] = '\0';
+
+  if (leitor->tratar != NULL) {
+    leitor->tratar(leitor->nome, leitor->valor, leitor->contexto);
+  }
+  leitor->estado = LP_INICIO_LINHA;
+}
+
+
+/*  Descarta a linha corrente, contando um erro.
+
+    Se a linha já terminou, volta ao início; senão, ignora até o '\n'.
+ */
+static void descartar_linha(leitor_parametros_t *leitor, char c) {
+  leitor->erros++;
+  if (leitor->descartada != NULL) {
+    leitor->descartada(leitor->linha, leitor->contexto);
+  }
+  leitor->estado = (c == '\n') ? LP_INICIO_LINHA : LP_DESCARTAR;
+}
+
+
+// Documentação das funções públicas no arquivo header.
+
+
+void leitor_parametros_iniciar(leitor_parametros_t *leitor, leitor_parametros_cb_t tratar,
+                               void *contexto) {
+  leitor->len_nome = 0;
+  leitor->len_valor = 0;
+  leitor->len_valor_util = 0;
+  leitor->valor = leitor->valor_padrao;
+  leitor->max_valor = MAX_VALOR_PARAMETRO;
+  leitor->estado = LP_INICIO_LINHA;
+  leitor->linha = 1;
+  leitor->erros = 0;
+  leitor->tratar = tratar;
+  leitor->descartada = NULL;
+  leitor->contexto = contexto;
+}
+
+
+void leitor_parametros_definir_valor(leitor_parametros_t *leitor, char *valor, size_t max_valor) {
+  leitor->valor = valor;
+  leitor->max_valor = max_valor;
+}
+
+
+void leitor_parametros_definir_descarte(leitor_parametros_t *leitor,
+                                        leitor_parametros_descarte_cb_t descartada) {
+  leitor->descartada = descartada;
+}
+
+
+void leitor_parametros_consumir(leitor_parametros_t *leitor, const char *dados, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    char c = dados[i];
+
+    switch (leitor->estado) {
+      case LP_INICIO_LINHA:
+        if (c == '\n' || eh_espaco(c)) {
+          // Linha vazia ou espaços antes do nome
+        } else if (c == '#') {
+          leitor->estado = LP_COMENTARIO;
+        } else if (c == '=') {
+          descartar_linha(leitor, c);
+        } else {
+          leitor->nome[0] = c;
+          leitor->len_nome = 1;
+          leitor->len_valor = 0;
+          leitor->len_valor_util = 0;
+          leitor->estado = LP_NOME;
+        }
+        break;
+
+      case LP_NOME:
+        if (c == '=') {
+          leitor->estado = LP_ANTES_VALOR;
+        } else if (eh_espaco(c)) {
+          leitor->estado = LP_APOS_NOME;
+        } else if (c == '\n' || leitor->len_nome >= MAX_NOME_PARAMETRO) {
+          descartar_linha(leitor, c);
+        } else {
+          leitor->nome[leitor->len_nome++] = c;
+        }
+        break;
+
+      case LP_APOS_NOME:
+        if (c == '=') {
+          leitor->estado = LP_ANTES_VALOR;
+        } else if (!eh_espaco(c)) {
+          // Nome com espaços no meio, ou linha sem '='
+          descartar_linha(leitor, c);
+        }
+        break;
+
+      case LP_ANTES_VALOR:
+      case LP_VALOR:
+        if (c == '\n') {
+          emitir_parametro(leitor);
+        } else if (leitor->estado == LP_ANTES_VALOR && eh_espaco(c)) {
+          // Espaços antes do valor
+        } else if (leitor->len_valor >= leitor->max_valor) {
+          descartar_linha(leitor, c);
+        } else {
+          leitor->valor[leitor->len_valor++] = c;
+          if (!eh_espaco(c)) {
+            leitor->len_valor_util = leitor->len_valor;
+          }
+          leitor->estado = LP_VALOR;
+        }
+        break;
+
+      case LP_COMENTARIO:
+      case LP_DESCARTAR:
+        if (c == '\n') {
+          leitor->estado = LP_INICIO_LINHA;
+        }
+        break;
+    }
+    if (c == '\n') {
+      leitor->linha++;
+    }
+  }
+}
+
+
+int leitor_parametros_terminar(leitor_parametros_t *leitor) {
+  switch (leitor->estado) {
+    case LP_ANTES_VALOR:
+    case LP_VALOR:
+      // Última linha sem '\n'
+      emitir_parametro(leitor);
+      break;
+
+    case LP_NOME:
+    case LP_APOS_NOME:
+      // Última linha sem '='
+      descartar_linha(leitor, '\n');
+      break;
+
+    default:
+      break;
+  }
+  leitor->estado = LP_INICIO_LINHA;
+
+  return leitor->erros;
+}
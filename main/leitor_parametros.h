@@ -0,0 +1,104 @@
+/** @file leitor_parametros.h - Leitura incremental de parâmetros 'nome = valor'.
+*/
+#pragma once
+
+#include <stddef.h>
+
+#define MAX_NOME_PARAMETRO    31    ///< Tamanho máximo do nome de um parâmetro.
+#define MAX_VALOR_PARAMETRO   63    ///< Tamanho máximo do valor de um parâmetro.
+
+
+/** Função chamada para cada parâmetro lido.
+
+    @param nome     Nome do parâmetro, sem espaços
+    @param valor    Valor do parâmetro, sem espaços no início e no fim (pode ser vazio)
+    @param contexto Ponteiro indicado em leitor_parametros_iniciar()
+*/
+typedef void (*leitor_parametros_cb_t)(const char *nome, const char *valor, void *contexto);
+
+
+/** Função chamada para cada linha descartada (ver leitor_parametros_definir_descarte()).
+
+    @param linha    Número da linha no texto (de 1 em diante)
+    @param contexto Ponteiro indicado em leitor_parametros_iniciar()
+*/
+typedef void (*leitor_parametros_descarte_cb_t)(int linha, void *contexto);
+
+
+/** Estado de um leitor de parâmetros.
+
+    Não utiliza memória dinâmica: nome e valor da linha corrente ficam na
+    própria estrutura, que pode ser declarada na pilha, ou, para valores
+    mais longos, em uma área indicada em leitor_parametros_definir_valor().
+*/
+typedef struct {
+  char    nome[MAX_NOME_PARAMETRO + 1];     ///< Nome da linha corrente
+  char    valor_padrao[MAX_VALOR_PARAMETRO + 1];  ///< Área do valor, se outra não foi indicada
+  char    *valor;                           ///< Valor da linha corrente
+  size_t  max_valor;                        ///< Tamanho máximo do valor
+  size_t  len_nome;                         ///< Caracteres em nome
+  size_t  len_valor;                        ///< Caracteres em valor
+  size_t  len_valor_util;                   ///< Caracteres em valor, sem espaços no fim
+  int     estado;                           ///< Estado interno do leitor
+  int     linha;                            ///< Linha corrente (de 1 em diante)
+  int     erros;                            ///< Linhas descartadas
+  leitor_parametros_cb_t tratar;            ///< Função chamada para cada parâmetro
+  leitor_parametros_descarte_cb_t descartada; ///< Função chamada para cada linha descartada
+  void    *contexto;                        ///< Repassado às funções tratar e descartada
+} leitor_parametros_t;
+
+
+/** Preparar um leitor para um novo texto.
+
+    @param leitor   Estado do leitor
+    @param tratar   Função chamada para cada parâmetro lido
+    @param contexto Ponteiro repassado a tratar
+*/
+void leitor_parametros_iniciar(leitor_parametros_t *leitor, leitor_parametros_cb_t tratar,
+                               void *contexto);
+
+
+/** Aceitar valores mais longos que MAX_VALOR_PARAMETRO.
+
+    Chamada depois de leitor_parametros_iniciar(), antes do texto.
+
+    @param leitor     Estado do leitor
+    @param valor      Área para o valor da linha corrente (max_valor + 1 bytes)
+    @param max_valor  Tamanho máximo do valor
+*/
+void leitor_parametros_definir_valor(leitor_parametros_t *leitor, char *valor, size_t max_valor);
+
+
+/** Ser avisado de cada linha descartada, com o seu número.
+
+    Chamada depois de leitor_parametros_iniciar(), antes do texto. Durante
+    a função tratar, o campo linha do leitor também indica a linha lida.
+
+    @param leitor     Estado do leitor
+    @param descartada Função chamada para cada linha descartada
+*/
+void leitor_parametros_definir_descarte(leitor_parametros_t *leitor,
+                                        leitor_parametros_descarte_cb_t descartada);
+
+
+/** Consumir um trecho do texto.
+
+    O texto pode ser entregue em pedaços de qualquer tamanho, à medida que
+    é recebido. Cada linha completa da forma 'nome = valor' é repassada
+    à função tratar. Linhas vazias e iniciadas por '#' são ignoradas.
+
+    Linhas sem '=', ou com nome ou valor mais longos que o limite, são
+    descartadas inteiras (nunca truncadas) e contadas como erro.
+
+    @param leitor Estado do leitor
+    @param dados  Trecho do texto (não precisa terminar em '\\0')
+    @param len    Número de bytes no trecho
+*/
+void leitor_parametros_consumir(leitor_parametros_t *leitor, const char *dados, size_t len);
+
+
+/** Terminar a leitura, tratando a última linha, caso não termine em '\\n'.
+
+    @return Número de linhas descartadas por erro.
+*/
+int leitor_parametros_terminar(leitor_parametros_t *leitor);
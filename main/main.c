@@ -10,11 +10,15 @@
     
     @see app_web_server.c Protocolo HTTP para controlar os periféricos.
     @see controle_gpio.c Interface com o micro-controlador.
+    @see sensor_adc.c Sensores analógicos.
+    @see persistencia.c Estado preservado entre partidas.
+    @see regras.c Regras de automação.
           
     https://docs.espressif.com/projects/esp-idf/en/latest/esp32/api-reference/protocols/mdns.html
     https://docs.espressif.com/projects/esp-protocols/mdns/docs/latest/en/index.html
 
-    @todo Telas HTML embutidas na memória flash, para testar e configurar.
+    @todo Telas HTML embutidas na memória flash para configurar (o console
+          de controle, pasta client, já é servido em GET /).
     @todo Melhorar documentação de instalação, e desenvolvimento do servidor e cliente.
  */
  
@@ -50,6 +54,7 @@
 #include <esp_log.h>
 
 #include <esp_system.h>
+#if !CONFIG_CONTROLE_GPIO_SIMULACAO
 #include <esp_wifi.h>
 #include <esp_event.h>
 #include <nvs_flash.h>
@@ -59,16 +64,27 @@
 
 #include "wifi_station.h"
 #include "wifi_softap.h"
+#endif
 
 #include "controle_gpio.h"
+#include "sensor_adc.h"
+#include "persistencia.h"
+#include "regras.h"
 #include "app_config.h"
+#if CONFIG_CONTROLE_GPIO_SIMULACAO
+#include "simulacao_gpio.h"
+#else
 #include "app_web_server.h"
+#endif
 
 
 static const char *TAG = "main.c";
 
 
+// Na simulação em tempo virtual (target linux) não há rede
+#if !CONFIG_CONTROLE_GPIO_SIMULACAO
 #define USAR_MDNS 1
+#endif
 
 #if defined USAR_MDNS
 
@@ -119,6 +135,61 @@ static void iniciar_mdns(const char *hostname)
 #endif
 
 
+#if CONFIG_CONTROLE_GPIO_SIMULACAO
+
+#define PASSO_SIMULACAO_US    (100 * 1000)    // Avanço do tempo virtual por chamada
+
+/*  Carrega o roteiro das entradas e executa a tarefa de controle em tempo
+    virtual até CONFIG_CONTROLE_GPIO_SIMULACAO_DURACAO_MS. As transições
+    das saídas são escritas na saída padrão ('transicao = us,gpio,nível'),
+    seguidas de um resumo das estatísticas.
+ */
+static void executar_simulacao(const char *roteiro)
+{
+  if (roteiro[0] != '\0') {
+    FILE *arquivo = fopen(roteiro, "r");
+
+    if (arquivo == NULL) {
+      ESP_LOGE(TAG, "Roteiro %s não encontrado, entradas em 1", roteiro);
+    } else {
+      int invalidas = simulacao_gpio_carregar(arquivo);
+
+      fclose(arquivo);
+      if (invalidas > 0) {
+        ESP_LOGW(TAG, "Roteiro %s: %d linhas inválidas ignoradas", roteiro, invalidas);
+      } else {
+        ESP_LOGI(TAG, "Roteiro %s carregado", roteiro);
+      }
+    }
+  }
+
+  int64_t fim_us = simulacao_gpio_agora_us() + (int64_t)CONFIG_CONTROLE_GPIO_SIMULACAO_DURACAO_MS * 1000;
+
+  simulacao_gpio_gravar_transicoes(stdout);
+  for (int64_t t = simulacao_gpio_agora_us(); t < fim_us; ) {
+    t = (fim_us - t > PASSO_SIMULACAO_US) ? t + PASSO_SIMULACAO_US : fim_us;
+    controle_gpio_simular_ate(t);
+  }
+  simulacao_gpio_gravar_transicoes(NULL);
+  fflush(stdout);
+
+  estatisticas_simulacao_t est;
+
+  simulacao_gpio_estatisticas(&est);
+  ESP_LOGI(TAG, "Simulação até %lld ms: %u ticks, %u degraus, %u pulsos de entrada, %u transições",
+           (long long)(est.agora_us / 1000), (unsigned)est.leituras, (unsigned)est.degraus,
+           (unsigned)est.pulsos_entrada, (unsigned)est.transicoes);
+  for (int id = 1; id <= MAX_CONTADORES; id++) {
+    ESP_LOGI(TAG, "Contador %d: %d", id, controle_gpio_ler_contador(id));
+  }
+  if (est.larguras > 0) {
+    ESP_LOGI(TAG, "Larguras em nível 1: %u, de %lld a %lld us, média %lld us",
+             (unsigned)est.larguras, (long long)est.largura_min_us, (long long)est.largura_max_us,
+             (long long)(est.soma_largura_us / est.larguras));
+  }
+}
+
+#else
 /*  Para o servidor HTTP quando a conexão Wifi é perdida.
  */
 static void disconnect_handler(void* arg, esp_event_base_t event_base,
@@ -147,6 +218,7 @@ static void connect_handler(void* arg, esp_event_base_t event_base,
         *server = start_webserver();
     }
 }
+#endif
 
 /** Função principal do aplicativo.
 
@@ -155,15 +227,44 @@ static void connect_handler(void* arg, esp_event_base_t event_base,
       Ler a configuração de memória permantente;
       Iniciar a comunicação via Wifi no modo configurado;
       Iniciar o servidor HTTP.
+
+    Na simulação (target linux), sem rede, executa o roteiro das entradas
+    em tempo virtual.
  */
 void app_main(void)
 {
+#if !CONFIG_CONTROLE_GPIO_SIMULACAO
   // Declarado como static para continuar existindo quando app_main() terminar.
   static httpd_handle_t server = NULL;
-  
+#endif
+
+  // Contagens e atuadores voltam ao estado anterior à partida
+  estado_placa_t estado_salvo;
+  persistencia_restaurar(&estado_salvo);
+  controle_gpio_restaurar(&estado_salvo);
+
   // Prepara portas para operação
   controle_gpio_iniciar();
 
+  // Regras de automação gravadas, avaliadas pela tarefa de controle
+  regras_iniciar();
+
+  // Tarefa de controle executa os comandos, a duração dos pulsos e detecta mudanças nas entradas
+  if (!controle_gpio_ativar_timer()) {
+    ESP_LOGE(TAG, "Falha ao ativar tarefa de controle dos periféricos");
+  }
+
+  // Mudanças são gravadas em lote, em segundo plano
+  if (!persistencia_iniciar()) {
+    ESP_LOGE(TAG, "Falha ao criar tarefa de persistência");
+  }
+
+  // Sensores analógicos: conversão contínua e filtro em tarefa própria
+  if (!sensor_adc_iniciar()) {
+    ESP_LOGW(TAG, "Sensores analógicos indisponíveis");
+  }
+
+#if !CONFIG_CONTROLE_GPIO_SIMULACAO
   //Initialize NVS
   esp_err_t ret = nvs_flash_init();
   if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -171,10 +272,22 @@ void app_main(void)
     ret = nvs_flash_init();
   }
   ESP_ERROR_CHECK(ret);
+#endif
 
   // Ler configuração gravada na memória permanente (FLASH)
   app_config_ler();
 
+  // Alterações feitas pelo servidor são gravadas em segundo plano
+  if (!app_config_iniciar_tarefa_gravacao()) {
+    ESP_LOGE(TAG, "Falha ao criar tarefa de gravação da configuração");
+  }
+
+#if CONFIG_CONTROLE_GPIO_SIMULACAO
+  // Sem rede: as entradas seguem o roteiro e o tempo virtual avança sem esperar
+  ESP_LOGI(TAG, "Simulação em tempo virtual, sem Wifi nem servidor HTTP");
+  executar_simulacao(CONFIG_CONTROLE_GPIO_SIMULACAO_ROTEIRO);
+#else
+
   ESP_ERROR_CHECK(esp_netif_init());
 
   ESP_ERROR_CHECK(esp_event_loop_create_default());
@@ -207,5 +320,6 @@ void app_main(void)
   if (server == NULL) {
     ESP_LOGE(TAG, "Falha ao ativar servidor");
   }
+#endif
 }
 
@@ -0,0 +1,385 @@
+/** @file persistencia.c - Contagens e atuadores preservados entre partidas.
+
+    Uma queda de energia não deve zerar os contadores nem desligar o que
+    estava ligado. O estado é guardado em dois lugares:
+
+      - Memória RTC: uma cópia atualizada a cada mudança, pela própria
+        tarefa de controle. Sobrevive a reinícios a quente (watchdog,
+        pânico, esp_restart), mas não à falta de energia;
+      - Diário na FLASH: registros curtos de mudança, gravados em lote
+        pela tarefa de persistência a cada INTERVALO_GRAVACAO_MS. Numa
+        queda de energia, perde-se no máximo esse intervalo.
+
+    O diário só cresce: cada registro leva um CRC, e a leitura para no
+    primeiro registro inválido, de modo que uma gravação interrompida
+    perde apenas o seu próprio lote. Quando passa de TAM_MAX_DIARIO, ou
+    se a partida encontra um final corrompido, o diário é reescrito como
+    um retrato do estado (em outro arquivo, renomeado por cima, o que o
+    littlefs faz de forma atômica).
+
+    Os contadores são gravados como diferenças; um valor absoluto só é
+    gravado quando a contagem diminui (contador zerado) e nas compactações.
+
+    @author João Vianna (jvianna@gmail.com)
+    @version 0.83
+
+    @see controle_gpio.c
+    @see app_config.c
+*/
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+
+#include "app_config.h"
+#include "persistencia.h"
+
+#define TAG "persistencia"
+
+#define ARQUIVO_DIARIO        DIRETORIO_ARMAZENAMENTO "/estado.jnl"
+#define ARQUIVO_TEMPORARIO    DIRETORIO_ARMAZENAMENTO "/estado.tmp"
+
+#define INTERVALO_GRAVACAO_MS (10000)
+#define TAM_MAX_DIARIO        (4096)
+
+#define PILHA_TAREFA_PERSISTENCIA       (3072)
+#define PRIORIDADE_TAREFA_PERSISTENCIA  (tskIDLE_PRIORITY + 1)
+
+#define MAGICO_RTC            (0x45535431)      // "EST1"
+
+
+// Tipos de registro no diário
+enum tipo_registro {
+  REG_CONTADOR_SOMA = 1,          // Soma valor à contagem
+  REG_CONTADOR_VALOR,             // Contagem absoluta
+  REG_ATUADOR                     // Valor do atuador
+};
+
+// Registro do diário (8 bytes); o CRC cobre o registro com crc = 0
+typedef struct __attribute__((packed)) {
+  uint8_t   tipo;
+  uint8_t   id;
+  uint16_t  crc;
+  int32_t   valor;
+} registro_diario_t;
+
+// Cópia na memória RTC, não inicializada na partida
+typedef struct {
+  uint32_t  magico;
+  int32_t   contadores[MAX_CONTADORES + 1];
+  int32_t   atuadores[MAX_ATUADORES + 1];
+  uint32_t  crc;
+} copia_rtc_t;
+
+static RTC_NOINIT_ATTR copia_rtc_t copia_rtc;
+
+// Último estado registrado pela tarefa de controle
+static estado_placa_t estado_atual;
+
+// Estado já gravado no diário (só a tarefa de persistência usa)
+static estado_placa_t estado_gravado;
+
+static bool compactar_na_partida = true;
+
+static estatisticas_persistencia_t estatisticas;
+
+static TaskHandle_t tarefa_persistencia = NULL;
+
+static portMUX_TYPE mux_persistencia = portMUX_INITIALIZER_UNLOCKED;
+
+
+static uint32_t crc_copia_rtc(const copia_rtc_t *copia) {
+  return esp_rom_crc32_le(0, (const uint8_t *)copia, offsetof(copia_rtc_t, crc));
+}
+
+
+static void atualizar_copia_rtc(const estado_placa_t *estado) {
+  copia_rtc.magico = MAGICO_RTC;
+  for (int id = 1; id <= MAX_CONTADORES; id++) {
+    copia_rtc.contadores[id] = estado->contadores[id];
+  }
+  for (int id = 1; id <= MAX_ATUADORES; id++) {
+    copia_rtc.atuadores[id] = estado->atuadores[id];
+  }
+  copia_rtc.crc = crc_copia_rtc(&copia_rtc);
+}
+
+
+static uint16_t crc_registro(registro_diario_t registro) {
+  registro.crc = 0;
+  return esp_rom_crc16_le(0, (const uint8_t *)&registro, sizeof(registro));
+}
+
+
+static registro_diario_t criar_registro(enum tipo_registro tipo, int id, int32_t valor) {
+  registro_diario_t registro = { .tipo = tipo, .id = id, .crc = 0, .valor = valor };
+  registro.crc = crc_registro(registro);
+  return registro;
+}
+
+
+static bool registro_valido(const registro_diario_t *registro) {
+  if (registro->crc != crc_registro(*registro)) {
+    return false;
+  }
+  switch (registro->tipo) {
+    case REG_CONTADOR_SOMA:
+    case REG_CONTADOR_VALOR:
+      return (registro->id >= 1 && registro->id <= MAX_CONTADORES);
+    case REG_ATUADOR:
+      return (registro->id >= 1 && registro->id <= MAX_ATUADORES);
+    default:
+      return false;
+  }
+}
+
+
+/*  Aplica um registro do diário ao estado.
+ */
+static void aplicar_registro(estado_placa_t *estado, const registro_diario_t *registro) {
+  switch (registro->tipo) {
+    case REG_CONTADOR_SOMA:
+      estado->contadores[registro->id] += registro->valor;
+      break;
+    case REG_CONTADOR_VALOR:
+      estado->contadores[registro->id] = registro->valor;
+      break;
+    case REG_ATUADOR:
+      estado->atuadores[registro->id] = registro->valor;
+      break;
+  }
+}
+
+
+/*  Relê o diário, aplicando os registros válidos.
+
+    Retorna false se o diário não existe. Registros após o primeiro
+    inválido (gravação interrompida) são descartados.
+ */
+static bool ler_diario(estado_placa_t *estado) {
+  FILE *f = fopen(ARQUIVO_DIARIO, "rb");
+  if (f == NULL) {
+    return false;
+  }
+
+  registro_diario_t registro;
+  size_t lidos;
+  uint32_t tamanho_valido = 0;
+
+  while ((lidos = fread(&registro, 1, sizeof(registro), f)) == sizeof(registro)) {
+    if (!registro_valido(&registro)) {
+      estatisticas.registros_invalidos++;
+      break;
+    }
+    aplicar_registro(estado, &registro);
+    tamanho_valido += sizeof(registro);
+  }
+  if (lidos > 0 && lidos < sizeof(registro)) {
+    // Último registro incompleto
+    estatisticas.registros_invalidos++;
+  }
+  fclose(f);
+
+  estatisticas.tamanho_diario = tamanho_valido;
+  if (estatisticas.registros_invalidos > 0) {
+    ESP_LOGW(TAG, "Diário truncado em %u bytes", (unsigned)tamanho_valido);
+  }
+  return true;
+}
+
+
+/*  Grava registros no final de um arquivo, garantindo que cheguem à FLASH.
+ */
+static bool gravar_registros(const char *arquivo, const char *modo,
+                             const registro_diario_t *registros, int quantidade) {
+  FILE *f = fopen(arquivo, modo);
+  if (f == NULL) {
+    ESP_LOGE(TAG, "Falha ao abrir %s", arquivo);
+    return false;
+  }
+  size_t tamanho = quantidade * sizeof(registro_diario_t);
+  bool ok = (fwrite(registros, 1, tamanho, f) == tamanho);
+  ok = (fflush(f) == 0) && ok;
+  ok = (fsync(fileno(f)) == 0) && ok;
+  fclose(f);
+
+  if (ok) {
+    estatisticas.bytes_gravados += tamanho;
+  }
+  return ok;
+}
+
+
+/*  Reescreve o diário como um retrato do estado gravado.
+ */
+static bool compactar_diario(void) {
+  registro_diario_t retrato[MAX_CONTADORES + MAX_ATUADORES];
+  int n = 0;
+
+  for (int id = 1; id <= MAX_CONTADORES; id++) {
+    retrato[n++] = criar_registro(REG_CONTADOR_VALOR, id, estado_gravado.contadores[id]);
+  }
+  for (int id = 1; id <= MAX_ATUADORES; id++) {
+    retrato[n++] = criar_registro(REG_ATUADOR, id, estado_gravado.atuadores[id]);
+  }
+
+  if (!gravar_registros(ARQUIVO_TEMPORARIO, "wb", retrato, n)) {
+    return false;
+  }
+  if (rename(ARQUIVO_TEMPORARIO, ARQUIVO_DIARIO) != 0) {
+    ESP_LOGE(TAG, "Falha ao substituir o diário");
+    unlink(ARQUIVO_TEMPORARIO);
+    return false;
+  }
+  estatisticas.compactacoes++;
+  estatisticas.tamanho_diario = n * sizeof(registro_diario_t);
+  return true;
+}
+
+
+/*  Grava no diário as diferenças entre o estado corrente e o gravado.
+ */
+static void gravar_mudancas(void) {
+  estado_placa_t estado;
+  registro_diario_t lote[MAX_CONTADORES + MAX_ATUADORES];
+  int n = 0;
+
+  if (compactar_na_partida) {
+    // Diário ausente ou com final corrompido: não acrescenta depois dele
+    compactar_na_partida = !compactar_diario();
+  }
+
+  portENTER_CRITICAL(&mux_persistencia);
+  estado = estado_atual;
+  portEXIT_CRITICAL(&mux_persistencia);
+
+  for (int id = 1; id <= MAX_CONTADORES; id++) {
+    int anterior = estado_gravado.contadores[id];
+    int contagem = estado.contadores[id];
+    if (contagem > anterior) {
+      lote[n++] = criar_registro(REG_CONTADOR_SOMA, id, contagem - anterior);
+    } else if (contagem < anterior) {
+      lote[n++] = criar_registro(REG_CONTADOR_VALOR, id, contagem);
+    }
+  }
+  for (int id = 1; id <= MAX_ATUADORES; id++) {
+    if (estado.atuadores[id] != estado_gravado.atuadores[id]) {
+      lote[n++] = criar_registro(REG_ATUADOR, id, estado.atuadores[id]);
+    }
+  }
+  if (n == 0) {
+    return;
+  }
+
+  if (!gravar_registros(ARQUIVO_DIARIO, "ab", lote, n)) {
+    // Tenta de novo no próximo intervalo
+    return;
+  }
+  estado_gravado = estado;
+  estatisticas.gravacoes++;
+  estatisticas.bytes_registros += n * sizeof(registro_diario_t);
+  estatisticas.tamanho_diario += n * sizeof(registro_diario_t);
+
+  if (estatisticas.tamanho_diario > TAM_MAX_DIARIO) {
+    compactar_diario();
+  }
+}
+
+
+/*  Grava as mudanças logo na partida e depois a cada
+    INTERVALO_GRAVACAO_MS, ou antes, quando notificada por
+    persistencia_gravar().
+ */
+static void executar_tarefa_persistencia(void *parametros) {
+  while (true) {
+    gravar_mudancas();
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(INTERVALO_GRAVACAO_MS));
+  }
+}
+
+
+// Ver a descrição das funções públicas em persistencia.h
+
+
+bool persistencia_restaurar(estado_placa_t *estado) {
+  int64_t inicio = esp_timer_get_time();
+  bool restaurado = false;
+
+  memset(estado, 0, sizeof(*estado));
+  memset(&estado_gravado, 0, sizeof(estado_gravado));
+
+  bool montado = app_config_montar_armazenamento();
+  if (montado && ler_diario(&estado_gravado)) {
+    *estado = estado_gravado;
+    restaurado = true;
+    // Sem registros descartados, o diário pode continuar a crescer
+    compactar_na_partida = (estatisticas.registros_invalidos > 0);
+  }
+
+  if (copia_rtc.magico == MAGICO_RTC && copia_rtc.crc == crc_copia_rtc(&copia_rtc)) {
+    // Reinício a quente: a memória RTC tem o estado mais recente
+    for (int id = 1; id <= MAX_CONTADORES; id++) {
+      estado->contadores[id] = copia_rtc.contadores[id];
+    }
+    for (int id = 1; id <= MAX_ATUADORES; id++) {
+      estado->atuadores[id] = copia_rtc.atuadores[id];
+    }
+    estatisticas.restaurado_rtc = true;
+    restaurado = true;
+  }
+
+  estado_atual = *estado;
+  atualizar_copia_rtc(estado);
+  estatisticas.restauracao_us = esp_timer_get_time() - inicio;
+  ESP_LOGI(TAG, "Estado restaurado %s em %lld us",
+           estatisticas.restaurado_rtc ? "da memória RTC" : (restaurado ? "do diário" : "com os valores padrão"),
+           (long long)estatisticas.restauracao_us);
+  return restaurado;
+}
+
+
+bool persistencia_iniciar(void) {
+  if (tarefa_persistencia != NULL) {
+    return true;
+  }
+  return (xTaskCreate(executar_tarefa_persistencia, "persist", PILHA_TAREFA_PERSISTENCIA, NULL,
+                      PRIORIDADE_TAREFA_PERSISTENCIA, &tarefa_persistencia) == pdPASS);
+}
+
+
+void persistencia_registrar(const estado_placa_t *estado) {
+  if (memcmp(estado->contadores, estado_atual.contadores, sizeof(estado->contadores)) == 0 &&
+      memcmp(estado->atuadores, estado_atual.atuadores, sizeof(estado->atuadores)) == 0) {
+    return;
+  }
+
+  portENTER_CRITICAL(&mux_persistencia);
+  estado_atual = *estado;
+  portEXIT_CRITICAL(&mux_persistencia);
+
+  atualizar_copia_rtc(estado);
+}
+
+
+void persistencia_gravar(void) {
+  if (tarefa_persistencia != NULL) {
+    xTaskNotifyGive(tarefa_persistencia);
+    return;
+  }
+  gravar_mudancas();
+}
+
+
+void persistencia_estatisticas(estatisticas_persistencia_t *saida) {
+  portENTER_CRITICAL(&mux_persistencia);
+  *saida = estatisticas;
+  portEXIT_CRITICAL(&mux_persistencia);
+}
@@ -0,0 +1,74 @@
+/** @file persistencia.h - Contagens e atuadores preservados entre partidas.
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "controle_gpio.h"
+
+
+/** Estatísticas da persistência.
+
+    A amplificação de escrita é bytes_gravados / bytes_registros: quanto
+    foi gravado na FLASH (incluindo compactações) para cada byte de
+    mudança registrada.
+*/
+typedef struct {
+  uint32_t  gravacoes;            ///< Lotes de registros gravados no diário
+  uint32_t  bytes_registros;      ///< Bytes de registros de mudança
+  uint32_t  bytes_gravados;       ///< Bytes gravados, incluindo compactações
+  uint32_t  compactacoes;         ///< Vezes que o diário foi reescrito
+  uint32_t  tamanho_diario;       ///< Tamanho atual do diário, em bytes
+  uint32_t  registros_invalidos;  ///< Registros descartados na restauração
+  int64_t   restauracao_us;       ///< Duração da restauração na partida
+  bool      restaurado_rtc;       ///< Estado veio da memória RTC (reinício a quente)
+} estatisticas_persistencia_t;
+
+
+/** Restaurar o estado salvo antes da última partida.
+
+    Usa a cópia na memória RTC, se válida (reinício a quente); senão,
+    relê o diário na FLASH. Monta o sistema de arquivos, que fica montado
+    para a tarefa de gravação.
+
+    Deve ser chamada antes de persistencia_iniciar().
+
+    @param estado Estrutura a ser preenchida (zerada se não há estado salvo)
+
+    @return false se não havia estado salvo válido.
+*/
+bool persistencia_restaurar(estado_placa_t *estado);
+
+
+/** Iniciar a tarefa que grava as mudanças no diário.
+
+    @return false se a tarefa não pôde ser criada.
+*/
+bool persistencia_iniciar(void);
+
+
+/** Registrar o estado corrente (chamada a cada tick pela tarefa de controle).
+
+    Atualiza a cópia na memória RTC quando algo muda; a gravação na FLASH
+    é feita depois, em lote, pela tarefa de persistência.
+
+    @param estado Estado dos periféricos no tick
+*/
+void persistencia_registrar(const estado_placa_t *estado);
+
+
+/** Gravar no diário, sem esperar o intervalo, as mudanças já registradas.
+
+    Com a tarefa de persistência ativa, apenas a acorda; antes de
+    persistencia_iniciar(), grava na própria chamada. Útil antes de um
+    reinício programado.
+*/
+void persistencia_gravar(void);
+
+
+/** Ler as estatísticas da persistência.
+
+    @param estatisticas Estrutura a ser preenchida
+*/
+void persistencia_estatisticas(estatisticas_persistencia_t *estatisticas);
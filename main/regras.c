@@ -0,0 +1,604 @@
+/** @file regras.c - Regras de automação avaliadas no próprio módulo.
+
+    Automações simples, como "campainha pressionada -> pulsar o refletor",
+    não dependem do console aberto: as regras são avaliadas pela tarefa de
+    controle, logo após o tick que detectou a mudança, e as ações são
+    executadas ali mesmo, sem passar pela fila de comandos.
+
+    Cada regra é uma linha 'regra = condição -> ação'. A condição é uma
+    sequência de termos ligados por 'e' e 'ou' ('e' tem precedência):
+
+      sensor(id) sobe | desce         Borda do sensor (após o debouncing)
+      sensor(id) ligado | desligado   Nível do sensor
+      atuador(id) ligado | desligado  Valor do atuador
+      contador(id) conta              Contador incrementado
+      contador(id) >= (n)             Contagem a partir de n
+      tempo(id) expira                Temporizador da regra venceu
+      tempo(id) ativo | inativo       Temporizador em contagem
+
+    A ação é uma só:
+
+      ligar | desligar | alternar atuador(id)
+      pulsar atuador(id) (ms)
+      zerar contador(id)
+      iniciar tempo(id) (ms)
+      parar tempo(id)
+
+    Exemplos:
+
+      regra = sensor1 desce -> pulsar atuador2 1000
+      regra = contador1 conta e atuador4 desligado -> pulsar atuador3 1000
+      regra = sensor2 ligado -> iniciar tempo1 60000
+      regra = tempo1 expira ou sensor2 desligado -> desligar atuador1
+
+    Regras cuja condição tem eventos (bordas, contagens, vencimentos)
+    disparam a cada evento; as demais, quando a condição passa de falsa
+    para verdadeira.
+
+    Na compilação, cada regra vira uma lista de cláusulas (os trechos
+    entre 'ou'), e cada cláusula vira máscaras de bits, uma por classe de
+    periférico: a avaliação é uma comparação de máscaras por cláusula,
+    sem texto nem desvios por termo.
+
+    As regras novas são compiladas em uma segunda tabela, que a tarefa de
+    controle passa a usar na avaliação seguinte. O texto é gravado em
+    littlefs e recarregado na partida.
+
+    @author João Vianna (jvianna@gmail.com)
+    @version 0.83
+
+    @see controle_gpio.c
+    @see app_web_server.c POST /regras
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+
+#include "app_config.h"
+#include "leitor_parametros.h"
+#include "regras.h"
+
+#define TAG "regras"
+
+#define ARQUIVO_REGRAS        DIRETORIO_ARMAZENAMENTO "/regras.txt"
+#define ARQUIVO_TEMPORARIO    DIRETORIO_ARMAZENAMENTO "/regras.tmp"
+
+#define MAX_CLAUSULAS         4       // Trechos separados por 'ou'
+#define TEMPO_MAX_CARGA_MS    (500)
+
+#define ESPACOS               " \t"
+
+// Sensores e atuadores já cabem em mapa_perifericos_t (controle_gpio.h)
+_Static_assert(MAX_CONTADORES <= 8 * sizeof(mapa_perifericos_t) &&
+               MAX_TEMPORIZADORES <= 8 * sizeof(mapa_perifericos_t),
+               "Cada classe ocupa um mapa de bits nas entradas das regras");
+
+
+// Cláusula: verdadeira se todos os termos forem verdadeiros
+typedef struct {
+  mapa_perifericos_t  mascara[NUM_NIVEIS_REGRA];    // Níveis testados
+  mapa_perifericos_t  niveis[NUM_NIVEIS_REGRA];     // Valor esperado dos níveis testados
+  mapa_perifericos_t  eventos[NUM_EVENTOS_REGRA];   // Eventos exigidos (todos)
+  bool                com_eventos;                  // Algum evento exigido
+  uint8_t             contador;                     // Contador comparado (0: nenhum)
+  int32_t             limite;                       // Contagem mínima
+} clausula_t;
+
+typedef struct {
+  clausula_t    clausulas[MAX_CLAUSULAS];
+  uint8_t       num_clausulas;
+  bool          verdadeira;       // Resultado da avaliação anterior
+  acao_regra_t  acao;
+} regra_t;
+
+typedef struct {
+  regra_t   regras[MAX_REGRAS + 1];   // De 1 em diante
+  int       num_regras;
+} tabela_regras_t;
+
+// Tabela em uso pela tarefa de controle e tabela da carga
+static tabela_regras_t tabelas[2];
+static int             atual = 0;
+static atomic_bool     pendente = false;
+
+static SemaphoreHandle_t semaforo_carga = NULL;
+
+// Estado da avaliação (só a tarefa de controle usa)
+static int64_t  fim_tempo[MAX_TEMPORIZADORES + 1];
+static mapa_perifericos_t niveis_anteriores[NUM_NIVEIS_REGRA];
+static int      contagens_anteriores[MAX_CONTADORES + 1];
+
+static estatisticas_regras_t estatisticas;
+
+static portMUX_TYPE mux_regras = portMUX_INITIALIZER_UNLOCKED;
+
+
+/*  Compilação ---------------------------------------------------------------
+ */
+
+/*  Lê o identificador de um periférico, na forma (prefixo)(id).
+ */
+static bool ler_id(const char *token, const char *prefixo, int max, uint8_t *id) {
+  size_t len = strlen(prefixo);
+
+  if (strncmp(token, prefixo, len) != 0 || token[len] == '\0') {
+    return false;
+  }
+  char *fim;
+  long valor = strtol(token + len, &fim, 10);
+
+  if (*fim != '\0' || valor < 1 || valor > max) {
+    return false;
+  }
+  *id = (uint8_t)valor;
+  return true;
+}
+
+
+/*  Lê um número positivo.
+ */
+static bool ler_numero(const char *token, int32_t *numero) {
+  if (token == NULL) {
+    return false;
+  }
+  char *fim;
+  long valor = strtol(token, &fim, 10);
+
+  if (*fim != '\0' || fim == token || valor < 1 || valor > INT32_MAX) {
+    return false;
+  }
+  *numero = (int32_t)valor;
+  return true;
+}
+
+
+/*  Acrescenta um teste de nível à cláusula.
+ */
+static void exigir_nivel(clausula_t *clausula, enum nivel_regra classe, int id, bool ligado) {
+  clausula->mascara[classe] |= REGRA_BIT(id);
+  if (ligado) {
+    clausula->niveis[classe] |= REGRA_BIT(id);
+  } else {
+    clausula->niveis[classe] &= ~REGRA_BIT(id);
+  }
+}
+
+
+/*  Acrescenta um evento exigido à cláusula.
+ */
+static void exigir_evento(clausula_t *clausula, enum evento_regra tipo, int id) {
+  clausula->eventos[tipo] |= REGRA_BIT(id);
+  clausula->com_eventos = true;
+}
+
+
+/*  Compila um termo da condição; o predicado vem nos próximos tokens.
+ */
+static bool compilar_termo(const char *token, char **resto, clausula_t *clausula) {
+  const char *predicado = strtok_r(NULL, ESPACOS, resto);
+  uint8_t id;
+
+  if (predicado == NULL) {
+    return false;
+  }
+
+  if (ler_id(token, "sensor", MAX_SENSORES, &id)) {
+    if (strcmp(predicado, "sobe") == 0) {
+      exigir_evento(clausula, REGRA_SUBIDAS, id);
+    } else if (strcmp(predicado, "desce") == 0) {
+      exigir_evento(clausula, REGRA_DESCIDAS, id);
+    } else if (strcmp(predicado, "ligado") == 0 || strcmp(predicado, "desligado") == 0) {
+      exigir_nivel(clausula, REGRA_SENSORES, id, predicado[0] == 'l');
+    } else {
+      return false;
+    }
+  } else if (ler_id(token, "atuador", MAX_ATUADORES, &id)) {
+    if (strcmp(predicado, "ligado") == 0 || strcmp(predicado, "desligado") == 0) {
+      exigir_nivel(clausula, REGRA_ATUADORES, id, predicado[0] == 'l');
+    } else {
+      return false;
+    }
+  } else if (ler_id(token, "contador", MAX_CONTADORES, &id)) {
+    if (strcmp(predicado, "conta") == 0) {
+      exigir_evento(clausula, REGRA_CONTAGENS, id);
+    } else if (strcmp(predicado, ">=") == 0 && clausula->contador == 0) {
+      // Uma comparação por cláusula
+      clausula->contador = id;
+      return ler_numero(strtok_r(NULL, ESPACOS, resto), &clausula->limite);
+    } else {
+      return false;
+    }
+  } else if (ler_id(token, "tempo", MAX_TEMPORIZADORES, &id)) {
+    if (strcmp(predicado, "expira") == 0) {
+      exigir_evento(clausula, REGRA_VENCIMENTOS, id);
+    } else if (strcmp(predicado, "ativo") == 0 || strcmp(predicado, "inativo") == 0) {
+      exigir_nivel(clausula, REGRA_TEMPORIZADORES, id, predicado[0] == 'a');
+    } else {
+      return false;
+    }
+  } else {
+    return false;
+  }
+  return true;
+}
+
+
+/*  Compila a ação, que ocupa o restante do texto.
+ */
+static bool compilar_acao(char **resto, acao_regra_t *acao) {
+  const char *verbo = strtok_r(NULL, ESPACOS, resto);
+  const char *alvo = strtok_r(NULL, ESPACOS, resto);
+  const char *numero = strtok_r(NULL, ESPACOS, resto);
+  bool com_numero = false;
+  bool ok;
+
+  if (verbo == NULL || alvo == NULL) {
+    return false;
+  }
+  acao->valor = 0;
+
+  if (strcmp(verbo, "ligar") == 0) {
+    acao->tipo = ACAO_REGRA_LIGAR;
+    ok = ler_id(alvo, "atuador", MAX_ATUADORES, &acao->id);
+  } else if (strcmp(verbo, "desligar") == 0) {
+    acao->tipo = ACAO_REGRA_DESLIGAR;
+    ok = ler_id(alvo, "atuador", MAX_ATUADORES, &acao->id);
+  } else if (strcmp(verbo, "alternar") == 0) {
+    acao->tipo = ACAO_REGRA_ALTERNAR;
+    ok = ler_id(alvo, "atuador", MAX_ATUADORES, &acao->id);
+  } else if (strcmp(verbo, "pulsar") == 0) {
+    acao->tipo = ACAO_REGRA_PULSAR;
+    ok = ler_id(alvo, "atuador", MAX_ATUADORES, &acao->id);
+    com_numero = true;
+  } else if (strcmp(verbo, "zerar") == 0) {
+    acao->tipo = ACAO_REGRA_ZERAR;
+    ok = ler_id(alvo, "contador", MAX_CONTADORES, &acao->id);
+  } else if (strcmp(verbo, "iniciar") == 0) {
+    acao->tipo = ACAO_REGRA_INICIAR_TEMPO;
+    ok = ler_id(alvo, "tempo", MAX_TEMPORIZADORES, &acao->id);
+    com_numero = true;
+  } else if (strcmp(verbo, "parar") == 0) {
+    acao->tipo = ACAO_REGRA_PARAR_TEMPO;
+    ok = ler_id(alvo, "tempo", MAX_TEMPORIZADORES, &acao->id);
+  } else {
+    return false;
+  }
+
+  if (com_numero) {
+    ok = ok && ler_numero(numero, &acao->valor);
+    numero = strtok_r(NULL, ESPACOS, resto);
+  }
+  // Nada pode sobrar depois da ação
+  return ok && (numero == NULL);
+}
+
+
+/*  Compila o texto de uma regra.
+ */
+static bool compilar_regra(const char *texto, regra_t *regra) {
+  char copia[MAX_VALOR_REGRA + 1];
+  char *resto;
+  bool espera_termo = true;
+
+  if (strlen(texto) >= sizeof(copia)) {
+    return false;
+  }
+  strcpy(copia, texto);
+  memset(regra, 0, sizeof(*regra));
+  regra->num_clausulas = 1;
+
+  for (char *token = strtok_r(copia, ESPACOS, &resto); token != NULL;
+       token = strtok_r(NULL, ESPACOS, &resto)) {
+    clausula_t *clausula = &regra->clausulas[regra->num_clausulas - 1];
+
+    if (espera_termo) {
+      if (!compilar_termo(token, &resto, clausula)) {
+        return false;
+      }
+      espera_termo = false;
+    } else if (strcmp(token, "e") == 0) {
+      espera_termo = true;
+    } else if (strcmp(token, "ou") == 0) {
+      if (regra->num_clausulas >= MAX_CLAUSULAS) {
+        return false;
+      }
+      regra->num_clausulas++;
+      espera_termo = true;
+    } else if (strcmp(token, "->") == 0) {
+      return compilar_acao(&resto, &regra->acao);
+    } else {
+      return false;
+    }
+  }
+  // Falta a ação
+  return false;
+}
+
+
+/*  Carga ---------------------------------------------------------------------
+ */
+
+/*  Prepara a tabela livre para receber as regras.
+ */
+static bool preparar_carga(carga_regras_t *carga) {
+  if (semaforo_carga == NULL ||
+      xSemaphoreTake(semaforo_carga, pdMS_TO_TICKS(TEMPO_MAX_CARGA_MS)) != pdTRUE) {
+    return false;
+  }
+
+  // A tabela livre só é liberada quando a tarefa de controle instala a carga anterior
+  for (int espera = 0; atomic_load_explicit(&pendente, memory_order_acquire); espera += 10) {
+    if (espera >= TEMPO_MAX_CARGA_MS) {
+      xSemaphoreGive(semaforo_carga);
+      return false;
+    }
+    vTaskDelay(pdMS_TO_TICKS(10));
+  }
+
+  memset(&tabelas[1 - atual], 0, sizeof(tabela_regras_t));
+  carga->regras = 0;
+  carga->erros = 0;
+  carga->arquivo = NULL;
+  carga->leitor = NULL;
+  return true;
+}
+
+
+/*  Anota uma linha rejeitada; as primeiras MAX_LINHAS_REJEITADAS são guardadas.
+ */
+static void rejeitar_linha(int linha, void *contexto) {
+  carga_regras_t *carga = (carga_regras_t *)contexto;
+
+  if (carga->erros < MAX_LINHAS_REJEITADAS) {
+    carga->linhas_rejeitadas[carga->erros] = linha;
+  }
+  carga->erros++;
+}
+
+
+// Ver a descrição das funções públicas em regras.h
+
+
+void regras_iniciar(void) {
+  carga_regras_t carga;
+
+  if (semaforo_carga == NULL) {
+    semaforo_carga = xSemaphoreCreateMutex();
+  }
+  if (!preparar_carga(&carga)) {
+    return;
+  }
+  if (app_config_montar_armazenamento()) {
+    FILE *f = fopen(ARQUIVO_REGRAS, "r");
+
+    if (f != NULL) {
+      leitor_parametros_t leitor;
+      char bloco[128];
+      size_t lidos;
+
+      regras_iniciar_leitor(&carga, &leitor);
+      while ((lidos = fread(bloco, 1, sizeof(bloco), f)) > 0) {
+        leitor_parametros_consumir(&leitor, bloco, lidos);
+      }
+      leitor_parametros_terminar(&leitor);
+      fclose(f);
+    }
+    app_config_desmontar_armazenamento();
+  }
+
+  ESP_LOGI(TAG, "%d regras carregadas, %d linhas rejeitadas", carga.regras, carga.erros);
+  // Regras válidas do arquivo valem mesmo que alguma linha tenha sido descartada
+  carga.erros = 0;
+  regras_concluir_carga(&carga, carga.regras > 0);
+}
+
+
+bool regras_iniciar_carga(carga_regras_t *carga) {
+  if (!preparar_carga(carga)) {
+    return false;
+  }
+  if (app_config_montar_armazenamento()) {
+    carga->arquivo = fopen(ARQUIVO_TEMPORARIO, "w");
+    if (carga->arquivo == NULL) {
+      app_config_desmontar_armazenamento();
+    }
+  }
+  return true;
+}
+
+
+void regras_iniciar_leitor(carga_regras_t *carga, leitor_parametros_t *leitor) {
+  leitor_parametros_iniciar(leitor, regras_tratar_parametro, carga);
+  leitor_parametros_definir_valor(leitor, carga->valor, MAX_VALOR_REGRA);
+  leitor_parametros_definir_descarte(leitor, rejeitar_linha);
+  carga->leitor = leitor;
+}
+
+
+void regras_tratar_parametro(const char *nome, const char *valor, void *contexto) {
+  carga_regras_t *carga = (carga_regras_t *)contexto;
+  tabela_regras_t *tabela = &tabelas[1 - atual];
+
+  if (strcmp(nome, "regra") != 0 || carga->regras >= MAX_REGRAS ||
+      !compilar_regra(valor, &tabela->regras[carga->regras + 1])) {
+    rejeitar_linha((carga->leitor != NULL) ? carga->leitor->linha : 0, carga);
+    return;
+  }
+  carga->regras++;
+  if (carga->arquivo != NULL) {
+    fprintf(carga->arquivo, "regra = %s\n", valor);
+  }
+}
+
+
+bool regras_concluir_carga(carga_regras_t *carga, bool aplicar) {
+  bool instalar = aplicar && (carga->erros == 0);
+
+  if (carga->arquivo != NULL) {
+    bool gravado = (fflush(carga->arquivo) == 0) && (fsync(fileno(carga->arquivo)) == 0);
+
+    fclose(carga->arquivo);
+    carga->arquivo = NULL;
+    if (instalar && gravado) {
+      if (rename(ARQUIVO_TEMPORARIO, ARQUIVO_REGRAS) != 0) {
+        ESP_LOGE(TAG, "Falha ao gravar as regras");
+      }
+    } else {
+      unlink(ARQUIVO_TEMPORARIO);
+    }
+    app_config_desmontar_armazenamento();
+  }
+
+  if (instalar) {
+    tabelas[1 - atual].num_regras = carga->regras;
+    atomic_store_explicit(&pendente, true, memory_order_release);
+  }
+  xSemaphoreGive(semaforo_carga);
+  return instalar;
+}
+
+
+/*  Avaliação -----------------------------------------------------------------
+ */
+
+static inline bool avaliar_clausula(const clausula_t *clausula, const entradas_regras_t *entradas) {
+  mapa_perifericos_t diferencas = 0;
+  int i;
+
+  // Acumula as diferenças de todas as classes, sem desvios
+  for (i = 0; i < NUM_NIVEIS_REGRA; i++) {
+    diferencas |= (entradas->niveis[i] & clausula->mascara[i]) ^ clausula->niveis[i];
+  }
+  for (i = 0; i < NUM_EVENTOS_REGRA; i++) {
+    diferencas |= ~entradas->eventos[i] & clausula->eventos[i];
+  }
+  return (diferencas == 0 &&
+          (clausula->contador == 0 || entradas->contagens[clausula->contador] >= clausula->limite));
+}
+
+
+int regras_avaliar(int64_t agora_us, const entradas_regras_t *entradas_tarefa,
+                   acao_regra_t *acoes, int *num_acoes) {
+  entradas_regras_t entradas = *entradas_tarefa;
+  bool instalando = false;
+  bool houve_eventos = false;
+  int disparos = 0;
+  int id;
+
+  *num_acoes = 0;
+
+  if (atomic_load_explicit(&pendente, memory_order_acquire)) {
+    // Carga nova: troca as tabelas e para os temporizadores
+    atual = 1 - atual;
+    memset(fim_tempo, 0, sizeof(fim_tempo));
+    instalando = true;
+    portENTER_CRITICAL(&mux_regras);
+    estatisticas.regras = tabelas[atual].num_regras;
+    memset(estatisticas.disparos_regra, 0, sizeof(estatisticas.disparos_regra));
+    portEXIT_CRITICAL(&mux_regras);
+    atomic_store_explicit(&pendente, false, memory_order_release);
+  }
+
+  entradas.niveis[REGRA_TEMPORIZADORES] = 0;
+  entradas.eventos[REGRA_VENCIMENTOS] = 0;
+  for (id = 1; id <= MAX_TEMPORIZADORES; id++) {
+    if (fim_tempo[id] != 0 && agora_us >= fim_tempo[id]) {
+      fim_tempo[id] = 0;
+      entradas.eventos[REGRA_VENCIMENTOS] |= REGRA_BIT(id);
+    }
+    if (fim_tempo[id] != 0) {
+      entradas.niveis[REGRA_TEMPORIZADORES] |= REGRA_BIT(id);
+    }
+  }
+  for (int i = 0; i < NUM_EVENTOS_REGRA; i++) {
+    houve_eventos = houve_eventos || (entradas.eventos[i] != 0);
+  }
+
+  bool contagens_mudaram = false;
+
+  for (id = 1; id <= MAX_CONTADORES; id++) {
+    if (entradas.contagens[id] != contagens_anteriores[id]) {
+      contagens_anteriores[id] = entradas.contagens[id];
+      contagens_mudaram = true;
+    }
+  }
+
+  tabela_regras_t *tabela = &tabelas[atual];
+  bool niveis_mudaram = (memcmp(entradas.niveis, niveis_anteriores, sizeof(niveis_anteriores)) != 0);
+
+  memcpy(niveis_anteriores, entradas.niveis, sizeof(niveis_anteriores));
+  if (tabela->num_regras == 0 ||
+      (!instalando && !houve_eventos && !niveis_mudaram && !contagens_mudaram)) {
+    return 0;
+  }
+
+  for (int i = 1; i <= tabela->num_regras; i++) {
+    regra_t *regra = &tabela->regras[i];
+    bool verdadeira = false;
+    bool por_evento = false;
+
+    for (int c = 0; c < regra->num_clausulas; c++) {
+      if (avaliar_clausula(&regra->clausulas[c], &entradas)) {
+        verdadeira = true;
+        por_evento = por_evento || regra->clausulas[c].com_eventos;
+      }
+    }
+
+    // Na instalação, as regras de nível só registram o estado corrente
+    bool disparar = verdadeira && (por_evento || (!regra->verdadeira && !instalando));
+
+    regra->verdadeira = verdadeira;
+    if (!disparar) {
+      continue;
+    }
+
+    disparos++;
+    estatisticas.disparos_regra[i]++;
+    switch (regra->acao.tipo) {
+      case ACAO_REGRA_INICIAR_TEMPO:
+        fim_tempo[regra->acao.id] = agora_us + (int64_t)regra->acao.valor * 1000;
+        break;
+      case ACAO_REGRA_PARAR_TEMPO:
+        fim_tempo[regra->acao.id] = 0;
+        break;
+      default:
+        acoes[(*num_acoes)++] = regra->acao;
+        break;
+    }
+  }
+
+  portENTER_CRITICAL(&mux_regras);
+  estatisticas.avaliacoes++;
+  estatisticas.disparos += disparos;
+  portEXIT_CRITICAL(&mux_regras);
+
+  return disparos;
+}
+
+
+void regras_registrar_latencia(uint32_t latencia_us, bool excedeu) {
+  portENTER_CRITICAL(&mux_regras);
+  estatisticas.medicoes++;
+  estatisticas.soma_latencia_us += latencia_us;
+  if (latencia_us > estatisticas.latencia_max_us) {
+    estatisticas.latencia_max_us = latencia_us;
+  }
+  if (excedeu) {
+    estatisticas.passos_excedidos++;
+  }
+  portEXIT_CRITICAL(&mux_regras);
+}
+
+
+void regras_estatisticas(estatisticas_regras_t *saida) {
+  portENTER_CRITICAL(&mux_regras);
+  *saida = estatisticas;
+  portEXIT_CRITICAL(&mux_regras);
+}
@@ -0,0 +1,187 @@
+/** @file regras.h - Regras de automação avaliadas no próprio módulo.
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "controle_gpio.h"
+#include "leitor_parametros.h"
+
+#define MAX_REGRAS            16    ///< Máximo de regras carregadas.
+#define MAX_TEMPORIZADORES    4     ///< Máximo de temporizadores das regras.
+#define MAX_VALOR_REGRA       191   ///< Tamanho máximo do texto de uma regra.
+#define MAX_LINHAS_REJEITADAS 8     ///< Linhas rejeitadas guardadas em uma carga.
+
+/** Bit de um periférico nos mapas das entradas das regras.
+ */
+#define REGRA_BIT(id)             ((mapa_perifericos_t)1 << ((id) - 1))
+
+
+/** Mapas de bits dos níveis nas entradas das regras, um por classe.
+ */
+enum nivel_regra {
+  REGRA_SENSORES,             ///< Sensor ligado
+  REGRA_ATUADORES,            ///< Atuador ligado
+  REGRA_TEMPORIZADORES,       ///< Temporizador ativo (preenchido em regras.c)
+  NUM_NIVEIS_REGRA
+};
+
+
+/** Mapas de bits dos eventos nas entradas das regras, um por tipo.
+ */
+enum evento_regra {
+  REGRA_SUBIDAS,              ///< Sensor passou a 1
+  REGRA_DESCIDAS,             ///< Sensor passou a 0
+  REGRA_CONTAGENS,            ///< Contador incrementado
+  REGRA_VENCIMENTOS,          ///< Temporizador venceu (preenchido em regras.c)
+  NUM_EVENTOS_REGRA
+};
+
+
+/** Ações das regras executadas pela tarefa de controle.
+ */
+enum acao_regra {
+  ACAO_REGRA_LIGAR = 1,       ///< Ligar atuador
+  ACAO_REGRA_DESLIGAR,        ///< Desligar atuador
+  ACAO_REGRA_ALTERNAR,        ///< Alternar atuador
+  ACAO_REGRA_PULSAR,          ///< Pulsar atuador por valor ms
+  ACAO_REGRA_ZERAR,           ///< Reiniciar contador
+  ACAO_REGRA_INICIAR_TEMPO,   ///< Iniciar temporizador por valor ms (executada em regras.c)
+  ACAO_REGRA_PARAR_TEMPO      ///< Parar temporizador (executada em regras.c)
+};
+
+
+/** Ação disparada por uma regra.
+ */
+typedef struct {
+  uint8_t   tipo;             ///< enum acao_regra
+  uint8_t   id;               ///< Identificador do atuador, contador ou temporizador
+  int32_t   valor;            ///< Duração do pulso ou do temporizador em ms
+} acao_regra_t;
+
+
+/** Entradas de uma avaliação das regras.
+ */
+typedef struct {
+  mapa_perifericos_t  niveis[NUM_NIVEIS_REGRA];     ///< Níveis dos sensores e atuadores (REGRA_BIT)
+  mapa_perifericos_t  eventos[NUM_EVENTOS_REGRA];   ///< Eventos desde a última avaliação (REGRA_BIT)
+  const int           *contagens;                   ///< Contagem de cada contador, indexada pelo id
+} entradas_regras_t;
+
+
+/** Carga de um conjunto de regras, de POST /regras ou da FLASH.
+ */
+typedef struct {
+  int   regras;               ///< Regras compiladas
+  int   erros;                ///< Linhas rejeitadas (regras inválidas ou linhas descartadas)
+  FILE  *arquivo;             ///< Cópia do texto, gravada na FLASH
+  const leitor_parametros_t *leitor;              ///< Leitor do texto (número da linha)
+  int   linhas_rejeitadas[MAX_LINHAS_REJEITADAS]; ///< Primeiras linhas rejeitadas
+  char  valor[MAX_VALOR_REGRA + 1];               ///< Texto da regra em leitura
+} carga_regras_t;
+
+
+/** Estatísticas das regras.
+
+    A latência vai da amostragem das entradas (ou do comando que disparou
+    a regra) até a escrita das saídas; não inclui a janela de debouncing.
+*/
+typedef struct {
+  uint32_t  regras;                       ///< Regras em vigor
+  uint32_t  avaliacoes;                   ///< Avaliações com alguma mudança
+  uint32_t  disparos;                     ///< Regras disparadas
+  uint32_t  passos_excedidos;             ///< Cadeias de regras interrompidas
+  uint32_t  medicoes;                     ///< Latências medidas (avaliações com disparos)
+  uint32_t  latencia_max_us;              ///< Maior latência
+  uint64_t  soma_latencia_us;             ///< Soma das latências (para a média)
+  uint32_t  disparos_regra[MAX_REGRAS + 1];   ///< Disparos de cada regra (de 1 em diante)
+} estatisticas_regras_t;
+
+
+/** Carregar as regras gravadas na FLASH.
+
+    Deve ser chamada antes de controle_gpio_ativar_timer().
+*/
+void regras_iniciar(void);
+
+
+/** Iniciar a carga de um novo conjunto de regras.
+
+    Apenas uma carga por vez; aguarda a instalação da carga anterior.
+
+    @param carga Estado da carga
+
+    @return false se a carga não pôde ser iniciada.
+*/
+bool regras_iniciar_carga(carga_regras_t *carga);
+
+
+/** Preparar um leitor de parâmetros para o texto da carga.
+
+    O leitor aceita regras de até MAX_VALOR_REGRA caracteres, repassa cada
+    linha a regras_tratar_parametro() e anota na carga o número das
+    linhas rejeitadas, inclusive as que o próprio leitor descarta.
+
+    @param carga  Carga iniciada por regras_iniciar_carga()
+    @param leitor Leitor a preparar
+*/
+void regras_iniciar_leitor(carga_regras_t *carga, leitor_parametros_t *leitor);
+
+
+/** Tratar um parâmetro da carga (leitor_parametros_cb_t).
+
+    Cada linha 'regra = condição -> ação' é compilada; os demais nomes
+    são contados como erro. Condição e ação estão descritas em regras.c.
+
+    @param nome     Nome do parâmetro
+    @param valor    Texto da regra
+    @param contexto Carga iniciada por regras_iniciar_carga()
+*/
+void regras_tratar_parametro(const char *nome, const char *valor, void *contexto);
+
+
+/** Concluir a carga.
+
+    Se aplicar e não houve erros, as novas regras substituem as atuais
+    (na próxima avaliação) e o texto é gravado na FLASH.
+
+    @param carga    Estado da carga
+    @param aplicar  false para descartar a carga
+
+    @return true se as regras foram substituídas.
+*/
+bool regras_concluir_carga(carga_regras_t *carga, bool aplicar);
+
+
+/** Avaliar as regras (chamada pela tarefa de controle).
+
+    Só avalia se houve algum evento, mudança de nível ou temporizador
+    vencido desde a avaliação anterior. Regras com eventos disparam a
+    cada evento; as demais, quando a condição passa a ser verdadeira.
+
+    @param agora_us  Instante da avaliação (esp_timer_get_time)
+    @param entradas  Níveis, eventos e contagens
+    @param acoes     Vetor com MAX_REGRAS posições, recebe as ações a executar
+    @param num_acoes Recebe o número de ações em acoes
+
+    @return Número de regras disparadas (inclui as que só agem nos temporizadores).
+*/
+int regras_avaliar(int64_t agora_us, const entradas_regras_t *entradas,
+                   acao_regra_t *acoes, int *num_acoes);
+
+
+/** Registrar a latência de uma avaliação que disparou regras.
+
+    @param latencia_us Do instante das entradas até a escrita das saídas
+    @param excedeu     true se a cadeia de regras foi interrompida
+*/
+void regras_registrar_latencia(uint32_t latencia_us, bool excedeu);
+
+
+/** Ler as estatísticas das regras.
+
+    @param estatisticas Estrutura a ser preenchida
+*/
+void regras_estatisticas(estatisticas_regras_t *estatisticas);
@@ -0,0 +1,377 @@
+/** @file sensor_adc.c - Sensores analógicos (ADC contínuo).
+
+    O conversor analógico-digital trabalha em modo contínuo: o hardware
+    amostra os canais dos sensores a uma taxa fixa e entrega blocos de
+    amostras por DMA, sem intervenção do processador em cada conversão.
+
+    Uma tarefa dedicada recebe os blocos e filtra as amostras de cada
+    sensor em dois estágios:
+      - Decimação: média de FATOR_DECIMACAO amostras (média móvel em
+        blocos), reduzindo a taxa de TAXA_AMOSTRAGEM_HZ para TAXA_SAIDA_HZ;
+      - IIR de primeira ordem sobre as médias, com frequência de corte
+        configurável (sensor_adc_definir_corte).
+
+    As saídas do filtro formam uma janela de cerca de 1 segundo, da qual
+    saem mínimo, máximo e média. O resultado é publicado com um contador
+    de sequência (como em controle_gpio.c): o servidor lê sem bloquear e
+    sem esperar conversões.
+
+    Nos chips sem ADC contínuo (SOC_ADC_DMA_SUPPORTED), não há sensores
+    analógicos, e as leituras retornam erro. Na simulação, o mesmo filtro
+    recebe as amostras de sensor_adc_simular(), no lugar do DMA.
+
+    @author João Vianna (jvianna@gmail.com)
+    @version 0.83
+
+    Código de configuração do conversor derivado de:
+    .../esp-idf/examples/peripherals/adc/continuous_read/main/continuous_read_main.c
+*/
+#include <string.h>
+#include <math.h>
+#include <stdatomic.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "soc/soc_caps.h"
+#if SOC_ADC_DMA_SUPPORTED
+#include "esp_adc/adc_continuous.h"
+#endif
+#include <esp_log.h>
+
+#include "sensor_adc.h"
+
+#define TAG "sensor_adc"
+
+#define TAXA_AMOSTRAGEM_HZ    (20000)     // Por canal
+#define FATOR_DECIMACAO       (100)
+#define TAXA_SAIDA_HZ         (TAXA_AMOSTRAGEM_HZ / FATOR_DECIMACAO)
+#define TAM_JANELA_ADC        (TAXA_SAIDA_HZ)     // Saídas em 1 segundo
+#define CORTE_PADRAO_HZ       (5.0f)
+
+#define PILHA_TAREFA_ADC      (3072)
+#define PRIORIDADE_TAREFA_ADC (tskIDLE_PRIORITY + 4)
+#define TAM_QUADRO_ADC        (256)       // Bytes por bloco entregue pelo DMA
+
+// Filtro das amostras: com o ADC contínuo, ou na simulação
+#define FILTRO_ADC            (SOC_ADC_DMA_SUPPORTED || CONFIG_CONTROLE_GPIO_SIMULACAO)
+
+
+/*  Estado do filtro de um sensor, alterado apenas pela tarefa do ADC.
+ */
+typedef struct {
+  uint32_t  soma_bloco;                 // Soma das amostras do bloco de decimação
+  int       amostras_bloco;             // Amostras no bloco corrente
+  int32_t   iir;                        // Saída do IIR, em ponto fixo Q16
+  bool      iniciado;                   // Já houve uma saída (IIR parte dela)
+  uint16_t  janela[TAM_JANELA_ADC];     // Últimas saídas (circular)
+  int       posicao_janela;             // Próxima posição a gravar
+  int       saidas_janela;              // Saídas válidas na janela
+  uint32_t  soma_janela;                // Soma das saídas na janela
+  uint64_t  amostras;                   // Total de amostras recebidas
+} filtro_adc_t;
+
+
+typedef struct {
+  int         canal;                    // Canal do ADC1 onde está ligado o sensor
+  float       corte_hz;                 // Frequência de corte do IIR
+  atomic_uint alfa;                     // Coeficiente do IIR em Q16 (alterado por outras tarefas)
+  filtro_adc_t filtro;
+} estado_sensor_adc_t;
+
+
+// Mapeia canais do ADC1 para id dos sensores analógicos
+static estado_sensor_adc_t mapa_sensores_adc[MAX_SENSORES_ADC + 1] = {
+  {0},
+  { .canal = 6,                         // GPIO34 no ESP32 (apenas entrada)
+    .corte_hz = CORTE_PADRAO_HZ
+  }
+};
+
+
+// Leituras publicadas pela tarefa do ADC (seqlock)
+static atomic_uint sequencia_adc = 0;
+static leitura_adc_t leituras_publicadas[MAX_SENSORES_ADC + 1];
+
+
+/*  Coeficiente do IIR de primeira ordem, em Q16, para a frequência de
+    corte indicada: alfa = 1 - exp(-2.pi.fc / fs).
+ */
+static uint32_t calcular_alfa(float corte_hz) {
+  if (corte_hz <= 0.0f || corte_hz >= TAXA_SAIDA_HZ / 2) {
+    return 1u << 16;      // Sem filtro: a saída é a média do bloco
+  }
+  float alfa = 1.0f - expf(-2.0f * (float)M_PI * corte_hz / (float)TAXA_SAIDA_HZ);
+
+  return (uint32_t)(alfa * 65536.0f + 0.5f);
+}
+
+
+#if FILTRO_ADC
+
+/*  Guarda uma saída na janela, atualizando a soma.
+ */
+static void guardar_saida(filtro_adc_t *f, uint16_t saida) {
+  if (f->saidas_janela == TAM_JANELA_ADC) {
+    f->soma_janela -= f->janela[f->posicao_janela];
+  } else {
+    f->saidas_janela++;
+  }
+  f->janela[f->posicao_janela] = saida;
+  f->soma_janela += saida;
+
+  if (++f->posicao_janela == TAM_JANELA_ADC) {
+    f->posicao_janela = 0;
+  }
+}
+
+
+/*  Processa uma amostra bruta.
+
+    @return true se gerou uma saída (fim de um bloco de decimação).
+ */
+static bool filtrar_amostra(filtro_adc_t *f, uint32_t alfa, uint32_t amostra) {
+  f->amostras++;
+  f->soma_bloco += amostra;
+  if (++f->amostras_bloco < FATOR_DECIMACAO) {
+    return false;
+  }
+
+  int32_t media_bloco = (int32_t)(((uint64_t)f->soma_bloco << 16) / FATOR_DECIMACAO);
+
+  f->soma_bloco = 0;
+  f->amostras_bloco = 0;
+
+  if (!f->iniciado) {
+    f->iir = media_bloco;
+    f->iniciado = true;
+  } else {
+    f->iir += (int32_t)(((int64_t)(media_bloco - f->iir) * alfa) >> 16);
+  }
+  guardar_saida(f, (uint16_t)((f->iir + 0x8000) >> 16));
+  return true;
+}
+
+
+/*  Calcula a leitura de um sensor a partir da janela.
+ */
+static void resumir_janela(const filtro_adc_t *f, leitura_adc_t *leitura) {
+  int ultima = (f->posicao_janela + TAM_JANELA_ADC - 1) % TAM_JANELA_ADC;
+  uint16_t minimo = UINT16_MAX;
+  uint16_t maximo = 0;
+
+  for (int i = 0; i < f->saidas_janela; i++) {
+    uint16_t saida = f->janela[i];
+
+    if (saida < minimo) {
+      minimo = saida;
+    }
+    if (saida > maximo) {
+      maximo = saida;
+    }
+  }
+  leitura->valor = f->janela[ultima];
+  leitura->minimo = minimo;
+  leitura->maximo = maximo;
+  leitura->media = (uint16_t)((f->soma_janela + f->saidas_janela / 2) / f->saidas_janela);
+  leitura->saidas = (uint32_t)f->saidas_janela;
+  leitura->amostras = f->amostras;
+}
+
+
+/*  Publica as leituras de todos os sensores (seqlock).
+ */
+static void publicar_leituras(void) {
+  atomic_fetch_add_explicit(&sequencia_adc, 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  for (int id = 1; id <= MAX_SENSORES_ADC; id++) {
+    const filtro_adc_t *f = &mapa_sensores_adc[id].filtro;
+
+    if (f->saidas_janela > 0) {
+      resumir_janela(f, &leituras_publicadas[id]);
+    }
+  }
+
+  atomic_thread_fence(memory_order_release);
+  atomic_fetch_add_explicit(&sequencia_adc, 1, memory_order_relaxed);
+}
+#endif
+
+
+#if SOC_ADC_DMA_SUPPORTED
+
+#if CONFIG_IDF_TARGET_ESP32 || CONFIG_IDF_TARGET_ESP32S2
+#define FORMATO_SAIDA_ADC     ADC_DIGI_OUTPUT_FORMAT_TYPE1
+#define CANAL_AMOSTRA(p)      ((p)->type1.channel)
+#define VALOR_AMOSTRA(p)      ((p)->type1.data)
+#else
+#define FORMATO_SAIDA_ADC     ADC_DIGI_OUTPUT_FORMAT_TYPE2
+#define CANAL_AMOSTRA(p)      ((p)->type2.channel)
+#define VALOR_AMOSTRA(p)      ((p)->type2.data)
+#endif
+
+static adc_continuous_handle_t conversor = NULL;
+static TaskHandle_t tarefa_adc = NULL;
+
+// Mapeia canais do ADC1 para id dos sensores (0 se o canal não é usado)
+static uint8_t id_por_canal[SOC_ADC_MAX_CHANNEL_NUM];
+
+
+/*  Chamada (em interrupção) quando um bloco de conversões está pronto.
+ */
+static bool IRAM_ATTR tratar_bloco_adc(adc_continuous_handle_t handle,
+                                       const adc_continuous_evt_data_t *dados, void *contexto) {
+  BaseType_t acordou = pdFALSE;
+
+  vTaskNotifyGiveFromISR(tarefa_adc, &acordou);
+  return (acordou == pdTRUE);
+}
+
+
+/*  Laço da tarefa do ADC: lê os blocos e filtra as amostras.
+ */
+static void executar_tarefa_adc(void *parametros) {
+  static uint8_t bloco[TAM_QUADRO_ADC] __attribute__((aligned(4)));
+
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    uint32_t lidos = 0;
+    bool novas_saidas = false;
+
+    while (adc_continuous_read(conversor, bloco, sizeof(bloco), &lidos, 0) == ESP_OK) {
+      for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= lidos; i += SOC_ADC_DIGI_RESULT_BYTES) {
+        const adc_digi_output_data_t *p = (const adc_digi_output_data_t *)&bloco[i];
+        uint32_t canal = CANAL_AMOSTRA(p);
+
+        if (canal < SOC_ADC_MAX_CHANNEL_NUM && id_por_canal[canal] != 0) {
+          estado_sensor_adc_t *sensor = &mapa_sensores_adc[id_por_canal[canal]];
+          uint32_t alfa = atomic_load_explicit(&sensor->alfa, memory_order_relaxed);
+
+          novas_saidas |= filtrar_amostra(&sensor->filtro, alfa, VALOR_AMOSTRA(p));
+        }
+      }
+    }
+    if (novas_saidas) {
+      publicar_leituras();
+    }
+  }
+}
+
+
+// Documentação das funções públicas no arquivo header.
+
+
+bool sensor_adc_iniciar(void) {
+  adc_continuous_handle_cfg_t config_conversor = {
+    .max_store_buf_size = 4 * TAM_QUADRO_ADC,
+    .conv_frame_size = TAM_QUADRO_ADC
+  };
+  adc_digi_pattern_config_t padrao[MAX_SENSORES_ADC] = {0};
+  adc_continuous_config_t config_digital = {
+    .pattern_num = MAX_SENSORES_ADC,
+    .adc_pattern = padrao,
+    .sample_freq_hz = TAXA_AMOSTRAGEM_HZ * MAX_SENSORES_ADC,
+    .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+    .format = FORMATO_SAIDA_ADC
+  };
+  adc_continuous_evt_cbs_t callbacks = {
+    .on_conv_done = tratar_bloco_adc
+  };
+
+  if (conversor != NULL) {
+    return true;
+  }
+  for (int id = 1; id <= MAX_SENSORES_ADC; id++) {
+    estado_sensor_adc_t *sensor = &mapa_sensores_adc[id];
+
+    atomic_store(&sensor->alfa, calcular_alfa(sensor->corte_hz));
+    id_por_canal[sensor->canal] = (uint8_t)id;
+
+    padrao[id - 1].atten = ADC_ATTEN_DB_12;
+    padrao[id - 1].channel = sensor->canal;
+    padrao[id - 1].unit = ADC_UNIT_1;
+    padrao[id - 1].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+  }
+
+  // A tarefa existe antes do primeiro bloco
+  if (xTaskCreate(executar_tarefa_adc, "adc", PILHA_TAREFA_ADC, NULL,
+                  PRIORIDADE_TAREFA_ADC, &tarefa_adc) != pdPASS) {
+    return false;
+  }
+  if (adc_continuous_new_handle(&config_conversor, &conversor) != ESP_OK ||
+      adc_continuous_config(conversor, &config_digital) != ESP_OK ||
+      adc_continuous_register_event_callbacks(conversor, &callbacks, NULL) != ESP_OK ||
+      adc_continuous_start(conversor) != ESP_OK) {
+    ESP_LOGE(TAG, "Falha ao iniciar o ADC contínuo");
+    return false;
+  }
+  ESP_LOGI(TAG, "ADC contínuo: %d Hz por canal, saídas a %d Hz", TAXA_AMOSTRAGEM_HZ, TAXA_SAIDA_HZ);
+  return true;
+}
+
+#elif CONFIG_CONTROLE_GPIO_SIMULACAO
+
+bool sensor_adc_iniciar(void) {
+  for (int id = 1; id <= MAX_SENSORES_ADC; id++) {
+    atomic_store(&mapa_sensores_adc[id].alfa, calcular_alfa(mapa_sensores_adc[id].corte_hz));
+  }
+  ESP_LOGI(TAG, "Simulação: amostras a %d Hz por canal, saídas a %d Hz", TAXA_AMOSTRAGEM_HZ, TAXA_SAIDA_HZ);
+  return true;
+}
+
+
+/*  Como um bloco do DMA na tarefa do ADC: filtra e publica uma vez.
+ */
+bool sensor_adc_simular(int id, const uint16_t *amostras, size_t quantidade) {
+  if (id < 1 || id > MAX_SENSORES_ADC) {
+    return false;
+  }
+  estado_sensor_adc_t *sensor = &mapa_sensores_adc[id];
+  uint32_t alfa = atomic_load_explicit(&sensor->alfa, memory_order_relaxed);
+  bool novas_saidas = false;
+
+  for (size_t i = 0; i < quantidade; i++) {
+    novas_saidas |= filtrar_amostra(&sensor->filtro, alfa, amostras[i]);
+  }
+  if (novas_saidas) {
+    publicar_leituras();
+  }
+  return true;
+}
+
+#else
+
+bool sensor_adc_iniciar(void) {
+  ESP_LOGW(TAG, "Chip sem ADC contínuo: sensores analógicos desativados");
+  return false;
+}
+
+#endif
+
+
+bool sensor_adc_ler(int id, leitura_adc_t *leitura) {
+  unsigned inicio;
+
+  if (id < 1 || id > MAX_SENSORES_ADC) {
+    return false;
+  }
+  do {
+    inicio = atomic_load_explicit(&sequencia_adc, memory_order_acquire);
+    *leitura = leituras_publicadas[id];
+    atomic_thread_fence(memory_order_acquire);
+  } while ((inicio & 1) != 0 ||
+           inicio != atomic_load_explicit(&sequencia_adc, memory_order_relaxed));
+
+  return (leitura->saidas > 0);
+}
+
+
+bool sensor_adc_definir_corte(int id, float corte_hz) {
+  if (id < 1 || id > MAX_SENSORES_ADC) {
+    return false;
+  }
+  mapa_sensores_adc[id].corte_hz = corte_hz;
+  atomic_store(&mapa_sensores_adc[id].alfa, calcular_alfa(corte_hz));
+  return true;
+}
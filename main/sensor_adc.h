@@ -0,0 +1,71 @@
+/** @file sensor_adc.h - Sensores analógicos (ADC contínuo).
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAX_SENSORES_ADC  1     ///< Máximo de sensores analógicos no módulo.
+
+
+/** Leitura de um sensor analógico.
+
+    Os valores estão na escala do conversor (0 a 4095 com 12 bits), já
+    filtrados; mínimo, máximo e média se referem à janela das últimas
+    saídas do filtro (cerca de 1 segundo).
+*/
+typedef struct {
+  uint16_t  valor;        ///< Última saída do filtro
+  uint16_t  minimo;       ///< Menor saída na janela
+  uint16_t  maximo;       ///< Maior saída na janela
+  uint16_t  media;        ///< Média das saídas na janela
+  uint32_t  saidas;       ///< Saídas do filtro na janela
+  uint64_t  amostras;     ///< Amostras convertidas desde o início
+} leitura_adc_t;
+
+
+/** Iniciar a conversão contínua (DMA) e a tarefa que filtra as amostras.
+
+    Nos chips sem ADC contínuo, não há sensores analógicos.
+
+    @return false se o conversor ou a tarefa não puderam ser iniciados.
+*/
+bool sensor_adc_iniciar(void);
+
+
+/** Ler um sensor analógico, sem aguardar conversões.
+
+    @param id       Identificador do sensor (de 1 a MAX_SENSORES_ADC)
+    @param leitura  Estrutura a ser preenchida
+
+    @return false se o id é inválido ou o sensor ainda não tem saídas.
+*/
+bool sensor_adc_ler(int id, leitura_adc_t *leitura);
+
+
+/** Alterar a frequência de corte do filtro de um sensor analógico.
+
+    O filtro é um passa-baixas de primeira ordem (IIR), aplicado depois
+    da média de cada bloco de decimação.
+
+    @param id       Identificador do sensor (de 1 a MAX_SENSORES_ADC)
+    @param corte_hz Frequência de corte em Hz; 0 desativa o IIR
+
+    @return false se o id é inválido.
+*/
+bool sensor_adc_definir_corte(int id, float corte_hz);
+
+
+#if CONFIG_CONTROLE_GPIO_SIMULACAO
+/** Entregar ao filtro um bloco de amostras de um sensor, como o DMA
+    entrega à tarefa do ADC (apenas na simulação).
+
+    @param id         Identificador do sensor (de 1 a MAX_SENSORES_ADC)
+    @param amostras   Amostras brutas, na escala do conversor
+    @param quantidade Número de amostras
+
+    @return false se o id é inválido.
+*/
+bool sensor_adc_simular(int id, const uint16_t *amostras, size_t quantidade);
+#endif
@@ -0,0 +1,367 @@
+/** @file simulacao_gpio.c - Simulação dos pinos do ESP32 em tempo virtual (Linux).
+
+    Para verificar contadores, debouncing, pulsos e regras sem a placa
+    e sem cronômetro, controle_gpio.c pode ser compilado para Linux com
+    CONFIG_CONTROLE_GPIO_SIMULACAO. Nessa versão:
+      - O relógio da tarefa de controle é um relógio virtual, avançado
+        por controle_gpio_simular_ate() direto para o próximo tick ou fim
+        de pulso, sem esperar: um dia de tráfego roda em segundos.
+      - As entradas seguem um roteiro (degraus e trens de pulsos),
+        calculado no instante de cada amostra, sem fila de eventos.
+      - Cada transição das saídas é registrada com o instante virtual,
+        para conferir as durações e medir a precisão dos tempos.
+
+    A simulação é determinística: o mesmo roteiro e os mesmos comandos
+    produzem sempre as mesmas transições, nos mesmos instantes.
+
+    @author João Vianna (jvianna@gmail.com)
+    @version 0.83
+
+    @see controle_gpio.c
+    @see backend_pinos.h
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "esp_log.h"
+
+#include "leitor_parametros.h"
+#include "simulacao_gpio.h"
+
+#if CONFIG_CONTROLE_GPIO_SIMULACAO
+
+#define TAG "simulacao"
+
+#define MAX_DEGRAUS           (4096)
+#define MAX_TRENS_PULSOS      (8)
+
+// Mudança de nível de uma entrada
+typedef struct {
+  int64_t   instante_us;
+  uint8_t   pino;
+  uint8_t   nivel;
+} degrau_t;
+
+// Pulsos periódicos em nível 0
+typedef struct {
+  int64_t   inicio_us;
+  int64_t   periodo_us;
+  int64_t   largura_us;
+  uint32_t  quantidade;
+  uint8_t   pino;
+} trem_pulsos_t;
+
+static int64_t agora_us = 0;
+
+// Roteiro das entradas
+static degrau_t       degraus[MAX_DEGRAUS];
+static int            num_degraus = 0;
+static int            proximo_degrau = 0;
+static trem_pulsos_t  trens[MAX_TRENS_PULSOS];
+static int            num_trens = 0;
+
+// Nível das entradas dado pelos degraus já aplicados (pull-up: 1)
+static uint64_t niveis_degraus = UINT64_MAX;
+
+// Degraus de 1 para 0 já aplicados, por pino (contador de pulsos simulado)
+static uint32_t descidas_degraus[PINOS_POR_BACKEND];
+
+// Saídas
+static uint64_t mascara_saidas = 0;
+static uint64_t niveis_saidas = 0;
+static int64_t  inicio_nivel_1[PINOS_POR_BACKEND];
+
+static transicao_simulada_t registro_transicoes[TAM_REGISTRO_TRANSICOES];
+static uint32_t             cabeca_transicoes = 0;
+static FILE                 *arquivo_transicoes = NULL;
+
+static estatisticas_simulacao_t estatisticas;
+
+static portMUX_TYPE mux_simulacao = portMUX_INITIALIZER_UNLOCKED;
+
+
+/*  Roteiro -------------------------------------------------------------------
+ */
+
+/*  Lê n números separados por vírgulas.
+ */
+static bool ler_campos(const char *valor, int64_t *campos, int n) {
+  const char *p = valor;
+
+  for (int i = 0; i < n; i++) {
+    char *fim;
+
+    campos[i] = strtoll(p, &fim, 10);
+    if (fim == p || campos[i] < 0 || *fim != ((i < n - 1) ? ',' : '\0')) {
+      return false;
+    }
+    p = fim + 1;
+  }
+  return true;
+}
+
+
+/*  Trata uma linha do roteiro (leitor_parametros_cb_t); conta os erros em contexto.
+ */
+static void tratar_linha_roteiro(const char *nome, const char *valor, void *contexto) {
+  int *erros = (int *)contexto;
+  int64_t campos[5];
+
+  if (strcmp(nome, "nivel") == 0 && ler_campos(valor, campos, 3) &&
+      campos[1] < PINOS_POR_BACKEND && campos[2] <= 1 && num_degraus < MAX_DEGRAUS &&
+      (num_degraus == 0 || campos[0] * 1000 >= degraus[num_degraus - 1].instante_us)) {
+    degraus[num_degraus++] = (degrau_t){
+      .instante_us = campos[0] * 1000, .pino = (uint8_t)campos[1], .nivel = (uint8_t)campos[2]
+    };
+  } else if (strcmp(nome, "pulsos") == 0 && ler_campos(valor, campos, 5) &&
+             campos[1] < PINOS_POR_BACKEND && campos[2] > 0 && campos[3] > 0 &&
+             campos[3] < campos[2] && campos[4] <= UINT32_MAX && num_trens < MAX_TRENS_PULSOS) {
+    trens[num_trens++] = (trem_pulsos_t){
+      .inicio_us = campos[0] * 1000, .pino = (uint8_t)campos[1], .periodo_us = campos[2] * 1000,
+      .largura_us = campos[3] * 1000, .quantidade = (uint32_t)campos[4]
+    };
+  } else {
+    ESP_LOGE(TAG, "Linha inválida no roteiro: %s = %s", nome, valor);
+    (*erros)++;
+  }
+}
+
+
+/*  Pulsos de um trem iniciados até o instante; *ativo indica se o pino
+    está em um pulso nesse instante.
+ */
+static uint32_t pulsos_iniciados(const trem_pulsos_t *trem, int64_t instante_us, bool *ativo) {
+  *ativo = false;
+  if (instante_us < trem->inicio_us) {
+    return 0;
+  }
+  int64_t decorrido = instante_us - trem->inicio_us;
+  int64_t k = decorrido / trem->periodo_us;
+
+  if (k >= trem->quantidade) {
+    return trem->quantidade;
+  }
+  *ativo = (decorrido - k * trem->periodo_us) < trem->largura_us;
+  return (uint32_t)k + 1;
+}
+
+
+/*  Saídas --------------------------------------------------------------------
+ */
+
+/*  Registra a transição de uma saída e mede os intervalos em nível 1.
+ */
+static void registrar_transicao(int pino, int nivel) {
+  transicao_simulada_t *transicao = &registro_transicoes[cabeca_transicoes & (TAM_REGISTRO_TRANSICOES - 1)];
+
+  portENTER_CRITICAL(&mux_simulacao);
+  transicao->seq = cabeca_transicoes++;
+  transicao->instante_us = agora_us;
+  transicao->pino = (uint8_t)pino;
+  transicao->nivel = (uint8_t)nivel;
+
+  estatisticas.transicoes++;
+  if (nivel) {
+    inicio_nivel_1[pino] = agora_us;
+  } else {
+    int64_t largura = agora_us - inicio_nivel_1[pino];
+
+    if (estatisticas.larguras == 0 || largura < estatisticas.largura_min_us) {
+      estatisticas.largura_min_us = largura;
+    }
+    if (largura > estatisticas.largura_max_us) {
+      estatisticas.largura_max_us = largura;
+    }
+    estatisticas.soma_largura_us += largura;
+    estatisticas.larguras++;
+  }
+  portEXIT_CRITICAL(&mux_simulacao);
+
+  if (arquivo_transicoes != NULL) {
+    fprintf(arquivo_transicoes, "transicao = %lld,%d,%d\n", (long long)agora_us, pino, nivel);
+  }
+}
+
+
+/*  Backend -------------------------------------------------------------------
+ */
+
+static bool iniciar_simulado(uint64_t saidas, uint64_t entradas, uint64_t nivel_saidas) {
+  mascara_saidas = saidas;
+  niveis_saidas = nivel_saidas & saidas;
+  for (int pino = 0; pino < PINOS_POR_BACKEND; pino++) {
+    inicio_nivel_1[pino] = agora_us;
+  }
+  ESP_LOGI(TAG, "Tempo virtual a partir de %lld us, %d degraus, %d trens de pulsos",
+           (long long)agora_us, num_degraus, num_trens);
+  return true;
+}
+
+
+/*  Aplica os degraus do roteiro até o instante corrente.
+ */
+static void aplicar_degraus(void) {
+  while (proximo_degrau < num_degraus && degraus[proximo_degrau].instante_us <= agora_us) {
+    const degrau_t *degrau = &degraus[proximo_degrau++];
+
+    if (degrau->nivel) {
+      niveis_degraus |= 1ULL << degrau->pino;
+    } else {
+      if (niveis_degraus & (1ULL << degrau->pino)) {
+        descidas_degraus[degrau->pino]++;
+      }
+      niveis_degraus &= ~(1ULL << degrau->pino);
+    }
+  }
+}
+
+
+static uint64_t ler_entradas_simuladas(void) {
+  uint64_t pulsos_ativos = 0;
+
+  aplicar_degraus();
+  for (int t = 0; t < num_trens; t++) {
+    bool ativo;
+
+    pulsos_iniciados(&trens[t], agora_us, &ativo);
+    if (ativo) {
+      pulsos_ativos |= 1ULL << trens[t].pino;
+    }
+  }
+
+  portENTER_CRITICAL(&mux_simulacao);
+  estatisticas.leituras++;
+  portEXIT_CRITICAL(&mux_simulacao);
+
+  // Saídas são lidas com o nível escrito, como nos registradores de entrada
+  return ((niveis_degraus & ~pulsos_ativos) & ~mascara_saidas) | niveis_saidas;
+}
+
+
+static void escrever_saidas_simuladas(uint64_t ligar, uint64_t desligar) {
+  uint64_t novos = ((niveis_saidas | ligar) & ~desligar) & mascara_saidas;
+  uint64_t mudancas = novos ^ niveis_saidas;
+
+  niveis_saidas = novos;
+  for (int pino = 0; mudancas != 0; pino++, mudancas >>= 1) {
+    if (mudancas & 1) {
+      registrar_transicao(pino, (int)((novos >> pino) & 1));
+    }
+  }
+}
+
+
+// Ver a descrição das funções públicas em simulacao_gpio.h
+
+const backend_pinos_t backend_simulado = {
+  .nome = "simulado",
+  .iniciar = iniciar_simulado,
+  .ler_entradas = ler_entradas_simuladas,
+  .escrever_saidas = escrever_saidas_simuladas,
+  .descarregar = NULL
+};
+
+
+int64_t simulacao_gpio_agora_us(void) {
+  return agora_us;
+}
+
+
+void simulacao_gpio_avancar(int64_t instante_us) {
+  if (instante_us > agora_us) {
+    agora_us = instante_us;
+  }
+}
+
+
+int simulacao_gpio_carregar(FILE *arquivo) {
+  leitor_parametros_t leitor;
+  char bloco[128];
+  size_t lidos;
+  int erros = 0;
+
+  num_degraus = 0;
+  proximo_degrau = 0;
+  num_trens = 0;
+  niveis_degraus = UINT64_MAX;
+  memset(descidas_degraus, 0, sizeof(descidas_degraus));
+
+  leitor_parametros_iniciar(&leitor, tratar_linha_roteiro, &erros);
+  while ((lidos = fread(bloco, 1, sizeof(bloco), arquivo)) > 0) {
+    leitor_parametros_consumir(&leitor, bloco, lidos);
+  }
+  erros += leitor_parametros_terminar(&leitor);
+
+  ESP_LOGI(TAG, "Roteiro: %d degraus, %d trens de pulsos, %d erros", num_degraus, num_trens, erros);
+  return erros;
+}
+
+
+uint32_t simulacao_gpio_contar_descidas(int pino) {
+  uint32_t descidas;
+
+  aplicar_degraus();
+  descidas = descidas_degraus[pino];
+  for (int t = 0; t < num_trens; t++) {
+    bool ativo;
+
+    if (trens[t].pino == pino) {
+      descidas += pulsos_iniciados(&trens[t], agora_us, &ativo);
+    }
+  }
+  return descidas;
+}
+
+
+void simulacao_gpio_gravar_transicoes(FILE *arquivo) {
+  arquivo_transicoes = arquivo;
+}
+
+
+int simulacao_gpio_ler_transicoes(uint32_t desde, transicao_simulada_t *transicoes, int max,
+                                  uint32_t *proximo, uint32_t *perdidas) {
+  int n = 0;
+
+  portENTER_CRITICAL(&mux_simulacao);
+  uint32_t cabeca = cabeca_transicoes;
+  uint32_t mais_antiga = (cabeca > TAM_REGISTRO_TRANSICOES) ? cabeca - TAM_REGISTRO_TRANSICOES : 0;
+
+  *perdidas = 0;
+  if (desde > cabeca) {
+    desde = mais_antiga;
+  }
+  if (desde < mais_antiga) {
+    *perdidas = mais_antiga - desde;
+    desde = mais_antiga;
+  }
+  for (; desde < cabeca && n < max; desde++) {
+    transicoes[n++] = registro_transicoes[desde & (TAM_REGISTRO_TRANSICOES - 1)];
+  }
+  portEXIT_CRITICAL(&mux_simulacao);
+
+  *proximo = desde;
+  return n;
+}
+
+
+void simulacao_gpio_estatisticas(estatisticas_simulacao_t *saida) {
+  uint32_t pulsos = 0;
+
+  for (int t = 0; t < num_trens; t++) {
+    bool ativo;
+
+    pulsos += pulsos_iniciados(&trens[t], agora_us, &ativo);
+  }
+
+  portENTER_CRITICAL(&mux_simulacao);
+  *saida = estatisticas;
+  portEXIT_CRITICAL(&mux_simulacao);
+
+  saida->agora_us = agora_us;
+  saida->degraus = (uint32_t)proximo_degrau;
+  saida->pulsos_entrada = pulsos;
+}
+
+#endif  // CONFIG_CONTROLE_GPIO_SIMULACAO
@@ -0,0 +1,121 @@
+/** @file simulacao_gpio.h - Simulação dos pinos do ESP32 em tempo virtual (Linux).
+*/
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "backend_pinos.h"
+
+#define TAM_REGISTRO_TRANSICOES   (1024)    ///< Transições guardadas para leitura (potência de 2).
+
+
+/** Transição de uma saída simulada.
+*/
+typedef struct {
+  uint32_t  seq;                    ///< Número de sequência da transição
+  int64_t   instante_us;            ///< Instante virtual da transição
+  uint8_t   pino;                   ///< Número do GPIO
+  uint8_t   nivel;                  ///< Nível após a transição
+} transicao_simulada_t;
+
+
+/** Estatísticas da simulação.
+
+    As larguras são medidas nas saídas, de cada subida até a descida
+    seguinte no mesmo pino (pulsos e atuadores ligados e desligados).
+*/
+typedef struct {
+  int64_t   agora_us;               ///< Instante virtual corrente
+  uint32_t  leituras;               ///< Amostras das entradas (uma por tick)
+  uint32_t  degraus;                ///< Degraus do roteiro já aplicados às entradas
+  uint32_t  pulsos_entrada;         ///< Pulsos dos trens do roteiro já iniciados
+  uint32_t  transicoes;             ///< Transições das saídas
+  uint32_t  larguras;               ///< Intervalos em nível 1 medidos nas saídas
+  int64_t   largura_min_us;         ///< Menor intervalo em nível 1
+  int64_t   largura_max_us;         ///< Maior intervalo em nível 1
+  int64_t   soma_largura_us;        ///< Soma dos intervalos (para a média)
+} estatisticas_simulacao_t;
+
+
+/** Backend dos GPIO do chip na simulação: as entradas seguem o roteiro
+    e as saídas são registradas com o instante virtual.
+*/
+extern const backend_pinos_t backend_simulado;
+
+
+/** Ler o relógio virtual.
+
+    @return Microssegundos desde o início da simulação.
+*/
+int64_t simulacao_gpio_agora_us(void);
+
+
+/** Avançar o relógio virtual (chamada por controle_gpio_simular_ate).
+
+    @param instante_us Novo instante; instantes passados são ignorados
+*/
+void simulacao_gpio_avancar(int64_t instante_us);
+
+
+/** Carregar o roteiro das entradas.
+
+    Uma linha por forma de onda, com instantes e durações em ms virtuais:
+
+      nivel = (instante),(gpio),(0 ou 1)
+      pulsos = (início),(gpio),(período),(largura),(quantidade)
+
+    Os degraus (nivel) devem vir em ordem de instante. Cada trem de
+    pulsos leva o pino a 0 durante a largura, a cada período, como um
+    contato que fecha para o terra. Sem roteiro, as entradas ficam em 1
+    (pull-up).
+
+    @param arquivo Texto do roteiro
+
+    @return Número de linhas inválidas (0 se o roteiro foi aceito por inteiro).
+*/
+int simulacao_gpio_carregar(FILE *arquivo);
+
+
+/** Contar as bordas de descida de uma entrada, como a unidade PCNT.
+
+    Conta cada degrau de 1 para 0 e cada pulso dos trens do roteiro, no
+    instante virtual em que ocorre, mesmo que dure menos que um tick.
+
+    @param pino Número do GPIO
+
+    @return Descidas desde o carregamento do roteiro, módulo 2^32.
+*/
+uint32_t simulacao_gpio_contar_descidas(int pino);
+
+
+/** Gravar também as transições das saídas em um arquivo, sem limite de
+    quantidade, uma por linha: 'transicao = (instante us),(gpio),(nível)'.
+
+    @param arquivo Arquivo aberto para escrita, ou NULL para parar de gravar
+*/
+void simulacao_gpio_gravar_transicoes(FILE *arquivo);
+
+
+/** Ler as transições das saídas, em ordem de sequência.
+
+    Como em controle_gpio_ler_bordas(), cada leitor mantém seu cursor.
+
+    @param desde    Sequência da primeira transição desejada
+    @param transicoes Vetor a preencher
+    @param max      Tamanho do vetor
+    @param proximo  Recebe o cursor para a próxima leitura
+    @param perdidas Recebe o número de transições já sobrescritas no registro
+
+    @return Número de transições copiadas.
+*/
+int simulacao_gpio_ler_transicoes(uint32_t desde, transicao_simulada_t *transicoes, int max,
+                                  uint32_t *proximo, uint32_t *perdidas);
+
+
+/** Ler as estatísticas da simulação.
+
+    @param estatisticas Estrutura a ser preenchida
+*/
+void simulacao_gpio_estatisticas(estatisticas_simulacao_t *estatisticas);